@@ -8,6 +8,7 @@
 
 #include "nunki/base.h"
 #include "nunki/root.h"
+#include "nunki/job.h"
 #include "nunki/window.h"
 #include "nunki/image.h"
 #include "nunki/device.h"
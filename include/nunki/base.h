@@ -7,6 +7,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define NUNKI_VERSION_MAJOR 0
@@ -19,6 +20,8 @@
 	#else
 		#define NUNKI_API __declspec(dllimport)
 	#endif
+#elif defined(__GNUC__)
+	#define NUNKI_API __attribute__((visibility("default")))
 #else
 	#error Implement this.
 #endif
@@ -27,6 +30,7 @@ typedef unsigned int uint;
 
 #define NU_HANDLE(name) typedef struct name##Impl* name;
 #define NU_HANDLE_INDEX(name) typedef size_t name;
+#define NU_HANDLE_ID(name) typedef uint32_t name;
 
 typedef enum NuResult {
 	NU_SUCCESS,
@@ -42,6 +46,54 @@ typedef struct NuAllocator {
 	void  (*free)(void* ptr, void* userData);
 } NuAllocator;
 
+typedef enum {
+	NU_MEMORY_TAG_GENERAL,
+	NU_MEMORY_TAG_DEVICE,
+	NU_MEMORY_TAG_SCENE2D,
+	NU_MEMORY_TAG_FONT,
+	NU_MEMORY_TAG_IMAGE,
+	NU_MEMORY_TAG_TEMP,
+	NU_MEMORY_TAG_COUNT_,
+} NuMemoryTag;
+
+/**
+ * Memory counters of a subsystem. For NU_MEMORY_TAG_TEMP, liveBytes is the memory committed by all
+ * thread temporary allocators and peakBytes the highest amount of temporary memory used at once by
+ * a single thread.
+ */
+typedef struct {
+	size_t   liveBytes;
+	size_t   peakBytes;
+	uint64_t numAllocations;
+	uint64_t numLiveAllocations;
+} NuMemoryStats;
+
+/**
+ * An allocator that forwards to a parent allocator and accounts every allocation to a memory tag.
+ * Pass &tracking->allocator wherever a NuAllocator* is expected.
+ */
+typedef struct {
+	NuAllocator allocator;
+	NuAllocator parent;
+	NuMemoryTag tag;
+} NuTrackingAllocator;
+
+/**
+ * Initializes \p tracking so that allocations made through it are served by \p parent (or the
+ * default allocator if null) and accounted to \p tag.
+ */
+NUNKI_API void nuInitTrackingAllocator(NuTrackingAllocator* tracking, NuMemoryTag tag, NuAllocator const* parent);
+
+/**
+ * @returns a snapshot of the memory counters of \p tag.
+ */
+NUNKI_API NuMemoryStats nuGetMemoryStats(NuMemoryTag tag);
+
+/**
+ * Prints the memory counters of all tags to the debug output.
+ */
+NUNKI_API void nuDumpMemoryStats(void);
+
 NU_HANDLE(NuTempAllocator);
 
 /**
@@ -49,6 +101,26 @@ NU_HANDLE(NuTempAllocator);
  */
 NUNKI_API NuTempAllocator nResetTempAlloc(void);
 
+/**
+ * A position in the calling thread temporary allocator, see nuTempMark().
+ */
+typedef struct {
+	void* cursor;
+	void* lastAllocationPtr;
+} NuTempMark;
+
+/**
+ * Records the current position of the calling thread temporary allocator. Everything allocated from the
+ * temporary allocator after this call is released by passing the returned mark to nuTempRewind().
+ * Marks can be nested as long as they are rewound in reverse order.
+ */
+NUNKI_API NuTempMark nuTempMark(void);
+
+/**
+ * Releases all temporary allocations made on the calling thread since \p mark was taken.
+ */
+NUNKI_API void nuTempRewind(NuTempMark mark);
+
 /**
  * Write the #documentation.
  */
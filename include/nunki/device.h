@@ -11,13 +11,18 @@
 
 #define NU_VERTEX_LAYOUT_MAX_STREAM_ATTRIBUTES 16
 #define NU_VERTEX_LAYOUT_MAX_STREAMS 8
+#define NU_RENDER_TARGET_MAX_COLOR_TEXTURES 4
 
 NU_HANDLE(NuContext);
-NU_HANDLE(NuVertexLayout);
-NU_HANDLE_INDEX(NuTechnique);
-NU_HANDLE(NuBuffer);
-NU_HANDLE(NuTexture);
-NU_HANDLE(NuSampler);
+NU_HANDLE(NuCommandBuffer);
+NU_HANDLE_ID(NuVertexLayout);
+NU_HANDLE_ID(NuTechnique);
+NU_HANDLE_ID(NuBuffer);
+NU_HANDLE_ID(NuTexture);
+NU_HANDLE_ID(NuSampler);
+NU_HANDLE_ID(NuPipeline);
+NU_HANDLE_ID(NuRenderTarget);
+NU_HANDLE_ID(NuReadback);
 
 typedef enum
 {
@@ -58,21 +63,31 @@ typedef enum
 	NU_BUFFER_TYPE_VERTEX,
 	NU_BUFFER_TYPE_INDEX,
 	NU_BUFFER_TYPE_CONSTANT,
+	NU_BUFFER_TYPE_INDIRECT, /* draw commands read by nuDeviceDraw*Indirect() */
 } NuBufferType;
 
 typedef enum
 {
 	NU_BUFFER_USAGE_IMMUTABLE,
 	NU_BUFFER_USAGE_DYNAMIC,
-	NU_BUFFER_USAGE_STREAM,
+	NU_BUFFER_USAGE_STREAM, /* respecified by every update, which never waits for the GPU */
 } NuBufferUsage;
 
+typedef enum
+{
+	NU_BUFFER_MAP_WRITE = 1,          /* the mapping is write only, required */
+	NU_BUFFER_MAP_DISCARD_RANGE = 2,  /* previous contents of the mapped range are undefined */
+	NU_BUFFER_MAP_UNSYNCHRONIZED = 4, /* the GPU is not reading the mapped range, do not wait for it */
+} NuBufferMapFlags;
+
 typedef enum {
 	NU_TECHNIQUE_CREATE_SUCCESS,
 	NU_TECHNIQUE_CREATE_ERROR_INVALID_VERTEX_SHADER,
 	NU_TECHNIQUE_CREATE_ERROR_INVALID_GEOMETRY_SHADER,
 	NU_TECHNIQUE_CREATE_ERROR_INVALID_FRAGMENT_SHADER,
 	NU_TECHNIQUE_CREATE_ERROR_LINK_FAILED,
+	NU_TECHNIQUE_CREATE_ERROR_OUT_OF_MEMORY,
+	NU_TECHNIQUE_CREATE_PENDING, /* see nuTechniqueGetStatus() */
 } NuTechniqueCreateResult;
 
 typedef enum {
@@ -128,6 +143,14 @@ typedef enum {
 	NU_TEXTURE_FORMAT_R8G8_UNORM,
 	NU_TEXTURE_FORMAT_R8G8B8_UNORM,
 	NU_TEXTURE_FORMAT_R8G8B8A8_UNORM,
+
+	/* block compressed formats, matching the NuImageFormat of the same name. They are decoded at upload
+	 * time on drivers that do not support them. Only 2D and 2D array textures can be compressed. */
+	NU_TEXTURE_FORMAT_BC1_UNORM,
+	NU_TEXTURE_FORMAT_BC3_UNORM,
+	NU_TEXTURE_FORMAT_BC4_UNORM,
+	NU_TEXTURE_FORMAT_BC5_UNORM,
+	NU_TEXTURE_FORMAT_BC7_UNORM,
 } NuTextureFormat;
 
 typedef enum {
@@ -162,6 +185,29 @@ typedef struct {
 	NuIndexType indexType;
 } NuIndexBufferView;
 
+/**
+ * Parameters of a draw of nuDeviceMultiDrawArrays() and nuDeviceDrawArraysIndirect(), laid out as GL
+ * indirect draw commands. A non zero firstInstance needs GL 4.2 or ARB_base_instance.
+ */
+typedef struct {
+	uint numVertices;
+	uint numInstances;
+	uint firstVertex;
+	uint firstInstance;
+} NuDrawArraysCommand;
+
+/**
+ * Parameters of a draw of nuDeviceMultiDrawIndexed() and nuDeviceDrawIndexedIndirect(), laid out as GL
+ * indirect draw commands.
+ */
+typedef struct {
+	uint numIndices;
+	uint numInstances;
+	uint firstIndex;
+	int  baseVertex;
+	uint firstInstance;
+} NuDrawIndexedCommand;
+
 typedef struct {
 	bool instanceData;
 } NuVertexStreamDesc;
@@ -192,6 +238,14 @@ typedef struct {
 	const char **samplers; /* null or null terminated */
 } NuTechniqueCreateInfo;
 
+/**
+ * State baked into a NuPipeline. The vertex layout is the one of the technique.
+ */
+typedef struct {
+	NuTechnique         technique;
+	NuBlendState const* blendState;
+} NuPipelineCreateInfo;
+
 typedef struct
 {
 	NuBufferType type;
@@ -212,12 +266,92 @@ typedef struct {
 	NuSampler    linearSampler;
 } NuDeviceDefaults;
 
+/**
+ * Categories of the device state tracked by the context state cache, see NuDeviceStats.
+ */
+typedef enum {
+	NU_STATE_CATEGORY_VIEWPORT,
+	NU_STATE_CATEGORY_TECHNIQUE,
+	NU_STATE_CATEGORY_BLEND,
+	NU_STATE_CATEGORY_CONSTANT_BUFFER,
+	NU_STATE_CATEGORY_VERTEX_ARRAY,
+	NU_STATE_CATEGORY_BUFFER,
+	NU_STATE_CATEGORY_TEXTURE,
+	NU_STATE_CATEGORY_SAMPLER,
+	NU_STATE_CATEGORY_RENDER_TARGET,
+	NU_STATE_CATEGORY_COUNT_,
+} NuStateCategory;
+
+/**
+ * Device counters of a context, see nuDeviceGetStats(). State changes count the state setting calls
+ * that reached the backend, redundant ones those filtered out by the context state cache, either
+ * because the value was already set or because it matched the backend state at draw time. Draw calls
+ * count the backend calls, so a multi draw counts once, and the instances of indirect draws are not
+ * known to the CPU.
+ */
+typedef struct {
+	uint64_t numDrawCalls;
+	uint64_t numInstances;
+	uint64_t numStateChanges;
+	uint64_t numStateChangesByCategory[NU_STATE_CATEGORY_COUNT_]; /* state changes that reached the backend per category */
+	uint64_t numRedundantStateChanges;
+	uint64_t numFilteredStateChanges[NU_STATE_CATEGORY_COUNT_]; /* redundant state changes per category */
+	uint64_t numBytesUploaded;
+	uint64_t numBuffersCreated;
+	uint64_t numTexturesCreated;
+} NuDeviceStats;
+
+/**
+ * Counters of the last frame of a context, frames end at nuDeviceSwapBuffers(). GPU time is measured
+ * with timer queries read without waiting, so it refers to an earlier frame than the counters.
+ */
+typedef struct {
+	NuDeviceStats counters;
+	uint64_t      frame;        /* index of the frame of the counters, zero before the first swap */
+	uint64_t      gpuTimeNs;    /* time the GPU spent on frame gpuTimeFrame */
+	uint64_t      gpuTimeFrame; /* zero if no GPU time was measured yet or timer queries are unsupported */
+} NuDeviceFrameStats;
+
 typedef struct {
 	NuTextureType   type;
 	NuSize3i        size;
 	NuTextureFormat format;
+
+	/* number of mip levels with storage, 0 or 1 for a single level, at most the full chain of the size */
+	uint            numLevels;
+
+	/* keeps a copy of the texture data in system memory, needed to sample it with nu2dRenderToImage() */
+	uint            keepCpuCopy : 1;
 } NuTextureCreateInfo;
 
+/**
+ * Region of a texture level written by nuTextureUploadAsync(). Layers of 1D array textures are
+ * addressed by y and height, layers of 2D array textures by z and depth. Data holds the
+ * width * height * depth texels of the region in \p format, tightly packed. Regions of compressed
+ * textures are in the texture format and aligned to blocks, except where they reach the level edge.
+ */
+typedef struct {
+	NuTexture     texture;
+	uint          level;
+	uint          x, y, z;
+	uint          width, height, depth;
+	NuImageFormat format;
+	const void*   data;
+} NuTextureUploadInfo;
+
+/**
+ * Attachments of a render target. Color textures are 2D, uncompressed and of the same size, the
+ * unused entries are null. The depth stencil buffer has 24 bits of depth and 8 of stencil and
+ * cannot be sampled.
+ */
+typedef struct {
+	NuTexture colorTextures[NU_RENDER_TARGET_MAX_COLOR_TEXTURES];
+	uint      depthStencil : 1;
+} NuRenderTargetCreateInfo;
+
+/* identifies an upload queued by nuTextureUploadAsync(), tickets increase in submission order */
+typedef uint64_t NuUploadTicket;
+
 typedef struct {
 	NuFilterMode minFilterMode;
 	NuFilterMode magFilterMode;
@@ -240,6 +374,41 @@ NUNKI_API void nuDestroyVertexLayout(NuVertexLayout vlayout, NuAllocator *alloca
  */
 NUNKI_API NuTechniqueCreateResult nuCreateTechnique(NuTechniqueCreateInfo const *info, NuTechnique *pTechnique);
 
+/**
+ * Creates a technique submitting its shaders and program to the driver without waiting for them to be
+ * built, so that creating many techniques in a row lets the driver build them in parallel. The
+ * technique is pending until nuTechniqueGetStatus() reports it built, setting it waits for it to be
+ * built. Errors are written to info->errorMessageBuffer, which must stay valid while pending. Failed
+ * techniques must still be destroyed.
+ */
+NUNKI_API NuTechniqueCreateResult nuCreateTechniqueAsync(NuTechniqueCreateInfo const *info, NuTechnique *pTechnique);
+
+/**
+ * @returns NU_TECHNIQUE_CREATE_PENDING if \p technique is still being built, its creation result
+ * otherwise. If \p wait is set, waits for it to be built. Drivers without parallel shader compile
+ * support cannot tell whether a technique is built without waiting for it.
+ */
+NUNKI_API NuTechniqueCreateResult nuTechniqueGetStatus(NuTechnique technique, bool wait);
+
+/**
+ * Write the #documentation.
+ */
+NUNKI_API void nuDestroyTechnique(NuTechnique technique);
+
+/**
+ * Retrieves the immutable pipeline baking technique, vertex layout and blend state in \p info.
+ * Pipelines are interned by the device: creating one with the same state returns the same handle, so
+ * there is no destroy function. Pipelines are released along with their technique.
+ */
+NUNKI_API NuResult nuCreatePipeline(NuPipelineCreateInfo const* info, NuPipeline* pPipeline);
+
+/**
+ * @returns a key ordering pipelines by the cost of switching between them: pipelines sharing the
+ * technique are contiguous and, within those, pipelines sharing the blend state. Sorting draws by
+ * this key minimises GL state changes.
+ */
+NUNKI_API uint64_t nuPipelineGetSortKey(NuPipeline pipeline);
+
 /**
  * Write the #documentation.
  */
@@ -251,10 +420,26 @@ NUNKI_API NuResult nuCreateBuffer(NuBufferCreateInfo const* info, NuAllocator* a
 NUNKI_API void nuDestroyBuffer(NuBuffer buffer, NuAllocator* allocator);
 
 /**
- * Write the #documentation.
+ * Writes \p size bytes of \p data at \p offset of \p buffer. Each update of a NU_BUFFER_USAGE_STREAM
+ * buffer gives it new contents, the bytes outside the written range are undefined afterwards, and
+ * draws issued before the update keep reading the previous contents.
  */
 NUNKI_API void nuBufferUpdate(NuBuffer buffer, uint offset, const void* data, uint size);
 
+/**
+ * Maps \p size bytes at \p offset of \p buffer for the CPU to write directly into, returning the
+ * pointer in \p pData. Mapping a NU_BUFFER_USAGE_STREAM buffer respecifies it like nuBufferUpdate()
+ * does, without ever waiting for the GPU. Immutable buffers cannot be mapped and other buffers can be
+ * mapped within their size only. The buffer cannot be updated or drawn from until nuBufferUnmap().
+ */
+NUNKI_API NuResult nuBufferMap(NuBuffer buffer, uint offset, uint size, NuBufferMapFlags flags, void** pData);
+
+/**
+ * Unmaps \p buffer, making the written data available to the commands issued next. Fails if the
+ * system lost the buffer contents while mapped, in which case they must be written again.
+ */
+NUNKI_API NuResult nuBufferUnmap(NuBuffer buffer);
+
 /**
  * Write the #documentation.
  */
@@ -265,6 +450,13 @@ NUNKI_API NuResult nuCreateContext(NuContextCreateInfo const* info, NuAllocator*
  */
 NUNKI_API void nuDestroyContext(NuContext context, NuAllocator* allocator);
 
+/**
+ * Detaches the calling thread from the context it last used, so that another thread can use it.
+ * A context is current on at most one thread at a time, while different threads can render to
+ * different contexts concurrently.
+ */
+NUNKI_API void nuDeviceReleaseContext(void);
+
 /**
  * Write the #documentation.
  */
@@ -276,10 +468,31 @@ NUNKI_API NuResult nuCreateTexture(NuTextureCreateInfo const* info, NuAllocator*
 NUNKI_API void nuDestroyTexture(NuTexture texture, NuAllocator* allocator);
 
 /**
- * Write the #documentation.
+ * Replaces levels [\p baseLevel, \p baseLevel + \p numLevels) of 1D or 2D \p texture with \p images,
+ * one per level and sized like it. The upload is issued immediately on the calling thread's context.
  */
 NUNKI_API void nuTextureUpdateLevels(NuTexture texture, uint baseLevel, uint numLevels, NuImageView const* images);
 
+/**
+ * Copies the texels of \p info to a staging ring and queues their upload, without issuing GL calls
+ * so that it can be called from any thread. Queued uploads are issued by nuDeviceFlushUploads() or
+ * nuDeviceSwapBuffers() in submission order. Uploads that do not fit the ring are staged in a heap
+ * copy instead. The system memory copy of textures created with keepCpuCopy is updated immediately.
+ */
+NUNKI_API NuResult nuTextureUploadAsync(NuTextureUploadInfo const* info, NuUploadTicket* pTicket);
+
+/**
+ * Issues the uploads queued by nuTextureUploadAsync() on \p context and fences them, then releases
+ * the staging space of the uploads the GPU completed.
+ */
+NUNKI_API void nuDeviceFlushUploads(NuContext context);
+
+/**
+ * @returns whether upload \p ticket and all the ones submitted before it were completed by the GPU,
+ * as last observed by nuDeviceFlushUploads() or nuDeviceSwapBuffers().
+ */
+NUNKI_API bool nuDeviceIsUploadComplete(NuUploadTicket ticket);
+
 /**
  * Write the #documentation.
  */
@@ -290,6 +503,47 @@ NUNKI_API NuResult nuCreateSampler(NuSamplerCreateInfo const* info, NuAllocator*
  */
 NUNKI_API void nuDestroySampler(NuSampler sampler, NuAllocator* allocator);
 
+/**
+ * Creates a render target drawing to the textures in \p info. GL framebuffers are not shared between
+ * contexts, so the render target can only be used with \p context and must be destroyed before it.
+ */
+NUNKI_API NuResult nuCreateRenderTarget(NuContext context, NuRenderTargetCreateInfo const* info, NuRenderTarget* pRenderTarget);
+
+/**
+ * Destroys \p renderTarget, its textures are not destroyed.
+ */
+NUNKI_API void nuDestroyRenderTarget(NuRenderTarget renderTarget);
+
+/**
+ * Makes the draws and clears of \p context render to \p renderTarget, or to the window if null. The
+ * viewport is not changed.
+ */
+NUNKI_API void nuDeviceSetRenderTarget(NuContext context, NuRenderTarget renderTarget);
+
+/**
+ * Queues the copy of \p rect of color texture \p colorIndex of the current render target of
+ * \p context, or of the window back buffer, to a pixel pack buffer without waiting for the GPU.
+ * The rectangle is in viewport coordinates. Pixels are converted to \p format, which must be
+ * uncompressed, and can be fetched with nuDeviceResolveReadback() once the GPU wrote them.
+ */
+NUNKI_API NuResult nuDeviceReadPixels(NuContext context, uint colorIndex, NuRect2i rect, NuImageFormat format, NuReadback* pReadback);
+
+/**
+ * @returns whether the pixels of \p readback have been written, without waiting for them.
+ */
+NUNKI_API bool nuDeviceIsReadbackComplete(NuContext context, NuReadback readback);
+
+/**
+ * Creates in \p pImage the image read by \p readback, its first row is the top of the rectangle,
+ * then destroys the readback if successful. Waits for the GPU if the readback is not complete yet.
+ */
+NUNKI_API NuResult nuDeviceResolveReadback(NuContext context, NuReadback readback, NuAllocator* allocator, NuImage* pImage);
+
+/**
+ * Destroys \p readback discarding its pixels.
+ */
+NUNKI_API void nuDestroyReadback(NuReadback readback);
+
 /**
  * Write the #documentation.
  */
@@ -310,6 +564,12 @@ NUNKI_API void nuDeviceSetTechnique(NuContext context, NuTechnique const techniq
  */
 NUNKI_API void nuDeviceSetBlendState(NuContext context, NuBlendState const* blendState);
 
+/**
+ * Sets technique and blend state of \p pipeline at once. Setting the pipeline that is already current
+ * costs a handle compare; setting technique or blend state individually forgets the current pipeline.
+ */
+NUNKI_API void nuDeviceSetPipeline(NuContext context, NuPipeline pipeline);
+
 /**
  * Write the #documentation.
  */
@@ -320,13 +580,28 @@ NUNKI_API void nuDeviceSetVertexBuffers(NuContext context, uint base, uint count
  */
 NUNKI_API void nuDeviceSetConstantBuffers(NuContext context, uint base, uint count, NuBufferView const *views);
 
+/**
+ * Copies \p size bytes of \p data to a free range of the device constant ring and returns a view of
+ * it in \p pView, to be set with nuDeviceSetConstantBuffers(). Per draw constants written this way
+ * neither respecify buffers nor wait for the GPU. Views are valid until the end of the frame. The ring
+ * is shared by all contexts, NU_ERROR_OUT_OF_MEMORY is returned if the frames in flight fill it.
+ */
+NUNKI_API NuResult nuDeviceWriteConstants(NuContext context, void const* data, uint size, NuBufferView* pView);
+
 /**
  * Write the #documentation.
  */
 NUNKI_API void nuDeviceSetTextures(NuContext context, uint base, uint count, NuTexture const* textures, NuSampler const* samplers);
 
 /**
- * Write the #documentation.
+ * Sets the samplers of texture units [\p base, \p base + \p count), a null sampler leaves sampling
+ * to the texture own parameters.
+ */
+NUNKI_API void nuDeviceSetSamplers(NuContext context, uint base, uint count, NuSampler const* samplers);
+
+/**
+ * Draws with the state recorded by the nuDeviceSet*() calls. Setters only record state in the
+ * context, draws apply what differs from the backend state first.
  */
 NUNKI_API void nuDeviceDrawArrays(NuContext context, NuPrimitiveType primitive, uint firstVertex, uint numVertices, uint numInstances);
 
@@ -335,6 +610,32 @@ NUNKI_API void nuDeviceDrawArrays(NuContext context, NuPrimitiveType primitive,
  */
 NUNKI_API void nuDeviceDrawIndexed(NuContext context, NuPrimitiveType primitive, NuIndexBufferView indexBuffer, uint firstVertex, uint numIndices, uint numInstances, uint baseVertex);
 
+/**
+ * Issues the \p count draws in \p commands with the same state, in a single backend call if the
+ * driver supports multi draw indirect. Vertex buffer view offsets apply as with nuDeviceDrawArrays().
+ */
+NUNKI_API void nuDeviceMultiDrawArrays(NuContext context, NuPrimitiveType primitive, NuDrawArraysCommand const* commands, uint count);
+
+/**
+ * Issues the \p count indexed draws in \p commands with the same state, in a single backend call if
+ * the driver supports multi draw indirect. First indices are relative to the \p indexBuffer offset.
+ */
+NUNKI_API void nuDeviceMultiDrawIndexed(NuContext context, NuPrimitiveType primitive, NuIndexBufferView indexBuffer, NuDrawIndexedCommand const* commands, uint count);
+
+/**
+ * Issues \p count draws whose NuDrawArraysCommand are read by the GPU from the indirect buffer of
+ * \p commands. The CPU cannot offset the commands, so vertex buffer view offsets are applied by
+ * the vertex array instead of by the draws. Without GL 4.0 or ARB_draw_indirect the contents of
+ * indirect buffers are kept in system memory and the draws are issued one by one by the CPU.
+ */
+NUNKI_API void nuDeviceDrawArraysIndirect(NuContext context, NuPrimitiveType primitive, NuBufferView commands, uint count);
+
+/**
+ * Issues \p count indexed draws whose NuDrawIndexedCommand are read by the GPU from the indirect
+ * buffer of \p commands. The view of \p indexBuffer must start at the beginning of its buffer.
+ */
+NUNKI_API void nuDeviceDrawIndexedIndirect(NuContext context, NuPrimitiveType primitive, NuIndexBufferView indexBuffer, NuBufferView commands, uint count);
+
 /**
  * Write the #documentation.
  */
@@ -344,3 +645,112 @@ NUNKI_API void nuDeviceSwapBuffers(NuContext context);
  * Write the #documentation.
  */
 NUNKI_API NuDeviceDefaults const* nuDeviceGetDefaults(void);
+
+/**
+ * Retrieves the counters accumulated by \p context since creation or the last nuDeviceResetStats().
+ * Pass a null context for the counters of calls made by the calling thread with no context bound.
+ */
+NUNKI_API void nuDeviceGetStats(NuContext context, NuDeviceStats* stats);
+
+/**
+ * Zeroes the counters of \p context, or of the calling thread if null.
+ */
+NUNKI_API void nuDeviceResetStats(NuContext context);
+
+/**
+ * Retrieves the counters of the last frame \p context completed. Objects created and data uploaded
+ * count towards the context current on the calling thread.
+ */
+NUNKI_API void nuDeviceGetFrameStats(NuContext context, NuDeviceFrameStats* stats);
+
+/*-------------------------------------------------------------------------------------------------
+ * Command buffers
+ *-----------------------------------------------------------------------------------------------*/
+/* Command buffers record device commands into a linear token stream that is later replayed by
+ * nuDeviceSubmit(). Recording makes no GL calls, so each buffer can be recorded by a different
+ * thread while all GL traffic stays on the submitting thread. A single command buffer must not
+ * be recorded by two threads at the same time. */
+
+/**
+ * Creates an empty command buffer owned by the caller, which destroys it with nuDestroyCommandBuffer()
+ * using the same \p allocator. Its stream grows from \p allocator as commands are recorded.
+ * Recording appends to whatever the buffer already holds, also after submission: call nuCmdReset()
+ * to record it anew. Recording only touches the command buffer and can run on any thread, as long as
+ * no other thread records or submits the same buffer meanwhile.
+ */
+NUNKI_API NuResult nuCreateCommandBuffer(NuAllocator* allocator, NuCommandBuffer* pCommandBuffer);
+
+/**
+ * Destroys \p commandBuffer and its recorded commands. It must not be being recorded or submitted.
+ */
+NUNKI_API void nuDestroyCommandBuffer(NuCommandBuffer commandBuffer, NuAllocator* allocator);
+
+/**
+ * Discards all recorded commands, keeping the memory for the next recording.
+ */
+NUNKI_API void nuCmdReset(NuCommandBuffer commandBuffer);
+
+/**
+ * Records a clear of the buffers in \p flags. \p color4 is copied and may be null to clear to zero.
+ */
+NUNKI_API void nuCmdClear(NuCommandBuffer commandBuffer, NuClearFlags flags, float const* color4, float depth, uint stencil);
+
+/**
+ * Records setting the viewport to \p viewport.
+ */
+NUNKI_API void nuCmdSetViewport(NuCommandBuffer commandBuffer, NuRect2i viewport);
+
+/**
+ * Records setting \p technique. Handles are resolved at submission, so recorded objects must be
+ * alive until every submission of the command buffer returns.
+ */
+NUNKI_API void nuCmdSetTechnique(NuCommandBuffer commandBuffer, NuTechnique technique);
+
+/**
+ * Records setting \p blendState, which is copied.
+ */
+NUNKI_API void nuCmdSetBlendState(NuCommandBuffer commandBuffer, NuBlendState const* blendState);
+
+/**
+ * Records setting \p pipeline, see nuDeviceSetPipeline().
+ */
+NUNKI_API void nuCmdSetPipeline(NuCommandBuffer commandBuffer, NuPipeline pipeline);
+
+/**
+ * Records binding \p count vertex buffer \p views from slot \p base. The views are copied.
+ */
+NUNKI_API void nuCmdSetVertexBuffers(NuCommandBuffer commandBuffer, uint base, uint count, NuBufferView const* views);
+
+/**
+ * Records binding \p count constant buffer \p views from slot \p base. The views are copied.
+ */
+NUNKI_API void nuCmdSetConstantBuffers(NuCommandBuffer commandBuffer, uint base, uint count, NuBufferView const* views);
+
+/**
+ * Records binding \p count \p textures from slot \p base with \p samplers, which may be null to keep
+ * the samplers set to the units. Both arrays are copied.
+ */
+NUNKI_API void nuCmdSetTextures(NuCommandBuffer commandBuffer, uint base, uint count, NuTexture const* textures, NuSampler const* samplers);
+
+/**
+ * Records a draw of \p numVertices from \p firstVertex. Consecutive array draws of the same
+ * \p primitive are replayed as a single multi draw.
+ */
+NUNKI_API void nuCmdDrawArrays(NuCommandBuffer commandBuffer, NuPrimitiveType primitive, uint firstVertex, uint numVertices, uint numInstances);
+
+/**
+ * Records an indexed draw of \p numIndices from \p indexBuffer, see nuDeviceDrawIndexed().
+ */
+NUNKI_API void nuCmdDrawIndexed(NuCommandBuffer commandBuffer, NuPrimitiveType primitive, NuIndexBufferView indexBuffer, uint firstVertex, uint numIndices, uint numInstances, uint baseVertex);
+
+/**
+ * Records an update of \p size bytes of \p buffer at \p offset. The \p data is copied into the
+ * command buffer, so it can be released right after this call.
+ */
+NUNKI_API void nuCmdUpdateBuffer(NuCommandBuffer commandBuffer, NuBuffer buffer, uint offset, const void* data, uint size);
+
+/**
+ * Replays \p count command buffers in order on \p context. Command buffers are left untouched and
+ * can be submitted again.
+ */
+NUNKI_API void nuDeviceSubmit(NuContext context, NuCommandBuffer const* commandBuffers, uint count);
@@ -8,7 +8,7 @@
 
 #include "./base.h"
 
-NU_HANDLE(NuTexture);
+NU_HANDLE_ID(NuTexture);
 NU_HANDLE(NuFont);
 
 typedef struct {
@@ -15,6 +15,13 @@ typedef enum {
 	NU_IMAGE_FORMAT_R8G8,
 	NU_IMAGE_FORMAT_R8G8B8,
 	NU_IMAGE_FORMAT_R8G8B8A8,
+
+	/* block compressed formats, made of 4x4 texel blocks stored in row order */
+	NU_IMAGE_FORMAT_BC1, /* RGB, 8 bytes per block */
+	NU_IMAGE_FORMAT_BC3, /* RGBA, 16 bytes per block */
+	NU_IMAGE_FORMAT_BC4, /* R, 8 bytes per block */
+	NU_IMAGE_FORMAT_BC5, /* RG, 16 bytes per block */
+	NU_IMAGE_FORMAT_BC7, /* RGBA, 16 bytes per block */
 	NU_IMAGE_FORMAT_COUNT_,
 } NuImageFormat;
 
@@ -30,6 +37,11 @@ typedef struct {
 	uint          initializeMemory : 1;
 } NuImageCreateInfo;
 
+typedef enum {
+	NU_MIP_FILTER_BOX,    /* average of the covered texels, fastest */
+	NU_MIP_FILTER_KAISER, /* Kaiser windowed sinc, keeps minified details sharper */
+} NuMipFilter;
+
 /**
  * Write the #documentation.
  */
@@ -50,3 +62,50 @@ NUNKI_API NuImageView nuImageGetView(NuImage const image);
  */
 NUNKI_API void* nuImageGetWritableDataPtr(NuImage image);
 
+/**
+ * @returns whether \p format is a block compressed format.
+ */
+NUNKI_API bool nuImageFormatIsCompressed(NuImageFormat format);
+
+/**
+ * @returns the uncompressed format block compressed \p format decodes to, \p format itself if it is
+ * not compressed.
+ */
+NUNKI_API NuImageFormat nuImageFormatGetDecompressed(NuImageFormat format);
+
+/**
+ * @returns the bytes taken by \p size texels in \p format. Compressed formats take whole blocks.
+ */
+NUNKI_API size_t nuImageFormatGetDataSize(NuImageFormat format, NuSize2i size);
+
+/**
+ * Encodes uncompressed \p image in block compressed \p format into a new image. BC4 and BC5 encode
+ * the red and red-green channels of \p image, while BC1 ignores its alpha. Meant to be done once at
+ * build or load time, encoding favours speed over the best achievable quality.
+ */
+NUNKI_API NuResult nuImageCompress(NuImageView const* image, NuImageFormat format, NuAllocator* allocator, NuImage* pImage);
+
+/**
+ * Decodes block compressed \p image into a new image in nuImageFormatGetDecompressed() format.
+ * BC7 blocks in the reserved mode decode to transparent black.
+ */
+NUNKI_API NuResult nuImageDecompress(NuImageView const* image, NuAllocator* allocator, NuImage* pImage);
+
+/**
+ * @returns the number of levels of the full mip chain of a \p size image, down to 1x1.
+ */
+NUNKI_API uint nuImageGetNumMipLevels(NuSize2i size);
+
+/**
+ * Downsamples \p image to the next mip level, half its size rounded down to at least one texel.
+ * Compressed images are decoded, downsampled and encoded again. If \p parallel is set rows are
+ * filtered on the job system worker threads.
+ */
+NUNKI_API NuResult nuImageDownsample(NuImageView const* image, NuMipFilter filter, bool parallel, NuAllocator* allocator, NuImage* pImage);
+
+/**
+ * Builds levels [1, \p numLevels) of the mip chain of \p image in \p levels, each downsampled from the
+ * previous one. Compressed images are downsampled decoded and each level is encoded once. On failure
+ * no image is returned.
+ */
+NUNKI_API NuResult nuImageGenerateMips(NuImageView const* image, NuMipFilter filter, bool parallel, uint numLevels, NuAllocator* allocator, NuImage* levels);
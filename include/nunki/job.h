@@ -0,0 +1,56 @@
+/*
+ * Nunki (simple rendering engine)
+ * Copyright (C) 2015 Canio Massimo Tristano <massimo.tristano@gmail.com>.
+ * For licensing info see LICENSE.
+ */
+
+#pragma once
+
+#include "./base.h"
+
+typedef void (*NuJobFunc)(void* data);
+
+typedef void (*NuParallelForFunc)(void* data, uint begin, uint end);
+
+typedef struct {
+	NuJobFunc func;
+	void*     data;
+} NuJobDecl;
+
+/**
+ * Counts the jobs still pending in one or more batches. Zero-initialize it before first use; it can
+ * be reused once it dropped back to zero. Fields are private.
+ */
+typedef struct {
+	int32_t volatile value;
+	int32_t volatile lock;
+	void*            waiters;
+} NuJobCounter;
+
+/**
+ * Schedules \p numJobs jobs and increments \p counter (if not NULL) by \p numJobs, decrementing it
+ * back as each job completes. Each job runs with a clean temporary allocator scope.
+ */
+NUNKI_API void nuRunJobs(NuJobDecl const* jobs, uint numJobs, NuJobCounter* counter);
+
+/**
+ * Like nuRunJobs() but jobs are not scheduled before \p dependency drops to zero.
+ */
+NUNKI_API void nuRunJobsAfter(NuJobCounter* dependency, NuJobDecl const* jobs, uint numJobs, NuJobCounter* counter);
+
+/**
+ * Blocks until \p counter drops to zero. The calling thread executes pending jobs while waiting.
+ */
+NUNKI_API void nuWaitForCounter(NuJobCounter* counter);
+
+/**
+ * Calls \p func on disjoint subranges of [0, \p count) of at least \p grainSize elements, in parallel,
+ * and returns when all of them have completed.
+ */
+NUNKI_API void nuParallelFor(uint count, uint grainSize, NuParallelForFunc func, void* data);
+
+/**
+ * @returns the number of worker threads started by nuInitialize(), zero if jobs run on the
+ * waiting threads only.
+ */
+NUNKI_API uint nuGetNumWorkerThreads(void);
@@ -15,6 +15,22 @@ typedef struct {
 	uint versionMajor;
 	uint versionMinor;
 	uint versionPatch;
+
+	/* starts the job system worker threads, see job.h */
+	uint enableWorkerThreads : 1;
+
+	/* number of worker threads to start, zero to use one per logical core minus the calling thread */
+	uint numWorkerThreads;
+
+	/* runs the device without GL, calls only update the device state and statistics */
+	uint nullDevice : 1;
+
+	/* when using the null device, records all backend calls to this file, see nu_device_null.inl */
+	const char* deviceTraceFilePath;
+
+	/* existing directory where linked shader programs are cached to skip compilation on later runs,
+	 * null to always compile them */
+	const char* programCacheDirectory;
 } NuInitializeInfo;
 
 /**
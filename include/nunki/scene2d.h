@@ -17,6 +17,15 @@ NU_HANDLE(NuScene2D);
  */
 #define NU_IMMEDIATE_SCENE2D NULL
 
+typedef struct
+{
+	/** Records into a double-buffered linear arena swapped by nu2dReset() instead of the scene allocator. */
+	uint   useFrameArena : 1;
+
+	/** Initial size in bytes of each frame arena, zero for a default. */
+	size_t frameArenaSize;
+} NuScene2DCreateInfo;
+
 typedef struct
 {
 	NuContext context;
@@ -35,6 +44,26 @@ typedef struct
 	const NuSampler     sampler;
 } Nu2dQuadsTexturedBeginInfo;
 
+/**
+ * State whose change keeps a command from extending the previous one, see Nu2dStats.
+ */
+typedef enum {
+	NU_2D_BATCH_BREAK_MESH_TYPE,
+	NU_2D_BATCH_BREAK_PIPELINE, /* technique or blend state */
+	NU_2D_BATCH_BREAK_TEXTURE,
+	NU_2D_BATCH_BREAK_SAMPLER,
+	NU_2D_BATCH_BREAK_COUNT_,
+} Nu2dBatchBreak;
+
+/**
+ * Counters of a 2D scene, each command is a device draw of nu2dPresent().
+ */
+typedef struct {
+	uint numCommands;
+	uint numInstances;
+	uint numBatchBreaks[NU_2D_BATCH_BREAK_COUNT_]; /* commands that could not extend the previous one, by first different state */
+} Nu2dStats;
+
 /**
  * Write the #documentation.
  */
@@ -48,7 +77,7 @@ NUNKI_API void nu2dImmediateEnd(void);
 /**
  * Write the #documentation.
  */
-NUNKI_API NuResult nuCreateScene2D(NuAllocator* allocator, NuScene2D* scene);
+NUNKI_API NuResult nuCreateScene2D(NuScene2DCreateInfo const* info, NuAllocator* allocator, NuScene2D* scene);
 
 /**
  * Write the #documentation.
@@ -65,6 +94,20 @@ NUNKI_API NuResult nu2dReset(NuScene2D scene, NuRect2i viewport);
  */
 NUNKI_API void nu2dPresent(NuScene2D scene, NuContext context);
 
+/**
+ * Retrieves the counters of what was recorded in \p scene since the last nu2dReset(), or in the
+ * immediate scene since nu2dImmediateBegin() if null.
+ */
+NUNKI_API void nu2dGetStats(NuScene2D scene, Nu2dStats* stats);
+
+/**
+ * Rasterizes \p scene on the CPU into \p image, which must be R8G8B8A8, blending over its content
+ * like nu2dPresent() does on the device. The scene viewport is stretched to the whole image. Work is
+ * spread over the job system worker threads. Textured quads are only drawn if their texture keeps a
+ * CPU copy, see NuTextureCreateInfo.
+ */
+NUNKI_API NuResult nu2dRenderToImage(NuScene2D scene, NuImage image);
+
 
 /**
  * Write the #documentation.
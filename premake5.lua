@@ -102,6 +102,7 @@ solution "Nunki"
 		files { "include/**.h", "source/**.h", "source/**.inl", "source/**.c", "source/**.glsl" }
 		links { "freetype261" }
 		configuration "windows"; links { "opengl32", "glu32" }
+		configuration "linux"; links { "GL", "dl", "pthread" }
 		configuration {}
 
 	project "NunkiSample"
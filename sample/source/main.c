@@ -70,7 +70,7 @@ int main()
 
 
 	NuScene2D scene;
-	nuCreateScene2D(NULL, &scene);
+	nuCreateScene2D(NULL, NULL, &scene);
 	nu2dReset(scene, (NuRect2i) { 0, 0, 1270, 720 });
 	nu2dBeginText(scene, font);
 	nu2dText(scene, "Welcome to\n<1>Nunki</>", (NuPoint2i) { 50, 50 }, styles, 0);
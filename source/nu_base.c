@@ -7,23 +7,72 @@
 #include "nunki/base.h"
 #include "nu_libs.h"
 #include <malloc.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+
+/* Address space reserved by each thread temporary allocator. Pages are committed lazily as the cursor
+ * moves forward, so this only costs virtual address space. */
+#if UINTPTR_MAX > 0xffffffffu
+	#define TEMP_ALLOCATOR_RESERVE_SIZE ((size_t)1 << 32) // 4Gb
+#else
+	#define TEMP_ALLOCATOR_RESERVE_SIZE ((size_t)1 << 28) // 256Mb
+#endif
+
+/* Minimum amount of memory committed at once when the cursor passes the committed region. */
+#define TEMP_ALLOCATOR_COMMIT_GRANULARITY (64 * 1024)
 
 typedef struct
 {
 	NuAllocator allocator;
 	char* cursor;
 	char* buffer;
+	char* committedEnd;
 	char* bufferEnd;
 	char* lastAllocationPtr;
 	size_t lastAllocationSize;
-#ifdef DEBUG
+	size_t highWater;
+	uint64_t numAllocations;
+#if defined(DEBUG) || defined(_DEBUG)
 	uint  mallocLocked : 1;
 #endif
 } TempAllocator;
 
 static n_threadlocal TempAllocator gTempAllocator;
 
+/* Counters of a memory tag, padded to avoid false sharing between tags. */
+typedef struct {
+	volatile int64_t liveBytes;
+	volatile int64_t peakBytes;
+	volatile int64_t numAllocations;
+	volatile int64_t numLiveAllocations;
+	char             padding[32];
+} MemoryCounters;
+
+static MemoryCounters gMemoryCounters[NU_MEMORY_TAG_COUNT_];
+
+static NuTrackingAllocator gTaggedAllocators[NU_MEMORY_TAG_COUNT_];
+static bool gTaggedAllocatorsInitialized;
+
+static const char* kMemoryTagNames[NU_MEMORY_TAG_COUNT_] = {
+	"general",
+	"device",
+	"scene2d",
+	"font",
+	"image",
+	"temp",
+};
+
+/* Every tracked allocation is preceded by this header, located right before the returned pointer. */
+typedef struct {
+	size_t   size;
+	uint32_t offset; /* from the parent allocation to the returned pointer */
+	uint32_t tag;
+} TrackingHeader;
+
+#define TRACKING_HEADER_SIZE 16
+
+#ifdef _WIN32
 static void* DefaultMalloc(size_t size, size_t alignment, void* userData)
 {
 	return _aligned_malloc(size, alignment);
@@ -38,22 +87,80 @@ static void DefaultFree(void* ptr, void* userData)
 {
 	_aligned_free(ptr);
 }
+#else
+static void* DefaultMalloc(size_t size, size_t alignment, void* userData)
+{
+	if (alignment <= n_alignof(max_align_t)) return malloc(size);
+	void* ptr;
+	return posix_memalign(&ptr, alignment, size) ? NULL : ptr;
+}
+
+static void* DefaultRealloc(void* ptr, size_t newSize, size_t alignment, void* userData)
+{
+	if (alignment <= n_alignof(max_align_t)) return realloc(ptr, newSize);
+
+	/* there is no aligned realloc, move the block by hand */
+	void* newPtr = DefaultMalloc(newSize, alignment, userData);
+	if (!newPtr) return NULL;
+	if (ptr) {
+		size_t oldSize = malloc_usable_size(ptr);
+		memcpy(newPtr, ptr, oldSize < newSize ? oldSize : newSize);
+		free(ptr);
+	}
+	return newPtr;
+}
+
+static void DefaultFree(void* ptr, void* userData)
+{
+	free(ptr);
+}
+#endif
+
+/**
+ * Makes sure memory up to \p end is committed.
+ */
+static bool TempCommit(TempAllocator* tempAllocator, char* end)
+{
+	if (end <= tempAllocator->committedEnd) {
+		return true;
+	}
+
+	if (end > tempAllocator->bufferEnd) {
+		nDebugError("Exhausted temporary allocator address space. This is critical, please report to the developers.");
+		return false;
+	}
+
+	char* newCommittedEnd = nAlignPtrUp(end, TEMP_ALLOCATOR_COMMIT_GRANULARITY);
+	if (newCommittedEnd > tempAllocator->bufferEnd) {
+		newCommittedEnd = tempAllocator->bufferEnd;
+	}
+
+	if (!nVirtualCommit(tempAllocator->committedEnd, newCommittedEnd - tempAllocator->committedEnd)) {
+		nDebugError("Could not commit temporary allocator memory.");
+		return false;
+	}
+
+	nAtomicAdd64(&gMemoryCounters[NU_MEMORY_TAG_TEMP].liveBytes, newCommittedEnd - tempAllocator->committedEnd);
+
+	tempAllocator->committedEnd = newCommittedEnd;
+	return true;
+}
 
 static void* TempMalloc(size_t size, size_t alignment, void* userData)
 {
 	TempAllocator* tempAllocator = userData;
 	nAssert (!tempAllocator->mallocLocked);
 
-	char* cursor = nAlignPtrUp(tempAllocator->cursor, (uint)alignment);
-	char* allocationPtr = cursor;
-	cursor += size;
-	if (cursor >= tempAllocator->bufferEnd) {
-		nDebugError("Exhausted temporary allocator. This is critical, please report to the developers.");
+	char* allocationPtr = nAlignPtrUp(tempAllocator->cursor, (uint)alignment);
+	char* cursor = allocationPtr + size;
+	if (!TempCommit(tempAllocator, cursor)) {
 		return NULL;
 	}
 	tempAllocator->cursor = cursor;
 	tempAllocator->lastAllocationPtr = allocationPtr;
 	tempAllocator->lastAllocationSize = size;
+	tempAllocator->highWater = max_size_t(tempAllocator->highWater, cursor - tempAllocator->buffer);
+	++tempAllocator->numAllocations;
 	return allocationPtr;
 }
 
@@ -61,16 +168,23 @@ static void* TempRealloc(void* ptr, size_t newSize, size_t alignment, void* user
 {
 	TempAllocator* tempAllocator = userData;
 	char* allocationPtr = tempAllocator->lastAllocationPtr;
-	if (ptr == allocationPtr) {
+	if (ptr && ptr == allocationPtr) {
+		/* last allocation, simply move the cursor */
 		nAssert((uintptr_t)allocationPtr % alignment == 0);
-		tempAllocator->cursor = allocationPtr + newSize;
-		if (tempAllocator->cursor >= tempAllocator->bufferEnd) {
-			nDebugError("Exhausted temporary allocator. This is critical, please report to the developers.");
+		if (!TempCommit(tempAllocator, allocationPtr + newSize)) {
 			return NULL;
 		}
+		tempAllocator->cursor = allocationPtr + newSize;
+		tempAllocator->lastAllocationSize = newSize;
+		tempAllocator->highWater = max_size_t(tempAllocator->highWater, tempAllocator->cursor - tempAllocator->buffer);
 	}
 	else {
+		/* the old size is unknown but the block cannot extend past the cursor, copy up to that */
+		char* oldCursor = tempAllocator->cursor;
 		allocationPtr = TempMalloc(newSize, alignment, userData);
+		if (allocationPtr && ptr) {
+			memcpy(allocationPtr, ptr, min_size_t(newSize, oldCursor - (char*)ptr));
+		}
 	}
 	return allocationPtr;
 }
@@ -91,13 +205,177 @@ const NuAllocator nDefaultAllocator = {
 	DefaultFree,
 };
 
+/**
+ * Publishes the calling thread temporary allocator counters to the temp memory tag.
+ */
+static void PublishTempStats(void)
+{
+	MemoryCounters* counters = &gMemoryCounters[NU_MEMORY_TAG_TEMP];
+	nAtomicMax64(&counters->peakBytes, (int64_t)gTempAllocator.highWater);
+	nAtomicAdd64(&counters->numAllocations, (int64_t)gTempAllocator.numAllocations);
+	gTempAllocator.numAllocations = 0;
+}
+
+static inline void CountAllocation(MemoryCounters* counters, int64_t size)
+{
+	int64_t liveBytes = nAtomicAdd64(&counters->liveBytes, size);
+	nAtomicAdd64(&counters->numAllocations, 1);
+	nAtomicAdd64(&counters->numLiveAllocations, 1);
+	if (liveBytes > counters->peakBytes) {
+		nAtomicMax64(&counters->peakBytes, liveBytes);
+	}
+}
+
+static inline void CountFree(MemoryCounters* counters, int64_t size)
+{
+	nAtomicAdd64(&counters->liveBytes, -size);
+	nAtomicAdd64(&counters->numLiveAllocations, -1);
+}
+
+static void* TrackingMalloc(size_t size, size_t alignment, void* userData)
+{
+	NuTrackingAllocator* tracking = userData;
+	const size_t offset = max_size_t(TRACKING_HEADER_SIZE, alignment);
+
+	char* block = tracking->parent.malloc(offset + size, alignment, tracking->parent.userData);
+	if (!block) return NULL;
+
+	char* ptr = block + offset;
+	TrackingHeader* header = (TrackingHeader*)(ptr - TRACKING_HEADER_SIZE);
+	header->size = size;
+	header->offset = (uint32_t)offset;
+	header->tag = tracking->tag;
+
+	CountAllocation(&gMemoryCounters[tracking->tag], size);
+	return ptr;
+}
+
+static void* TrackingRealloc(void* ptr, size_t newSize, size_t alignment, void* userData)
+{
+	if (!ptr) {
+		return TrackingMalloc(newSize, alignment, userData);
+	}
+
+	NuTrackingAllocator* tracking = userData;
+	TrackingHeader* header = (TrackingHeader*)((char*)ptr - TRACKING_HEADER_SIZE);
+	nEnforce(header->tag == tracking->tag, "Memory reallocated with a tracking allocator of a different tag.");
+	nAssert(header->offset == max_size_t(TRACKING_HEADER_SIZE, alignment));
+
+	const size_t oldSize = header->size;
+	const size_t offset = header->offset;
+	char* block = tracking->parent.realloc((char*)ptr - offset, offset + newSize, alignment, tracking->parent.userData);
+	if (!block) return NULL;
+
+	ptr = block + offset;
+	header = (TrackingHeader*)((char*)ptr - TRACKING_HEADER_SIZE);
+	header->size = newSize;
+
+	MemoryCounters* counters = &gMemoryCounters[tracking->tag];
+	int64_t liveBytes = nAtomicAdd64(&counters->liveBytes, (int64_t)newSize - (int64_t)oldSize);
+	if (liveBytes > counters->peakBytes) {
+		nAtomicMax64(&counters->peakBytes, liveBytes);
+	}
+	return ptr;
+}
+
+static void TrackingFree(void* ptr, void* userData)
+{
+	if (!ptr) return;
+	NuTrackingAllocator* tracking = userData;
+	TrackingHeader* header = (TrackingHeader*)((char*)ptr - TRACKING_HEADER_SIZE);
+	nEnforce(header->tag == tracking->tag, "Memory freed with a tracking allocator of a different tag.");
+	CountFree(&gMemoryCounters[tracking->tag], header->size);
+	tracking->parent.free((char*)ptr - header->offset, tracking->parent.userData);
+}
+
+void nuInitTrackingAllocator(NuTrackingAllocator* tracking, NuMemoryTag tag, NuAllocator const* parent)
+{
+	nEnforce(tag < NU_MEMORY_TAG_COUNT_, "Invalid memory tag.");
+	tracking->allocator = (NuAllocator) {
+		tracking,
+		TrackingMalloc,
+		TrackingRealloc,
+		TrackingFree,
+	};
+	tracking->parent = parent ? *parent : nDefaultAllocator;
+	tracking->tag = tag;
+}
+
+void nInitTaggedAllocators(NuAllocator const* parent)
+{
+	for (uint i = 0; i < NU_MEMORY_TAG_COUNT_; ++i) {
+		nEnforce(!gTaggedAllocatorsInitialized || gMemoryCounters[i].numLiveAllocations == 0 || i == NU_MEMORY_TAG_TEMP,
+			"Cannot change the parent of tagged allocators while %s memory is still allocated.", kMemoryTagNames[i]);
+		nuInitTrackingAllocator(&gTaggedAllocators[i], i, parent);
+	}
+	gTaggedAllocatorsInitialized = true;
+}
+
+NuAllocator* nGetTaggedOrAllocator(NuAllocator* allocator, NuMemoryTag tag)
+{
+	if (allocator) return allocator;
+	if (!gTaggedAllocatorsInitialized) {
+		nInitTaggedAllocators(NULL);
+	}
+	return &gTaggedAllocators[tag].allocator;
+}
+
+NuMemoryStats nuGetMemoryStats(NuMemoryTag tag)
+{
+	nEnforce(tag < NU_MEMORY_TAG_COUNT_, "Invalid memory tag.");
+	if (tag == NU_MEMORY_TAG_TEMP && gTempAllocator.buffer) {
+		PublishTempStats();
+	}
+
+	MemoryCounters const* counters = &gMemoryCounters[tag];
+	return (NuMemoryStats) {
+		.liveBytes = (size_t)nAtomicLoad64(&counters->liveBytes),
+		.peakBytes = (size_t)nAtomicLoad64(&counters->peakBytes),
+		.numAllocations = (uint64_t)nAtomicLoad64(&counters->numAllocations),
+		.numLiveAllocations = (uint64_t)nAtomicLoad64(&counters->numLiveAllocations),
+	};
+}
+
+void nuDumpMemoryStats(void)
+{
+	nDebugPrint("%-10s %14s %14s %14s %14s\n", "tag", "live bytes", "peak bytes", "allocations", "live allocs");
+	for (uint i = 0; i < NU_MEMORY_TAG_COUNT_; ++i) {
+		NuMemoryStats stats = nuGetMemoryStats(i);
+		nDebugPrint("%-10s %14llu %14llu %14llu %14llu\n", kMemoryTagNames[i],
+			(unsigned long long)stats.liveBytes, (unsigned long long)stats.peakBytes,
+			(unsigned long long)stats.numAllocations, (unsigned long long)stats.numLiveAllocations);
+	}
+}
+
 NuTempAllocator nResetTempAlloc(void)
 {
 	nEnforce(gTempAllocator.buffer, "Uninitialized temp allocator, please use nuInitThread() if this is a separate thread from which Nunki was initialized on.");
+	PublishTempStats();
 	gTempAllocator.cursor = gTempAllocator.buffer;
+	gTempAllocator.lastAllocationPtr = NULL;
 	return (NuTempAllocator)&gTempAllocator.allocator;
 }
 
+NuAllocator* nGetTempAllocator(void)
+{
+	nEnforce(gTempAllocator.buffer, "Uninitialized temp allocator, please use nuInitThread() if this is a separate thread from which Nunki was initialized on.");
+	return &gTempAllocator.allocator;
+}
+
+NuTempMark nuTempMark(void)
+{
+	nEnforce(gTempAllocator.buffer, "Uninitialized temp allocator, please use nuInitThread() if this is a separate thread from which Nunki was initialized on.");
+	return (NuTempMark) { gTempAllocator.cursor, gTempAllocator.lastAllocationPtr };
+}
+
+void nuTempRewind(NuTempMark mark)
+{
+	nEnforce((char*)mark.cursor >= gTempAllocator.buffer && (char*)mark.cursor <= gTempAllocator.cursor,
+		"Invalid temp mark, marks must be rewound in reverse order on the thread that created them.");
+	gTempAllocator.cursor = mark.cursor;
+	gTempAllocator.lastAllocationPtr = mark.lastAllocationPtr;
+}
+
 NuResult nInitThreadTempAllocator(NuAllocator* allocator)
 {
 	if (gTempAllocator.buffer) {
@@ -105,9 +383,14 @@ NuResult nInitThreadTempAllocator(NuAllocator* allocator)
 		return NU_SUCCESS;
 	}
 
-	size_t capacity = 1024 * 1024 * 10; // 10Mb
-	gTempAllocator.buffer = n_malloc(capacity, nGetDefaultOrAllocator(allocator));
-	gTempAllocator.bufferEnd = gTempAllocator.buffer + capacity;
+	/* reserve the address space only, pages get committed as they are touched */
+	gTempAllocator.buffer = nVirtualReserve(TEMP_ALLOCATOR_RESERVE_SIZE);
+	if (!gTempAllocator.buffer) {
+		return NU_ERROR_OUT_OF_MEMORY;
+	}
+
+	gTempAllocator.bufferEnd = gTempAllocator.buffer + TEMP_ALLOCATOR_RESERVE_SIZE;
+	gTempAllocator.committedEnd = gTempAllocator.buffer;
 	gTempAllocator.cursor = gTempAllocator.buffer;
 
 	gTempAllocator.allocator = (NuAllocator) {
@@ -117,7 +400,7 @@ NuResult nInitThreadTempAllocator(NuAllocator* allocator)
 		TempFree,
 	};
 
-	return gTempAllocator.buffer ? NU_SUCCESS : NU_ERROR_OUT_OF_MEMORY;
+	return NU_SUCCESS;
 }
 
 void nDeinitThreadTempAllocator(NuAllocator* allocator)
@@ -126,20 +409,22 @@ void nDeinitThreadTempAllocator(NuAllocator* allocator)
 		nDebugWarning("Nunki temporary allocator already deinitialized on this thread.");
 		return;
 	}
-	n_free(gTempAllocator.buffer, nGetDefaultOrAllocator(allocator));
+	PublishTempStats();
+	nAtomicAdd64(&gMemoryCounters[NU_MEMORY_TAG_TEMP].liveBytes, -(int64_t)(gTempAllocator.committedEnd - gTempAllocator.buffer));
+	nVirtualRelease(gTempAllocator.buffer, TEMP_ALLOCATOR_RESERVE_SIZE);
 	nZero(&gTempAllocator);
 }
 
 void nTempAllocatorLockMalloc(void)
 {
-#ifdef DEBUG
+#if defined(DEBUG) || defined(_DEBUG)
 	gTempAllocator.mallocLocked = true;
 #endif
 }
 
 void nTempAllocatorUnlockMalloc(void)
 {
-#ifdef DEBUG
+#if defined(DEBUG) || defined(_DEBUG)
 	gTempAllocator.mallocLocked = false;
 #endif
 }
@@ -147,7 +432,11 @@ void nTempAllocatorUnlockMalloc(void)
 size_t nuFileLoader(void* buffer, size_t bufferSize, void* faceUserData, void* loaderUserData)
 {
 	FILE* file = 0;
+#ifdef _MSC_VER
 	fopen_s(&file, (const char*)faceUserData, "rb");
+#else
+	file = fopen((const char*)faceUserData, "rb");
+#endif
 	if (!file) {
 		return 0;
 	}
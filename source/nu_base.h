@@ -16,6 +16,17 @@ inline NuAllocator* nGetDefaultOrAllocator(NuAllocator* allocator)
 	return allocator ? allocator : &nDefaultAllocator;
 }
 
+/**
+ * @returns \p allocator if not null, otherwise the default allocator of subsystem \p tag, which
+ * accounts its allocations to that tag.
+ */
+NuAllocator* nGetTaggedOrAllocator(NuAllocator* allocator, NuMemoryTag tag);
+
+/**
+ * Makes the default allocator of each subsystem tag forward to \p parent.
+ */
+void nInitTaggedAllocators(NuAllocator const* parent);
+
 static inline void* n_newEx(NuAllocator* allocator, size_t size, size_t alignment)
 {
 	void* ptr = allocator->malloc(size, alignment, allocator->userData);
@@ -44,6 +55,12 @@ void nDeinitThreadTempAllocator(NuAllocator* allocator);
  */
 inline NuAllocator* nAllocatorFromTemp(NuTempAllocator tempAllocator) { return (NuAllocator*)tempAllocator; }
 
+/**
+ * @returns the calling thread temporary allocator without resetting it, pair with nuTempMark() and
+ * nuTempRewind() to release what is allocated from it.
+ */
+NuAllocator* nGetTempAllocator(void);
+
 /**
  * Write the #documentation.
  */
@@ -15,7 +15,16 @@ static NBuiltinResources gBuiltins;
 
 static void CompileTechnique(const char* name, NuTechniqueCreateInfo* info, NuTechnique* pTechnique)
 {
-	NuTechniqueCreateResult result = nuCreateTechnique(info, pTechnique);
+	NuTechniqueCreateResult result = nuCreateTechniqueAsync(info, pTechnique);
+	nEnforce(result == NU_TECHNIQUE_CREATE_SUCCESS, "Out of memory creating builtin technique %s.", name);
+}
+
+/**
+ * Waits for the builtin technique \p technique compiled by CompileTechnique() to be built.
+ */
+static void WaitTechnique(const char* name, NuTechnique technique, const char* errorMessage)
+{
+	NuTechniqueCreateResult result = nuTechniqueGetStatus(technique, true);
 
 	static const char* errorMsgs[] = {
 		"Error compiling builtin vertex shader",
@@ -24,7 +33,7 @@ static void CompileTechnique(const char* name, NuTechniqueCreateInfo* info, NuTe
 		"Error linking builtin shader",
 	};
 
-	nEnforce(result == NU_TECHNIQUE_CREATE_SUCCESS, "%s %s:\n%s", errorMsgs[result - 1], name, info->errorMessageBuffer);
+	nEnforce(result == NU_TECHNIQUE_CREATE_SUCCESS, "%s %s:\n%s", errorMsgs[result - 1], name, errorMessage);
 }
 
 #define LoadVertexLayout(name, alloc)\
@@ -88,6 +97,11 @@ static void CreateTechniques(void)
 	info2d.fragmentShaderSource = N_SHADER_SRC_2D_QUAD_TEXTURED_FONT_FRAG;
 	info2d.samplers = (const char*[]) { "sTexture", NULL };
 	CompileTechnique("2d quad textured font", &info2d, &gBuiltins.technique2dQuadTexturedFont);
+
+	/* the driver builds the techniques in parallel, check them once all submitted */
+	WaitTechnique("2D quad solid", gBuiltins.technique2dQuadSolid, msgBuffer);
+	WaitTechnique("2d quad textured", gBuiltins.technique2dQuadTextured, msgBuffer);
+	WaitTechnique("2d quad textured font", gBuiltins.technique2dQuadTexturedFont, msgBuffer);
 }
 
 
@@ -99,7 +113,11 @@ void nInitBuiltinResources(NuAllocator* allocator)
 
 void nDeinitBuiltinResources(NuAllocator* allocator)
 {
+	nuDestroyTechnique(gBuiltins.technique2dQuadSolid);
+	nuDestroyTechnique(gBuiltins.technique2dQuadTextured);
+	nuDestroyTechnique(gBuiltins.technique2dQuadTexturedFont);
 	nuDestroyVertexLayout(gBuiltins.vertexLayout2dQuadSolid, allocator);
+	nuDestroyVertexLayout(gBuiltins.vertexLayout2dQuadTextured, allocator);
 }
 
 NBuiltinResources const* nGetBuiltins(void)
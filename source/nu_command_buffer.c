@@ -0,0 +1,341 @@
+/*
+ * Nunki (simple rendering engine)
+ * Copyright (C) 2015 Canio Massimo Tristano <massimo.tristano@gmail.com>.
+ * For licensing info see LICENSE.
+ */
+
+#include "nunki/device.h"
+#include "nu_base.h"
+#include "nu_libs.h"
+
+/* every command in the stream starts at this alignment */
+#define COMMAND_ALIGNMENT 8
+
+/* consecutive array draws replayed by a single multi draw at most */
+#define MAX_BATCHED_DRAWS 64
+
+typedef enum {
+	COMMAND_CLEAR,
+	COMMAND_SET_VIEWPORT,
+	COMMAND_SET_TECHNIQUE,
+	COMMAND_SET_BLEND_STATE,
+	COMMAND_SET_PIPELINE,
+	COMMAND_SET_VERTEX_BUFFERS,
+	COMMAND_SET_CONSTANT_BUFFERS,
+	COMMAND_SET_TEXTURES,
+	COMMAND_DRAW_ARRAYS,
+	COMMAND_DRAW_INDEXED,
+	COMMAND_UPDATE_BUFFER,
+} CommandType;
+
+typedef struct {
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t size; /* of the whole command including this header, multiple of COMMAND_ALIGNMENT */
+} CommandHeader;
+
+typedef struct {
+	NuClearFlags flags;
+	float        color[4];
+	float        depth;
+	uint         stencil;
+} ClearCommand;
+
+typedef struct {
+	uint base;
+	uint count;
+	/* followed by count NuBufferView */
+} SetBufferViewsCommand;
+
+typedef struct {
+	uint base;
+	uint count;
+	/* followed by count NuTexture and count NuSampler */
+} SetTexturesCommand;
+
+typedef struct {
+	NuPrimitiveType primitive;
+	uint            firstVertex;
+	uint            numVertices;
+	uint            numInstances;
+} DrawArraysCommand;
+
+typedef struct {
+	NuPrimitiveType   primitive;
+	NuIndexBufferView indexBuffer;
+	uint              firstVertex;
+	uint              numIndices;
+	uint              numInstances;
+	uint              baseVertex;
+} DrawIndexedCommand;
+
+typedef struct {
+	NuBuffer buffer;
+	uint     offset;
+	uint     size;
+	/* followed by size bytes of data */
+} UpdateBufferCommand;
+
+typedef struct NuCommandBufferImpl {
+	NuAllocator allocator;
+	char*       stream; /* nArray */
+	uint        numCommands;
+	bool        outOfMemory;
+} CommandBuffer;
+
+#define CommandPayload(header) ((void*)((CommandHeader*)(header) + 1))
+
+/**
+ * Appends a command of \p type with \p payloadSize bytes of payload to the stream.
+ * @returns the payload or NULL if out of memory, in which case the command buffer is marked invalid.
+ */
+static void* PushCommand(CommandBuffer* commandBuffer, CommandType type, size_t payloadSize)
+{
+	nEnforce(commandBuffer, "Null command buffer provided.");
+	const size_t size = nAlignUintUp(sizeof(CommandHeader) + payloadSize, COMMAND_ALIGNMENT);
+	nEnforce(size <= UINT32_MAX, "Command too large.");
+
+	CommandHeader* header = nArrayPushEx(&commandBuffer->stream, &commandBuffer->allocator, 1, size);
+	if (!header) {
+		nDebugError("Out of memory while recording command buffer.");
+		commandBuffer->outOfMemory = true;
+		return NULL;
+	}
+
+	header->type = (uint16_t)type;
+	header->reserved = 0;
+	header->size = (uint32_t)size;
+	++commandBuffer->numCommands;
+	return CommandPayload(header);
+}
+
+static void Replay(NuContext context, CommandBuffer const* commandBuffer)
+{
+	char const* cursor = commandBuffer->stream;
+	char const* end = cursor + nArrayLen(commandBuffer->stream);
+
+	while (cursor < end) {
+		CommandHeader const* header = (CommandHeader const*)cursor;
+		void const* payload = CommandPayload(header);
+		cursor += header->size;
+
+		switch (header->type) {
+			case COMMAND_CLEAR:
+			{
+				ClearCommand const* cmd = payload;
+				nuDeviceClear(context, cmd->flags, (float*)cmd->color, cmd->depth, cmd->stencil);
+				break;
+			}
+
+			case COMMAND_SET_VIEWPORT:
+				nuDeviceSetViewport(context, *(NuRect2i const*)payload);
+				break;
+
+			case COMMAND_SET_TECHNIQUE:
+				nuDeviceSetTechnique(context, *(NuTechnique const*)payload);
+				break;
+
+			case COMMAND_SET_BLEND_STATE:
+				nuDeviceSetBlendState(context, payload);
+				break;
+
+			case COMMAND_SET_PIPELINE:
+				nuDeviceSetPipeline(context, *(NuPipeline const*)payload);
+				break;
+
+			case COMMAND_SET_VERTEX_BUFFERS:
+			{
+				SetBufferViewsCommand const* cmd = payload;
+				nuDeviceSetVertexBuffers(context, cmd->base, cmd->count, (NuBufferView const*)(cmd + 1));
+				break;
+			}
+
+			case COMMAND_SET_CONSTANT_BUFFERS:
+			{
+				SetBufferViewsCommand const* cmd = payload;
+				nuDeviceSetConstantBuffers(context, cmd->base, cmd->count, (NuBufferView const*)(cmd + 1));
+				break;
+			}
+
+			case COMMAND_SET_TEXTURES:
+			{
+				SetTexturesCommand const* cmd = payload;
+				NuTexture const* textures = (NuTexture const*)(cmd + 1);
+				nuDeviceSetTextures(context, cmd->base, cmd->count, textures, (NuSampler const*)(textures + cmd->count));
+				break;
+			}
+
+			case COMMAND_DRAW_ARRAYS:
+			{
+				/* nothing changes the state between consecutive draws, so they go out as one multi draw */
+				DrawArraysCommand const* cmd = payload;
+				NuDrawArraysCommand draws[MAX_BATCHED_DRAWS];
+				uint numDraws = 0;
+				for (;;) {
+					draws[numDraws++] = (NuDrawArraysCommand) { cmd->numVertices, cmd->numInstances, cmd->firstVertex, 0 };
+					if (cursor >= end || numDraws == MAX_BATCHED_DRAWS) break;
+
+					CommandHeader const* next = (CommandHeader const*)cursor;
+					DrawArraysCommand const* nextCmd = CommandPayload(next);
+					if (next->type != COMMAND_DRAW_ARRAYS || nextCmd->primitive != cmd->primitive) break;
+					cursor += next->size;
+					cmd = nextCmd;
+				}
+
+				if (numDraws == 1) {
+					nuDeviceDrawArrays(context, cmd->primitive, cmd->firstVertex, cmd->numVertices, cmd->numInstances);
+				} else {
+					nuDeviceMultiDrawArrays(context, cmd->primitive, draws, numDraws);
+				}
+				break;
+			}
+
+			case COMMAND_DRAW_INDEXED:
+			{
+				DrawIndexedCommand const* cmd = payload;
+				nuDeviceDrawIndexed(context, cmd->primitive, cmd->indexBuffer, cmd->firstVertex, cmd->numIndices, cmd->numInstances, cmd->baseVertex);
+				break;
+			}
+
+			case COMMAND_UPDATE_BUFFER:
+			{
+				UpdateBufferCommand const* cmd = payload;
+				nuBufferUpdate(cmd->buffer, cmd->offset, cmd + 1, cmd->size);
+				break;
+			}
+
+			default:
+				nAssert(false);
+				return;
+		}
+	}
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * API
+ *-----------------------------------------------------------------------------------------------*/
+NuResult nuCreateCommandBuffer(NuAllocator* allocator, NuCommandBuffer* pCommandBuffer)
+{
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_DEVICE);
+	*pCommandBuffer = n_new(CommandBuffer, allocator);
+	if (!*pCommandBuffer) return NU_ERROR_OUT_OF_MEMORY;
+	(*pCommandBuffer)->allocator = *allocator;
+	return NU_SUCCESS;
+}
+
+void nuDestroyCommandBuffer(NuCommandBuffer commandBuffer, NuAllocator* allocator)
+{
+	if (!commandBuffer) return;
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_DEVICE);
+	nArrayFree(commandBuffer->stream, &commandBuffer->allocator);
+	n_free(commandBuffer, allocator);
+}
+
+void nuCmdReset(NuCommandBuffer commandBuffer)
+{
+	nArrayClear(commandBuffer->stream);
+	commandBuffer->numCommands = 0;
+	commandBuffer->outOfMemory = false;
+}
+
+void nuCmdClear(NuCommandBuffer commandBuffer, NuClearFlags flags, float const* color4, float depth, uint stencil)
+{
+	ClearCommand* cmd = PushCommand(commandBuffer, COMMAND_CLEAR, sizeof(ClearCommand));
+	if (!cmd) return;
+	*cmd = (ClearCommand) { .flags = flags, .depth = depth, .stencil = stencil };
+	if (color4) memcpy(cmd->color, color4, sizeof cmd->color);
+}
+
+void nuCmdSetViewport(NuCommandBuffer commandBuffer, NuRect2i viewport)
+{
+	NuRect2i* cmd = PushCommand(commandBuffer, COMMAND_SET_VIEWPORT, sizeof(NuRect2i));
+	if (cmd) *cmd = viewport;
+}
+
+void nuCmdSetTechnique(NuCommandBuffer commandBuffer, NuTechnique technique)
+{
+	NuTechnique* cmd = PushCommand(commandBuffer, COMMAND_SET_TECHNIQUE, sizeof(NuTechnique));
+	if (cmd) *cmd = technique;
+}
+
+void nuCmdSetBlendState(NuCommandBuffer commandBuffer, NuBlendState const* blendState)
+{
+	nEnforce(blendState, "Null blend state provided.");
+	NuBlendState* cmd = PushCommand(commandBuffer, COMMAND_SET_BLEND_STATE, sizeof(NuBlendState));
+	if (cmd) *cmd = *blendState;
+}
+
+void nuCmdSetPipeline(NuCommandBuffer commandBuffer, NuPipeline pipeline)
+{
+	NuPipeline* cmd = PushCommand(commandBuffer, COMMAND_SET_PIPELINE, sizeof(NuPipeline));
+	if (cmd) *cmd = pipeline;
+}
+
+static void PushBufferViews(CommandBuffer* commandBuffer, CommandType type, uint base, uint count, NuBufferView const* views)
+{
+	SetBufferViewsCommand* cmd = PushCommand(commandBuffer, type, sizeof(SetBufferViewsCommand) + sizeof(NuBufferView) * count);
+	if (!cmd) return;
+	cmd->base = base;
+	cmd->count = count;
+	memcpy(cmd + 1, views, sizeof(NuBufferView) * count);
+}
+
+void nuCmdSetVertexBuffers(NuCommandBuffer commandBuffer, uint base, uint count, NuBufferView const* views)
+{
+	PushBufferViews(commandBuffer, COMMAND_SET_VERTEX_BUFFERS, base, count, views);
+}
+
+void nuCmdSetConstantBuffers(NuCommandBuffer commandBuffer, uint base, uint count, NuBufferView const* views)
+{
+	PushBufferViews(commandBuffer, COMMAND_SET_CONSTANT_BUFFERS, base, count, views);
+}
+
+void nuCmdSetTextures(NuCommandBuffer commandBuffer, uint base, uint count, NuTexture const* textures, NuSampler const* samplers)
+{
+	SetTexturesCommand* cmd = PushCommand(commandBuffer, COMMAND_SET_TEXTURES, sizeof(SetTexturesCommand) + (sizeof(NuTexture) + sizeof(NuSampler)) * count);
+	if (!cmd) return;
+	cmd->base = base;
+	cmd->count = count;
+	NuTexture* cmdTextures = (NuTexture*)(cmd + 1);
+	NuSampler* cmdSamplers = (NuSampler*)(cmdTextures + count);
+	memcpy(cmdTextures, textures, sizeof(NuTexture) * count);
+	if (samplers) {
+		memcpy(cmdSamplers, samplers, sizeof(NuSampler) * count);
+	}
+	else {
+		memset(cmdSamplers, 0, sizeof(NuSampler) * count);
+	}
+}
+
+void nuCmdDrawArrays(NuCommandBuffer commandBuffer, NuPrimitiveType primitive, uint firstVertex, uint numVertices, uint numInstances)
+{
+	DrawArraysCommand* cmd = PushCommand(commandBuffer, COMMAND_DRAW_ARRAYS, sizeof(DrawArraysCommand));
+	if (cmd) *cmd = (DrawArraysCommand) { primitive, firstVertex, numVertices, numInstances };
+}
+
+void nuCmdDrawIndexed(NuCommandBuffer commandBuffer, NuPrimitiveType primitive, NuIndexBufferView indexBuffer, uint firstVertex, uint numIndices, uint numInstances, uint baseVertex)
+{
+	DrawIndexedCommand* cmd = PushCommand(commandBuffer, COMMAND_DRAW_INDEXED, sizeof(DrawIndexedCommand));
+	if (cmd) *cmd = (DrawIndexedCommand) { primitive, indexBuffer, firstVertex, numIndices, numInstances, baseVertex };
+}
+
+void nuCmdUpdateBuffer(NuCommandBuffer commandBuffer, NuBuffer buffer, uint offset, const void* data, uint size)
+{
+	UpdateBufferCommand* cmd = PushCommand(commandBuffer, COMMAND_UPDATE_BUFFER, sizeof(UpdateBufferCommand) + size);
+	if (!cmd) return;
+	*cmd = (UpdateBufferCommand) { buffer, offset, size };
+	memcpy(cmd + 1, data, size);
+}
+
+void nuDeviceSubmit(NuContext context, NuCommandBuffer const* commandBuffers, uint count)
+{
+	for (uint i = 0; i < count; ++i) {
+		CommandBuffer const* commandBuffer = commandBuffers[i];
+		nEnforce(commandBuffer, "Null command buffer provided.");
+		if (commandBuffer->outOfMemory) {
+			nDebugWarning("Skipping submission of command buffer %d, it ran out of memory while recording.", i);
+			continue;
+		}
+		Replay(context, commandBuffer);
+	}
+}
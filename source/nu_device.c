@@ -12,10 +12,25 @@
 
 #ifdef _WIN32
 #include "nu_device_context_win32.inl"
+#else
+#include "nu_device_context_headless.inl"
 #endif
+#include "nu_device_null.inl"
 
 #define MAX_NUM_CONSTANT_BUFFERS 16
 #define MAX_TEXTURE_UINTS 16
+#define STREAM_BUFFER_NUM_FRAMES 3  /* frames the GPU may lag behind, each owns a range of the stream buffer rings */
+#define STREAM_BUFFER_ALIGNMENT 256 /* largest uniform buffer offset alignment GL allows */
+#define VERTEX_ARRAY_CACHE_SIZE 32  /* vertex array objects cached by each context */
+#define PROGRAM_CACHE_MAGIC 0x3142504e /* "NPB1" */
+#define UPLOAD_RING_SIZE (4u << 20) /* bytes of the texture upload staging ring */
+#define UPLOAD_ALIGNMENT 16         /* alignment of uploads in the staging ring */
+#define CONSTANT_RING_SIZE (4u << 20) /* bytes of the ring nuDeviceWriteConstants() suballocates */
+#define TIMER_QUERY_RING_SIZE (STREAM_BUFFER_NUM_FRAMES + 1) /* frames timed at once by a context */
+
+/* KHR_parallel_shader_compile and ARB_parallel_shader_compile, not in glcorearb.h */
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
 
 /*-------------------------------------------------------------------------------------------------
  * Types
@@ -34,35 +49,68 @@ typedef struct {
 	VertexLayoutAttribute attributes[NU_VERTEX_LAYOUT_MAX_STREAM_ATTRIBUTES];
 } VertexLayoutStream;
 
-typedef struct NuVertexLayoutImpl {
+typedef struct {
 	uint numAttributes;
 	uint numStreams;
 	VertexLayoutStream streams[NU_VERTEX_LAYOUT_MAX_STREAMS];
 } VertexLayout;
 
 typedef struct {
-	VertexLayout const *layout;
+	NuVertexLayout layout;
 	GLuint programId;
 	uint   numConstantBuffers;
 	uint   numSamplers;
+
+	/* techniques are pending until the driver built their program, see CompleteTechnique() */
+	NuTechniqueCreateResult status;
+	int32_t volatile        lock;
+	GLuint                  shaders[3]; /* vertex, geometry and fragment shaders being compiled */
+	char**                  constantBuffers; /* null terminated copies of the creation info lists */
+	char**                  samplers;
+	char*                   errorMessageBuffer;
+	uint                    errorMessageBufferSize;
+	uint64_t                cacheKey; /* key to store the program binary with once built, zero if none */
 } Technique;
 
-typedef struct NuBufferImpl {
-	GLuint        id;
-	NuBufferType  type;
-	uint          size;
-	NuBufferUsage usage;
-	uint          mapped : 1;
+typedef struct {
+	uint64_t frame; /* device frame that wrote this range of the ring, zero if none */
+	uint     begin;
+	uint     end;   /* lower than or equal to begin if the range wraps around the end of the ring */
+} StreamFrameRange;
+
+typedef struct {
+	GLuint           id;
+	NuBufferType     type;
+	uint             size;
+	NuBufferUsage    usage;
+	uint             mapped : 1;
+
+	/* Stream buffers are rings, each update writes the new contents to a range of it the GPU is not
+	 * reading and views are relative to base, the beginning of the current contents. */
+	uint             base;
+	uint             capacity;
+	uint             head;
+	char*            ring; /* persistent mapping of the whole ring, or null if not supported */
+	StreamFrameRange frames[STREAM_BUFFER_NUM_FRAMES];
+
+	/* capacity bytes of contents of indirect buffers if draw indirect is not supported, the CPU issues
+	 * the draws they contain */
+	char*            commands;
 } Buffer;
 
-typedef struct NuTextureImpl {
+typedef struct {
 	GLuint          id;
 	NuTextureType   type;
 	NuSize3i        size;
 	NuTextureFormat format;
+	bool            keepCpuCopy;
+	NuImage         cpuCopy;
+	int32_t volatile cpuCopyLock;    /* uploads update the copy from any thread */
+	uint            numLevels;
+	bool            decompress;      /* compressed format not supported, stored decoded */
 } Texture;
 
-typedef struct NuSamplerImpl {
+typedef struct {
 	GLuint       id;
 	NuFilterMode minFilterMod;
 	NuFilterMode magFilterMode;
@@ -71,59 +119,404 @@ typedef struct NuSamplerImpl {
 } Sampler;
 
 typedef struct {
-	GLuint              boundBuffers[3];
-	NuRect2i            viewport;
-	const Technique*    technique;
-	const VertexLayout* vertexLayout;
-	bool                vertexLayoutIsDirty;
-	uint                numActiveAttributes;
-	NuBlendState        blendState;
+	GLuint                framebuffer;
+	GLuint                depthStencil; /* renderbuffer, zero if none */
+	struct NuContextImpl* context;      /* framebuffers are not shared between contexts */
+	uint                  numColorTextures;
+} RenderTarget;
+
+/* pixel pack buffer readbacks are copied to, reused once its readback is destroyed */
+typedef struct {
+	GLuint id;
+	uint   capacity;
+} ReadbackBuffer;
+
+typedef struct {
+	ReadbackBuffer buffer;
+	GLsync         fence; /* zero once the GPU wrote the pixels */
+	NuImageFormat  format;
+	NuSize2i       size;
+} Readback;
+
+/* Pipelines are interned, PipelineKey maps the state they bake to the pipeline handle. */
+typedef struct {
+	NuTechnique  technique;
+	NuBlendState blendState;
+} PipelineKey;
+
+typedef struct {
+	NuTechnique  technique;
+	NuBlendState blendState;
+	uint64_t     sortKey;
+} Pipeline;
+
+/* Vertex array objects are cached per context by vertex layout and vertex buffers. View offsets are
+ * applied at draw time as base vertex and base instance where possible, so that moving a view does
+ * not respecify the attributes. Buffers are identified by both handle and GL name, as stream buffers
+ * can recreate their GL buffer and GL names of deleted buffers are reused. */
+typedef struct {
+	NuVertexLayout layout;
+	NuBuffer       buffers[NU_VERTEX_LAYOUT_MAX_STREAMS];
+	GLuint         ids[NU_VERTEX_LAYOUT_MAX_STREAMS];
+} VertexArrayKey;
+
+typedef struct {
+	VertexArrayKey key;
+	GLuint         id;
+	GLuint         elementBuffer; /* element array buffer binding, part of the vertex array state */
+	uint           offsets[NU_VERTEX_LAYOUT_MAX_STREAMS]; /* offsets the stream attributes were specified at */
+	uint64_t       lastUse;
+} VertexArray;
+
+/* Program binary cache files are named after the program key and made of this header followed by
+ * the binary returned by glGetProgramBinary(). */
+typedef struct {
+	uint32_t magic;
+	uint32_t format;
+	uint64_t key;
+	uint32_t size;
+	uint32_t reserved;
+} ProgramCacheHeader;
+
+/* Texture uploads are staged by nuTextureUploadAsync() in a persistently mapped pixel unpack ring
+ * and issued in batches by nuDeviceFlushUploads(). Ring positions are byte counts since the device
+ * was initialized, so that head - tail is the space in use. Each batch is fenced and releases the
+ * ring space up to its end when the fence signals. */
+typedef struct {
+	NuTextureUploadInfo info;    /* data points to the heap copy if the upload is not in the ring */
+	uint64_t            ringPosition;
+	void*               heapCopy;
+	NuUploadTicket      ticket;
+	int32_t volatile    ready;   /* texels have been copied, the upload can be issued */
+} TextureUpload;
+
+typedef struct {
+	GLsync         fence;
+	uint64_t       ringEnd;
+	NuUploadTicket lastTicket;
+} UploadBatch;
+
+/* buffer range last given to a GL binding point */
+typedef struct {
+	GLuint id;
+	uint   offset;
+	uint   size;
+} BoundBufferRange;
+
+/* pending state that differs from the applied one, see FlushState() */
+typedef enum {
+	DIRTY_VIEWPORT    = 1 << 0,
+	DIRTY_TECHNIQUE   = 1 << 1,
+	DIRTY_BLEND_STATE = 1 << 2,
+	DIRTY_RENDER_TARGET = 1 << 3,
+} DirtyFlag;
+
+/* The device setters record the pending state only, draws apply it to GL diffing it against the
+ * applied state, which shadows the GL context one. */
+typedef struct {
+	/* pending state */
+	uint32_t            dirty;                /* DirtyFlag bits */
+	uint32_t            dirtyConstantBuffers; /* bitmasks of the slots to diff on draw */
+	uint32_t            dirtyTextures;
+	uint32_t            dirtySamplers;
+	NuRect2i            pendingViewport;
+	NuPipeline          pipeline; /* zero if state was set piecewise since the last pipeline */
+	NuTechnique         pendingTechnique;
+	NuVertexLayout      vertexLayout;
+	NuBlendState        pendingBlendState;
 	NuBufferView        constantBuffers[MAX_NUM_CONSTANT_BUFFERS];
 	NuBufferView        vertexBuffers[NU_VERTEX_LAYOUT_MAX_STREAMS];
-	const Texture*      textures[MAX_TEXTURE_UINTS][NU_TEXTURE_TYPE_COUNT_];
-	Sampler const*      samplers[MAX_TEXTURE_UINTS];
-	bool                dirtySamplers[MAX_TEXTURE_UINTS];
+	bool                vertexArrayIsDirty; /* layout or vertex buffers changed since the last draw */
+	NuTexture           pendingTextures[MAX_TEXTURE_UINTS];
+	NuSampler           pendingSamplers[MAX_TEXTURE_UINTS];
+	NuRenderTarget      pendingRenderTarget;
+
+	/* applied state */
+	GLuint              boundBuffers[4]; /* by NuBufferType */
+	NuRect2i            viewport;
+	NuTechnique         technique;
+	NuBlendState        blendState;
+	BoundBufferRange    boundConstantBuffers[MAX_NUM_CONSTANT_BUFFERS];
+	GLuint              boundVertexArray;
+	GLuint              defaultVertexArray;
+	VertexArray*        vertexArray; /* cache entry of the bound vertex array, null for the default one */
+	VertexArray         vertexArrays[VERTEX_ARRAY_CACHE_SIZE];
+	uint                numVertexArrays;
+	uint64_t            vertexArrayClock;
+	GLint               baseVertex;   /* offsets of the vertex buffers views not applied to the vertex array */
+	GLuint              baseInstance;
+	uint                activeTextureUnit;
+	NuTexture           textures[MAX_TEXTURE_UINTS][NU_TEXTURE_TYPE_COUNT_];
+	NuSampler           samplers[MAX_TEXTURE_UINTS];
+	GLuint              framebuffer;
+	NuDeviceStats       stats;
+	int32_t             streamGeneration;   /* device generations the applied state was validated against */
+	int32_t             deletionGeneration;
+
+	/* frame statistics, see EndFrameStats() */
+	NuDeviceStats       frameBeginStats;
+	NuDeviceFrameStats  frameStats;
+	uint64_t            frame;            /* frames completed */
+	GLuint              timerQueries[TIMER_QUERY_RING_SIZE]; /* by frame, zeros if not timing */
+	uint64_t            oldestTimerFrame; /* oldest frame whose time was not read yet */
 } State;
 
 typedef struct NuContextImpl {
-	NGlContext nglContext;
-	State state;
+	NGlContext       nglContext;
+	State            state;
+	int32_t volatile bound; /* whether the context is current on some thread */
 } Context;
 
 static struct {
 	bool              initialized;
+	bool              nullBackend;
 	NuAllocator       allocator;
 	NGlContextManager nglContextManager;
 	NuDeviceDefaults  defaults;
-	Technique*        techniques;
-	State             state;
-	State*            currentState;
+	int32_t volatile  poolLock;
+	int32_t volatile  streamGeneration;   /* bumped when stream buffer contents move, see FlushState() */
+	int32_t volatile  deletionGeneration; /* bumped when GL buffers, textures or samplers are deleted, see CurrentState() */
+	NPool             techniques;
+	NPool             vertexLayouts;
+	NPool             buffers;
+	NPool             textures;
+	NPool             samplers;
+	NPool             pipelines;
+	NPool             renderTargets;
+	NPool             readbacks;
+	NHashMap          pipelineMap;   /* PipelineKey to NuPipeline, guarded by poolLock */
+	NHashMap          blendStateIds; /* NuBlendState to its uint index in the pipeline sort keys */
+
+	bool              baseInstance; /* GL 4.2 or ARB_base_instance */
+	bool              drawIndirect;      /* GL 4.0 or ARB_draw_indirect */
+	bool              multiDrawIndirect; /* GL 4.3 or ARB_multi_draw_indirect */
+	bool              timerQueries;      /* GL 3.3 or ARB_timer_query */
+	bool              parallelShaderCompile; /* program completion can be polled, see IsTechniqueBuilt() */
+	uint32_t          compressedFormats;     /* bitmask of the compressed NuTextureFormat supported by the driver */
+	bool              textureStorage;        /* GL 4.2 or ARB_texture_storage */
+	char*             programCacheDirectory; /* null if the program binary cache is disabled */
+	uint64_t          programCacheSeed;      /* hash of the driver identity, binaries only load on the driver that produced them */
+
+	/* texture upload queue, see nuTextureUploadAsync() */
+	int32_t volatile  uploadLock;
+	GLuint            uploadRing;
+	char*             uploadRingData;  /* persistent mapping, null if uploads are staged in heap copies */
+	uint64_t          uploadRingHead;
+	uint64_t          uploadRingTail;
+	TextureUpload*    uploads;         /* nArray of the queued uploads in ticket order */
+	UploadBatch*      uploadBatches;   /* nArray of the issued batches the GPU may not have completed */
+	NuUploadTicket    lastUploadTicket;
+	NuUploadTicket    completedUploadTicket;
+
+	/* constant ring, see nuDeviceWriteConstants() */
+	int32_t volatile  constantRingLock;
+	NuBuffer          constantRing;
+	uint              constantAlignment; /* GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT */
+
+	/* pixel pack buffers of destroyed readbacks, see nuDeviceReadPixels() */
+	int32_t volatile  readbackLock;
+	ReadbackBuffer*   readbackBuffers; /* nArray */
+
+	/* frame fencing, see EndDeviceFrame() */
+	bool              persistentStreamBuffers;
+	int32_t volatile  frameLock;
+	uint64_t          frame;
+	uint64_t          completedFrame;
+	GLsync            frameFences[STREAM_BUFFER_NUM_FRAMES];
 } gDevice;
 
+/* The GL context current on a thread and its state cache are per thread, so that independent contexts
+ * can be driven concurrently by different threads. Threads that have no context bound track the
+ * state of whatever GL context the platform layer made current in gThreadDefaultState. */
+static n_threadlocal Context* gThreadContext;
+static n_threadlocal State    gThreadDefaultState;
+static n_threadlocal State*   gCurrentState;
+
 /*-------------------------------------------------------------------------------------------------
  * Static functions
  *-----------------------------------------------------------------------------------------------*/
 
+static void ForgetDeletedObjects(State* state);
+
+/**
+ * @returns the state of the GL context current on the calling thread. Objects may have been deleted
+ * by other threads since it was last used, in which case its caches are revalidated first.
+ */
+static inline State* CurrentState(void)
+{
+	State* state = gCurrentState ? gCurrentState : &gThreadDefaultState;
+	if (state->deletionGeneration != nAtomicLoad32(&gDevice.deletionGeneration)) ForgetDeletedObjects(state);
+	return state;
+}
+
+/**
+ * Invalidates the stream buffer bindings of the states of all contexts, as the contents of a stream
+ * buffer moved. Each state revalidates them on its next draw, see FlushState().
+ */
+static inline void InvalidateStreamBufferBindings(void)
+{
+	nAtomicAdd32(&gDevice.streamGeneration, 1);
+}
+
+/**
+ * Tells the states of all contexts that GL objects were deleted, GL reuses the names of deleted
+ * objects so each state drops its cached bindings when next used, see CurrentState().
+ */
+static inline void InvalidateDeletedObjects(void)
+{
+	nAtomicAdd32(&gDevice.deletionGeneration, 1);
+}
+
+/**
+ * Makes the hidden global context current for object creation. This releases the thread's context, so
+ * that the next draw binds it again and creation-time GL calls are tracked in gThreadDefaultState.
+ */
 static inline void BindGlobalContext(void)
 {
-	nGlContextManagerMakeCurrent(&gDevice.nglContextManager);
-	gDevice.currentState = &gDevice.state;
+	if (gThreadContext) nAtomicStore32(&gThreadContext->bound, 0);
+	if (gDevice.nullBackend) {
+		NullGlMakeCurrent(gThreadDefaultState.boundBuffers, gThreadDefaultState.boundVertexArray);
+	} else {
+		nGlContextManagerMakeCurrent(&gDevice.nglContextManager);
+	}
+	gThreadContext = NULL;
+	gCurrentState = &gThreadDefaultState;
+}
+
+/**
+ * @returns the state of \p context. Setters only record pending state, so they do not need the context
+ * to be current, but they must not race with the thread it is current on.
+ */
+static inline State* ContextState(Context* context)
+{
+	nEnforce(context, "Null context provided.");
+	nAssert(gThreadContext == context || !nAtomicLoad32(&context->bound));
+	return &context->state;
 }
 
 static inline void BindContext(Context* context)
 {
-	nGlContextMakeCurrent(&context->nglContext);
-	gDevice.currentState = &context->state;
+	nEnforce(context, "Null context provided.");
+	if (gThreadContext == context) return;
+
+	/* a GL context can be current on one thread only */
+	bool acquired = nAtomicCas32(&context->bound, 0, 1);
+	nEnforce(acquired, "Context is current on another thread, call nuDeviceReleaseContext() on that thread first.");
+
+	if (gThreadContext) nAtomicStore32(&gThreadContext->bound, 0);
+	if (gDevice.nullBackend) {
+		NullGlMakeCurrent(context->state.boundBuffers, context->state.boundVertexArray);
+	} else {
+		nGlContextMakeCurrent(&context->nglContext);
+	}
+	gThreadContext = context;
+	gCurrentState = &context->state;
+}
+
+static inline NHandle DevicePoolAlloc(NPool* pool, void** pElement)
+{
+	nSpinLock(&gDevice.poolLock);
+	NHandle handle = nPoolAlloc(pool, pElement);
+	nSpinUnlock(&gDevice.poolLock);
+	return handle;
+}
+
+static inline void DevicePoolFree(NPool* pool, NHandle handle)
+{
+	nSpinLock(&gDevice.poolLock);
+	nPoolFree(pool, handle);
+	nSpinUnlock(&gDevice.poolLock);
 }
 
 #define EnforceInitialized() nEnforce(gDevice.initialized, "Device uninitialized");
 
+/**
+ * Accounts a state setting call of \p category to the statistics of \p state, \p changed tells
+ * whether it reached GL or was filtered out by the state cache.
+ */
+static inline void CountStateChange(State* state, NuStateCategory category, bool changed)
+{
+	if (changed) {
+		++state->stats.numStateChanges;
+		++state->stats.numStateChangesByCategory[category];
+	} else {
+		++state->stats.numRedundantStateChanges;
+		++state->stats.numFilteredStateChanges[category];
+	}
+}
+
 static inline NuAllocator* GetDeviceAllocator(NuAllocator* allocator)
 {
 	return allocator ? allocator : &gDevice.allocator;
 }
 
-static void __stdcall debugCallbackGL(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, const void* user_data)
+static inline VertexLayout* DeviceGetVertexLayout(NuVertexLayout handle)
+{
+	VertexLayout* layout = nPoolGet(&gDevice.vertexLayouts, handle);
+	nEnforce(layout, "Invalid or stale vertex layout provided.");
+	return layout;
+}
+
+static inline Buffer* DeviceGetBuffer(NuBuffer handle)
+{
+	Buffer* buffer = nPoolGet(&gDevice.buffers, handle);
+	nEnforce(buffer, "Invalid or stale buffer provided.");
+	return buffer;
+}
+
+static inline Texture* DeviceGetTexture(NuTexture handle)
+{
+	Texture* texture = nPoolGet(&gDevice.textures, handle);
+	nEnforce(texture, "Invalid or stale texture provided.");
+	return texture;
+}
+
+static inline Technique* DeviceGetTechnique(NuTechnique handle)
+{
+	Technique* technique = nPoolGet(&gDevice.techniques, handle);
+	nEnforce(technique, "Invalid or stale technique provided.");
+	return technique;
+}
+
+static inline Pipeline const* DeviceGetPipeline(NuPipeline handle)
+{
+	Pipeline const* pipeline = nPoolGet(&gDevice.pipelines, handle);
+	nEnforce(pipeline, "Invalid or stale pipeline provided.");
+	return pipeline;
+}
+
+static inline Sampler* DeviceGetSampler(NuSampler handle)
+{
+	Sampler* sampler = nPoolGet(&gDevice.samplers, handle);
+	nEnforce(sampler, "Invalid or stale sampler provided.");
+	return sampler;
+}
+
+static inline RenderTarget* DeviceGetRenderTarget(NuRenderTarget handle)
+{
+	RenderTarget* renderTarget = nPoolGet(&gDevice.renderTargets, handle);
+	nEnforce(renderTarget, "Invalid or stale render target provided.");
+	return renderTarget;
+}
+
+static inline Readback* DeviceGetReadback(NuReadback handle)
+{
+	Readback* readback = nPoolGet(&gDevice.readbacks, handle);
+	nEnforce(readback, "Invalid or stale readback provided.");
+	return readback;
+}
+
+/**
+ * Warns about device objects still alive in \p pool.
+ */
+static void ReportLeakedObjects(NPool* pool, const char* typeName)
+{
+	if (pool->numAlive) {
+		nDebugWarning("%d %s objects were not destroyed before device deinitialization.", pool->numAlive, typeName);
+	}
+}
+
+static void APIENTRY debugCallbackGL(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, const void* user_data)
 {
 	switch (severity) {
 		case GL_DEBUG_SEVERITY_HIGH:
@@ -142,77 +535,1509 @@ static void __stdcall debugCallbackGL(GLenum source, GLenum type, GLuint id, GLe
 
 static void BindBuffer(const Buffer* buffer)
 {
-	if (gDevice.currentState->boundBuffers[buffer->type] != buffer->id)
+	bool changed = CurrentState()->boundBuffers[buffer->type] != buffer->id;
+	CountStateChange(CurrentState(), NU_STATE_CATEGORY_BUFFER, changed);
+	if (changed)
 	{
-		gDevice.currentState->boundBuffers[buffer->type] = buffer->id;
+		CurrentState()->boundBuffers[buffer->type] = buffer->id;
 		glBindBuffer(BufferTypeToGl(buffer->type), buffer->id);
+
+		/* the element array buffer binding is stored in the bound vertex array */
+		if (buffer->type == NU_BUFFER_TYPE_INDEX && CurrentState()->vertexArray) {
+			CurrentState()->vertexArray->elementBuffer = buffer->id;
+		}
 	}
 }
 
-static void UnbindBuffer(const Buffer *buffer)
+static void SetActiveTextureUnit(State* state, uint unit)
 {
-	if (gDevice.currentState->boundBuffers[buffer->type] != buffer->id)
-	{
-		glBindBuffer(BufferTypeToGl(buffer->type), 0);
-		gDevice.currentState->boundBuffers[buffer->type] = 0;
+	if (state->activeTextureUnit != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		state->activeTextureUnit = unit;
+	}
+}
+
+/**
+ * Binds \p handle to \p unit of the current state. Texture updates bind to unit 0 too, so changing a
+ * binding marks the unit dirty for the next draw to restore the pending texture.
+ */
+static void BindTexture(uint unit, NuTexture handle)
+{
+	nAssert(unit < MAX_TEXTURE_UINTS);
+	State* state = CurrentState();
+	const Texture* texture = DeviceGetTexture(handle);
+	bool changed = state->textures[unit][texture->type] != handle;
+	CountStateChange(state, NU_STATE_CATEGORY_TEXTURE, changed);
+	if (changed) {
+		SetActiveTextureUnit(state, unit);
+		glBindTexture(kGlTextureType[texture->type], texture->id);
+		state->textures[unit][texture->type] = handle;
+		state->dirtyTextures |= 1u << unit;
+	}
+}
+
+static void BindSampler(uint unit, NuSampler sampler)
+{
+	nAssert(unit < MAX_TEXTURE_UINTS);
+	State* state = CurrentState();
+	bool changed = state->samplers[unit] != sampler;
+	CountStateChange(state, NU_STATE_CATEGORY_SAMPLER, changed);
+	if (changed) {
+		state->samplers[unit] = sampler;
+		glBindSampler(unit, sampler ? DeviceGetSampler(sampler)->id : 0);
+	}
+}
+
+static void CompleteTechnique(Technique* technique);
+
+/**
+ * Records \p handle as pending technique of \p state, along with its vertex layout.
+ */
+static void SetTechnique(State* state, NuTechnique handle)
+{
+	Technique const* technique = DeviceGetTechnique(handle);
+	nEnforce(technique->status == NU_TECHNIQUE_CREATE_SUCCESS || technique->status == NU_TECHNIQUE_CREATE_PENDING, "Technique failed to build, see nuTechniqueGetStatus().");
+
+	if (state->pendingTechnique == handle) {
+		CountStateChange(state, NU_STATE_CATEGORY_TECHNIQUE, false);
+		return;
+	}
+	state->pendingTechnique = handle;
+	state->dirty |= DIRTY_TECHNIQUE;
+
+	if (state->vertexLayout != technique->layout) {
+		state->vertexLayout = technique->layout;
+		state->vertexArrayIsDirty = true;
+	}
+}
+
+static void SetBlendState(State* state, NuBlendState const* blendState)
+{
+	if (!memcmp(&state->pendingBlendState, blendState, sizeof *blendState)) {
+		CountStateChange(state, NU_STATE_CATEGORY_BLEND, false);
+		return;
+	}
+	state->pendingBlendState = *blendState;
+	state->dirty |= DIRTY_BLEND_STATE;
+}
+
+/**
+ * Makes the pending technique of \p state current, completing its build if still in flight.
+ */
+static void ApplyTechnique(State* state)
+{
+	Technique *technique = DeviceGetTechnique(state->pendingTechnique);
+	if (technique->status == NU_TECHNIQUE_CREATE_PENDING) CompleteTechnique(technique);
+	nEnforce(technique->status == NU_TECHNIQUE_CREATE_SUCCESS, "Technique failed to build, see nuTechniqueGetStatus().");
+
+	bool changed = state->technique != state->pendingTechnique;
+	CountStateChange(state, NU_STATE_CATEGORY_TECHNIQUE, changed);
+	if (changed) {
+		state->technique = state->pendingTechnique;
+		glUseProgram(technique->programId);
+	}
+}
+
+static void ApplyBlendState(State* state, NuBlendState const* blendState)
+{
+	static const GLenum nglBlendFuncs[] = {
+		GL_ZERO,
+		GL_ONE,
+		GL_SRC_COLOR,
+		GL_ONE_MINUS_SRC_COLOR,
+		GL_DST_COLOR,
+		GL_ONE_MINUS_DST_COLOR,
+		GL_SRC_ALPHA,
+		GL_ONE_MINUS_SRC_ALPHA,
+		GL_DST_ALPHA,
+		GL_ONE_MINUS_DST_ALPHA,
+		GL_CONSTANT_COLOR,
+		GL_ONE_MINUS_CONSTANT_COLOR,
+		GL_CONSTANT_ALPHA,
+		GL_ONE_MINUS_CONSTANT_ALPHA,
+		GL_SRC_ALPHA_SATURATE,
+		GL_SRC1_COLOR,
+		GL_ONE_MINUS_SRC1_COLOR,
+		GL_SRC1_ALPHA,
+		GL_ONE_MINUS_SRC1_ALPHA,
+	};
+
+	static const GLenum nglBlendEquats[] = {
+		GL_FUNC_ADD,
+		GL_FUNC_SUBTRACT,
+		GL_FUNC_REVERSE_SUBTRACT,
+		GL_MIN,
+		GL_MAX,
+	};
+
+	bool changed = memcmp(&state->blendState, blendState, sizeof *blendState) != 0;
+	CountStateChange(state, NU_STATE_CATEGORY_BLEND, changed);
+	if (changed) {
+		state->blendState = *blendState;
+		glBlendEquationSeparate(nglBlendEquats[blendState->rgbOp], nglBlendEquats[blendState->alphaOp]);
+		glBlendFuncSeparate(nglBlendFuncs[blendState->srcRgbFactor], nglBlendFuncs[blendState->dstRgbFactor], nglBlendFuncs[blendState->srcAlphaFactor], nglBlendFuncs[blendState->dstAlphaFactor]);
+	}
+}
+
+/**
+ * Ends the current device frame by fencing the commands issued so far, then waits for the GPU to
+ * complete the frame STREAM_BUFFER_NUM_FRAMES - 1 frames older, so that the stream buffer ranges of
+ * the frame starting can be reused.
+ */
+static void EndDeviceFrame(void)
+{
+	nSpinLock(&gDevice.frameLock);
+
+	if (gDevice.persistentStreamBuffers) {
+		gDevice.frameFences[gDevice.frame % STREAM_BUFFER_NUM_FRAMES] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		GLsync* oldestFence = &gDevice.frameFences[(gDevice.frame + 1) % STREAM_BUFFER_NUM_FRAMES];
+		if (*oldestFence) {
+			glClientWaitSync(*oldestFence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(*oldestFence);
+			*oldestFence = NULL;
+			gDevice.completedFrame = max_uint64_t(gDevice.completedFrame, gDevice.frame + 1 - STREAM_BUFFER_NUM_FRAMES);
+		}
+	}
+
+	++gDevice.frame;
+	nSpinUnlock(&gDevice.frameLock);
+}
+
+/**
+ * @returns whether the GPU completed the commands issued during device \p frame.
+ */
+static bool IsDeviceFrameComplete(uint64_t frame)
+{
+	nSpinLock(&gDevice.frameLock);
+	bool complete = frame <= gDevice.completedFrame;
+
+	if (!complete && frame < gDevice.frame) {
+		GLsync fence = gDevice.frameFences[frame % STREAM_BUFFER_NUM_FRAMES];
+		nAssert(fence);
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		complete = status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+
+		/* fences signal in order */
+		if (complete) gDevice.completedFrame = frame;
+	}
+
+	nSpinUnlock(&gDevice.frameLock);
+	return complete;
+}
+
+/**
+ * Computes the counters of the frame \p state just completed and reads the GPU time of the frames
+ * whose timer query is available, then starts timing the next frame.
+ */
+static void EndFrameStats(State* state)
+{
+	uint64_t* frameCounters = (uint64_t*)&state->frameStats.counters;
+	uint64_t const* counters = (uint64_t const*)&state->stats;
+	uint64_t const* beginCounters = (uint64_t const*)&state->frameBeginStats;
+	for (size_t i = 0; i < sizeof(NuDeviceStats) / sizeof(uint64_t); ++i) {
+		frameCounters[i] = counters[i] - beginCounters[i];
+	}
+	state->frameBeginStats = state->stats;
+	state->frameStats.frame = ++state->frame;
+
+	if (!state->timerQueries[0]) return;
+	glEndQuery(GL_TIME_ELAPSED);
+
+	/* the query of the next frame is waited for if still pending, as the device never lags that many
+	 * frames behind this rarely blocks */
+	for (; state->oldestTimerFrame <= state->frame; ++state->oldestTimerFrame) {
+		GLuint query = state->timerQueries[state->oldestTimerFrame % TIMER_QUERY_RING_SIZE];
+		if (state->frame + 1 - state->oldestTimerFrame < TIMER_QUERY_RING_SIZE) {
+			GLint available = 0;
+			glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) break;
+		}
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		state->frameStats.gpuTimeNs = elapsed;
+		state->frameStats.gpuTimeFrame = state->oldestTimerFrame;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, state->timerQueries[(state->frame + 1) % TIMER_QUERY_RING_SIZE]);
+}
+
+static inline bool RangesOverlap(uint begin1, uint end1, uint begin2, uint end2)
+{
+	return begin1 < end2 && begin2 < end1;
+}
+
+/**
+ * @returns whether [begin, end) of the ring of stream buffer \p buffer may still be read by the GPU.
+ */
+static bool StreamRangeInUse(Buffer const* buffer, uint begin, uint end)
+{
+	for (uint i = 0; i < STREAM_BUFFER_NUM_FRAMES; ++i) {
+		StreamFrameRange const* range = &buffer->frames[i];
+		if (!range->frame || IsDeviceFrameComplete(range->frame)) continue;
+
+		if (range->begin < range->end) {
+			if (RangesOverlap(begin, end, range->begin, range->end)) return true;
+		}
+		else if (RangesOverlap(begin, end, range->begin, buffer->capacity) || RangesOverlap(begin, end, 0, range->end)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Gives stream buffer \p buffer a new empty ring of \p capacity bytes. With persistent mapping a new
+ * GL buffer is created as its storage is immutable, otherwise the storage is orphaned. Either way the
+ * GL keeps the previous storage alive until the GPU is done reading it.
+ */
+static NuResult ResetStreamRing(Buffer* buffer, uint capacity)
+{
+	GLenum target = BufferTypeToGl(buffer->type);
+
+	if (gDevice.persistentStreamBuffers) {
+		if (buffer->capacity) {
+			glDeleteBuffers(1, &buffer->id);
+			InvalidateDeletedObjects();
+			buffer->ring = NULL;
+			glGenBuffers(1, &buffer->id);
+			if (!buffer->id) {
+				nDebugError("Could not create GPU device object.");
+				buffer->capacity = 0;
+				return NU_FAILURE;
+			}
+		}
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		BindBuffer(buffer);
+		glBufferStorage(target, capacity, NULL, flags);
+		buffer->ring = glMapBufferRange(target, 0, capacity, flags);
+		if (!buffer->ring) {
+			nDebugError("Could not map stream buffer storage.");
+			buffer->capacity = 0;
+			return NU_FAILURE;
+		}
+	}
+	else {
+		BindBuffer(buffer);
+		glBufferData(target, capacity, NULL, GL_STREAM_DRAW);
+	}
+
+	buffer->capacity = capacity;
+	buffer->head = 0;
+	memset(buffer->frames, 0, sizeof buffer->frames);
+	return NU_SUCCESS;
+}
+
+/**
+ * Reserves \p size bytes of the ring of stream buffer \p buffer the GPU is not reading, growing or
+ * orphaning the ring if needed.
+ */
+static NuResult AllocateStreamRange(Buffer* buffer, uint size, uint* pPosition)
+{
+	uint position = buffer->head + size <= buffer->capacity ? buffer->head : 0;
+
+	if (gDevice.persistentStreamBuffers) {
+		/* the frames in flight are STREAM_BUFFER_NUM_FRAMES at most, when their ranges fill up the ring
+		 * it is grown rather than waited for */
+		if (position + size > buffer->capacity || StreamRangeInUse(buffer, position, position + size)) {
+			NuResult result = ResetStreamRing(buffer, max_uint(buffer->capacity * 2, size * STREAM_BUFFER_NUM_FRAMES));
+			if (result) return result;
+			position = 0;
+		}
+	}
+	else if (buffer->head + size > buffer->capacity) {
+		/* restarting from the beginning, orphan the storage the GPU may be reading */
+		NuResult result = ResetStreamRing(buffer, max_uint(buffer->capacity, size * STREAM_BUFFER_NUM_FRAMES));
+		if (result) return result;
+		position = 0;
+	}
+
+	StreamFrameRange* range = &buffer->frames[gDevice.frame % STREAM_BUFFER_NUM_FRAMES];
+	if (range->frame != gDevice.frame) {
+		range->frame = gDevice.frame;
+		range->begin = position;
+	}
+	range->end = position + size;
+
+	buffer->head = position + size;
+	*pPosition = position;
+	return NU_SUCCESS;
+}
+
+/**
+ * Gives stream buffer \p buffer new contents of \p offset + \p size bytes in a free range of its ring.
+ * @returns where to write the \p size bytes at \p offset of the new contents, or NULL on failure.
+ */
+static void* MapStreamBuffer(Buffer* buffer, uint offset, uint size)
+{
+	uint position;
+	if (AllocateStreamRange(buffer, nAlignUintUp(offset + size, STREAM_BUFFER_ALIGNMENT), &position)) return NULL;
+	buffer->base = position;
+	buffer->size = offset + size;
+	if (buffer->ring) return buffer->ring + position + offset;
+
+	BindBuffer(buffer);
+	void* mapped = glMapBufferRange(BufferTypeToGl(buffer->type), position + offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!mapped) nDebugError("Could not map stream buffer range.");
+	return mapped;
+}
+
+static void UnmapStreamBuffer(Buffer* buffer)
+{
+	if (buffer->ring) return;
+	BindBuffer(buffer);
+	glUnmapBuffer(BufferTypeToGl(buffer->type));
+}
+
+/**
+ * @returns whether the contents of \p buffer are kept in system memory for the CPU to issue the draws
+ * they contain, as draw indirect is not supported.
+ */
+static inline bool IsEmulatedIndirectBuffer(Buffer const* buffer)
+{
+	return buffer->type == NU_BUFFER_TYPE_INDIRECT && !gDevice.drawIndirect;
+}
+
+/**
+ * Writes \p size bytes of \p data, if not null, at \p offset of the system memory contents of
+ * emulated indirect buffer \p buffer, growing them as needed. Stream buffers are respecified.
+ */
+static NuResult UpdateIndirectCommands(Buffer* buffer, uint offset, void const* data, uint size)
+{
+	const uint newSize = buffer->usage == NU_BUFFER_USAGE_STREAM ? offset + size : max_uint(buffer->size, offset + size);
+	if (newSize > buffer->capacity) {
+		NuAllocator* allocator = &gDevice.allocator;
+		char* commands = n_realloc(buffer->commands, newSize, allocator);
+		if (!commands) {
+			nDebugWarning("Out of memory while updating indirect buffer.");
+			return NU_ERROR_OUT_OF_MEMORY;
+		}
+		buffer->commands = commands;
+		buffer->capacity = newSize;
+	}
+	if (data) memcpy(buffer->commands + offset, data, size);
+	buffer->size = newSize;
+	return NU_SUCCESS;
+}
+
+/**
+ * Reserves \p size bytes of the constant ring \p ring for the current frame. Unlike other stream
+ * buffers the ring is never grown or orphaned, as views of it already handed out must stay valid.
+ * @returns false if the ranges of the frames in flight leave no room.
+ */
+static bool AllocateConstantRange(Buffer* ring, uint size, uint* pPosition)
+{
+	uint position = ring->head + size <= ring->capacity ? ring->head : 0;
+	if (position + size > ring->capacity) return false;
+
+	/* without fences GL orders the buffer writes after the draws reading the range */
+	if (gDevice.persistentStreamBuffers && StreamRangeInUse(ring, position, position + size)) return false;
+
+	StreamFrameRange* range = &ring->frames[gDevice.frame % STREAM_BUFFER_NUM_FRAMES];
+	if (range->frame != gDevice.frame) {
+		range->frame = gDevice.frame;
+		range->begin = position;
+	}
+	range->end = position + size;
+
+	ring->head = position + size;
+	*pPosition = position;
+	return true;
+}
+
+/**
+ * Specifies the attributes of \p stream of the bound vertex array to read \p buffer from \p offset.
+ */
+static void SpecifyVertexStream(VertexLayoutStream const* stream, Buffer const* buffer, uint offset)
+{
+	BindBuffer(buffer);
+
+	for (uint i = 0; i < stream->numAttributes; ++i) {
+		const VertexLayoutAttribute *attribute = &stream->attributes[i];
+
+		GLenum gl_type;
+		bool normalized;
+		bool is_integer;
+		UnpackVertexLayoutAttributeTypeToGl(attribute->type, &gl_type, &normalized, &is_integer);
+
+		const void *offset_ptr = (void*)(uintptr_t)(offset + attribute->stride);
+
+		if (is_integer) {
+			glVertexAttribIPointer(attribute->location, attribute->dimension, gl_type, stream->stride, offset_ptr);
+		} else {
+			glVertexAttribPointer(attribute->location, attribute->dimension, gl_type, normalized, stream->stride, offset_ptr);
+		}
+
+		glVertexAttribDivisor(attribute->location, stream->instanced != 0);
+	}
+}
+
+static void BindVertexArray(State* state, VertexArray* vertexArray)
+{
+	GLuint id = vertexArray ? vertexArray->id : state->defaultVertexArray;
+	CountStateChange(state, NU_STATE_CATEGORY_VERTEX_ARRAY, state->boundVertexArray != id);
+	if (state->boundVertexArray != id) {
+		glBindVertexArray(id);
+		state->boundVertexArray = id;
+
+		/* the element array buffer of the default vertex array is not tracked, bind it again when used */
+		state->boundBuffers[NU_BUFFER_TYPE_INDEX] = vertexArray ? vertexArray->elementBuffer : 0;
+	}
+	state->vertexArray = vertexArray;
+}
+
+/**
+ * @returns the cache entry of \p state for \p key, creating its vertex array in place of the least
+ * recently used one if missing. New entries have no stream specified yet.
+ */
+static VertexArray* GetVertexArray(State* state, VertexArrayKey const* key, VertexLayout const* layout)
+{
+	VertexArray* lru = NULL;
+	for (uint i = 0; i < state->numVertexArrays; ++i) {
+		VertexArray* vertexArray = &state->vertexArrays[i];
+		if (!memcmp(&vertexArray->key, key, sizeof *key)) return vertexArray;
+		if (!lru || vertexArray->lastUse < lru->lastUse) lru = vertexArray;
+	}
+
+	VertexArray* vertexArray = lru;
+	if (state->numVertexArrays < VERTEX_ARRAY_CACHE_SIZE) {
+		vertexArray = &state->vertexArrays[state->numVertexArrays++];
+	}
+	else {
+		if (state->vertexArray == vertexArray) BindVertexArray(state, NULL);
+		glDeleteVertexArrays(1, &vertexArray->id);
+	}
+
+	nZero(vertexArray);
+	vertexArray->key = *key;
+	glGenVertexArrays(1, &vertexArray->id);
+	BindVertexArray(state, vertexArray);
+	for (uint i = 0; i < layout->numAttributes; ++i) {
+		glEnableVertexAttribArray(i);
+	}
+	memset(vertexArray->offsets, 0xff, sizeof vertexArray->offsets);
+	return vertexArray;
+}
+
+/**
+ * Binds the vertex array of the current layout and vertex buffers of \p state and computes the base
+ * vertex and instance draws must add to apply the view offsets. If \p bakeOffsets the vertex array
+ * applies the whole offsets instead, as needed by indirect draws the CPU cannot offset.
+ */
+static void PrepareVertexArray(State* state, bool bakeOffsets)
+{
+	if (!state->vertexArrayIsDirty && (!bakeOffsets || (!state->baseVertex && !state->baseInstance))) return;
+	state->vertexArrayIsDirty = false;
+
+	VertexLayout const* layout = DeviceGetVertexLayout(state->vertexLayout);
+	Buffer const* buffers[NU_VERTEX_LAYOUT_MAX_STREAMS];
+	uint offsets[NU_VERTEX_LAYOUT_MAX_STREAMS];
+
+	VertexArrayKey key;
+	nZero(&key);
+	key.layout = state->vertexLayout;
+
+	/* the whole number of elements all streams of a rate are offset by is applied at draw time */
+	uint base[2] = { bakeOffsets ? 0 : UINT32_MAX, gDevice.baseInstance && !bakeOffsets ? UINT32_MAX : 0 };
+	for (uint i = 0; i < layout->numStreams; ++i) {
+		NuBufferView const* view = &state->vertexBuffers[i];
+		buffers[i] = view->buffer ? DeviceGetBuffer(view->buffer) : NULL;
+		if (!buffers[i]) continue;
+
+		VertexLayoutStream const* stream = &layout->streams[i];
+		key.buffers[i] = view->buffer;
+		key.ids[i] = buffers[i]->id;
+		offsets[i] = buffers[i]->base + view->offset;
+		if (stream->stride) base[stream->instanced] = min_uint(base[stream->instanced], offsets[i] / stream->stride);
+	}
+	if (base[0] == UINT32_MAX) base[0] = 0;
+	if (base[1] == UINT32_MAX) base[1] = 0;
+
+	VertexArray* vertexArray = GetVertexArray(state, &key, layout);
+	vertexArray->lastUse = ++state->vertexArrayClock;
+	BindVertexArray(state, vertexArray);
+
+	for (uint i = 0; i < layout->numStreams; ++i) {
+		if (!buffers[i]) continue;
+		VertexLayoutStream const* stream = &layout->streams[i];
+		uint offset = offsets[i] - base[stream->instanced] * stream->stride;
+		CountStateChange(state, NU_STATE_CATEGORY_VERTEX_ARRAY, vertexArray->offsets[i] != offset);
+		if (vertexArray->offsets[i] != offset) {
+			SpecifyVertexStream(stream, buffers[i], offset);
+			vertexArray->offsets[i] = offset;
+		}
+	}
+
+	state->baseVertex = (GLint)base[0];
+	state->baseInstance = base[1];
+}
+
+/**
+ * Binds the range of constant buffer \p slot pending in \p state, unless it is bound already. Stream
+ * buffers move as they are updated, so the range is resolved here rather than when set.
+ */
+static void ApplyConstantBuffer(State* state, uint slot)
+{
+	NuBufferView const* view = &state->constantBuffers[slot];
+	if (!view->buffer) return;
+
+	Buffer const* buffer = DeviceGetBuffer(view->buffer);
+	BoundBufferRange range = { buffer->id, buffer->base + view->offset, view->size ? view->size : buffer->size - view->offset };
+	BoundBufferRange* bound = &state->boundConstantBuffers[slot];
+
+	bool changed = bound->id != range.id || bound->offset != range.offset || bound->size != range.size;
+	CountStateChange(state, NU_STATE_CATEGORY_CONSTANT_BUFFER, changed);
+	if (changed) {
+		glBindBufferRange(GL_UNIFORM_BUFFER, slot, range.id, range.offset, range.size);
+		*bound = range;
+
+		/* binding a range also sets the generic binding point */
+		state->boundBuffers[NU_BUFFER_TYPE_CONSTANT] = range.id;
+	}
+}
+
+/**
+ * Binds the framebuffer of the render target pending in \p state if dirty. Besides draws, clears and
+ * pixel reads apply it too.
+ */
+static void ApplyRenderTarget(State* state)
+{
+	if (!(state->dirty & DIRTY_RENDER_TARGET)) return;
+	state->dirty &= ~DIRTY_RENDER_TARGET;
+
+	GLuint framebuffer = state->pendingRenderTarget ? DeviceGetRenderTarget(state->pendingRenderTarget)->framebuffer : 0;
+	bool changed = state->framebuffer != framebuffer;
+	CountStateChange(state, NU_STATE_CATEGORY_RENDER_TARGET, changed);
+	if (changed) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		state->framebuffer = framebuffer;
+	}
+}
+
+/**
+ * Applies the pending state of \p state that is dirty, issuing GL calls only for what differs from
+ * the applied state, then binds the vertex array of the pending layout and vertex buffers, see
+ * PrepareVertexArray() for \p bakeOffsets.
+ */
+static void FlushState(State* state, bool bakeOffsets)
+{
+	nEnforce(state->pendingTechnique, "No valid technique bound to the device.");
+	nEnforce(state->vertexLayout, "No valid vertex layout bound to the device.");
+
+	/* stream buffers moved since the last draw, views of them must be resolved again */
+	const int32_t streamGeneration = nAtomicLoad32(&gDevice.streamGeneration);
+	if (state->streamGeneration != streamGeneration) {
+		state->streamGeneration = streamGeneration;
+		state->vertexArrayIsDirty = true;
+		for (uint i = 0; i < MAX_NUM_CONSTANT_BUFFERS; ++i) {
+			if (state->constantBuffers[i].buffer) state->dirtyConstantBuffers |= 1u << i;
+		}
+	}
+
+	ApplyRenderTarget(state);
+	if (state->dirty & DIRTY_VIEWPORT) {
+		NuRect2i const* rect = &state->pendingViewport;
+		bool changed = memcmp(rect, &state->viewport, sizeof *rect) != 0;
+		CountStateChange(state, NU_STATE_CATEGORY_VIEWPORT, changed);
+		if (changed) {
+			state->viewport = *rect;
+			glViewport(rect->position.x, rect->position.y, rect->size.width, rect->size.height);
+		}
+	}
+	if (state->dirty & DIRTY_TECHNIQUE) ApplyTechnique(state);
+	if (state->dirty & DIRTY_BLEND_STATE) ApplyBlendState(state, &state->pendingBlendState);
+	state->dirty = 0;
+
+	for (uint i = 0; state->dirtyConstantBuffers; ++i) {
+		if (!(state->dirtyConstantBuffers & (1u << i))) continue;
+		state->dirtyConstantBuffers &= ~(1u << i);
+		ApplyConstantBuffer(state, i);
+	}
+
+	for (uint i = 0; state->dirtyTextures | state->dirtySamplers; ++i) {
+		const uint32_t bit = 1u << i;
+		if ((state->dirtyTextures & bit) && state->pendingTextures[i]) BindTexture(i, state->pendingTextures[i]);
+		if (state->dirtySamplers & bit) BindSampler(i, state->pendingSamplers[i]);
+		state->dirtyTextures &= ~bit;
+		state->dirtySamplers &= ~bit;
+	}
+
+	PrepareVertexArray(state, bakeOffsets);
+}
+
+/**
+ * Binds GL buffer \p id to the draw indirect target. Besides indirect buffers the constant ring is
+ * bound there, as it also stages the commands of multi draws.
+ */
+static void BindIndirectBuffer(State* state, GLuint id)
+{
+	bool changed = state->boundBuffers[NU_BUFFER_TYPE_INDIRECT] != id;
+	CountStateChange(state, NU_STATE_CATEGORY_BUFFER, changed);
+	if (changed) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, id);
+		state->boundBuffers[NU_BUFFER_TYPE_INDIRECT] = id;
+	}
+}
+
+static void IssueDrawArrays(State* state, GLenum mode, NuDrawArraysCommand const* command)
+{
+	nEnforce(gDevice.baseInstance || !command->firstInstance, "Draws with a first instance need GL 4.2 or ARB_base_instance.");
+	if (gDevice.baseInstance) {
+		glDrawArraysInstancedBaseInstance(mode, state->baseVertex + command->firstVertex, command->numVertices, command->numInstances, state->baseInstance + command->firstInstance);
+	} else {
+		glDrawArraysInstanced(mode, state->baseVertex + command->firstVertex, command->numVertices, command->numInstances);
+	}
+	state->stats.numDrawCalls++;
+	state->stats.numInstances += command->numInstances;
+}
+
+static void IssueDrawIndexed(State* state, GLenum mode, GLenum indexType, uint indexSize, uint indexOffset, NuDrawIndexedCommand const* command)
+{
+	nEnforce(gDevice.baseInstance || !command->firstInstance, "Draws with a first instance need GL 4.2 or ARB_base_instance.");
+	const void* indices = (const void*)(uintptr_t)(indexOffset + command->firstIndex * indexSize);
+	if (gDevice.baseInstance) {
+		glDrawElementsInstancedBaseVertexBaseInstance(mode, command->numIndices, indexType, indices, command->numInstances, state->baseVertex + command->baseVertex, state->baseInstance + command->firstInstance);
+	} else {
+		glDrawElementsInstancedBaseVertex(mode, command->numIndices, indexType, indices, command->numInstances, state->baseVertex + command->baseVertex);
+	}
+	state->stats.numDrawCalls++;
+	state->stats.numInstances += command->numInstances;
+}
+
+/**
+ * Drops the bindings \p state caches of deleted objects. Buffers are cached by GL name, which GL
+ * reuses, and it is not known which were deleted, so all buffer bindings are forgotten and bound again
+ * when next used. Vertex arrays that read from deleted or recreated buffers are dropped.
+ */
+static void ForgetDeletedObjects(State* state)
+{
+	state->deletionGeneration = nAtomicLoad32(&gDevice.deletionGeneration);
+
+	memset(state->boundBuffers, 0, sizeof state->boundBuffers);
+	for (uint i = 0; i < MAX_NUM_CONSTANT_BUFFERS; ++i) {
+		nZero(&state->boundConstantBuffers[i]);
+		if (state->constantBuffers[i].buffer) state->dirtyConstantBuffers |= 1u << i;
+	}
+	for (uint i = 0; i < MAX_TEXTURE_UINTS; ++i) {
+		for (uint type = 0; type < NU_TEXTURE_TYPE_COUNT_; ++type) {
+			if (!nPoolGet(&gDevice.textures, state->textures[i][type])) state->textures[i][type] = 0;
+		}
+		if (!nPoolGet(&gDevice.samplers, state->samplers[i])) state->samplers[i] = 0;
+	}
+
+	for (uint i = 0; i < state->numVertexArrays;) {
+		VertexArray* vertexArray = &state->vertexArrays[i];
+		vertexArray->elementBuffer = 0;
+
+		bool stale = false;
+		for (uint j = 0; j < NU_VERTEX_LAYOUT_MAX_STREAMS; ++j) {
+			if (!vertexArray->key.buffers[j]) continue;
+			Buffer const* buffer = nPoolGet(&gDevice.buffers, vertexArray->key.buffers[j]);
+			stale |= !buffer || buffer->id != vertexArray->key.ids[j];
+		}
+		if (!stale) {
+			++i;
+			continue;
+		}
+
+		if (state->vertexArray == vertexArray) {
+			BindVertexArray(state, NULL);
+			state->vertexArrayIsDirty = true;
+		}
+		glDeleteVertexArrays(1, &vertexArray->id);
+
+		/* move the last entry in place of the dropped one */
+		VertexArray* last = &state->vertexArrays[--state->numVertexArrays];
+		if (state->vertexArray == last) state->vertexArray = vertexArray;
+		*vertexArray = *last;
+	}
+}
+
+/**
+ * Writes the \p width x \p height texels at \p x, \p y of level 0 of \p texture to its system memory
+ * copy, recreating the copy if \p format changed.
+ */
+static void UpdateTextureCpuCopy(Texture* texture, uint x, uint y, uint width, uint height, NuImageFormat format, void const* data)
+{
+	if (!data) return;
+	nSpinLock(&texture->cpuCopyLock);
+	NuImageView copy = texture->cpuCopy ? nuImageGetView(texture->cpuCopy) : (NuImageView) { 0 };
+	if (copy.format != format || copy.size.width != texture->size.width || copy.size.height != texture->size.height || !copy.data) {
+		nuDestroyImage(texture->cpuCopy, &gDevice.allocator);
+		texture->cpuCopy = NULL;
+		NuImageCreateInfo info = {
+			.format = format,
+			.size = { texture->size.width, texture->size.height },
+			.initializeMemory = width != texture->size.width || height != texture->size.height,
+		};
+		if (nuCreateImage(&info, &gDevice.allocator, &texture->cpuCopy)) {
+			nDebugWarning("Out of memory while updating texture system memory copy.");
+			nSpinUnlock(&texture->cpuCopyLock);
+			return;
+		}
+	}
+
+	const size_t pixelSize = GetImageFormatPixelSize(format);
+	char* dst = (char*)nuImageGetWritableDataPtr(texture->cpuCopy) + ((size_t)y * texture->size.width + x) * pixelSize;
+	for (uint row = 0; row < height; ++row) {
+		memcpy(dst + row * texture->size.width * pixelSize, (char const*)data + row * width * pixelSize, width * pixelSize);
+	}
+	nSpinUnlock(&texture->cpuCopyLock);
+}
+
+/**
+ * @returns the size of \p level of \p texture, extents the texture type does not use are 1 and layers
+ * of array textures are not reduced.
+ */
+static NuSize3i GetTextureLevelSize(Texture const* texture, uint level)
+{
+	const NuSize3i size = texture->size;
+	switch (texture->type) {
+		case NU_TEXTURE_TYPE_1D: return (NuSize3i) { max_uint(size.width >> level, 1), 1, 1 };
+		case NU_TEXTURE_TYPE_2D: return (NuSize3i) { max_uint(size.width >> level, 1), max_uint(size.height >> level, 1), 1 };
+		case NU_TEXTURE_TYPE_3D: return (NuSize3i) { max_uint(size.width >> level, 1), max_uint(size.height >> level, 1), max_uint(size.depth >> level, 1) };
+		case NU_TEXTURE_TYPE_1D_ARRAY: return (NuSize3i) { max_uint(size.width >> level, 1), max_uint(size.height, 1), 1 };
+		case NU_TEXTURE_TYPE_2D_ARRAY: return (NuSize3i) { max_uint(size.width >> level, 1), max_uint(size.height >> level, 1), max_uint(size.depth, 1) };
+		default: nAssert(false); return size;
+	}
+}
+
+/**
+ * @returns the bytes of texel data of the region of \p upload.
+ */
+static inline size_t GetUploadDataSize(NuTextureUploadInfo const* upload)
+{
+	return nuImageFormatGetDataSize(upload->format, (NuSize2i) { upload->width, upload->height }) * upload->depth;
+}
+
+/**
+ * Decodes the \p depth layers of \p width x \p height block compressed texels \p data.
+ * @returns the decoded texels allocated with the device allocator, or NULL if out of memory.
+ */
+static void* DecompressTexels(NuImageFormat format, uint width, uint height, uint depth, void const* data)
+{
+	NuAllocator* allocator = &gDevice.allocator;
+	const NuSize2i size = { width, height };
+	const size_t layerSize = nuImageFormatGetDataSize(format, size);
+	const size_t decompressedLayerSize = nuImageFormatGetDataSize(nuImageFormatGetDecompressed(format), size);
+	char* texels = n_malloc(decompressedLayerSize * depth, allocator);
+	if (!texels) return NULL;
+
+	for (uint layer = 0; layer < depth; ++layer) {
+		NuImageView compressed = { format, size, (char const*)data + layer * layerSize };
+		NuImage decompressed;
+		if (nuImageDecompress(&compressed, allocator, &decompressed)) {
+			n_free(texels, allocator);
+			return NULL;
+		}
+		memcpy(texels + layer * decompressedLayerSize, nuImageGetView(decompressed).data, decompressedLayerSize);
+		nuDestroyImage(decompressed, allocator);
+	}
+	return texels;
+}
+
+/**
+ * @returns the number of levels of the full mip chain of \p texture, layers are not mipmapped.
+ */
+static uint GetTextureMaxLevels(Texture const* texture)
+{
+	const NuSize3i size = GetTextureLevelSize(texture, 0);
+	uint extent = size.width;
+	if (texture->type != NU_TEXTURE_TYPE_1D && texture->type != NU_TEXTURE_TYPE_1D_ARRAY) extent = max_uint(extent, size.height);
+	if (texture->type == NU_TEXTURE_TYPE_3D) extent = max_uint(extent, size.depth);
+
+	uint numLevels = 1;
+	for (; extent > 1; extent /= 2) ++numLevels;
+	return numLevels;
+}
+
+/**
+ * Specifies the storage of all the levels of \p texture, bound to the active texture unit. Storage
+ * is immutable with GL 4.2 or ARB_texture_storage, otherwise levels are specified one by one and
+ * sampling is limited to them.
+ */
+static void AllocateTextureStorage(Texture const* texture)
+{
+	const NuSize3i size = GetTextureLevelSize(texture, 0);
+	const GLenum target = kGlTextureType[texture->type];
+	const NuImageFormat decompressedFormat = nuImageFormatGetDecompressed((NuImageFormat)texture->format);
+	const GLint internalFormat = kGlTextureInternalFormat[texture->decompress ? decompressedFormat : texture->format];
+
+	if (gDevice.textureStorage) {
+		switch (texture->type) {
+			case NU_TEXTURE_TYPE_1D:
+				glTexStorage1D(target, texture->numLevels, internalFormat, size.width);
+				break;
+			case NU_TEXTURE_TYPE_2D:
+			case NU_TEXTURE_TYPE_1D_ARRAY:
+				glTexStorage2D(target, texture->numLevels, internalFormat, size.width, size.height);
+				break;
+			default:
+				glTexStorage3D(target, texture->numLevels, internalFormat, size.width, size.height, size.depth);
+				break;
+		}
+		return;
+	}
+
+	GLenum pixelFormat, pixelType;
+	ImageFormatToGl(decompressedFormat, &pixelFormat, &pixelType);
+	for (uint level = 0; level < texture->numLevels; ++level) {
+		const NuSize3i levelSize = GetTextureLevelSize(texture, level);
+		switch (texture->type) {
+			case NU_TEXTURE_TYPE_1D:
+				glTexImage1D(target, level, internalFormat, levelSize.width, 0, pixelFormat, pixelType, NULL);
+				break;
+			case NU_TEXTURE_TYPE_2D:
+			case NU_TEXTURE_TYPE_1D_ARRAY:
+				glTexImage2D(target, level, internalFormat, levelSize.width, levelSize.height, 0, pixelFormat, pixelType, NULL);
+				break;
+			default:
+				glTexImage3D(target, level, internalFormat, levelSize.width, levelSize.height, levelSize.depth, 0, pixelFormat, pixelType, NULL);
+				break;
+		}
+	}
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, texture->numLevels - 1);
+}
+
+/**
+ * Writes the region of \p upload to its texture, bound to the active texture unit, reading texels
+ * from \p pixels, an offset in the bound pixel unpack buffer if any.
+ */
+static void TexSubImage(Texture const* texture, NuTextureUploadInfo const* upload, void const* pixels)
+{
+	const GLenum target = kGlTextureType[texture->type];
+	const size_t size = GetUploadDataSize(upload);
+	CurrentState()->stats.numBytesUploaded += size;
+
+	if (nuImageFormatIsCompressed(upload->format)) {
+		const GLenum internalFormat = kGlTextureInternalFormat[upload->format];
+		if (texture->type == NU_TEXTURE_TYPE_2D) {
+			glCompressedTexSubImage2D(target, upload->level, upload->x, upload->y, upload->width, upload->height, internalFormat, (GLsizei)size, pixels);
+		} else {
+			glCompressedTexSubImage3D(target, upload->level, upload->x, upload->y, upload->z, upload->width, upload->height, upload->depth, internalFormat, (GLsizei)size, pixels);
+		}
+		return;
+	}
+
+	GLenum pixelFormat, pixelType;
+	ImageFormatToGl(upload->format, &pixelFormat, &pixelType);
+
+	switch (texture->type) {
+		case NU_TEXTURE_TYPE_1D:
+			glTexSubImage1D(target, upload->level, upload->x, upload->width, pixelFormat, pixelType, pixels);
+			break;
+		case NU_TEXTURE_TYPE_2D:
+		case NU_TEXTURE_TYPE_1D_ARRAY:
+			glTexSubImage2D(target, upload->level, upload->x, upload->y, upload->width, upload->height, pixelFormat, pixelType, pixels);
+			break;
+		default:
+			glTexSubImage3D(target, upload->level, upload->x, upload->y, upload->z, upload->width, upload->height, upload->depth, pixelFormat, pixelType, pixels);
+			break;
+	}
+}
+
+/**
+ * Reserves \p size bytes of the constant ring, aligned for constant buffer views.
+ * @returns the ring or null if it is missing or has no room left until the GPU completes some frames.
+ */
+static Buffer* AllocateConstantRingRange(uint size, uint* pPosition)
+{
+	if (!gDevice.constantRing) return NULL;
+	Buffer* ring = DeviceGetBuffer(gDevice.constantRing);
+	nSpinLock(&gDevice.constantRingLock);
+	bool allocated = AllocateConstantRange(ring, nAlignUintUp(size, gDevice.constantAlignment), pPosition);
+	nSpinUnlock(&gDevice.constantRingLock);
+	return allocated ? ring : NULL;
+}
+
+/**
+ * Creates the constant ring as a stream constant buffer whose ring is never respecified, views of it
+ * are absolute offsets.
+ */
+static void InitConstantRing(void)
+{
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	gDevice.constantAlignment = alignment > 0 ? (uint)alignment : STREAM_BUFFER_ALIGNMENT;
+
+	NuBufferCreateInfo info = { .type = NU_BUFFER_TYPE_CONSTANT, .usage = NU_BUFFER_USAGE_STREAM };
+	if (nuCreateBuffer(&info, &gDevice.allocator, &gDevice.constantRing)) return;
+
+	Buffer* ring = DeviceGetBuffer(gDevice.constantRing);
+	if (ResetStreamRing(ring, CONSTANT_RING_SIZE)) {
+		nDebugWarning("Could not create the constant ring, nuDeviceWriteConstants() will fail.");
+		nuDestroyBuffer(gDevice.constantRing, &gDevice.allocator);
+		gDevice.constantRing = 0;
+		return;
+	}
+	ring->size = ring->capacity;
+}
+
+/**
+ * Creates the persistently mapped texture upload staging ring. Without persistent mapping uploads
+ * are staged in heap copies.
+ */
+static void InitUploadRing(void)
+{
+	if (!gDevice.persistentStreamBuffers) return;
+
+	glGenBuffers(1, &gDevice.uploadRing);
+	if (!gDevice.uploadRing) return;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gDevice.uploadRing);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, UPLOAD_RING_SIZE, NULL, flags);
+	gDevice.uploadRingData = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, UPLOAD_RING_SIZE, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (!gDevice.uploadRingData) {
+		nDebugWarning("Could not map texture upload ring, uploads will be staged in system memory.");
+		glDeleteBuffers(1, &gDevice.uploadRing);
+		gDevice.uploadRing = 0;
+	}
+}
+
+static void DeinitUploadRing(void)
+{
+	NuAllocator* allocator = &gDevice.allocator;
+	for (size_t i = 0; i < nArrayLen(gDevice.uploads); ++i) {
+		if (gDevice.uploads[i].heapCopy) n_free(gDevice.uploads[i].heapCopy, allocator);
+	}
+	for (size_t i = 0; i < nArrayLen(gDevice.uploadBatches); ++i) {
+		glDeleteSync(gDevice.uploadBatches[i].fence);
+	}
+	nArrayFree(gDevice.uploads, allocator);
+	nArrayFree(gDevice.uploadBatches, allocator);
+	if (gDevice.uploadRing) glDeleteBuffers(1, &gDevice.uploadRing);
+}
+
+/**
+ * Reserves \p size bytes of the upload ring, must be called with the upload lock held.
+ * @returns false if the ring has no room left until the GPU completes some of the queued uploads.
+ */
+static bool AllocateUploadRange(uint64_t size, uint64_t* pPosition)
+{
+	if (!gDevice.uploadRingData || size > UPLOAD_RING_SIZE) return false;
+
+	/* ranges do not wrap around the end of the ring */
+	uint64_t position = gDevice.uploadRingHead;
+	const uint64_t offset = position % UPLOAD_RING_SIZE;
+	if (offset + size > UPLOAD_RING_SIZE) position += UPLOAD_RING_SIZE - offset;
+
+	if (position + size - gDevice.uploadRingTail > UPLOAD_RING_SIZE) return false;
+	gDevice.uploadRingHead = (position + size + UPLOAD_ALIGNMENT - 1) & ~(uint64_t)(UPLOAD_ALIGNMENT - 1);
+	*pPosition = position;
+	return true;
+}
+
+/**
+ * Releases the ring space of the upload batches the GPU completed, must be called with the upload
+ * lock held on a thread with a context bound.
+ */
+static void RetireUploadBatches(void)
+{
+	size_t numRetired = 0;
+	for (; numRetired < nArrayLen(gDevice.uploadBatches); ++numRetired) {
+		UploadBatch* batch = &gDevice.uploadBatches[numRetired];
+		GLenum status = glClientWaitSync(batch->fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+		/* fences signal in order */
+		glDeleteSync(batch->fence);
+		gDevice.uploadRingTail = max_uint64_t(gDevice.uploadRingTail, batch->ringEnd);
+		gDevice.completedUploadTicket = batch->lastTicket;
+	}
+	if (numRetired) nArrayErase(gDevice.uploadBatches, UploadBatch, 0, numRetired);
+}
+
+/**
+ * Issues the queued uploads whose texels are ready, in ticket order, on the current context.
+ */
+static void FlushUploads(void)
+{
+	NuAllocator* allocator = &gDevice.allocator;
+	nSpinLock(&gDevice.uploadLock);
+	RetireUploadBatches();
+
+	size_t numReady = 0;
+	while (numReady < nArrayLen(gDevice.uploads) && nAtomicLoad32(&gDevice.uploads[numReady].ready)) ++numReady;
+
+	if (numReady) {
+		UploadBatch* batch = nArrayPush(&gDevice.uploadBatches, allocator, UploadBatch);
+		nEnforce(batch, "Out of memory.");
+		batch->ringEnd = gDevice.uploadRingTail;
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		bool ringBound = false;
+		for (size_t i = 0; i < numReady; ++i) {
+			TextureUpload* upload = &gDevice.uploads[i];
+			const bool inRing = !upload->heapCopy;
+			if (inRing) {
+				batch->ringEnd = max_uint64_t(batch->ringEnd, upload->ringPosition + GetUploadDataSize(&upload->info));
+			}
+			if (upload->info.texture) {
+				if (inRing != ringBound) {
+					glBindBuffer(GL_PIXEL_UNPACK_BUFFER, inRing ? gDevice.uploadRing : 0);
+					ringBound = inRing;
+				}
+				BindTexture(0, upload->info.texture);
+				TexSubImage(DeviceGetTexture(upload->info.texture), &upload->info, inRing ? (void const*)(uintptr_t)(upload->ringPosition % UPLOAD_RING_SIZE) : upload->heapCopy);
+			}
+			if (upload->heapCopy) n_free(upload->heapCopy, allocator);
+		}
+		if (ringBound) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		batch->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		batch->lastTicket = gDevice.uploads[numReady - 1].ticket;
+		nArrayErase(gDevice.uploads, TextureUpload, 0, numReady);
+	}
+
+	nSpinUnlock(&gDevice.uploadLock);
+}
+
+/**
+ * Takes from the free readback buffers the smallest one that fits \p size bytes, or respecifies one
+ * that does not, and creates a new one if none is free. Leaves the buffer bound to
+ * GL_PIXEL_PACK_BUFFER.
+ * @returns false if a new buffer could not be created.
+ */
+static bool AcquireReadbackBuffer(uint size, ReadbackBuffer* pBuffer)
+{
+	nSpinLock(&gDevice.readbackLock);
+	const size_t numFree = nArrayLen(gDevice.readbackBuffers);
+	size_t best = numFree;
+	for (size_t i = 0; i < numFree; ++i) {
+		const uint capacity = gDevice.readbackBuffers[i].capacity;
+		if (capacity >= size && (best == numFree || capacity < gDevice.readbackBuffers[best].capacity)) best = i;
+	}
+	if (best == numFree && numFree) best = 0;
+	*pBuffer = (ReadbackBuffer) { 0 };
+	if (best < numFree) {
+		*pBuffer = gDevice.readbackBuffers[best];
+		nArrayErase(gDevice.readbackBuffers, ReadbackBuffer, best, 1);
+	}
+	nSpinUnlock(&gDevice.readbackLock);
+
+	if (!pBuffer->id) {
+		glGenBuffers(1, &pBuffer->id);
+		if (!pBuffer->id) return false;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pBuffer->id);
+	if (pBuffer->capacity < size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		pBuffer->capacity = size;
+	}
+	return true;
+}
+
+/**
+ * Writes the path of the cache file of program \p key to \p path.
+ * @returns false if it does not fit in \p size bytes.
+ */
+static bool GetProgramCachePath(uint64_t key, char* path, size_t size)
+{
+	int length = snprintf(path, size, "%s/%016llx.bin", gDevice.programCacheDirectory, (unsigned long long)key);
+	return length > 0 && (size_t)length < size;
+}
+
+static uint64_t GetProgramCacheKey(NuTechniqueCreateInfo const* info)
+{
+	const char* sources[] = { info->vertexShaderSource, info->geometryShaderSource, info->fragmentShaderSource };
+	uint64_t key = gDevice.programCacheSeed;
+	for (uint i = 0; i < 3; ++i) {
+		key = nHashCombine(key, sources[i] ? nHash64(sources[i], strlen(sources[i]), i) : 0);
+	}
+	return key;
+}
+
+/**
+ * Enables the program binary cache in \p directory if not null and supported by the driver.
+ */
+static void InitProgramCache(const char* directory)
+{
+	if (!directory || !glGetProgramBinary || !glProgramBinary || !glProgramParameteri) return;
+
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	if (numFormats <= 0) {
+		nDebugInfo("Program binaries not supported by the driver, program binary cache disabled.");
+		return;
+	}
+
+	const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+	for (uint i = 0; i < sizeof names / sizeof *names; ++i) {
+		const char* string = (const char*)glGetString(names[i]);
+		if (string) gDevice.programCacheSeed = nHash64(string, strlen(string), gDevice.programCacheSeed);
+	}
+
+	NuAllocator* allocator = &gDevice.allocator;
+	size_t size = strlen(directory) + 1;
+	gDevice.programCacheDirectory = n_malloc(size, allocator);
+	if (gDevice.programCacheDirectory) memcpy(gDevice.programCacheDirectory, directory, size);
+}
+
+/**
+ * @returns a program created from the cached binary of \p key, or zero if missing or rejected by the
+ * driver.
+ */
+static GLuint LoadCachedProgram(uint64_t key)
+{
+	char path[1024];
+	if (!GetProgramCachePath(key, path, sizeof path)) return 0;
+
+	FILE* file = NULL;
+#ifdef _MSC_VER
+	fopen_s(&file, path, "rb");
+#else
+	file = fopen(path, "rb");
+#endif
+	if (!file) return 0;
+
+	NuAllocator* allocator = &gDevice.allocator;
+	ProgramCacheHeader header;
+	void* binary = NULL;
+	bool valid = fread(&header, sizeof header, 1, file) == 1 && header.magic == PROGRAM_CACHE_MAGIC && header.key == key && header.size;
+	if (valid) {
+		binary = n_malloc(header.size, allocator);
+		valid = binary && fread(binary, 1, header.size, file) == header.size;
+	}
+	fclose(file);
+
+	GLuint programId = 0;
+	if (valid) {
+		programId = glCreateProgram();
+		glProgramBinary(programId, header.format, binary, header.size);
+
+		GLint linked;
+		glGetProgramiv(programId, GL_LINK_STATUS, &linked);
+		if (!linked) {
+			nDebugInfo("Cached program binary '%s' rejected by the driver, compiling it again.", path);
+			glDeleteProgram(programId);
+			programId = 0;
+		}
+	}
+
+	if (binary) n_free(binary, allocator);
+	return programId;
+}
+
+/**
+ * Writes the binary of linked program \p programId to the cache file of \p key.
+ */
+static void StoreCachedProgram(uint64_t key, GLuint programId)
+{
+	char path[1024];
+	if (!GetProgramCachePath(key, path, sizeof path)) {
+		nDebugWarning("Program binary cache directory path too long.");
+		return;
+	}
+
+	GLint size = 0;
+	glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0) return;
+
+	NuAllocator* allocator = &gDevice.allocator;
+	void* binary = n_malloc(size, allocator);
+	if (!binary) return;
+
+	ProgramCacheHeader header = { .magic = PROGRAM_CACHE_MAGIC, .key = key };
+	GLsizei written = 0;
+	GLenum format = 0;
+	glGetProgramBinary(programId, size, &written, &format, binary);
+	header.format = format;
+	header.size = (uint32_t)written;
+
+	FILE* file = NULL;
+	if (written > 0) {
+#ifdef _MSC_VER
+		fopen_s(&file, path, "wb");
+#else
+		file = fopen(path, "wb");
+#endif
+	}
+	if (file) {
+		/* a partially written file fails the size check on load */
+		if (fwrite(&header, sizeof header, 1, file) != 1 || fwrite(binary, 1, written, file) != (size_t)written) {
+			nDebugWarning("Could not write program binary cache file '%s'.", path);
+		}
+		fclose(file);
+	}
+	else if (written > 0) {
+		nDebugWarning("Could not create program binary cache file '%s'.", path);
+	}
+
+	n_free(binary, allocator);
+}
+
+static bool HasGlExtension(const char* name)
+{
+	if (!glGetStringi) return false;
+	GLint numExtensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+	for (GLint i = 0; i < numExtensions; ++i) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && !strcmp(extension, name)) return true;
+	}
+	return false;
+}
+
+/**
+ * Detects the compressed texture formats supported by the driver. RGTC is core since GL 3.0.
+ */
+static void InitCompressedTextureFormats(void)
+{
+	gDevice.compressedFormats = 1u << NU_TEXTURE_FORMAT_BC4_UNORM | 1u << NU_TEXTURE_FORMAT_BC5_UNORM;
+	if (HasGlExtension("GL_EXT_texture_compression_s3tc")) {
+		gDevice.compressedFormats |= 1u << NU_TEXTURE_FORMAT_BC1_UNORM | 1u << NU_TEXTURE_FORMAT_BC3_UNORM;
+	}
+	if (gl3wIsSupported(4, 2) || HasGlExtension("GL_ARB_texture_compression_bptc")) {
+		gDevice.compressedFormats |= 1u << NU_TEXTURE_FORMAT_BC7_UNORM;
+	}
+}
+
+/**
+ * Lets the driver compile shaders on as many threads as it likes, if supported.
+ */
+static void InitParallelShaderCompile(void)
+{
+	bool khr = HasGlExtension("GL_KHR_parallel_shader_compile");
+	if (!khr && !HasGlExtension("GL_ARB_parallel_shader_compile")) return;
+
+	PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)gl3wGetProcAddress(khr ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB");
+	if (maxShaderCompilerThreads) maxShaderCompilerThreads(0xFFFFFFFF);
+	gDevice.parallelShaderCompile = true;
+}
+
+/**
+ * @returns a null terminated copy of null terminated string list \p names, in a single allocation.
+ */
+static char** CopyNames(const char** names, NuAllocator* allocator, bool* pOutOfMemory)
+{
+	if (!names) return NULL;
+
+	uint count = 0;
+	size_t size = sizeof(char*);
+	for (; names[count]; ++count) {
+		size += sizeof(char*) + strlen(names[count]) + 1;
+	}
+
+	char** copy = n_malloc(size, allocator);
+	if (!copy) {
+		*pOutOfMemory = true;
+		return NULL;
+	}
+
+	char* strings = (char*)(copy + count + 1);
+	for (uint i = 0; i < count; ++i) {
+		size_t length = strlen(names[i]) + 1;
+		copy[i] = memcpy(strings, names[i], length);
+		strings += length;
 	}
+	copy[count] = NULL;
+	return copy;
 }
 
-static void BindTexture(uint unit, const Texture* texture)
+/**
+ * Releases what \p technique only needs while pending.
+ */
+static void ReleaseTechniqueBuildState(Technique* technique)
 {
-	nAssert(unit < MAX_TEXTURE_UINTS);
-	if (gDevice.currentState->textures[unit][texture->type] != texture) {
-		glActiveTexture(GL_TEXTURE0 + unit);
-		glBindTexture(kGlTextureType[texture->type], texture->id);
+	NuAllocator* allocator = &gDevice.allocator;
+	for (uint i = 0; i < 3; ++i) {
+		if (technique->shaders[i]) glDeleteShader(technique->shaders[i]);
+		technique->shaders[i] = 0;
 	}
+	if (technique->constantBuffers) n_free(technique->constantBuffers, allocator);
+	if (technique->samplers) n_free(technique->samplers, allocator);
+	technique->constantBuffers = NULL;
+	technique->samplers = NULL;
 }
 
-static void UnbindTexture(uint unit, NuTextureType type)
+/**
+ * Submits the shaders in \p info for compilation and their program for linking, without waiting for
+ * either. Errors are checked by CompleteTechnique().
+ */
+static void SubmitTechniqueProgram(Technique* technique, NuTechniqueCreateInfo const* info)
 {
-	nAssert(unit < MAX_TEXTURE_UINTS);
-	if (gDevice.currentState->textures[unit][type]) {
-		glActiveTexture(GL_TEXTURE0 + unit);
-		glBindTexture(kGlTextureType[type], 0);
+	static const GLenum types[] = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
+	const char* sources[] = { info->vertexShaderSource, info->geometryShaderSource, info->fragmentShaderSource };
+
+	technique->programId = glCreateProgram();
+	for (uint i = 0; i < 3; ++i) {
+		if (!sources[i]) continue;
+		GLuint shader = glCreateShader(types[i]);
+		glShaderSource(shader, 1, &sources[i], NULL);
+		glCompileShader(shader);
+		glAttachShader(technique->programId, shader);
+		technique->shaders[i] = shader;
 	}
+	if (technique->cacheKey) glProgramParameteri(technique->programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(technique->programId);
 }
 
-static void BindSampler(uint unit, NuSampler sampler)
+/**
+ * @returns whether the driver finished building the program of pending \p technique, querying it
+ * without parallel shader compile support would wait so it is assumed built.
+ */
+static bool IsTechniqueBuilt(Technique const* technique)
 {
-	nAssert(unit < MAX_TEXTURE_UINTS);
-	Sampler const** pCachedSampler = &gDevice.currentState->samplers[unit];
-	if (*pCachedSampler != sampler) {
-		*pCachedSampler = sampler;
-		glActiveTexture(GL_TEXTURE0 + unit);
-		glBindSampler(unit, sampler->id);
-	}
+	if (!gDevice.parallelShaderCompile) return true;
+	GLint completed = GL_TRUE;
+	glGetProgramiv(technique->programId, GL_COMPLETION_STATUS_KHR, &completed);
+	return completed != GL_FALSE;
 }
 
-static inline Technique const* DeviceGetTechnique(NuTechnique techniqueIndex)
+/**
+ * Checks the result of building the program of \p technique, waiting for the driver if needed, then
+ * registers its constant buffers and samplers.
+ */
+static void CompleteTechnique(Technique* technique)
 {
-	nEnforce(techniqueIndex > 0, "Null technique provided.");
-	nEnforce(techniqueIndex - 1 < nArrayLen(gDevice.techniques), "Invalid technique provided.");
-	return &gDevice.techniques[techniqueIndex - 1];
+	static const NuTechniqueCreateResult shaderErrors[] = {
+		NU_TECHNIQUE_CREATE_ERROR_INVALID_VERTEX_SHADER,
+		NU_TECHNIQUE_CREATE_ERROR_INVALID_GEOMETRY_SHADER,
+		NU_TECHNIQUE_CREATE_ERROR_INVALID_FRAGMENT_SHADER,
+	};
+
+	nSpinLock(&technique->lock);
+	if (technique->status != NU_TECHNIQUE_CREATE_PENDING) {
+		nSpinUnlock(&technique->lock);
+		return;
+	}
+
+	NuTechniqueCreateResult status = NU_TECHNIQUE_CREATE_SUCCESS;
+	for (uint i = 0; i < 3 && !status; ++i) {
+		if (!technique->shaders[i]) continue;
+		GLint compiled;
+		glGetShaderiv(technique->shaders[i], GL_COMPILE_STATUS, &compiled);
+		if (compiled == GL_FALSE) {
+			if (technique->errorMessageBufferSize) {
+				GLsizei written;
+				glGetShaderInfoLog(technique->shaders[i], technique->errorMessageBufferSize, &written, technique->errorMessageBuffer);
+			}
+			status = shaderErrors[i];
+		}
+	}
+
+	if (!status) {
+		GLint linked;
+		glGetProgramiv(technique->programId, GL_LINK_STATUS, &linked);
+		if (linked == GL_FALSE) {
+			if (technique->errorMessageBufferSize) {
+				GLsizei written;
+				glGetProgramInfoLog(technique->programId, technique->errorMessageBufferSize, &written, technique->errorMessageBuffer);
+			}
+			status = NU_TECHNIQUE_CREATE_ERROR_LINK_FAILED;
+		}
+	}
+
+	if (status) {
+		glDeleteProgram(technique->programId);
+		technique->programId = 0;
+	}
+	else {
+		if (technique->cacheKey) StoreCachedProgram(technique->cacheKey, technique->programId);
+
+		/* register constant buffers */
+		if (technique->constantBuffers) {
+			for (uint i = 0; technique->constantBuffers[i]; ++i) {
+				const char *cbufferName = technique->constantBuffers[i];
+				GLuint index = glGetUniformBlockIndex(technique->programId, cbufferName);
+				if (index == GL_INVALID_INDEX) {
+					nDebugWarning("Undefined shader uniform block '%s', maybe it's unused?", cbufferName);
+					++technique->numConstantBuffers; /* bump it up anyway, as this slot will be considered in use. */
+				} else {
+					glUniformBlockBinding(technique->programId, index, technique->numConstantBuffers++);
+				}
+			}
+		}
+
+		/* register samplers, without changing the program in use if possible */
+		if (technique->samplers) {
+			State const* state = CurrentState();
+			if (!glProgramUniform1i) glUseProgram(technique->programId);
+
+			for (uint i = 0; technique->samplers[i]; ++i) {
+				const char* samplerName = technique->samplers[i];
+				GLint index = glGetUniformLocation(technique->programId, samplerName);
+				if (index == -1) {
+					nDebugWarning("Undefined uniform sampler '%s', maybe it's unused?", samplerName);
+					++technique->numSamplers;
+				} else if (glProgramUniform1i) {
+					glProgramUniform1i(technique->programId, index, technique->numSamplers++);
+				} else {
+					glUniform1i(index, technique->numSamplers++);
+				}
+			}
+
+			if (!glProgramUniform1i) {
+				Technique const* current = state->technique ? nPoolGet(&gDevice.techniques, state->technique) : NULL;
+				glUseProgram(current ? current->programId : 0);
+			}
+		}
+	}
+
+	ReleaseTechniqueBuildState(technique);
+	technique->status = status;
+	nSpinUnlock(&technique->lock);
 }
 
 /*-------------------------------------------------------------------------------------------------
  * API
  *-----------------------------------------------------------------------------------------------*/
-NuResult nInitDevice(NuAllocator* allocator, void* dummyWindowHandle)
+NuResult nInitDevice(NuAllocator* allocator, void* dummyWindowHandle, bool nullBackend, const char* traceFilePath, const char* programCacheDirectory)
 {
 	nEnforce(!gDevice.initialized, "Device already initialized.");
+	nEnforce(nullBackend || !traceFilePath, "Device traces can only be recorded by the null backend.");
 	gDevice.initialized = true;
+	gDevice.nullBackend = nullBackend;
 	gDevice.allocator = *allocator;
 
-	NuResult result = nInitGlContextManager(&gDevice.nglContextManager, dummyWindowHandle);
+	nInitPool(&gDevice.techniques, allocator, sizeof(Technique), 4);
+	nInitPool(&gDevice.vertexLayouts, allocator, sizeof(VertexLayout), 4);
+	nInitPool(&gDevice.buffers, allocator, sizeof(Buffer), 8);
+	nInitPool(&gDevice.textures, allocator, sizeof(Texture), 8);
+	nInitPool(&gDevice.samplers, allocator, sizeof(Sampler), 6);
+	nInitPool(&gDevice.pipelines, allocator, sizeof(Pipeline), 6);
+	nInitPool(&gDevice.renderTargets, allocator, sizeof(RenderTarget), 4);
+	nInitPool(&gDevice.readbacks, allocator, sizeof(Readback), 4);
+	nInitHashMap(&gDevice.pipelineMap, allocator, sizeof(PipelineKey), sizeof(NuPipeline));
+	nInitHashMap(&gDevice.blendStateIds, allocator, sizeof(NuBlendState), sizeof(uint));
+
+	NuResult result = nullBackend ? InitNullGl(allocator, traceFilePath) : nInitGlContextManager(&gDevice.nglContextManager, dummyWindowHandle);
 	if (result) {
+		nDeinitPool(&gDevice.techniques);
+		nDeinitPool(&gDevice.vertexLayouts);
+		nDeinitPool(&gDevice.buffers);
+		nDeinitPool(&gDevice.textures);
+		nDeinitPool(&gDevice.samplers);
+		nDeinitPool(&gDevice.pipelines);
+		nDeinitPool(&gDevice.renderTargets);
+		nDeinitPool(&gDevice.readbacks);
+		nDeinitHashMap(&gDevice.pipelineMap);
+		nDeinitHashMap(&gDevice.blendStateIds);
 		nZero(&gDevice);
 		return result;
 	}
 
 	BindGlobalContext();
 
+	/* stream buffers are persistently mapped if GL 4.4 or ARB_buffer_storage are available */
+	gDevice.persistentStreamBuffers = gl3wIsSupported(4, 4) || HasGlExtension("GL_ARB_buffer_storage");
+	gDevice.baseInstance = gl3wIsSupported(4, 2) || HasGlExtension("GL_ARB_base_instance");
+	gDevice.drawIndirect = gl3wIsSupported(4, 0) || HasGlExtension("GL_ARB_draw_indirect");
+	gDevice.multiDrawIndirect = gDevice.drawIndirect && (gl3wIsSupported(4, 3) || HasGlExtension("GL_ARB_multi_draw_indirect"));
+	gDevice.timerQueries = glGenQueries != NULL && glBeginQuery != NULL && glEndQuery != NULL && glGetQueryObjectiv != NULL && glGetQueryObjectui64v != NULL;
+	gDevice.textureStorage = gl3wIsSupported(4, 2) || HasGlExtension("GL_ARB_texture_storage");
+	InitUploadRing();
+	InitProgramCache(programCacheDirectory);
+	InitParallelShaderCompile();
+	InitCompressedTextureFormats();
+	gDevice.frame = 1;
+
 	/* setup GL debug callback */
-#ifdef _DEBUG
+#if defined(DEBUG) || defined(_DEBUG)
 	if (glDebugMessageCallback) {
 		//nu_debug_info("OpenGL debugging supported and enabled.");
 		glDebugMessageCallback(debugCallbackGL, NULL);
@@ -265,6 +2090,8 @@ NuResult nInitDevice(NuAllocator* allocator, void* dummyWindowHandle)
 		nAssert(gDevice.defaults.linearSampler);
 	}
 
+	InitConstantRing();
+
 	return NU_SUCCESS;
 }
 
@@ -277,8 +2104,47 @@ void nDeinitDevice(void)
 		nuDestroySampler(gDevice.defaults.nearestSampler, &gDevice.allocator);
 		nuDestroySampler(gDevice.defaults.linearSampler, &gDevice.allocator);
 	}
+	nuDestroyBuffer(gDevice.constantRing, &gDevice.allocator);
+
+	ReportLeakedObjects(&gDevice.techniques, "technique");
+	ReportLeakedObjects(&gDevice.vertexLayouts, "vertex layout");
+	ReportLeakedObjects(&gDevice.buffers, "buffer");
+	ReportLeakedObjects(&gDevice.textures, "texture");
+	ReportLeakedObjects(&gDevice.samplers, "sampler");
+	ReportLeakedObjects(&gDevice.renderTargets, "render target");
+	ReportLeakedObjects(&gDevice.readbacks, "readback");
+
+	nDeinitPool(&gDevice.techniques);
+	nDeinitPool(&gDevice.vertexLayouts);
+	nDeinitPool(&gDevice.buffers);
+	nDeinitPool(&gDevice.textures);
+	nDeinitPool(&gDevice.samplers);
+	nDeinitPool(&gDevice.pipelines);
+	nDeinitPool(&gDevice.renderTargets);
+	nDeinitPool(&gDevice.readbacks);
+	nDeinitHashMap(&gDevice.pipelineMap);
+	nDeinitHashMap(&gDevice.blendStateIds);
+
+	for (size_t i = 0; i < nArrayLen(gDevice.readbackBuffers); ++i) {
+		glDeleteBuffers(1, &gDevice.readbackBuffers[i].id);
+	}
+	nArrayFree(gDevice.readbackBuffers, &gDevice.allocator);
+
+	for (uint i = 0; i < STREAM_BUFFER_NUM_FRAMES; ++i) {
+		if (gDevice.frameFences[i]) glDeleteSync(gDevice.frameFences[i]);
+	}
+	DeinitUploadRing();
 
-	nDeinitGlContextManager(&gDevice.nglContextManager);
+	if (gDevice.programCacheDirectory) {
+		NuAllocator* allocator = &gDevice.allocator;
+		n_free(gDevice.programCacheDirectory, allocator);
+	}
+
+	if (gDevice.nullBackend) {
+		DeinitNullGl();
+	} else {
+		nDeinitGlContextManager(&gDevice.nglContextManager);
+	}
 	nZero(&gDevice);
 }
 
@@ -288,10 +2154,11 @@ NuResult nuCreateVertexLayout(NuVertexLayoutDesc* const desc, NuAllocator *alloc
 	nEnforce(desc, "Null info provided.");
 	nEnforce(desc->numStreams <= NU_VERTEX_LAYOUT_MAX_STREAMS, "Number of streams in provided 'desc' higher than maximum NU_VERTEX_LAYOUT_MAX_STREAMS.");
 
-	*pLayout = NULL;
+	*pLayout = 0;
 
-	VertexLayout* layout = n_new(VertexLayout, GetDeviceAllocator(allocator));
-	if (!layout) return NU_FAILURE;
+	VertexLayout* layout;
+	NuVertexLayout handle = DevicePoolAlloc(&gDevice.vertexLayouts, &layout);
+	if (!handle) return NU_ERROR_OUT_OF_MEMORY;
 
 	layout->numStreams = desc->numStreams;
 	layout->numAttributes = desc->numAttributes;
@@ -301,7 +2168,7 @@ NuResult nuCreateVertexLayout(NuVertexLayoutDesc* const desc, NuAllocator *alloc
 
 		nEnforce(attrDesc->stream < desc->numStreams, "Attribute %d specified an invalid stream index (%d).", i, attrDesc->stream);
 		VertexLayoutStream *stream = &layout->streams[attrDesc->stream];
-		stream->instanced = desc->streams[i].instanceData;
+		stream->instanced = desc->streams[attrDesc->stream].instanceData;
 
 		nEnforce(stream->numAttributes < NU_VERTEX_LAYOUT_MAX_STREAM_ATTRIBUTES, "Number of attributes in stream %d greater than NU_VERTEX_LAYOUT_MAX_STREAM_ATTRIBUTES.", i);
 		VertexLayoutAttribute *attribute = &stream->attributes[stream->numAttributes++];
@@ -314,309 +2181,885 @@ NuResult nuCreateVertexLayout(NuVertexLayoutDesc* const desc, NuAllocator *alloc
 		stream->stride += GetAttributeTypeSize(attrDesc->type) * attrDesc->dimension;
 	}
 
-	*pLayout = layout;
+	*pLayout = handle;
 	return NU_SUCCESS;
 }
 
 void nuDestroyVertexLayout(NuVertexLayout vlayout, NuAllocator *allocator)
 {
 	EnforceInitialized();
-	n_free(vlayout, GetDeviceAllocator(allocator));
+	if (!vlayout) return;
+	DevicePoolFree(&gDevice.vertexLayouts, vlayout);
 }
 
-static GLuint CreateShader(GLenum type, const char *source, char* message_buffer, uint message_buffer_size)
+NuTechniqueCreateResult nuCreateTechniqueAsync(NuTechniqueCreateInfo const *info, NuTechnique *pTechnique)
 {
-	/* create the shader and compile it */
-	GLuint shader_id = glCreateShader(type);
-	glShaderSource(shader_id, 1, &source, NULL);
-	glCompileShader(shader_id);
+	EnforceInitialized();
+	BindGlobalContext();
+
+	nEnforce(info, "Null info provided.");
+	nEnforce(info->vertexShaderSource, "A vertex shader must have been provided.");
+	nEnforce(info->fragmentShaderSource, "A fragment shader must have been provided.");
+	nEnforce(nPoolGet(&gDevice.vertexLayouts, info->layout), "A valid layout must have been provided.");
+
+	*pTechnique = 0;
+
+	Technique *technique;
+	NuTechnique handle = DevicePoolAlloc(&gDevice.techniques, &technique);
+	if (!handle) return NU_TECHNIQUE_CREATE_ERROR_OUT_OF_MEMORY;
+
+	*technique = (Technique) {
+		.layout = info->layout,
+		.status = NU_TECHNIQUE_CREATE_PENDING,
+		.errorMessageBuffer = info->errorMessageBuffer,
+		.errorMessageBufferSize = info->errorMessageBuffer ? info->errorMessageBufferSize : 0,
+	};
 
-	/* check results */
-	GLint result;
-	glGetShaderiv(shader_id, GL_COMPILE_STATUS, &result);
+	/* names are resolved once the program is linked */
+	bool outOfMemory = false;
+	technique->constantBuffers = CopyNames(info->constantBuffers, &gDevice.allocator, &outOfMemory);
+	technique->samplers = CopyNames(info->samplers, &gDevice.allocator, &outOfMemory);
+	if (outOfMemory) {
+		ReleaseTechniqueBuildState(technique);
+		DevicePoolFree(&gDevice.techniques, handle);
+		return NU_TECHNIQUE_CREATE_ERROR_OUT_OF_MEMORY;
+	}
 
-	if (result == GL_FALSE) {
-		GLsizei size;
-		glGetShaderInfoLog(shader_id, message_buffer_size, &size, message_buffer);
-		return 0;
+	/* load the program from the binary cache, build it and cache it once built if missing or rejected */
+	if (gDevice.programCacheDirectory) {
+		technique->cacheKey = GetProgramCacheKey(info);
+		technique->programId = LoadCachedProgram(technique->cacheKey);
+		if (technique->programId) technique->cacheKey = 0;
+	}
+	if (!technique->programId) {
+		SubmitTechniqueProgram(technique, info);
 	}
 
-	return shader_id;
+	*pTechnique = handle;
+	return NU_TECHNIQUE_CREATE_SUCCESS;
 }
 
 NuTechniqueCreateResult nuCreateTechnique(NuTechniqueCreateInfo const *info, NuTechnique *pTechnique)
+{
+	NuTechniqueCreateResult result = nuCreateTechniqueAsync(info, pTechnique);
+	if (result) return result;
+
+	result = nuTechniqueGetStatus(*pTechnique, true);
+	if (result) {
+		nuDestroyTechnique(*pTechnique);
+		*pTechnique = 0;
+	}
+	return result;
+}
+
+NuTechniqueCreateResult nuTechniqueGetStatus(NuTechnique handle, bool wait)
 {
 	EnforceInitialized();
-	BindGlobalContext();
+	Technique* technique = DeviceGetTechnique(handle);
+	if (technique->status == NU_TECHNIQUE_CREATE_PENDING) {
+		BindGlobalContext();
+		if (!wait && !IsTechniqueBuilt(technique)) return NU_TECHNIQUE_CREATE_PENDING;
+		CompleteTechnique(technique);
+	}
+	return technique->status;
+}
 
+NuResult nuCreateBuffer(NuBufferCreateInfo const* info, NuAllocator* allocator, NuBuffer *pBuffer)
+{
+	EnforceInitialized();
 	nEnforce(info, "Null info provided.");
-	nEnforce(info->vertexShaderSource, "A vertex shader must have been provided.");
-	nEnforce(info->fragmentShaderSource, "A fragment shader must have been provided.");
-	nEnforce(info->layout, "A layout must have been provided.");
+	nEnforce(!*pBuffer, "Buffer has already been created.");
 
-	GLuint vsId = CreateShader(GL_VERTEX_SHADER, info->vertexShaderSource, info->errorMessageBuffer, info->errorMessageBufferSize);
-	if (!vsId) return NU_TECHNIQUE_CREATE_ERROR_INVALID_VERTEX_SHADER;
+	*pBuffer = 0;
 
+	GLuint id;
+	glGenBuffers(1, &id);
+	if (!id) {
+		nDebugError("Could not create GPU device object.");
+		return NU_FAILURE;
+	}
 
-	GLuint gsId = 0;
-	if (info->geometryShaderSource) {
-		gsId = CreateShader(GL_GEOMETRY_SHADER, info->geometryShaderSource, info->errorMessageBuffer, info->errorMessageBufferSize);
-		glDeleteShader(vsId);
-		if (!gsId) return NU_TECHNIQUE_CREATE_ERROR_INVALID_GEOMETRY_SHADER;
+	Buffer *buffer;
+	NuBuffer handle = DevicePoolAlloc(&gDevice.buffers, &buffer);
+	if (!handle) {
+		glDeleteBuffers(1, &id);
+		return NU_ERROR_OUT_OF_MEMORY;
 	}
 
-	GLuint fsId = CreateShader(GL_FRAGMENT_SHADER, info->fragmentShaderSource, info->errorMessageBuffer, info->errorMessageBufferSize);
-	if (!fsId) {
-		glDeleteShader(vsId);
-		glDeleteShader(gsId);
-		return NU_TECHNIQUE_CREATE_ERROR_INVALID_FRAGMENT_SHADER;
+	nZero(buffer);
+	buffer->id = id;
+	buffer->type = info->type;
+	buffer->usage = info->usage;
+
+	nuBufferUpdate(handle, 0, info->initialData, info->initialSize);
+	CurrentState()->stats.numBuffersCreated++;
+
+	*pBuffer = handle;
+	return NU_SUCCESS;
+}
+
+void nuDestroyBuffer(NuBuffer handle, NuAllocator* allocator)
+{
+	EnforceInitialized();
+	if (!handle) return;
+
+	Buffer const* buffer = DeviceGetBuffer(handle);
+	NuAllocator* deviceAllocator = &gDevice.allocator;
+	glDeleteBuffers(1, &buffer->id);
+	if (buffer->commands) n_free(buffer->commands, deviceAllocator);
+	DevicePoolFree(&gDevice.buffers, handle);
+	InvalidateDeletedObjects();
+}
+
+void nuBufferUpdate(NuBuffer handle, uint offset, const void* data, uint size)
+{
+	EnforceInitialized();
+	nEnforce(handle, "Null buffer provided.");
+	Buffer* buffer = DeviceGetBuffer(handle);
+	nEnforce(!buffer->mapped, "Mapped buffers cannot be updated.");
+	if (IsEmulatedIndirectBuffer(buffer)) {
+		UpdateIndirectCommands(buffer, offset, data, size);
+		CurrentState()->stats.numBytesUploaded += size;
+		return;
 	}
+	CurrentState()->stats.numBytesUploaded += size;
+
+	/* stream buffers contents are respecified by each update, bytes not written are undefined */
+	if (buffer->usage == NU_BUFFER_USAGE_STREAM) {
+		if (!size) return;
+		void* mapped = MapStreamBuffer(buffer, offset, size);
+		if (!mapped) return;
+		if (data) memcpy(mapped, data, size);
+		UnmapStreamBuffer(buffer);
+		InvalidateStreamBufferBindings();
+		return;
+	}
+
+	BindBuffer(buffer);
+	uint newSize = max_uint(buffer->size, offset + size);
 
-	/* create program and link it */
-	GLuint programId = glCreateProgram();
-	glAttachShader(programId, vsId);
-	if (gsId) glAttachShader(programId, gsId);
-	glAttachShader(programId, fsId);
-	glDeleteShader(vsId);
-	if (gsId) glDeleteShader(gsId);
-	glDeleteShader(fsId);
-	glLinkProgram(programId);
+	if (buffer->size < newSize) {
+		if (offset == 0) {
+			glBufferData(BufferTypeToGl(buffer->type), size, data, BufferUsageToGl(buffer->usage));
+		} else {
+			glBufferData(BufferTypeToGl(buffer->type), newSize, NULL, BufferUsageToGl(buffer->usage));
+			glBufferSubData(BufferTypeToGl(buffer->type), offset, size, data);
+		}
+	} else {
+		glBufferSubData(BufferTypeToGl(buffer->type), offset, size, data);
+	}
 
-	/* check result */
-	int result;
-	glGetProgramiv(programId, GL_LINK_STATUS, &result);
+	buffer->size = newSize;
+}
 
-	if (result == GL_FALSE) {
-		GLsizei written;
-		glGetProgramInfoLog(programId, info->errorMessageBufferSize, &written, info->errorMessageBuffer);
-		glDeleteProgram(programId);
-		return NU_TECHNIQUE_CREATE_ERROR_LINK_FAILED;
+NuResult nuBufferMap(NuBuffer handle, uint offset, uint size, NuBufferMapFlags flags, void** pData)
+{
+	EnforceInitialized();
+	nEnforce(handle, "Null buffer provided.");
+	nEnforce(flags & NU_BUFFER_MAP_WRITE, "Buffers can only be mapped for writing.");
+	nEnforce(size, "Empty buffer range provided.");
+	Buffer* buffer = DeviceGetBuffer(handle);
+	nEnforce(!buffer->mapped, "Buffer already mapped.");
+	nEnforce(buffer->usage != NU_BUFFER_USAGE_IMMUTABLE, "Immutable buffers cannot be mapped.");
+
+	*pData = NULL;
+
+	if (IsEmulatedIndirectBuffer(buffer)) {
+		/* stream buffers are respecified by mapping, as their GL counterparts */
+		bool respecified = buffer->usage != NU_BUFFER_USAGE_STREAM || !UpdateIndirectCommands(buffer, offset, NULL, size);
+		nEnforce(offset + size <= buffer->size, "Mapped range [%d, %d) out of buffer bounds.", offset, offset + size);
+		*pData = respecified ? buffer->commands + offset : NULL;
+	}
+	else if (buffer->usage == NU_BUFFER_USAGE_STREAM) {
+		/* stream buffers get a new range of their ring, as if the whole buffer was discarded */
+		*pData = MapStreamBuffer(buffer, offset, size);
+	}
+	else {
+		nEnforce(offset + size <= buffer->size, "Mapped range [%d, %d) out of buffer bounds.", offset, offset + size);
+		GLbitfield access = GL_MAP_WRITE_BIT;
+		if (flags & NU_BUFFER_MAP_DISCARD_RANGE) access |= GL_MAP_INVALIDATE_RANGE_BIT;
+		if (flags & NU_BUFFER_MAP_UNSYNCHRONIZED) access |= GL_MAP_UNSYNCHRONIZED_BIT;
+		BindBuffer(buffer);
+		*pData = glMapBufferRange(BufferTypeToGl(buffer->type), offset, size, access);
+		if (!*pData) nDebugError("Could not map buffer range.");
 	}
 
-	glUseProgram(programId);
+	if (!*pData) return NU_FAILURE;
+	buffer->mapped = true;
+	CurrentState()->stats.numBytesUploaded += size;
+	return NU_SUCCESS;
+}
 
-	Technique *technique = nArrayPush(&gDevice.techniques, &gDevice.allocator, Technique);
-	*technique = (Technique) {
-		.layout = info->layout,
-		.programId = programId,
-	};
+NuResult nuBufferUnmap(NuBuffer handle)
+{
+	EnforceInitialized();
+	nEnforce(handle, "Null buffer provided.");
+	Buffer* buffer = DeviceGetBuffer(handle);
+	nEnforce(buffer->mapped, "Buffer not mapped.");
+	buffer->mapped = false;
+	if (IsEmulatedIndirectBuffer(buffer)) return NU_SUCCESS;
+
+	if (buffer->usage == NU_BUFFER_USAGE_STREAM) {
+		UnmapStreamBuffer(buffer);
+		InvalidateStreamBufferBindings();
+		return NU_SUCCESS;
+	}
 
-	/* register constant buffers */
-	if (info->constantBuffers) {
-		for (uint i = 0; info->constantBuffers[i]; ++i) {
-			const char *cbufferName = info->constantBuffers[i];
-			auto index = glGetUniformBlockIndex(technique->programId, cbufferName);
-			if (index == GL_INVALID_INDEX) {
-				nDebugWarning("Undefined shader uniform block '%s', maybe it's unused?", cbufferName);
-				++technique->numConstantBuffers; /* bump it up anyway, as this slot will be considered in use. */
-			} else {
-				glUniformBlockBinding(technique->programId, index, technique->numConstantBuffers++);
-			}
+	BindBuffer(buffer);
+	if (!glUnmapBuffer(BufferTypeToGl(buffer->type))) {
+		nDebugWarning("Buffer contents were lost while mapped and must be written again.");
+		return NU_FAILURE;
+	}
+	return NU_SUCCESS;
+}
+
+NuResult nuCreateContext(NuContextCreateInfo const* info, NuAllocator* allocator, NuContext* outContext)
+{
+	EnforceInitialized();
+	*outContext = NULL;
+	Context* context = n_new(Context, GetDeviceAllocator(allocator));
+	if (!context) {
+		return NU_ERROR_OUT_OF_MEMORY;
+	}
+
+	/* context initialization changes the GL context current on this thread */
+	nuDeviceReleaseContext();
+
+	NuResult result = gDevice.nullBackend ? NU_SUCCESS : nInitGlContext(&gDevice.nglContextManager, info->windowHandle, &context->nglContext);
+	if (result) {
+		nDebugError("Could not initialize OpenGL context for specified window.");
+		n_free(context, GetDeviceAllocator(allocator));
+		return result;
+	}
+
+	/* initialize opengl context */
+	BindContext(context);
+	glEnable(GL_BLEND);
+	
+	/* create default VAO, bound until the first draw binds a cached one */
+	GLuint vao;
+	glGenVertexArrays(1, &vao);
+	nAssert(vao);
+	glBindVertexArray(vao);
+	context->state.boundVertexArray = vao;
+	context->state.defaultVertexArray = vao;
+
+	/* time the first frame, queries are deleted with the GL context */
+	if (gDevice.timerQueries) {
+		glGenQueries(TIMER_QUERY_RING_SIZE, context->state.timerQueries);
+		context->state.oldestTimerFrame = 1;
+		glBeginQuery(GL_TIME_ELAPSED, context->state.timerQueries[1 % TIMER_QUERY_RING_SIZE]);
+	}
+
+	*outContext = context;
+	return NU_SUCCESS;
+}
+
+void nuDestroyContext(NuContext context, NuAllocator* allocator)
+{
+	EnforceInitialized();
+	nEnforce(gThreadContext == context || !nAtomicLoad32(&context->bound), "Context is current on another thread and cannot be destroyed.");
+
+	/* deinitialization leaves no GL context current on this thread */
+	nuDeviceReleaseContext();
+	if (!gDevice.nullBackend) nDeinitGlContext(&gDevice.nglContextManager, &context->nglContext);
+	n_free(context, GetDeviceAllocator(allocator));
+}
+
+void nuDestroyTechnique(NuTechnique handle)
+{
+	EnforceInitialized();
+	if (!handle) return;
+
+	Technique* technique = DeviceGetTechnique(handle);
+	nSpinLock(&technique->lock);
+	ReleaseTechniqueBuildState(technique);
+	nSpinUnlock(&technique->lock);
+	if (technique->programId) glDeleteProgram(technique->programId);
+	State* state = CurrentState();
+	if (state->technique == handle) state->technique = 0;
+	if (state->pendingTechnique == handle) {
+		state->pendingTechnique = 0;
+		state->pipeline = 0;
+	}
+
+	/* pipelines live as long as their technique */
+	nSpinLock(&gDevice.poolLock);
+	for (uint i = 0; i < gDevice.pipelines.numSlots; ++i) {
+		NuPipeline pipelineHandle;
+		Pipeline const* pipeline = nPoolAt(&gDevice.pipelines, i, &pipelineHandle);
+		if (!pipeline || pipeline->technique != handle) continue;
+		nHashMapRemove(&gDevice.pipelineMap, &(PipelineKey) { pipeline->technique, pipeline->blendState });
+		nPoolFree(&gDevice.pipelines, pipelineHandle);
+	}
+	nSpinUnlock(&gDevice.poolLock);
+
+	DevicePoolFree(&gDevice.techniques, handle);
+}
+
+NuResult nuCreatePipeline(NuPipelineCreateInfo const* info, NuPipeline* pPipeline)
+{
+	EnforceInitialized();
+	nEnforce(info, "Null info provided.");
+	nEnforce(info->blendState, "Null blend state provided.");
+	DeviceGetTechnique(info->technique);
+
+	PipelineKey key;
+	nZero(&key);
+	key.technique = info->technique;
+	key.blendState = *info->blendState;
+
+	nSpinLock(&gDevice.poolLock);
+	NuResult result = NU_SUCCESS;
+	bool inserted;
+	NuPipeline* pHandle = nHashMapInsert(&gDevice.pipelineMap, &key, &inserted);
+	if (!pHandle) {
+		result = NU_ERROR_OUT_OF_MEMORY;
+	}
+	else if (inserted) {
+		bool newBlendState;
+		uint* blendStateId = nHashMapInsert(&gDevice.blendStateIds, &key.blendState, &newBlendState);
+		Pipeline* pipeline;
+		*pHandle = blendStateId ? nPoolAlloc(&gDevice.pipelines, &pipeline) : 0;
+
+		if (*pHandle) {
+			if (newBlendState) *blendStateId = (uint)gDevice.blendStateIds.count - 1;
+			pipeline->technique = key.technique;
+			pipeline->blendState = key.blendState;
+
+			/* most expensive state first: program, then blend state, the pipeline slot breaks ties */
+			pipeline->sortKey =
+				(uint64_t)(key.technique & N_POOL_INDEX_MASK) << 40 |
+				(uint64_t)(*blendStateId & N_POOL_INDEX_MASK) << 20 |
+				(uint64_t)(*pHandle & N_POOL_INDEX_MASK);
+		}
+		else {
+			if (blendStateId && newBlendState) nHashMapRemove(&gDevice.blendStateIds, &key.blendState);
+			nHashMapRemove(&gDevice.pipelineMap, &key);
+			result = NU_ERROR_OUT_OF_MEMORY;
 		}
 	}
 
-	/* register samplers */
-	if (info->samplers) {
-		for (uint i = 0; info->samplers[i]; ++i) {
-			const char* samplerName = info->samplers[i];
-			auto index = glGetUniformLocation(technique->programId, samplerName);
-			if (index == GL_INVALID_INDEX) {
-				nDebugWarning("Undefined uniform sampler '%s', maybe it's unused?", samplerName);
-				++technique->numSamplers;
-			} else {
-				glUniform1i(index, technique->numSamplers++);
+	*pPipeline = result ? 0 : *pHandle;
+	nSpinUnlock(&gDevice.poolLock);
+	return result;
+}
+
+uint64_t nuPipelineGetSortKey(NuPipeline handle)
+{
+	EnforceInitialized();
+	return DeviceGetPipeline(handle)->sortKey;
+}
+
+NuPipelineCreateInfo nPipelineGetInfo(NuPipeline handle)
+{
+	EnforceInitialized();
+	Pipeline const* pipeline = DeviceGetPipeline(handle);
+	return (NuPipelineCreateInfo) { pipeline->technique, &pipeline->blendState };
+}
+
+void nuDeviceReleaseContext(void)
+{
+	if (!gThreadContext) return;
+	if (gDevice.nullBackend) {
+		NullGlMakeCurrent(gThreadDefaultState.boundBuffers, gThreadDefaultState.boundVertexArray);
+	} else {
+		nGlContextRelease(&gThreadContext->nglContext);
+	}
+	nAtomicStore32(&gThreadContext->bound, 0);
+	gThreadContext = NULL;
+	gCurrentState = NULL;
+}
+
+NuResult nuCreateTexture(NuTextureCreateInfo const* info, NuAllocator* allocator, NuTexture* ppTexture)
+{
+	EnforceInitialized();
+	const bool compressed = nuImageFormatIsCompressed((NuImageFormat)info->format);
+	nEnforce(!compressed || info->type == NU_TEXTURE_TYPE_2D || info->type == NU_TEXTURE_TYPE_2D_ARRAY, "Only 2D and 2D array textures can be compressed.");
+
+	*ppTexture = 0;
+	Texture* pTexture;
+	NuTexture handle = DevicePoolAlloc(&gDevice.textures, &pTexture);
+	if (!handle) return NU_ERROR_OUT_OF_MEMORY;
+
+	glGenTextures(1, &pTexture->id);
+	if (!pTexture->id) {
+		nDebugError("Could not create OpenGL texture object.");
+		DevicePoolFree(&gDevice.textures, handle);
+		return NU_FAILURE;
+	}
+
+	pTexture->type = info->type;
+	pTexture->size = info->size;
+	pTexture->format = info->format;
+	pTexture->numLevels = max_uint(info->numLevels, 1);
+	pTexture->keepCpuCopy = info->keepCpuCopy;
+	pTexture->cpuCopy = NULL;
+	pTexture->decompress = compressed && !(gDevice.compressedFormats & (1u << info->format));
+	nEnforce(pTexture->numLevels <= GetTextureMaxLevels(pTexture), "More levels requested than the texture size allows.");
+
+	BindTexture(0, handle);
+	AllocateTextureStorage(pTexture);
+	CurrentState()->stats.numTexturesCreated++;
+
+	*ppTexture = handle;
+	return NU_SUCCESS;
+}
+
+void nuDestroyTexture(NuTexture handle, NuAllocator* allocator)
+{
+	EnforceInitialized();
+	if (!handle) return;
+	Texture* texture = DeviceGetTexture(handle);
+
+	/* queued uploads to the texture are dropped, their staging space is released as usual */
+	nSpinLock(&gDevice.uploadLock);
+	for (size_t i = 0; i < nArrayLen(gDevice.uploads); ++i) {
+		if (gDevice.uploads[i].info.texture == handle) gDevice.uploads[i].info.texture = 0;
+	}
+	nSpinUnlock(&gDevice.uploadLock);
+
+	glDeleteTextures(1, &texture->id);
+	nuDestroyImage(texture->cpuCopy, &gDevice.allocator);
+	DevicePoolFree(&gDevice.textures, handle);
+	InvalidateDeletedObjects();
+}
+
+void nuTextureUpdateLevels(NuTexture handle, uint baseLevel, uint numLevels, NuImageView const* images)
+{
+	EnforceInitialized();
+	Texture* texture = DeviceGetTexture(handle);
+	nEnforce(texture->type == NU_TEXTURE_TYPE_1D || texture->type == NU_TEXTURE_TYPE_2D, "Only levels of 1D and 2D textures can be updated from images.");
+	nEnforce(baseLevel + numLevels <= texture->numLevels, "Texture level out of range.");
+	BindTexture(0, handle);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (uint i = 0; i < numLevels; ++i) {
+		const uint level = baseLevel + i;
+		const NuSize3i size = GetTextureLevelSize(texture, level);
+		nEnforce(images[i].size.width == size.width && max_uint(images[i].size.height, 1) == size.height, "Image size does not match the texture level.");
+		if (nuImageFormatIsCompressed((NuImageFormat)texture->format)) {
+			nEnforce(images[i].format == (NuImageFormat)texture->format, "Images updating compressed textures must be in the texture format.");
+		} else {
+			nEnforce(!nuImageFormatIsCompressed(images[i].format), "Compressed images can only update compressed textures.");
+		}
+
+		if (!images[i].data) continue;
+
+		NuTextureUploadInfo upload = {
+			.texture = handle,
+			.level = level,
+			.width = size.width,
+			.height = size.height,
+			.depth = 1,
+			.format = images[i].format,
+			.data = images[i].data,
+		};
+		const bool updateCpuCopy = level == 0 && texture->keepCpuCopy && texture->type == NU_TEXTURE_TYPE_2D;
+		void* decompressed = NULL;
+		if (nuImageFormatIsCompressed(upload.format) && (texture->decompress || updateCpuCopy)) {
+			decompressed = DecompressTexels(upload.format, size.width, size.height, 1, upload.data);
+			if (!decompressed) {
+				nDebugError("Out of memory while decompressing texture level.");
+				continue;
 			}
 		}
+
+		if (texture->decompress) {
+			upload.format = nuImageFormatGetDecompressed(upload.format);
+			upload.data = decompressed;
+		}
+		TexSubImage(texture, &upload, upload.data);
+
+		if (updateCpuCopy) {
+			UpdateTextureCpuCopy(texture, 0, 0, size.width, size.height, nuImageFormatGetDecompressed(images[i].format), decompressed ? decompressed : images[i].data);
+		}
+		if (decompressed) {
+			NuAllocator* allocator = &gDevice.allocator;
+			n_free(decompressed, allocator);
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+NuResult nuTextureUploadAsync(NuTextureUploadInfo const* info, NuUploadTicket* pTicket)
+{
+	EnforceInitialized();
+	nEnforce(info->data, "Null upload data provided.");
+	nEnforce(info->width && info->height && info->depth, "Empty upload region provided.");
+	Texture* texture = DeviceGetTexture(info->texture);
+	nEnforce(info->level < texture->numLevels, "Texture level out of range.");
+	const NuSize3i levelSize = GetTextureLevelSize(texture, info->level);
+	nEnforce(info->x + info->width <= levelSize.width && info->y + info->height <= levelSize.height && info->z + info->depth <= levelSize.depth, "Upload region exceeds the texture level.");
+	if (nuImageFormatIsCompressed((NuImageFormat)texture->format)) {
+		nEnforce(info->format == (NuImageFormat)texture->format, "Texels uploaded to compressed textures must be in the texture format.");
+		nEnforce(!(info->x % 4) && !(info->y % 4), "Compressed texture regions must be aligned to blocks.");
+		nEnforce((!(info->width % 4) || info->x + info->width == levelSize.width) && (!(info->height % 4) || info->y + info->height == levelSize.height), "Compressed texture regions must be made of whole blocks.");
+	} else {
+		nEnforce(!nuImageFormatIsCompressed(info->format), "Compressed texels can only be uploaded to compressed textures.");
+	}
+
+	*pTicket = 0;
+	NuAllocator* allocator = &gDevice.allocator;
+
+	/* compressed texels are decoded here if the driver cannot sample them or for the system memory
+	 * copy, keeping the decoding off the thread that flushes the uploads */
+	const bool updateCpuCopy = info->level == 0 && texture->keepCpuCopy && texture->type == NU_TEXTURE_TYPE_2D;
+	void* decompressed = NULL;
+	if (nuImageFormatIsCompressed(info->format) && (texture->decompress || updateCpuCopy)) {
+		decompressed = DecompressTexels(info->format, info->width, info->height, info->depth, info->data);
+		if (!decompressed) return NU_ERROR_OUT_OF_MEMORY;
+	}
+	if (updateCpuCopy) {
+		UpdateTextureCpuCopy(texture, info->x, info->y, info->width, info->height, nuImageFormatGetDecompressed(info->format), decompressed ? decompressed : info->data);
+	}
+
+	NuTextureUploadInfo source = *info;
+	if (texture->decompress) {
+		source.format = nuImageFormatGetDecompressed(info->format);
+		source.data = decompressed;
+	}
+	const size_t size = GetUploadDataSize(&source);
+
+	/* the upload is queued as soon as its ring range is reserved so that ranges are issued in ring
+	 * order, it is marked ready once the texels are copied outside the lock */
+	nSpinLock(&gDevice.uploadLock);
+	const uint64_t head = gDevice.uploadRingHead;
+	uint64_t position;
+	TextureUpload* upload = NULL;
+	if (AllocateUploadRange(size, &position)) {
+		upload = nArrayPush(&gDevice.uploads, allocator, TextureUpload);
+		if (!upload) gDevice.uploadRingHead = head;
+	}
+	if (!upload) {
+		nSpinUnlock(&gDevice.uploadLock);
+
+		/* texels decoded for the upload serve as its heap copy */
+		void* heapCopy = texture->decompress ? decompressed : n_malloc(size, allocator);
+		if (!heapCopy) {
+			if (decompressed) n_free(decompressed, allocator);
+			return NU_ERROR_OUT_OF_MEMORY;
+		}
+		if (heapCopy != decompressed) memcpy(heapCopy, source.data, size);
+		if (decompressed && heapCopy != decompressed) n_free(decompressed, allocator);
+
+		nSpinLock(&gDevice.uploadLock);
+		upload = nArrayPush(&gDevice.uploads, allocator, TextureUpload);
+		if (!upload) {
+			nSpinUnlock(&gDevice.uploadLock);
+			n_free(heapCopy, allocator);
+			return NU_ERROR_OUT_OF_MEMORY;
+		}
+		*upload = (TextureUpload) { .info = source, .heapCopy = heapCopy, .ticket = ++gDevice.lastUploadTicket, .ready = 1 };
+		upload->info.data = heapCopy;
+		*pTicket = upload->ticket;
+		nSpinUnlock(&gDevice.uploadLock);
+		return NU_SUCCESS;
+	}
+
+	const NuUploadTicket ticket = ++gDevice.lastUploadTicket;
+	*upload = (TextureUpload) { .info = source, .ringPosition = position, .ticket = ticket };
+	upload->info.data = NULL;
+	nSpinUnlock(&gDevice.uploadLock);
+
+	memcpy(gDevice.uploadRingData + position % UPLOAD_RING_SIZE, source.data, size);
+	if (decompressed) n_free(decompressed, allocator);
+
+	/* queued uploads may have moved meanwhile */
+	nSpinLock(&gDevice.uploadLock);
+	for (size_t i = nArrayLen(gDevice.uploads); i-- > 0;) {
+		if (gDevice.uploads[i].ticket == ticket) {
+			nAtomicStore32(&gDevice.uploads[i].ready, 1);
+			break;
+		}
 	}
+	nSpinUnlock(&gDevice.uploadLock);
+	*pTicket = ticket;
+	return NU_SUCCESS;
+}
 
-	*pTechnique = technique - gDevice.techniques + 1;
+void nuDeviceFlushUploads(NuContext context)
+{
+	EnforceInitialized();
+	BindContext(context);
+	FlushUploads();
+}
 
-	return NU_SUCCESS;
+bool nuDeviceIsUploadComplete(NuUploadTicket ticket)
+{
+	EnforceInitialized();
+	nSpinLock(&gDevice.uploadLock);
+	bool complete = ticket <= gDevice.completedUploadTicket;
+	nSpinUnlock(&gDevice.uploadLock);
+	return complete;
 }
 
-NuResult nuCreateBuffer(NuBufferCreateInfo const* info, NuAllocator* allocator, NuBuffer *pBuffer)
+NuImageView nTextureGetCpuCopy(NuTexture handle)
 {
 	EnforceInitialized();
-	nEnforce(info, "Null info provided.");
-	nEnforce(!*pBuffer, "Buffer has already been created.");
+	Texture* texture = DeviceGetTexture(handle);
+	nSpinLock(&texture->cpuCopyLock);
+	NuImageView view = texture->cpuCopy ? nuImageGetView(texture->cpuCopy) : (NuImageView) { 0 };
+	nSpinUnlock(&texture->cpuCopyLock);
+	return view;
+}
+
+NuResult nuCreateSampler(NuSamplerCreateInfo const* info, NuAllocator* allocator, NuSampler* ppSampler)
+{
+	EnforceInitialized();
+	
+	*ppSampler = 0;
 
-	*pBuffer = NULL;
+	Sampler* pSampler;
+	NuSampler handle = DevicePoolAlloc(&gDevice.samplers, &pSampler);
+	if (!handle) return NU_ERROR_OUT_OF_MEMORY;
 
-	GLuint id;
-	glGenBuffers(1, &id);
-	if (!id) {
-		nDebugError("Could not create GPU device object.");
+	glGenSamplers(1, &pSampler->id);
+	if (!pSampler->id) {
+		nDebugError("Could not create OpenGL sampler object.");
+		DevicePoolFree(&gDevice.samplers, handle);
 		return NU_FAILURE;
 	}
 
-	Buffer *buffer = n_new(Buffer, GetDeviceAllocator(allocator));
-	buffer->id = id;
-	buffer->type = info->type;
-	buffer->usage = info->usage;
-	buffer->size = 0;
+	pSampler->minFilterMod = info->minFilterMode;
+	pSampler->magFilterMode = info->magFilterMode;
+	pSampler->uWrapMode = info->uWrapMode;
+	pSampler->vWrapMode = info->vWrapMode;
 
-	nuBufferUpdate((NuBuffer) { buffer }, 0, info->initialData, info->initialSize);
+	glSamplerParameteri(pSampler->id, GL_TEXTURE_MIN_FILTER, kGlSamplerMinFilter[pSampler->minFilterMod]);
+	glSamplerParameteri(pSampler->id, GL_TEXTURE_MAG_FILTER, kGlSamplerMagFilter[pSampler->magFilterMode]);
+	glSamplerParameteri(pSampler->id, GL_TEXTURE_WRAP_S, kGlSamplerWrapMode[pSampler->uWrapMode]);
+	glSamplerParameteri(pSampler->id, GL_TEXTURE_WRAP_T, kGlSamplerWrapMode[pSampler->vWrapMode]);
 
-	*pBuffer = buffer;
+	*ppSampler = handle;
 	return NU_SUCCESS;
 }
 
-void nuDestroyBuffer(NuBuffer buffer, NuAllocator* allocator)
+NuSamplerCreateInfo nSamplerGetInfo(NuSampler handle)
 {
 	EnforceInitialized();
-	if (!buffer) return;
-
-	glDeleteBuffers(1, &buffer->id);
-	n_free(buffer, GetDeviceAllocator(allocator));
+	Sampler const* sampler = DeviceGetSampler(handle);
+	return (NuSamplerCreateInfo) {
+		.minFilterMode = sampler->minFilterMod,
+		.magFilterMode = sampler->magFilterMode,
+		.uWrapMode = sampler->uWrapMode,
+		.vWrapMode = sampler->vWrapMode,
+	};
 }
 
-void nuBufferUpdate(NuBuffer buffer, uint offset, const void* data, uint size)
+void nuDestroySampler(NuSampler handle, NuAllocator* allocator)
 {
-	EnforceInitialized();
-	nEnforce(buffer, "Null buffer provided.");
-
-	BindBuffer(buffer);
-	uint newSize = max_uint(buffer->size, offset + size);
-
-	if (buffer->size < newSize) {
-		if (offset == 0) {
-			glBufferData(BufferTypeToGl(buffer->type), size, data, BufferUsageToGl(buffer->usage));
-		} else {
-			glBufferData(BufferTypeToGl(buffer->type), newSize, NULL, BufferUsageToGl(buffer->usage));
-			glBufferSubData(BufferTypeToGl(buffer->type), offset, size, data);
-		}
-	} else {
-		glBufferSubData(BufferTypeToGl(buffer->type), offset, size, data);
-	}
-
-	buffer->size = newSize;
+	if (!handle) return;
+	glDeleteSamplers(1, &DeviceGetSampler(handle)->id);
+	DevicePoolFree(&gDevice.samplers, handle);
+	InvalidateDeletedObjects();
 }
 
-NuResult nuCreateContext(NuContextCreateInfo const* info, NuAllocator* allocator, NuContext* outContext)
+NuResult nuCreateRenderTarget(NuContext context, NuRenderTargetCreateInfo const* info, NuRenderTarget* pRenderTarget)
 {
 	EnforceInitialized();
-	*outContext = NULL;
-	Context* context = n_new(Context, GetDeviceAllocator(allocator));
-	if (!context) {
-		return NU_ERROR_OUT_OF_MEMORY;
+	*pRenderTarget = 0;
+
+	uint numColorTextures = 0;
+	while (numColorTextures < NU_RENDER_TARGET_MAX_COLOR_TEXTURES && info->colorTextures[numColorTextures]) ++numColorTextures;
+	nEnforce(numColorTextures, "Render targets need at least a color texture.");
+
+	NuSize3i size = DeviceGetTexture(info->colorTextures[0])->size;
+	for (uint i = 0; i < numColorTextures; ++i) {
+		Texture const* texture = DeviceGetTexture(info->colorTextures[i]);
+		nEnforce(texture->type == NU_TEXTURE_TYPE_2D, "Render target color textures must be 2D.");
+		nEnforce(!nuImageFormatIsCompressed((NuImageFormat)texture->format), "Render target color textures cannot be compressed.");
+		nEnforce(texture->size.width == size.width && texture->size.height == size.height, "Render target color textures must have the same size.");
 	}
 
-	NuResult result = nInitGlContext(&gDevice.nglContextManager, info->windowHandle, &context->nglContext);
-	if (result) {
-		nDebugError("Could not initialize OpenGL context for specified window.");
-		return result;
-	}
+	RenderTarget* renderTarget;
+	NuRenderTarget handle = DevicePoolAlloc(&gDevice.renderTargets, &renderTarget);
+	if (!handle) return NU_ERROR_OUT_OF_MEMORY;
 
-	/* initialize opengl context */
+	/* the framebuffer is bound to be built, the pending render target is restored on the next draw */
 	BindContext(context);
-	glEnable(GL_BLEND);
-	
-	/* create default VAO */
-	GLuint vao;
-	glGenVertexArrays(1, &vao);
-	nAssert(vao == 1);
-	glBindVertexArray(vao);
+	State* state = CurrentState();
+	*renderTarget = (RenderTarget) { .context = context, .numColorTextures = numColorTextures };
+	glGenFramebuffers(1, &renderTarget->framebuffer);
+	if (!renderTarget->framebuffer) {
+		nDebugError("Could not create OpenGL framebuffer object.");
+		DevicePoolFree(&gDevice.renderTargets, handle);
+		return NU_FAILURE;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, renderTarget->framebuffer);
+	state->framebuffer = renderTarget->framebuffer;
+	state->dirty |= DIRTY_RENDER_TARGET;
+
+	GLenum drawBuffers[NU_RENDER_TARGET_MAX_COLOR_TEXTURES];
+	for (uint i = 0; i < numColorTextures; ++i) {
+		drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, drawBuffers[i], GL_TEXTURE_2D, DeviceGetTexture(info->colorTextures[i])->id, 0);
+	}
+	glDrawBuffers(numColorTextures, drawBuffers);
+
+	if (info->depthStencil) {
+		glGenRenderbuffers(1, &renderTarget->depthStencil);
+		glBindRenderbuffer(GL_RENDERBUFFER, renderTarget->depthStencil);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size.width, size.height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderTarget->depthStencil);
+	}
 
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		nDebugError("Render target attachments are not supported by the driver.");
+		nuDestroyRenderTarget(handle);
+		return NU_FAILURE;
+	}
 
-	*outContext = context;
+	*pRenderTarget = handle;
 	return NU_SUCCESS;
 }
 
-void nuDestroyContext(NuContext context, NuAllocator* allocator)
+void nuDestroyRenderTarget(NuRenderTarget handle)
 {
 	EnforceInitialized();
-	nDeinitGlContext(&gDevice.nglContextManager, &context->nglContext);
-	n_free(context, GetDeviceAllocator(allocator));
+	if (!handle) return;
+	RenderTarget* renderTarget = DeviceGetRenderTarget(handle);
+
+	/* deleting the bound framebuffer binds the window one */
+	BindContext(renderTarget->context);
+	State* state = CurrentState();
+	if (state->framebuffer == renderTarget->framebuffer) state->framebuffer = 0;
+	if (state->pendingRenderTarget == handle) {
+		state->pendingRenderTarget = 0;
+		state->dirty |= DIRTY_RENDER_TARGET;
+	}
+
+	glDeleteFramebuffers(1, &renderTarget->framebuffer);
+	if (renderTarget->depthStencil) glDeleteRenderbuffers(1, &renderTarget->depthStencil);
+	DevicePoolFree(&gDevice.renderTargets, handle);
 }
 
-NuResult nuCreateTexture(NuTextureCreateInfo const* info, NuAllocator* allocator, NuTexture* ppTexture)
+void nuDeviceSetRenderTarget(NuContext context, NuRenderTarget handle)
 {
 	EnforceInitialized();
-	allocator = nGetDefaultOrAllocator(allocator);
+	State* state = ContextState(context);
+	if (handle) nEnforce(DeviceGetRenderTarget(handle)->context == context, "Render target belongs to another context.");
 
-	*ppTexture = NULL;
-	Texture* pTexture = n_new(Texture, allocator);
-	if (!pTexture) return NU_ERROR_OUT_OF_MEMORY;
+	if (state->pendingRenderTarget == handle) {
+		CountStateChange(state, NU_STATE_CATEGORY_RENDER_TARGET, false);
+		return;
+	}
+	state->pendingRenderTarget = handle;
+	state->dirty |= DIRTY_RENDER_TARGET;
+}
 
-	glGenTextures(1, &pTexture->id);
-	if (!pTexture->id) {
-		nDebugError("Could not create OpenGL texture object.");
-		n_free(pTexture, allocator);
+NuResult nuDeviceReadPixels(NuContext context, uint colorIndex, NuRect2i rect, NuImageFormat format, NuReadback* pReadback)
+{
+	EnforceInitialized();
+	nEnforce(!nuImageFormatIsCompressed(format), "Pixels cannot be read in a compressed format.");
+	nEnforce(rect.size.width && rect.size.height, "Empty rectangle provided.");
+	*pReadback = 0;
+
+	BindContext(context);
+	State* state = CurrentState();
+	ApplyRenderTarget(state);
+	const uint numColorBuffers = state->pendingRenderTarget ? DeviceGetRenderTarget(state->pendingRenderTarget)->numColorTextures : 1;
+	nEnforce(colorIndex < numColorBuffers, "Color index out of the render target bounds.");
+
+	Readback* readback;
+	NuReadback handle = DevicePoolAlloc(&gDevice.readbacks, &readback);
+	if (!handle) return NU_ERROR_OUT_OF_MEMORY;
+
+	const uint size = (uint)nuImageFormatGetDataSize(format, rect.size);
+	if (!AcquireReadbackBuffer(size, &readback->buffer)) {
+		nDebugError("Could not create OpenGL pixel pack buffer.");
+		DevicePoolFree(&gDevice.readbacks, handle);
 		return NU_FAILURE;
 	}
+	readback->format = format;
+	readback->size = rect.size;
 
-	pTexture->type = info->type;
-	pTexture->size = info->size;
-	pTexture->format = info->format;
-
-	*ppTexture = pTexture;
+	/* the copy to the pack buffer is asynchronous, the fence tells when it is done */
+	GLenum pixelFormat, pixelType;
+	ImageFormatToGl(format, &pixelFormat, &pixelType);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadBuffer(state->framebuffer ? GL_COLOR_ATTACHMENT0 + colorIndex : GL_BACK);
+	glReadPixels(rect.position.x, rect.position.y, rect.size.width, rect.size.height, pixelFormat, pixelType, NULL);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	*pReadback = handle;
 	return NU_SUCCESS;
 }
 
-void nuDestroyTexture(NuTexture texture, NuAllocator* allocator)
+bool nuDeviceIsReadbackComplete(NuContext context, NuReadback handle)
 {
 	EnforceInitialized();
-	if (!texture) return;
-	allocator = nGetDefaultOrAllocator(allocator);
-	glDeleteTextures(1, &texture->id);
-	n_free(texture, allocator);
-}
+	Readback* readback = DeviceGetReadback(handle);
+	if (!readback->fence) return true;
 
-void nuTextureUpdateLevels(NuTexture texture, uint baseLevel, uint numLevels, NuImageView const* images)
-{
-	BindTexture(0, texture);
-	GLenum pixelFormat, pixelType;
-
-	switch (texture->type) {
-		case NU_TEXTURE_TYPE_2D:
-			nEnforce(baseLevel == 0, "Level must be zero for 2D textures.");
-			nEnforce(numLevels == 1, "2D textures only have one level.");
-			ImageFormatToGl(images->format, &pixelFormat, &pixelType);
-			glTexImage2D(GL_TEXTURE_2D, 0, kGlTextureInternalFormat[texture->format], texture->size.width, texture->size.height, 0, pixelFormat, pixelType, images->data);
-			break;
-
-		default:
-			nAssert(false);
-			break;
-	}
+	/* flushing makes sure the read is submitted and the fence eventually signals */
+	BindContext(context);
+	GLenum status = glClientWaitSync(readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+	glDeleteSync(readback->fence);
+	readback->fence = 0;
+	return true;
 }
 
-NuResult nuCreateSampler(NuSamplerCreateInfo const* info, NuAllocator* allocator, NuSampler* ppSampler)
+NuResult nuDeviceResolveReadback(NuContext context, NuReadback handle, NuAllocator* allocator, NuImage* pImage)
 {
 	EnforceInitialized();
-	
-	allocator = nGetDefaultOrAllocator(allocator);
-	*ppSampler = NULL;
+	*pImage = NULL;
+	Readback* readback = DeviceGetReadback(handle);
 
-	Sampler* pSampler = n_new(Sampler, allocator);
-	if (!pSampler) return NU_ERROR_OUT_OF_MEMORY;
+	BindContext(context);
+	if (readback->fence) {
+		glClientWaitSync(readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(readback->fence);
+		readback->fence = 0;
+	}
 
-	glGenSamplers(1, &pSampler->id);
-	if (!pSampler->id) {
-		nDebugError("Could not create OpenGL sampler object.");
+	NuImageCreateInfo info = { .format = readback->format, .size = readback->size };
+	NuResult result = nuCreateImage(&info, allocator, pImage);
+	if (result) return result;
+
+	const size_t rowSize = nuImageFormatGetDataSize(readback->format, (NuSize2i) { readback->size.width, 1 });
+	const uint numRows = readback->size.height;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer.id);
+	char const* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rowSize * numRows, GL_MAP_READ_BIT);
+	if (!pixels) {
+		nDebugError("Could not map OpenGL pixel pack buffer.");
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		nuDestroyImage(*pImage, allocator);
+		*pImage = NULL;
 		return NU_FAILURE;
 	}
 
-	pSampler->minFilterMod = info->minFilterMode;
-	pSampler->magFilterMode = info->magFilterMode;
-	pSampler->uWrapMode = info->uWrapMode;
-	pSampler->vWrapMode = info->vWrapMode;
-
-	glSamplerParameterf(pSampler->id, GL_TEXTURE_MIN_FILTER, kGlSamplerFilter[pSampler->minFilterMod]);
-	glSamplerParameterf(pSampler->id, GL_TEXTURE_MAG_FILTER, kGlSamplerFilter[pSampler->magFilterMode]);
-	glSamplerParameterf(pSampler->id, GL_TEXTURE_WRAP_S, kGlSamplerWrapMode[pSampler->uWrapMode]);
-	glSamplerParameterf(pSampler->id, GL_TEXTURE_WRAP_T, kGlSamplerWrapMode[pSampler->vWrapMode]);
+	/* GL rows go bottom to top */
+	char* data = nuImageGetWritableDataPtr(*pImage);
+	for (uint i = 0; i < numRows; ++i) {
+		memcpy(data + rowSize * i, pixels + rowSize * (numRows - 1 - i), rowSize);
+	}
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-	*ppSampler = pSampler;
+	nuDestroyReadback(handle);
 	return NU_SUCCESS;
 }
 
-void nuDestroySampler(NuSampler sampler, NuAllocator* allocator)
+void nuDestroyReadback(NuReadback handle)
 {
-	if (!sampler) return;
-	allocator = nGetDefaultOrAllocator(allocator);
-	glDeleteSamplers(1, &sampler->id);
-	n_free(sampler, allocator);
+	EnforceInitialized();
+	if (!handle) return;
+	Readback* readback = DeviceGetReadback(handle);
+	if (readback->fence) glDeleteSync(readback->fence);
+
+	nSpinLock(&gDevice.readbackLock);
+	ReadbackBuffer* buffer = nArrayPush(&gDevice.readbackBuffers, &gDevice.allocator, ReadbackBuffer);
+	if (buffer) *buffer = readback->buffer;
+	nSpinUnlock(&gDevice.readbackLock);
+	if (!buffer) glDeleteBuffers(1, &readback->buffer.id);
+
+	DevicePoolFree(&gDevice.readbacks, handle);
 }
 
 void nuDeviceClear(NuContext context, NuClearFlags flags, float* color4, float depth, uint stencil)
@@ -624,6 +3067,7 @@ void nuDeviceClear(NuContext context, NuClearFlags flags, float* color4, float d
 	EnforceInitialized();
 	BindContext(context);
 	nEnforce(flags != 0, "Some flag must have been set.");
+	ApplyRenderTarget(CurrentState());
 
 	GLenum glflags = 0;
 	if (flags & NU_CLEAR_COLOR) {
@@ -633,12 +3077,12 @@ void nuDeviceClear(NuContext context, NuClearFlags flags, float* color4, float d
 
 	if (flags & NU_CLEAR_DEPTH) {
 		glClearDepthf(depth);
-		glflags |= GL_COLOR_BUFFER_BIT;
+		glflags |= GL_DEPTH_BUFFER_BIT;
 	}
 
 	if (flags & NU_CLEAR_STENCIL) {
 		glClearStencil(stencil);
-		glflags |= GL_COLOR_BUFFER_BIT;
+		glflags |= GL_STENCIL_BUFFER_BIT;
 	}
 
 	glClear(glflags);
@@ -647,217 +3091,352 @@ void nuDeviceClear(NuContext context, NuClearFlags flags, float* color4, float d
 void nuDeviceSetViewport(NuContext context, NuRect2i rect)
 {
 	EnforceInitialized();
-	BindContext(context);
-	if (memcmp(&rect, &gDevice.currentState->viewport, sizeof rect)) {
-		gDevice.currentState->viewport = rect;
-		glViewport(rect.position.x, rect.position.y, rect.size.width, rect.size.height);
+	State* state = ContextState(context);
+	if (!memcmp(&rect, &state->pendingViewport, sizeof rect)) {
+		CountStateChange(state, NU_STATE_CATEGORY_VIEWPORT, false);
+		return;
 	}
+	state->pendingViewport = rect;
+	state->dirty |= DIRTY_VIEWPORT;
 }
 
-void nuDeviceSetTechnique(NuContext context, NuTechnique const techniqueIndex)
+void nuDeviceSetTechnique(NuContext context, NuTechnique const handle)
 {
 	EnforceInitialized();
-	BindContext(context);
-	Technique const *technique = DeviceGetTechnique(techniqueIndex);
-	
-	if (technique && gDevice.currentState->technique != technique) {
-		gDevice.currentState->technique = technique;
-		glUseProgram(technique->programId);
-	}
-
-	if (gDevice.currentState->vertexLayout != technique->layout) {
-		/* force vertex buffer pointers to be set again */
-		gDevice.currentState->vertexLayoutIsDirty = true;
-		gDevice.currentState->vertexLayout = technique->layout;
-
-		/* activate or deactivate vertex attrib pointers */
-		const uint numActiveAttributes = technique->layout->numAttributes;
-		if (gDevice.currentState->numActiveAttributes != numActiveAttributes) {
-			uint min = min_uint(gDevice.currentState->numActiveAttributes, numActiveAttributes);
-			uint max = max_uint(gDevice.currentState->numActiveAttributes, numActiveAttributes);
-			for (uint i = min; i < numActiveAttributes; ++i) {
-				glEnableVertexAttribArray(i);
-			}
-			for (uint i = numActiveAttributes; i < max; ++i) {
-				glDisableVertexAttribArray(i);
-			}
-		}
-	}
+	State* state = ContextState(context);
+	SetTechnique(state, handle);
+	state->pipeline = 0;
 }
 
 void nuDeviceSetBlendState(NuContext context, NuBlendState const* blendState)
 {
-	static const GLenum nglBlendFuncs[] = {
-		GL_ZERO,
-		GL_ONE,
-		GL_SRC_COLOR,
-		GL_ONE_MINUS_SRC_COLOR,
-		GL_DST_COLOR,
-		GL_ONE_MINUS_DST_COLOR,
-		GL_SRC_ALPHA,
-		GL_ONE_MINUS_SRC_ALPHA,
-		GL_DST_ALPHA,
-		GL_ONE_MINUS_DST_ALPHA,
-		GL_CONSTANT_COLOR,
-		GL_ONE_MINUS_CONSTANT_COLOR,
-		GL_CONSTANT_ALPHA,
-		GL_ONE_MINUS_CONSTANT_ALPHA,
-		GL_SRC_ALPHA_SATURATE,
-		GL_SRC1_COLOR,
-		GL_ONE_MINUS_SRC1_COLOR,
-		GL_SRC1_ALPHA,
-		GL_ONE_MINUS_SRC1_ALPHA,
-	};
-
-	static const GLenum nglBlendEquats[] = {
-		GL_FUNC_ADD,
-		GL_FUNC_SUBTRACT,
-		GL_FUNC_REVERSE_SUBTRACT,
-		GL_MIN,
-		GL_MAX,
-	};
+	EnforceInitialized();
+	State* state = ContextState(context);
+	SetBlendState(state, blendState);
+	state->pipeline = 0;
+}
 
+void nuDeviceSetPipeline(NuContext context, NuPipeline handle)
+{
 	EnforceInitialized();
-	BindContext(context);
+	State* state = ContextState(context);
 
-	if (memcmp(&gDevice.currentState->blendState, blendState, sizeof *blendState)) {
-		gDevice.currentState->blendState = *blendState;
-		glBlendEquationSeparate(nglBlendEquats[blendState->rgbOp], nglBlendEquats[blendState->alphaOp]);
-		glBlendFuncSeparate(nglBlendFuncs[blendState->srcRgbFactor], nglBlendFuncs[blendState->dstRgbFactor], nglBlendFuncs[blendState->srcAlphaFactor], nglBlendFuncs[blendState->dstAlphaFactor]);
+	if (state->pipeline == handle) {
+		CountStateChange(state, NU_STATE_CATEGORY_TECHNIQUE, false);
+		return;
 	}
+
+	Pipeline const* pipeline = DeviceGetPipeline(handle);
+	SetTechnique(state, pipeline->technique);
+	SetBlendState(state, &pipeline->blendState);
+	state->pipeline = handle;
 }
 
 void nuDeviceSetVertexBuffers(NuContext context, uint base, uint count, NuBufferView const *views)
 {
 	EnforceInitialized();
-	BindContext(context);
-	State* currentState = gDevice.currentState;
+	State* state = ContextState(context);
 
-	nEnforce(currentState->technique && currentState->technique->layout, "A technique with a valid input layout must be set before setting vertex buffers.");
+	nEnforce(state->pendingTechnique && state->vertexLayout, "A technique with a valid input layout must be set before setting vertex buffers.");
+	const VertexLayout *layout = DeviceGetVertexLayout(state->vertexLayout);
 
+	/* vertex buffers are applied to the vertex array on draw */
 	for (uint i = 0; i < count; ++i) {
 		uint streamId = i + base;
-		const NuBufferView* view = &views[i];
-		const Buffer* buffer = view->buffer;
-
-		nEnforce(streamId < currentState->technique->layout->numStreams, "Stream too large for currently bound technique input layout.");
+		nEnforce(streamId < layout->numStreams, "Stream too large for currently bound technique input layout.");
+		DeviceGetBuffer(views[i].buffer);
 
-		/* check cache first */
-		if (!currentState->vertexLayoutIsDirty &&
-			(currentState->vertexBuffers[streamId].buffer == buffer && currentState->vertexBuffers[streamId].offset == view->offset)) {
+		bool changed = memcmp(&state->vertexBuffers[streamId], &views[i], sizeof(NuBufferView)) != 0;
+		if (!changed) {
+			CountStateChange(state, NU_STATE_CATEGORY_VERTEX_ARRAY, false);
 			continue;
 		}
+		state->vertexBuffers[streamId] = views[i];
+		state->vertexArrayIsDirty = true;
+	}
+}
 
-		currentState->vertexBuffers[streamId] = *view;
+void nuDeviceSetConstantBuffers(NuContext context, uint base, uint count, NuBufferView const *views)
+{
+	EnforceInitialized();
+	State* state = ContextState(context);
+	nEnforce(base + count <= MAX_NUM_CONSTANT_BUFFERS, "Constant buffers array out of device bounds.");
 
-		const VertexLayout *layout = currentState->technique->layout;
-		const VertexLayoutStream *stream = &layout->streams[streamId];
+	for (uint i = 0; i < count; ++i) {
+		uint index = i + base;
+		DeviceGetBuffer(views[i].buffer);
+		if (!memcmp(&state->constantBuffers[index], &views[i], sizeof(NuBufferView))) {
+			CountStateChange(state, NU_STATE_CATEGORY_CONSTANT_BUFFER, false);
+			continue;
+		}
+		state->constantBuffers[index] = views[i];
+		state->dirtyConstantBuffers |= 1u << index;
+	}
+}
 
-		BindBuffer(buffer);
+NuResult nuDeviceWriteConstants(NuContext context, void const* data, uint size, NuBufferView* pView)
+{
+	EnforceInitialized();
+	nEnforce(size, "Empty constants provided.");
+	*pView = (NuBufferView) { 0 };
+	if (!gDevice.constantRing) return NU_FAILURE;
+	BindContext(context);
 
-		for (uint i = 0; i < stream->numAttributes; ++i) {
-			const VertexLayoutAttribute *attribute = &stream->attributes[i];
+	uint position;
+	Buffer* ring = AllocateConstantRingRange(size, &position);
+	if (!ring) {
+		nDebugWarning("Constant ring exhausted by the frames in flight.");
+		return NU_ERROR_OUT_OF_MEMORY;
+	}
 
-			GLenum gl_type;
-			bool normalized;
-			bool is_integer;
-			UnpackVertexLayoutAttributeTypeToGl(attribute->type, &gl_type, &normalized, &is_integer);
+	if (ring->ring) {
+		memcpy(ring->ring + position, data, size);
+	} else {
+		BindBuffer(ring);
+		glBufferSubData(GL_UNIFORM_BUFFER, position, size, data);
+	}
+	CurrentState()->stats.numBytesUploaded += size;
 
-			const void *offset_ptr = (void*)(uintptr_t)(view->offset + attribute->stride);
+	*pView = (NuBufferView) { gDevice.constantRing, position, size };
+	return NU_SUCCESS;
+}
 
-			if (is_integer) {
-				glVertexAttribIPointer(attribute->location, attribute->dimension, gl_type, stream->stride, offset_ptr);
-			} else {
-				glVertexAttribPointer(attribute->location, attribute->dimension, gl_type, normalized, stream->stride, offset_ptr);
-			}
+void nuDeviceSetTextures(NuContext context, uint base, uint count, NuTexture const* textures, NuSampler const* samplers)
+{
+	EnforceInitialized();
+	State* state = ContextState(context);
+	nEnforce(base + count <= MAX_TEXTURE_UINTS, "Textures array larger than device bounds.");
 
-			glVertexAttribDivisor(attribute->location, stream->instanced != 0);
+	for (uint i = 0; i < count; ++i) {
+		uint unit = i + base;
+		DeviceGetTexture(textures[i]);
+		if (state->pendingTextures[unit] == textures[i]) {
+			CountStateChange(state, NU_STATE_CATEGORY_TEXTURE, false);
+		} else {
+			state->pendingTextures[unit] = textures[i];
+			state->dirtyTextures |= 1u << unit;
 		}
-	}
 
-	currentState->vertexLayoutIsDirty = false;
+		/* null samplers keep the one set to the unit */
+		if (samplers && samplers[i]) nuDeviceSetSamplers(context, unit, 1, &samplers[i]);
+	}
 }
 
-void nuDeviceSetConstantBuffers(NuContext context, uint base, uint count, NuBufferView const *views)
+void nuDeviceSetSamplers(NuContext context, uint base, uint count, NuSampler const* samplers)
 {
 	EnforceInitialized();
-	BindContext(context);
+	State* state = ContextState(context);
+	nEnforce(base + count <= MAX_TEXTURE_UINTS, "Samplers array out of device bounds.");
 
 	for (uint i = 0; i < count; ++i) {
-		uint index = i + base;
-		const NuBufferView* view = &views[index];
-		NuBufferView* cache = &gDevice.currentState->constantBuffers[index];
-		uint size = view->size ? view->size : view->buffer->size;
-		if (cache->buffer != view->buffer || cache->offset != view->offset || cache->size != size) {
-			glBindBufferRange(GL_UNIFORM_BUFFER, index, view->buffer->id, view->offset, size);
-			*cache = *view;
-			cache->size = size;
+		uint unit = i + base;
+		if (state->pendingSamplers[unit] == samplers[i]) {
+			CountStateChange(state, NU_STATE_CATEGORY_SAMPLER, false);
+			continue;
 		}
+		if (samplers[i]) DeviceGetSampler(samplers[i]);
+		state->pendingSamplers[unit] = samplers[i];
+		state->dirtySamplers |= 1u << unit;
 	}
 }
 
-void nuDeviceSetTextures(NuContext context, uint base, uint count, NuTexture const* textures, NuSampler const* samplers)
+void nuDeviceDrawArrays(NuContext context, NuPrimitiveType primitive, uint firstVertex, uint numVertices, uint numInstances)
 {
 	EnforceInitialized();
 	BindContext(context);
-	nEnforce(base + count <= MAX_TEXTURE_UINTS, "Textures array larger than device bounds.");
+	State* state = CurrentState();
+	FlushState(state, false);
+	IssueDrawArrays(state, kGlPrimitiveType[primitive], &(NuDrawArraysCommand) { numVertices, numInstances, firstVertex, 0 });
+}
+
+void nuDeviceDrawIndexed(NuContext context, NuPrimitiveType primitive, NuIndexBufferView indexBuffer, uint firstVertex, uint numIndices, uint numInstances, uint baseVertex)
+{
+	EnforceInitialized();
+	BindContext(context);
+	State* state = CurrentState();
+	FlushState(state, false);
+
+	const Buffer* indices = DeviceGetBuffer(indexBuffer.bufferView.buffer);
+	BindBuffer(indices);
+
+	const GLenum indexType = (GLenum[]) { GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT }[indexBuffer.indexType];
+	const uint indexSize = (uint[]) { 1, 2, 4 }[indexBuffer.indexType];
+	IssueDrawIndexed(state, kGlPrimitiveType[primitive], indexType, indexSize, indices->base + indexBuffer.bufferView.offset, &(NuDrawIndexedCommand) { numIndices, numInstances, 0, (int)baseVertex, 0 });
+}
+
+void nuDeviceMultiDrawArrays(NuContext context, NuPrimitiveType primitive, NuDrawArraysCommand const* commands, uint count)
+{
+	EnforceInitialized();
+	if (!count) return;
+	BindContext(context);
+	State* state = CurrentState();
+	FlushState(state, false);
+	const GLenum mode = kGlPrimitiveType[primitive];
+
+	/* the commands are staged in the persistently mapped constant ring with the base vertex and
+	 * instance applied, then drawn by a single call. Without room in the ring draws are issued one
+	 * by one. */
+	uint position;
+	Buffer* ring = gDevice.multiDrawIndirect && gDevice.persistentStreamBuffers ? AllocateConstantRingRange(sizeof *commands * count, &position) : NULL;
+	if (!ring) {
+		for (uint i = 0; i < count; ++i) IssueDrawArrays(state, mode, &commands[i]);
+		return;
+	}
 
+	NuDrawArraysCommand* staged = (NuDrawArraysCommand*)(ring->ring + position);
 	for (uint i = 0; i < count; ++i) {
-		gDevice.currentState->dirtySamplers[i] = true;
-		BindTexture(base + i, textures[i]);
-		if (samplers[i]) BindSampler(base + i, samplers[i]);
+		nEnforce(gDevice.baseInstance || !commands[i].firstInstance, "Draws with a first instance need GL 4.2 or ARB_base_instance.");
+		staged[i] = commands[i];
+		staged[i].firstVertex += state->baseVertex;
+		staged[i].firstInstance += state->baseInstance;
+		state->stats.numInstances += commands[i].numInstances;
 	}
+	BindIndirectBuffer(state, ring->id);
+	glMultiDrawArraysIndirect(mode, (const void*)(uintptr_t)position, count, 0);
+	state->stats.numDrawCalls++;
 }
 
-void nuDeviceSetSamplers(NuContext context, uint base, uint count, NuSampler const* samplers)
+void nuDeviceMultiDrawIndexed(NuContext context, NuPrimitiveType primitive, NuIndexBufferView indexBuffer, NuDrawIndexedCommand const* commands, uint count)
 {
 	EnforceInitialized();
+	if (!count) return;
 	BindContext(context);
-	nEnforce(base + count <= MAX_TEXTURE_UINTS, "Samplers array out of device bounds.");
-	
+	State* state = CurrentState();
+	FlushState(state, false);
+	const GLenum mode = kGlPrimitiveType[primitive];
+
+	const Buffer* indices = DeviceGetBuffer(indexBuffer.bufferView.buffer);
+	BindBuffer(indices);
+	const GLenum indexType = (GLenum[]) { GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT }[indexBuffer.indexType];
+	const uint indexSize = (uint[]) { 1, 2, 4 }[indexBuffer.indexType];
+	const uint indexOffset = indices->base + indexBuffer.bufferView.offset;
+
+	/* staged as in nuDeviceMultiDrawArrays(), the index buffer offset becomes part of the first index */
+	uint position;
+	Buffer* ring = gDevice.multiDrawIndirect && gDevice.persistentStreamBuffers && indexOffset % indexSize == 0 ? AllocateConstantRingRange(sizeof *commands * count, &position) : NULL;
+	if (!ring) {
+		for (uint i = 0; i < count; ++i) IssueDrawIndexed(state, mode, indexType, indexSize, indexOffset, &commands[i]);
+		return;
+	}
+
+	NuDrawIndexedCommand* staged = (NuDrawIndexedCommand*)(ring->ring + position);
 	for (uint i = 0; i < count; ++i) {
-		if (gDevice.currentState->samplers[i] == samplers[i]) continue;
-		gDevice.currentState->samplers[i + base] = samplers[i];
-		gDevice.currentState->dirtySamplers[i + base] = true;
+		nEnforce(gDevice.baseInstance || !commands[i].firstInstance, "Draws with a first instance need GL 4.2 or ARB_base_instance.");
+		staged[i] = commands[i];
+		staged[i].firstIndex += indexOffset / indexSize;
+		staged[i].baseVertex += state->baseVertex;
+		staged[i].firstInstance += state->baseInstance;
+		state->stats.numInstances += commands[i].numInstances;
 	}
+	BindIndirectBuffer(state, ring->id);
+	glMultiDrawElementsIndirect(mode, indexType, (const void*)(uintptr_t)position, count, 0);
+	state->stats.numDrawCalls++;
 }
 
-void nuDeviceDrawArrays(NuContext context, NuPrimitiveType primitive, uint firstVertex, uint numVertices, uint numInstances)
+void nuDeviceDrawArraysIndirect(NuContext context, NuPrimitiveType primitive, NuBufferView commands, uint count)
 {
 	EnforceInitialized();
+	if (!count) return;
 	BindContext(context);
+	State* state = CurrentState();
+	FlushState(state, gDevice.drawIndirect);
+
+	Buffer const* buffer = DeviceGetBuffer(commands.buffer);
+	nEnforce(buffer->type == NU_BUFFER_TYPE_INDIRECT, "Indirect draws read their commands from indirect buffers.");
+	nEnforce(commands.offset % 4 == 0 && commands.offset + sizeof(NuDrawArraysCommand) * count <= buffer->size, "Draw commands out of the indirect buffer bounds.");
+	const GLenum mode = kGlPrimitiveType[primitive];
+
+	/* without draw indirect the commands are in system memory */
+	if (IsEmulatedIndirectBuffer(buffer)) {
+		NuDrawArraysCommand const* cpuCommands = (NuDrawArraysCommand const*)(buffer->commands + commands.offset);
+		for (uint i = 0; i < count; ++i) IssueDrawArrays(state, mode, &cpuCommands[i]);
+		return;
+	}
 
-	nEnforce(gDevice.currentState->technique, "No valid technique bound to the device.");
-	nEnforce(gDevice.currentState->vertexLayout, "No valid vertex layout bound to the device.");
+	BindIndirectBuffer(state, buffer->id);
+	const uintptr_t offset = buffer->base + commands.offset;
+	if (gDevice.multiDrawIndirect) {
+		glMultiDrawArraysIndirect(mode, (const void*)offset, count, 0);
+		state->stats.numDrawCalls++;
+		return;
+	}
+	for (uint i = 0; i < count; ++i) {
+		glDrawArraysIndirect(mode, (const void*)(offset + sizeof(NuDrawArraysCommand) * i));
+	}
+	state->stats.numDrawCalls += count;
+}
 
-	if (gDevice.currentState->vertexLayoutIsDirty) {
-		nuDeviceSetVertexBuffers(context, 0, gDevice.currentState->numActiveAttributes, gDevice.currentState->vertexBuffers);
+void nuDeviceDrawIndexedIndirect(NuContext context, NuPrimitiveType primitive, NuIndexBufferView indexBuffer, NuBufferView commands, uint count)
+{
+	EnforceInitialized();
+	if (!count) return;
+	BindContext(context);
+	State* state = CurrentState();
+	FlushState(state, gDevice.drawIndirect);
+
+	const Buffer* indices = DeviceGetBuffer(indexBuffer.bufferView.buffer);
+	nEnforce(indices->base + indexBuffer.bufferView.offset == 0, "Indirect indexed draws read indices from the beginning of the index buffer.");
+	BindBuffer(indices);
+
+	Buffer const* buffer = DeviceGetBuffer(commands.buffer);
+	nEnforce(buffer->type == NU_BUFFER_TYPE_INDIRECT, "Indirect draws read their commands from indirect buffers.");
+	nEnforce(commands.offset % 4 == 0 && commands.offset + sizeof(NuDrawIndexedCommand) * count <= buffer->size, "Draw commands out of the indirect buffer bounds.");
+	const GLenum mode = kGlPrimitiveType[primitive];
+	const GLenum indexType = (GLenum[]) { GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT }[indexBuffer.indexType];
+
+	if (IsEmulatedIndirectBuffer(buffer)) {
+		const uint indexSize = (uint[]) { 1, 2, 4 }[indexBuffer.indexType];
+		NuDrawIndexedCommand const* cpuCommands = (NuDrawIndexedCommand const*)(buffer->commands + commands.offset);
+		for (uint i = 0; i < count; ++i) IssueDrawIndexed(state, mode, indexType, indexSize, 0, &cpuCommands[i]);
+		return;
 	}
 
-	glDrawArraysInstanced(kGlPrimitiveType[primitive], firstVertex, numVertices, numInstances);
+	BindIndirectBuffer(state, buffer->id);
+	const uintptr_t offset = buffer->base + commands.offset;
+	if (gDevice.multiDrawIndirect) {
+		glMultiDrawElementsIndirect(mode, indexType, (const void*)offset, count, 0);
+		state->stats.numDrawCalls++;
+		return;
+	}
+	for (uint i = 0; i < count; ++i) {
+		glDrawElementsIndirect(mode, indexType, (const void*)(offset + sizeof(NuDrawIndexedCommand) * i));
+	}
+	state->stats.numDrawCalls += count;
 }
 
-void nuDeviceDrawIndexed(NuContext context, NuPrimitiveType primitive, NuIndexBufferView indexBuffer, uint firstVertex, uint numIndices, uint numInstances, uint baseVertex)
+void nuDeviceSwapBuffers(NuContext context)
 {
 	EnforceInitialized();
 	BindContext(context);
+	FlushUploads();
+	EndDeviceFrame();
+	EndFrameStats(&context->state);
 
-	nEnforce(gDevice.currentState->technique, "No valid technique bound to the device.");
-	nEnforce(gDevice.currentState->vertexLayout, "No valid vertex layout bound to the device.");
-
-	if (gDevice.currentState->vertexLayoutIsDirty) {
-		nuDeviceSetVertexBuffers(context, 0, gDevice.currentState->numActiveAttributes, gDevice.currentState->vertexBuffers);
+	if (gDevice.nullBackend) {
+		NullGlSwapBuffers();
+	} else {
+		nGlContextSwapBuffers(&context->nglContext);
 	}
+}
 
-	BindBuffer(indexBuffer.bufferView.buffer);
+void nuDeviceGetStats(NuContext context, NuDeviceStats* stats)
+{
+	EnforceInitialized();
+	*stats = context ? context->state.stats : gThreadDefaultState.stats;
+}
 
-	GLenum glIndexType = (GLenum[]) { GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT }[indexBuffer.indexType];
-	glDrawElementsInstancedBaseVertex(kGlPrimitiveType[primitive], numIndices, glIndexType, (const void*)(uintptr_t)indexBuffer.bufferView.offset, numInstances, baseVertex);
+void nuDeviceResetStats(NuContext context)
+{
+	EnforceInitialized();
+	State* state = context ? &context->state : &gThreadDefaultState;
+	nZero(&state->stats);
+	nZero(&state->frameBeginStats);
 }
 
-void nuDeviceSwapBuffers(NuContext context)
+void nuDeviceGetFrameStats(NuContext context, NuDeviceFrameStats* stats)
 {
-	nGlContextSwapBuffers(&context->nglContext);
+	EnforceInitialized();
+	*stats = context ? context->state.frameStats : gThreadDefaultState.frameStats;
 }
 
 NuDeviceDefaults const* nuDeviceGetDefaults(void)
@@ -9,11 +9,30 @@
 #include "nunki/device.h"
 
 /**
- * Write the #documentation.
+ * Initializes the device. If \p nullBackend is set no GL context is created and device calls only go as
+ * far as the state cache, optionally recording the backend calls to \p traceFilePath. Linked programs
+ * are cached in \p programCacheDirectory if not null.
  */
-NuResult nInitDevice(NuAllocator* allocator, void* windowHandle);
+NuResult nInitDevice(NuAllocator* allocator, void* windowHandle, bool nullBackend, const char* traceFilePath, const char* programCacheDirectory);
 
 /**
  * Write the #documentation.
  */
 void nDeinitDevice(void);
+
+/**
+ * @returns the system memory copy of \p texture, with null data if the texture was not created with
+ * keepCpuCopy or was never updated. Uploads of level 0 may recreate the copy, so the view must not be
+ * used concurrently with them.
+ */
+NuImageView nTextureGetCpuCopy(NuTexture texture);
+
+/**
+ * @returns the parameters \p sampler was created with.
+ */
+NuSamplerCreateInfo nSamplerGetInfo(NuSampler sampler);
+
+/**
+ * @returns the state baked into \p pipeline, the blend state points into the pipeline itself.
+ */
+NuPipelineCreateInfo nPipelineGetInfo(NuPipeline pipeline);
@@ -0,0 +1,50 @@
+/*
+ * Nunki (simple rendering engine)
+ * Copyright (C) 2015 Canio Massimo Tristano <massimo.tristano@gmail.com>.
+ * For licensing info see LICENSE.
+ */
+
+/* Platforms without a GL context layer, only the null device backend can be used. */
+
+typedef struct {
+	bool initialized;
+} NGlContextManager;
+
+typedef struct {
+	void* windowHandle;
+} NGlContext;
+
+NuResult nInitGlContextManager(NGlContextManager* glCM, void* dummyWindowHandle)
+{
+	nDebugError("No OpenGL context support on this platform, initialize Nunki with the null device backend.");
+	return NU_FAILURE;
+}
+
+void nDeinitGlContextManager(NGlContextManager* glCM)
+{
+}
+
+void nGlContextManagerMakeCurrent(NGlContextManager* glCM)
+{
+}
+
+NuResult nInitGlContext(NGlContextManager* glCM, void* windowHandle, NGlContext* context)
+{
+	return NU_FAILURE;
+}
+
+void nDeinitGlContext(NGlContextManager* glCM, NGlContext* context)
+{
+}
+
+void nGlContextMakeCurrent(NGlContext* context)
+{
+}
+
+void nGlContextRelease(NGlContext* context)
+{
+}
+
+void nGlContextSwapBuffers(NGlContext* context)
+{
+}
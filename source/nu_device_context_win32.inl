@@ -215,7 +215,7 @@ NuResult nInitGlContext(NGlContextManager* glCM, void* windowHandle, NGlContext*
 
 void nDeinitGlContext(NGlContextManager* glCM, NGlContext* context)
 {
-	wglMakeCurrent(NULL, NULL);
+	MakeCurrent(NULL, NULL);
 	if (context->hglrc) wglDeleteContext(context->hglrc);
 	if (context->hdc) ReleaseDC(context->hwnd, context->hdc);
 }
@@ -225,6 +225,11 @@ void nGlContextMakeCurrent(NGlContext* context)
 	MakeCurrent(context->hdc, context->hglrc);
 }
 
+void nGlContextRelease(NGlContext* context)
+{
+	MakeCurrent(NULL, NULL);
+}
+
 void nGlContextSwapBuffers(NGlContext* context)
 {
 	nAssert(context && "Invalid context provided.");
@@ -11,7 +11,7 @@
 
 static inline GLenum BufferTypeToGl(NuBufferType type)
 {
-	return (GLenum[]) { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER }[type];
+	return (GLenum[]) { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_DRAW_INDIRECT_BUFFER }[type];
 }
 
 static inline GLenum BufferUsageToGl(NuBufferUsage usage)
@@ -65,11 +65,20 @@ static const GLenum kGlTextureType[] = {
 	GL_TEXTURE_2D_ARRAY
 };
 
+/* EXT_texture_compression_s3tc, not in glcorearb.h */
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+
 static const kGlTextureInternalFormat[] = {
 	GL_R8,
 	GL_RG8,
 	GL_RGB8,
 	GL_RGBA8,
+	GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+	GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+	GL_COMPRESSED_RED_RGTC1,
+	GL_COMPRESSED_RG_RGTC2,
+	GL_COMPRESSED_RGBA_BPTC_UNORM,
 };
 
 static void ImageFormatToGl(NuImageFormat format, GLenum* pixelFormat, GLenum* pixelType)
@@ -83,14 +92,27 @@ static void ImageFormatToGl(NuImageFormat format, GLenum* pixelFormat, GLenum* p
 	}
 }
 
-static const float kGlSamplerFilter[] = {
+static inline uint GetImageFormatPixelSize(NuImageFormat format)
+{
+	return (uint[]) { 1, 2, 3, 4 }[format];
+}
+
+static const GLint kGlSamplerMinFilter[] = {
 	GL_NEAREST,
 	GL_LINEAR,
 	GL_NEAREST_MIPMAP_NEAREST,
 	GL_LINEAR_MIPMAP_LINEAR,
 };
 
-static const float kGlSamplerWrapMode[] = {
+/* magnification never samples mips, mipmap modes fall back to their in-level filter */
+static const GLint kGlSamplerMagFilter[] = {
+	GL_NEAREST,
+	GL_LINEAR,
+	GL_NEAREST,
+	GL_LINEAR,
+};
+
+static const GLint kGlSamplerWrapMode[] = {
 	GL_CLAMP_TO_EDGE,
 	GL_REPEAT,
 };
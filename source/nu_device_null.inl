@@ -0,0 +1,684 @@
+/*
+ * Nunki (simple rendering engine)
+ * Copyright (C) 2015 Canio Massimo Tristano <massimo.tristano@gmail.com>.
+ * For licensing info see LICENSE.
+ */
+
+/* Null device backend. Instead of creating a GL context, it points the gl3w entry points used by
+ * the device at stubs that do nothing but hand out object names, so that the whole device API (and
+ * its state filtering) runs on machines with no GPU and no window.
+ *
+ * When a trace file is provided, each stubbed GL call is appended to it as a record made of a
+ * uint16 opcode (NullGlOp), a uint16 argument count and that many uint32 arguments. Floats are
+ * stored by bit pattern, pointers and sizes are truncated to 32 bits and buffer or pixel contents
+ * are not stored. The file starts with the 8 bytes magic "NUTRACE1".
+ *
+ * Buffer contents are kept in system memory so that mapping them hands out real memory. The element
+ * array buffer binding is tracked per vertex array as GL does. Fences are always signaled and program
+ * binaries are a fixed token that is always accepted. Framebuffers are always complete and read
+ * pixels have every byte set to the low 8 bits of their window row. Timer queries are always
+ * available and measure zero. */
+
+#include "thirdparty/gl3w.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+	NULL_GL_OP_ACTIVE_TEXTURE,
+	NULL_GL_OP_ATTACH_SHADER,
+	NULL_GL_OP_BEGIN_QUERY,
+	NULL_GL_OP_BIND_BUFFER,
+	NULL_GL_OP_BIND_BUFFER_RANGE,
+	NULL_GL_OP_BIND_FRAMEBUFFER,
+	NULL_GL_OP_BIND_RENDERBUFFER,
+	NULL_GL_OP_BIND_SAMPLER,
+	NULL_GL_OP_BIND_TEXTURE,
+	NULL_GL_OP_BIND_VERTEX_ARRAY,
+	NULL_GL_OP_BLEND_EQUATION_SEPARATE,
+	NULL_GL_OP_BLEND_FUNC_SEPARATE,
+	NULL_GL_OP_BUFFER_DATA,
+	NULL_GL_OP_BUFFER_STORAGE,
+	NULL_GL_OP_BUFFER_SUB_DATA,
+	NULL_GL_OP_CLEAR,
+	NULL_GL_OP_CLEAR_COLOR,
+	NULL_GL_OP_CLEAR_DEPTH,
+	NULL_GL_OP_CLEAR_STENCIL,
+	NULL_GL_OP_CLIENT_WAIT_SYNC,
+	NULL_GL_OP_COMPILE_SHADER,
+	NULL_GL_OP_COMPRESSED_TEX_SUB_IMAGE_2D,
+	NULL_GL_OP_COMPRESSED_TEX_SUB_IMAGE_3D,
+	NULL_GL_OP_CREATE_PROGRAM,
+	NULL_GL_OP_CREATE_SHADER,
+	NULL_GL_OP_DELETE_BUFFERS,
+	NULL_GL_OP_DELETE_FRAMEBUFFERS,
+	NULL_GL_OP_DELETE_PROGRAM,
+	NULL_GL_OP_DELETE_RENDERBUFFERS,
+	NULL_GL_OP_DELETE_SAMPLERS,
+	NULL_GL_OP_DELETE_SHADER,
+	NULL_GL_OP_DELETE_SYNC,
+	NULL_GL_OP_DELETE_TEXTURES,
+	NULL_GL_OP_DELETE_VERTEX_ARRAYS,
+	NULL_GL_OP_DISABLE_VERTEX_ATTRIB_ARRAY,
+	NULL_GL_OP_DRAW_ARRAYS_INDIRECT,
+	NULL_GL_OP_DRAW_ARRAYS_INSTANCED,
+	NULL_GL_OP_DRAW_ARRAYS_INSTANCED_BASE_INSTANCE,
+	NULL_GL_OP_DRAW_BUFFERS,
+	NULL_GL_OP_DRAW_ELEMENTS_INDIRECT,
+	NULL_GL_OP_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX,
+	NULL_GL_OP_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX_BASE_INSTANCE,
+	NULL_GL_OP_ENABLE,
+	NULL_GL_OP_ENABLE_VERTEX_ATTRIB_ARRAY,
+	NULL_GL_OP_END_QUERY,
+	NULL_GL_OP_FENCE_SYNC,
+	NULL_GL_OP_FRAMEBUFFER_RENDERBUFFER,
+	NULL_GL_OP_FRAMEBUFFER_TEXTURE_2D,
+	NULL_GL_OP_GEN_BUFFERS,
+	NULL_GL_OP_GEN_FRAMEBUFFERS,
+	NULL_GL_OP_GEN_QUERIES,
+	NULL_GL_OP_GEN_RENDERBUFFERS,
+	NULL_GL_OP_GEN_SAMPLERS,
+	NULL_GL_OP_GEN_TEXTURES,
+	NULL_GL_OP_GEN_VERTEX_ARRAYS,
+	NULL_GL_OP_LINK_PROGRAM,
+	NULL_GL_OP_MAP_BUFFER_RANGE,
+	NULL_GL_OP_MULTI_DRAW_ARRAYS_INDIRECT,
+	NULL_GL_OP_MULTI_DRAW_ELEMENTS_INDIRECT,
+	NULL_GL_OP_PIXEL_STOREI,
+	NULL_GL_OP_PROGRAM_BINARY,
+	NULL_GL_OP_PROGRAM_PARAMETER_I,
+	NULL_GL_OP_READ_BUFFER,
+	NULL_GL_OP_READ_PIXELS,
+	NULL_GL_OP_RENDERBUFFER_STORAGE,
+	NULL_GL_OP_SAMPLER_PARAMETERI,
+	NULL_GL_OP_SHADER_SOURCE,
+	NULL_GL_OP_TEX_IMAGE_1D,
+	NULL_GL_OP_TEX_IMAGE_2D,
+	NULL_GL_OP_TEX_IMAGE_3D,
+	NULL_GL_OP_TEX_PARAMETERI,
+	NULL_GL_OP_TEX_STORAGE_1D,
+	NULL_GL_OP_TEX_STORAGE_2D,
+	NULL_GL_OP_TEX_STORAGE_3D,
+	NULL_GL_OP_TEX_SUB_IMAGE_1D,
+	NULL_GL_OP_TEX_SUB_IMAGE_2D,
+	NULL_GL_OP_TEX_SUB_IMAGE_3D,
+	NULL_GL_OP_UNIFORM_1I,
+	NULL_GL_OP_UNIFORM_BLOCK_BINDING,
+	NULL_GL_OP_UNMAP_BUFFER,
+	NULL_GL_OP_USE_PROGRAM,
+	NULL_GL_OP_VERTEX_ATTRIB_DIVISOR,
+	NULL_GL_OP_VERTEX_ATTRIB_I_POINTER,
+	NULL_GL_OP_VERTEX_ATTRIB_POINTER,
+	NULL_GL_OP_VIEWPORT,
+	NULL_GL_OP_SWAP_BUFFERS, /* not a GL call, marks the end of a frame */
+} NullGlOp;
+
+typedef struct {
+	void*  data;
+	size_t size;
+} NullGlBuffer;
+
+enum {
+	NULL_GL_NUM_BUFFER_TARGETS = 6,
+	NULL_GL_NUM_CACHED_BUFFER_TARGETS = 4, /* targets tracked by the device state cache */
+};
+
+static struct {
+	NuAllocator      allocator;
+	FILE*            trace;
+	int32_t volatile traceLock;
+	int32_t volatile nextName;
+	int32_t volatile buffersLock;    /* guards the arrays below and the buffers, contexts are per thread */
+	NullGlBuffer**   buffers;        /* nArray indexed by buffer name, null if never specified */
+	GLuint*          elementBuffers; /* nArray of the element array buffer of each vertex array, by name */
+} gNullGl;
+
+/* buffers bound to each target, GL bindings are per context and contexts are per thread */
+static n_threadlocal GLuint gNullGlBoundBuffers[NULL_GL_NUM_BUFFER_TARGETS];
+static n_threadlocal GLuint gNullGlBoundVertexArray;
+
+static void TraceCall(NullGlOp op, uint32_t const* args, uint numArgs)
+{
+	if (!gNullGl.trace) return;
+	uint16_t header[2] = { (uint16_t)op, (uint16_t)numArgs };
+	nSpinLock(&gNullGl.traceLock);
+	fwrite(header, sizeof header, 1, gNullGl.trace);
+	fwrite(args, sizeof *args, numArgs, gNullGl.trace);
+	nSpinUnlock(&gNullGl.traceLock);
+}
+
+#define NullTrace(op, ...) { const uint32_t args_[] = { __VA_ARGS__ }; TraceCall(op, args_, sizeof args_ / sizeof *args_); }
+
+static inline uint32_t FloatBits(float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof bits);
+	return bits;
+}
+
+static inline GLuint NewName(void)
+{
+	return (GLuint)nAtomicAdd32(&gNullGl.nextName, 1);
+}
+
+static void GenNames(NullGlOp op, GLsizei n, GLuint* names)
+{
+	for (GLsizei i = 0; i < n; ++i) {
+		names[i] = NewName();
+		NullTrace(op, names[i]);
+	}
+}
+
+static void DeleteNames(NullGlOp op, GLsizei n, GLuint const* names)
+{
+	for (GLsizei i = 0; i < n; ++i) {
+		NullTrace(op, names[i]);
+	}
+}
+
+static uint NullGlBufferTargetIndex(GLenum target)
+{
+	switch (target) {
+		case GL_ARRAY_BUFFER: return 0;
+		case GL_ELEMENT_ARRAY_BUFFER: return 1;
+		case GL_UNIFORM_BUFFER: return 2;
+		case GL_DRAW_INDIRECT_BUFFER: return 3;
+		case GL_PIXEL_UNPACK_BUFFER: return 4;
+		case GL_PIXEL_PACK_BUFFER: return 5;
+	}
+	nAssert(false);
+	return 0;
+}
+
+/**
+ * @returns the element array buffer binding slot of \p vertexArray, buffersLock must be held.
+ */
+static GLuint* NullGlElementBufferSlot(GLuint vertexArray)
+{
+	if (nArrayLen(gNullGl.elementBuffers) <= vertexArray) {
+		size_t count = vertexArray + 1 - nArrayLen(gNullGl.elementBuffers);
+		GLuint* added = nArrayPushN(&gNullGl.elementBuffers, &gNullGl.allocator, GLuint, count);
+		nEnforce(added, "Out of memory.");
+		memset(added, 0, sizeof(GLuint) * count);
+	}
+	return &gNullGl.elementBuffers[vertexArray];
+}
+
+static GLuint NullGlGetElementBuffer(GLuint vertexArray)
+{
+	nSpinLock(&gNullGl.buffersLock);
+	GLuint elementBuffer = *NullGlElementBufferSlot(vertexArray);
+	nSpinUnlock(&gNullGl.buffersLock);
+	return elementBuffer;
+}
+
+static void NullGlSetElementBuffer(GLuint vertexArray, GLuint buffer)
+{
+	nSpinLock(&gNullGl.buffersLock);
+	*NullGlElementBufferSlot(vertexArray) = buffer;
+	nSpinUnlock(&gNullGl.buffersLock);
+}
+
+/**
+ * @returns the buffer bound to \p target, after resizing it to \p size bytes if not zero. Buffers are
+ * allocated individually, so the returned pointer is stable until the buffer is deleted and its data
+ * until it is respecified.
+ */
+static NullGlBuffer* NullGlGetBoundBuffer(GLenum target, size_t size)
+{
+	GLuint name = gNullGlBoundBuffers[NullGlBufferTargetIndex(target)];
+	nAssert(name);
+
+	NuAllocator* allocator = &gNullGl.allocator;
+	nSpinLock(&gNullGl.buffersLock);
+	if (nArrayLen(gNullGl.buffers) <= name) {
+		size_t count = name + 1 - nArrayLen(gNullGl.buffers);
+		NullGlBuffer** added = nArrayPushN(&gNullGl.buffers, allocator, NullGlBuffer*, count);
+		nEnforce(added, "Out of memory.");
+		memset(added, 0, sizeof(NullGlBuffer*) * count);
+	}
+	NullGlBuffer* buffer = gNullGl.buffers[name];
+	if (!buffer) {
+		buffer = gNullGl.buffers[name] = n_new(NullGlBuffer, allocator);
+		nEnforce(buffer, "Out of memory.");
+	}
+	if (size) {
+		if (buffer->data) n_free(buffer->data, allocator);
+		buffer->data = n_malloc(size, allocator);
+		nEnforce(buffer->data, "Out of memory.");
+		buffer->size = size;
+	}
+	nSpinUnlock(&gNullGl.buffersLock);
+	return buffer;
+}
+
+static void APIENTRY NullActiveTexture(GLenum texture) { NullTrace(NULL_GL_OP_ACTIVE_TEXTURE, texture); }
+static void APIENTRY NullAttachShader(GLuint program, GLuint shader) { NullTrace(NULL_GL_OP_ATTACH_SHADER, program, shader); }
+static void APIENTRY NullBeginQuery(GLenum target, GLuint id) { NullTrace(NULL_GL_OP_BEGIN_QUERY, target, id); }
+static void APIENTRY NullBindBuffer(GLenum target, GLuint buffer)
+{
+	gNullGlBoundBuffers[NullGlBufferTargetIndex(target)] = buffer;
+	if (target == GL_ELEMENT_ARRAY_BUFFER) NullGlSetElementBuffer(gNullGlBoundVertexArray, buffer);
+	NullTrace(NULL_GL_OP_BIND_BUFFER, target, buffer);
+}
+
+static void APIENTRY NullBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	/* indexed bindings also set the generic binding point */
+	gNullGlBoundBuffers[NullGlBufferTargetIndex(target)] = buffer;
+	NullTrace(NULL_GL_OP_BIND_BUFFER_RANGE, target, index, buffer, (uint32_t)offset, (uint32_t)size);
+}
+static void APIENTRY NullBindFramebuffer(GLenum target, GLuint framebuffer) { NullTrace(NULL_GL_OP_BIND_FRAMEBUFFER, target, framebuffer); }
+static void APIENTRY NullBindRenderbuffer(GLenum target, GLuint renderbuffer) { NullTrace(NULL_GL_OP_BIND_RENDERBUFFER, target, renderbuffer); }
+static void APIENTRY NullBindSampler(GLuint unit, GLuint sampler) { NullTrace(NULL_GL_OP_BIND_SAMPLER, unit, sampler); }
+static void APIENTRY NullBindTexture(GLenum target, GLuint texture) { NullTrace(NULL_GL_OP_BIND_TEXTURE, target, texture); }
+static void APIENTRY NullBindVertexArray(GLuint array)
+{
+	gNullGlBoundVertexArray = array;
+	gNullGlBoundBuffers[NullGlBufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = NullGlGetElementBuffer(array);
+	NullTrace(NULL_GL_OP_BIND_VERTEX_ARRAY, array);
+}
+
+static void APIENTRY NullBlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha) { NullTrace(NULL_GL_OP_BLEND_EQUATION_SEPARATE, modeRGB, modeAlpha); }
+static void APIENTRY NullBlendFuncSeparate(GLenum sfactorRGB, GLenum dfactorRGB, GLenum sfactorAlpha, GLenum dfactorAlpha) { NullTrace(NULL_GL_OP_BLEND_FUNC_SEPARATE, sfactorRGB, dfactorRGB, sfactorAlpha, dfactorAlpha); }
+
+static void APIENTRY NullBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+	NullGlBuffer* buffer = NullGlGetBoundBuffer(target, size);
+	if (data) memcpy(buffer->data, data, size);
+	NullTrace(NULL_GL_OP_BUFFER_DATA, target, (uint32_t)size, data != NULL, usage);
+}
+
+static void APIENTRY NullBufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags)
+{
+	NullGlBuffer* buffer = NullGlGetBoundBuffer(target, size);
+	if (data) memcpy(buffer->data, data, size);
+	NullTrace(NULL_GL_OP_BUFFER_STORAGE, target, (uint32_t)size, data != NULL, flags);
+}
+
+static void APIENTRY NullBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+	NullGlBuffer* buffer = NullGlGetBoundBuffer(target, 0);
+	nAssert((size_t)(offset + size) <= buffer->size);
+	if (size) memcpy((char*)buffer->data + offset, data, size);
+	NullTrace(NULL_GL_OP_BUFFER_SUB_DATA, target, (uint32_t)offset, (uint32_t)size);
+}
+
+static void* APIENTRY NullMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+	NullGlBuffer* buffer = NullGlGetBoundBuffer(target, 0);
+	nAssert((size_t)(offset + length) <= buffer->size);
+	NullTrace(NULL_GL_OP_MAP_BUFFER_RANGE, target, (uint32_t)offset, (uint32_t)length, access);
+	return (char*)buffer->data + offset;
+}
+
+/**
+ * Checks that the \p drawcount commands at \p indirect fit the bound draw indirect buffer.
+ */
+static void NullGlCheckIndirectCommands(void const* indirect, GLsizei drawcount, GLsizei stride, size_t commandSize)
+{
+	nAssert((uintptr_t)indirect % 4 == 0);
+	nAssert((uintptr_t)indirect + (stride ? (size_t)stride : commandSize) * (size_t)drawcount <= NullGlGetBoundBuffer(GL_DRAW_INDIRECT_BUFFER, 0)->size);
+}
+
+static void APIENTRY NullDrawArraysIndirect(GLenum mode, const void* indirect)
+{
+	NullGlCheckIndirectCommands(indirect, 1, 0, 4 * sizeof(GLuint));
+	NullTrace(NULL_GL_OP_DRAW_ARRAYS_INDIRECT, mode, (uint32_t)(uintptr_t)indirect);
+}
+
+static void APIENTRY NullDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect)
+{
+	NullGlCheckIndirectCommands(indirect, 1, 0, 5 * sizeof(GLuint));
+	NullTrace(NULL_GL_OP_DRAW_ELEMENTS_INDIRECT, mode, type, (uint32_t)(uintptr_t)indirect);
+}
+
+static void APIENTRY NullMultiDrawArraysIndirect(GLenum mode, const void* indirect, GLsizei drawcount, GLsizei stride)
+{
+	NullGlCheckIndirectCommands(indirect, drawcount, stride, 4 * sizeof(GLuint));
+	NullTrace(NULL_GL_OP_MULTI_DRAW_ARRAYS_INDIRECT, mode, (uint32_t)(uintptr_t)indirect, drawcount, stride);
+}
+
+static void APIENTRY NullMultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride)
+{
+	NullGlCheckIndirectCommands(indirect, drawcount, stride, 5 * sizeof(GLuint));
+	NullTrace(NULL_GL_OP_MULTI_DRAW_ELEMENTS_INDIRECT, mode, type, (uint32_t)(uintptr_t)indirect, drawcount, stride);
+}
+
+static GLboolean APIENTRY NullUnmapBuffer(GLenum target)
+{
+	NullTrace(NULL_GL_OP_UNMAP_BUFFER, target);
+	return GL_TRUE;
+}
+
+static GLsync APIENTRY NullFenceSync(GLenum condition, GLbitfield flags)
+{
+	GLuint name = NewName();
+	NullTrace(NULL_GL_OP_FENCE_SYNC, name);
+	return (GLsync)(uintptr_t)name;
+}
+
+static GLenum APIENTRY NullClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	NullTrace(NULL_GL_OP_CLIENT_WAIT_SYNC, (uint32_t)(uintptr_t)sync, flags);
+	return GL_ALREADY_SIGNALED;
+}
+
+static void APIENTRY NullDeleteSync(GLsync sync) { NullTrace(NULL_GL_OP_DELETE_SYNC, (uint32_t)(uintptr_t)sync); }
+
+static void APIENTRY NullClear(GLbitfield mask) { NullTrace(NULL_GL_OP_CLEAR, mask); }
+static void APIENTRY NullClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) { NullTrace(NULL_GL_OP_CLEAR_COLOR, FloatBits(red), FloatBits(green), FloatBits(blue), FloatBits(alpha)); }
+static void APIENTRY NullClearDepthf(GLfloat d) { NullTrace(NULL_GL_OP_CLEAR_DEPTH, FloatBits(d)); }
+static void APIENTRY NullClearStencil(GLint s) { NullTrace(NULL_GL_OP_CLEAR_STENCIL, s); }
+static void APIENTRY NullCompileShader(GLuint shader) { NullTrace(NULL_GL_OP_COMPILE_SHADER, shader); }
+static void APIENTRY NullCompressedTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const void* data) { NullTrace(NULL_GL_OP_COMPRESSED_TEX_SUB_IMAGE_2D, target, level, xoffset, yoffset, width, height, format, imageSize, (uint32_t)(uintptr_t)data); }
+static void APIENTRY NullCompressedTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLsizei imageSize, const void* data) { NullTrace(NULL_GL_OP_COMPRESSED_TEX_SUB_IMAGE_3D, target, level, xoffset, yoffset, zoffset, width, height, depth, format, imageSize, (uint32_t)(uintptr_t)data); }
+static void APIENTRY NullDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	NuAllocator* allocator = &gNullGl.allocator;
+	for (GLsizei i = 0; i < n; ++i) {
+		nSpinLock(&gNullGl.buffersLock);
+		NullGlBuffer* buffer = buffers[i] < nArrayLen(gNullGl.buffers) ? gNullGl.buffers[buffers[i]] : NULL;
+		if (buffer) {
+			if (buffer->data) n_free(buffer->data, allocator);
+			n_free(buffer, allocator);
+			gNullGl.buffers[buffers[i]] = NULL;
+		}
+		nSpinUnlock(&gNullGl.buffersLock);
+
+		for (uint target = 0; target < NULL_GL_NUM_BUFFER_TARGETS; ++target) {
+			if (gNullGlBoundBuffers[target] == buffers[i]) gNullGlBoundBuffers[target] = 0;
+		}
+	}
+	DeleteNames(NULL_GL_OP_DELETE_BUFFERS, n, buffers);
+}
+
+static void APIENTRY NullDeleteFramebuffers(GLsizei n, const GLuint* framebuffers) { DeleteNames(NULL_GL_OP_DELETE_FRAMEBUFFERS, n, framebuffers); }
+static void APIENTRY NullDeleteProgram(GLuint program) { NullTrace(NULL_GL_OP_DELETE_PROGRAM, program); }
+static void APIENTRY NullDeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers) { DeleteNames(NULL_GL_OP_DELETE_RENDERBUFFERS, n, renderbuffers); }
+static void APIENTRY NullDeleteSamplers(GLsizei n, const GLuint* samplers) { DeleteNames(NULL_GL_OP_DELETE_SAMPLERS, n, samplers); }
+static void APIENTRY NullDeleteShader(GLuint shader) { NullTrace(NULL_GL_OP_DELETE_SHADER, shader); }
+static void APIENTRY NullDeleteTextures(GLsizei n, const GLuint* textures) { DeleteNames(NULL_GL_OP_DELETE_TEXTURES, n, textures); }
+static void APIENTRY NullDeleteVertexArrays(GLsizei n, const GLuint* arrays)
+{
+	for (GLsizei i = 0; i < n; ++i) {
+		NullGlSetElementBuffer(arrays[i], 0);
+		if (gNullGlBoundVertexArray == arrays[i]) NullBindVertexArray(0);
+	}
+	DeleteNames(NULL_GL_OP_DELETE_VERTEX_ARRAYS, n, arrays);
+}
+
+static void APIENTRY NullDisableVertexAttribArray(GLuint index) { NullTrace(NULL_GL_OP_DISABLE_VERTEX_ATTRIB_ARRAY, index); }
+static void APIENTRY NullDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount) { NullTrace(NULL_GL_OP_DRAW_ARRAYS_INSTANCED, mode, first, count, instancecount); }
+static void APIENTRY NullDrawArraysInstancedBaseInstance(GLenum mode, GLint first, GLsizei count, GLsizei instancecount, GLuint baseinstance) { NullTrace(NULL_GL_OP_DRAW_ARRAYS_INSTANCED_BASE_INSTANCE, mode, first, count, instancecount, baseinstance); }
+static void APIENTRY NullDrawBuffers(GLsizei n, const GLenum* bufs) { NullTrace(NULL_GL_OP_DRAW_BUFFERS, n, n ? bufs[0] : 0); }
+static void APIENTRY NullDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount, GLint basevertex) { NullTrace(NULL_GL_OP_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX, mode, count, type, (uint32_t)(uintptr_t)indices, instancecount, basevertex); }
+static void APIENTRY NullDrawElementsInstancedBaseVertexBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount, GLint basevertex, GLuint baseinstance) { NullTrace(NULL_GL_OP_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX_BASE_INSTANCE, mode, count, type, (uint32_t)(uintptr_t)indices, instancecount, basevertex, baseinstance); }
+static void APIENTRY NullEnable(GLenum cap) { NullTrace(NULL_GL_OP_ENABLE, cap); }
+static void APIENTRY NullEnableVertexAttribArray(GLuint index) { NullTrace(NULL_GL_OP_ENABLE_VERTEX_ATTRIB_ARRAY, index); }
+static void APIENTRY NullEndQuery(GLenum target) { NullTrace(NULL_GL_OP_END_QUERY, target); }
+static void APIENTRY NullFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer) { NullTrace(NULL_GL_OP_FRAMEBUFFER_RENDERBUFFER, target, attachment, renderbuffertarget, renderbuffer); }
+static void APIENTRY NullFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) { NullTrace(NULL_GL_OP_FRAMEBUFFER_TEXTURE_2D, target, attachment, textarget, texture, level); }
+static void APIENTRY NullGenBuffers(GLsizei n, GLuint* buffers) { GenNames(NULL_GL_OP_GEN_BUFFERS, n, buffers); }
+static void APIENTRY NullGenFramebuffers(GLsizei n, GLuint* framebuffers) { GenNames(NULL_GL_OP_GEN_FRAMEBUFFERS, n, framebuffers); }
+static void APIENTRY NullGenQueries(GLsizei n, GLuint* ids) { GenNames(NULL_GL_OP_GEN_QUERIES, n, ids); }
+static void APIENTRY NullGenRenderbuffers(GLsizei n, GLuint* renderbuffers) { GenNames(NULL_GL_OP_GEN_RENDERBUFFERS, n, renderbuffers); }
+static void APIENTRY NullGenSamplers(GLsizei n, GLuint* samplers) { GenNames(NULL_GL_OP_GEN_SAMPLERS, n, samplers); }
+static void APIENTRY NullGenTextures(GLsizei n, GLuint* textures) { GenNames(NULL_GL_OP_GEN_TEXTURES, n, textures); }
+static void APIENTRY NullGenVertexArrays(GLsizei n, GLuint* arrays) { GenNames(NULL_GL_OP_GEN_VERTEX_ARRAYS, n, arrays); }
+static void APIENTRY NullLinkProgram(GLuint program) { NullTrace(NULL_GL_OP_LINK_PROGRAM, program); }
+static void APIENTRY NullSamplerParameteri(GLuint sampler, GLenum pname, GLint param) { NullTrace(NULL_GL_OP_SAMPLER_PARAMETERI, sampler, pname, param); }
+static void APIENTRY NullShaderSource(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length) { NullTrace(NULL_GL_OP_SHADER_SOURCE, shader, count); }
+static void APIENTRY NullPixelStorei(GLenum pname, GLint param) { NullTrace(NULL_GL_OP_PIXEL_STOREI, pname, param); }
+static void APIENTRY NullTexImage1D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLint border, GLenum format, GLenum type, const void* pixels) { NullTrace(NULL_GL_OP_TEX_IMAGE_1D, target, level, internalformat, width, format, type); }
+static void APIENTRY NullTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels) { NullTrace(NULL_GL_OP_TEX_IMAGE_2D, target, level, internalformat, width, height, format, type); }
+static void APIENTRY NullTexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels) { NullTrace(NULL_GL_OP_TEX_IMAGE_3D, target, level, internalformat, width, height, depth, format, type); }
+static void APIENTRY NullTexParameteri(GLenum target, GLenum pname, GLint param) { NullTrace(NULL_GL_OP_TEX_PARAMETERI, target, pname, param); }
+static void APIENTRY NullTexStorage1D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width) { NullTrace(NULL_GL_OP_TEX_STORAGE_1D, target, levels, internalformat, width); }
+static void APIENTRY NullTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height) { NullTrace(NULL_GL_OP_TEX_STORAGE_2D, target, levels, internalformat, width, height); }
+static void APIENTRY NullTexStorage3D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth) { NullTrace(NULL_GL_OP_TEX_STORAGE_3D, target, levels, internalformat, width, height, depth); }
+static void APIENTRY NullTexSubImage1D(GLenum target, GLint level, GLint xoffset, GLsizei width, GLenum format, GLenum type, const void* pixels) { NullTrace(NULL_GL_OP_TEX_SUB_IMAGE_1D, target, level, xoffset, width, format, type, (uint32_t)(uintptr_t)pixels); }
+static void APIENTRY NullTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels) { NullTrace(NULL_GL_OP_TEX_SUB_IMAGE_2D, target, level, xoffset, yoffset, width, height, format, type, (uint32_t)(uintptr_t)pixels); }
+static void APIENTRY NullTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels) { NullTrace(NULL_GL_OP_TEX_SUB_IMAGE_3D, target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, (uint32_t)(uintptr_t)pixels); }
+static void APIENTRY NullUniform1i(GLint location, GLint v0) { NullTrace(NULL_GL_OP_UNIFORM_1I, location, v0); }
+static void APIENTRY NullUniformBlockBinding(GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding) { NullTrace(NULL_GL_OP_UNIFORM_BLOCK_BINDING, program, uniformBlockIndex, uniformBlockBinding); }
+static void APIENTRY NullProgramBinary(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length) { NullTrace(NULL_GL_OP_PROGRAM_BINARY, program, binaryFormat, length); }
+static void APIENTRY NullProgramParameteri(GLuint program, GLenum pname, GLint value) { NullTrace(NULL_GL_OP_PROGRAM_PARAMETER_I, program, pname, value); }
+static void APIENTRY NullReadBuffer(GLenum src) { NullTrace(NULL_GL_OP_READ_BUFFER, src); }
+
+static void APIENTRY NullReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels)
+{
+	nAssert(type == GL_UNSIGNED_BYTE);
+	const size_t rowSize = (size_t)width * (format == GL_RED ? 1 : format == GL_RG ? 2 : format == GL_RGB ? 3 : 4);
+
+	/* pixels is an offset in the pixel pack buffer if one is bound */
+	char* data = pixels;
+	if (gNullGlBoundBuffers[NullGlBufferTargetIndex(GL_PIXEL_PACK_BUFFER)]) {
+		NullGlBuffer* buffer = NullGlGetBoundBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		nAssert((uintptr_t)pixels + rowSize * height <= buffer->size);
+		data = (char*)buffer->data + (uintptr_t)pixels;
+	}
+	for (GLsizei i = 0; i < height; ++i) {
+		memset(data + rowSize * i, (y + i) & 0xff, rowSize);
+	}
+	NullTrace(NULL_GL_OP_READ_PIXELS, x, y, width, height, format, type, (uint32_t)(uintptr_t)pixels);
+}
+
+static void APIENTRY NullRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height) { NullTrace(NULL_GL_OP_RENDERBUFFER_STORAGE, target, internalformat, width, height); }
+static void APIENTRY NullUseProgram(GLuint program) { NullTrace(NULL_GL_OP_USE_PROGRAM, program); }
+static void APIENTRY NullVertexAttribDivisor(GLuint index, GLuint divisor) { NullTrace(NULL_GL_OP_VERTEX_ATTRIB_DIVISOR, index, divisor); }
+static void APIENTRY NullVertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer) { NullTrace(NULL_GL_OP_VERTEX_ATTRIB_I_POINTER, index, size, type, stride, (uint32_t)(uintptr_t)pointer); }
+static void APIENTRY NullVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer) { NullTrace(NULL_GL_OP_VERTEX_ATTRIB_POINTER, index, size, type, normalized, stride, (uint32_t)(uintptr_t)pointer); }
+static void APIENTRY NullViewport(GLint x, GLint y, GLsizei width, GLsizei height) { NullTrace(NULL_GL_OP_VIEWPORT, x, y, width, height); }
+
+static GLuint APIENTRY NullCreateProgram(void)
+{
+	GLuint program = NewName();
+	NullTrace(NULL_GL_OP_CREATE_PROGRAM, program);
+	return program;
+}
+
+static GLuint APIENTRY NullCreateShader(GLenum type)
+{
+	GLuint shader = NewName();
+	NullTrace(NULL_GL_OP_CREATE_SHADER, type, shader);
+	return shader;
+}
+
+/* queries are not traced, shaders always compile and link and every uniform exists */
+static const char kNullGlProgramBinary[] = "NULLPROG";
+
+/* extensions whose entry points the null device implements */
+static const char* const kNullGlExtensions[] = {
+	"GL_ARB_base_instance",
+	"GL_ARB_buffer_storage",
+	"GL_ARB_draw_indirect",
+	"GL_ARB_multi_draw_indirect",
+	"GL_ARB_texture_storage",
+};
+
+static void APIENTRY NullGetShaderiv(GLuint shader, GLenum pname, GLint* params) { *params = GL_TRUE; }
+static void APIENTRY NullGetProgramiv(GLuint program, GLenum pname, GLint* params) { *params = pname == GL_PROGRAM_BINARY_LENGTH ? sizeof kNullGlProgramBinary : GL_TRUE; }
+static void APIENTRY NullGetIntegerv(GLenum pname, GLint* data)
+{
+	switch (pname) {
+		case GL_NUM_PROGRAM_BINARY_FORMATS: *data = 1; break;
+		case GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT: *data = 256; break;
+		case GL_NUM_EXTENSIONS: *data = sizeof kNullGlExtensions / sizeof *kNullGlExtensions; break;
+		default: *data = 0; break;
+	}
+}
+static void APIENTRY NullGetQueryObjectiv(GLuint id, GLenum pname, GLint* params) { *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0; }
+static void APIENTRY NullGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64* params) { *params = 0; }
+static GLenum APIENTRY NullCheckFramebufferStatus(GLenum target) { return GL_FRAMEBUFFER_COMPLETE; }
+static const GLubyte* APIENTRY NullGetString(GLenum name) { return (const GLubyte*)"Nunki null device"; }
+static const GLubyte* APIENTRY NullGetStringi(GLenum name, GLuint index) { return index < sizeof kNullGlExtensions / sizeof *kNullGlExtensions ? (const GLubyte*)kNullGlExtensions[index] : NULL; }
+
+static void APIENTRY NullGetProgramBinary(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary)
+{
+	GLsizei size = min_int(bufSize, sizeof kNullGlProgramBinary);
+	memcpy(binary, kNullGlProgramBinary, size);
+	if (length) *length = size;
+	*binaryFormat = 1;
+}
+static void APIENTRY NullGetInfoLog(GLuint object, GLsizei bufSize, GLsizei* length, GLchar* infoLog) { if (length) *length = 0; if (bufSize) *infoLog = 0; }
+static GLuint APIENTRY NullGetUniformBlockIndex(GLuint program, const GLchar* uniformBlockName) { return 0; }
+static GLint APIENTRY NullGetUniformLocation(GLuint program, const GLchar* name) { return 0; }
+
+/**
+ * Routes the GL entry points used by the device to the null stubs and opens \p traceFilePath for
+ * writing if not null. Buffer contents are allocated from \p allocator.
+ */
+static NuResult InitNullGl(NuAllocator* allocator, const char* traceFilePath)
+{
+	nZero(&gNullGl);
+	gNullGl.allocator = *allocator;
+	gNullGl.nextName = 1;
+
+	if (traceFilePath) {
+#ifdef _MSC_VER
+		fopen_s(&gNullGl.trace, traceFilePath, "wb");
+#else
+		gNullGl.trace = fopen(traceFilePath, "wb");
+#endif
+		if (!gNullGl.trace) {
+			nDebugError("Could not open device trace file '%s'.", traceFilePath);
+			return NU_FAILURE;
+		}
+		fwrite("NUTRACE1", 8, 1, gNullGl.trace);
+	}
+
+	gl3wActiveTexture = NullActiveTexture;
+	gl3wAttachShader = NullAttachShader;
+	gl3wBeginQuery = NullBeginQuery;
+	gl3wBindBuffer = NullBindBuffer;
+	gl3wBindBufferRange = NullBindBufferRange;
+	gl3wBindFramebuffer = NullBindFramebuffer;
+	gl3wBindRenderbuffer = NullBindRenderbuffer;
+	gl3wBindSampler = NullBindSampler;
+	gl3wBindTexture = NullBindTexture;
+	gl3wBindVertexArray = NullBindVertexArray;
+	gl3wBlendEquationSeparate = NullBlendEquationSeparate;
+	gl3wBlendFuncSeparate = NullBlendFuncSeparate;
+	gl3wBufferData = NullBufferData;
+	gl3wBufferStorage = NullBufferStorage;
+	gl3wBufferSubData = NullBufferSubData;
+	gl3wCheckFramebufferStatus = NullCheckFramebufferStatus;
+	gl3wClear = NullClear;
+	gl3wClearColor = NullClearColor;
+	gl3wClearDepthf = NullClearDepthf;
+	gl3wClearStencil = NullClearStencil;
+	gl3wClientWaitSync = NullClientWaitSync;
+	gl3wCompileShader = NullCompileShader;
+	gl3wCompressedTexSubImage2D = NullCompressedTexSubImage2D;
+	gl3wCompressedTexSubImage3D = NullCompressedTexSubImage3D;
+	gl3wCreateProgram = NullCreateProgram;
+	gl3wCreateShader = NullCreateShader;
+	gl3wDebugMessageCallback = NULL;
+	gl3wDeleteBuffers = NullDeleteBuffers;
+	gl3wDeleteFramebuffers = NullDeleteFramebuffers;
+	gl3wDeleteProgram = NullDeleteProgram;
+	gl3wDeleteRenderbuffers = NullDeleteRenderbuffers;
+	gl3wDeleteSamplers = NullDeleteSamplers;
+	gl3wDeleteShader = NullDeleteShader;
+	gl3wDeleteSync = NullDeleteSync;
+	gl3wDeleteTextures = NullDeleteTextures;
+	gl3wDeleteVertexArrays = NullDeleteVertexArrays;
+	gl3wDisableVertexAttribArray = NullDisableVertexAttribArray;
+	gl3wDrawArraysIndirect = NullDrawArraysIndirect;
+	gl3wDrawArraysInstanced = NullDrawArraysInstanced;
+	gl3wDrawArraysInstancedBaseInstance = NullDrawArraysInstancedBaseInstance;
+	gl3wDrawBuffers = NullDrawBuffers;
+	gl3wDrawElementsIndirect = NullDrawElementsIndirect;
+	gl3wDrawElementsInstancedBaseVertex = NullDrawElementsInstancedBaseVertex;
+	gl3wDrawElementsInstancedBaseVertexBaseInstance = NullDrawElementsInstancedBaseVertexBaseInstance;
+	gl3wEnable = NullEnable;
+	gl3wEnableVertexAttribArray = NullEnableVertexAttribArray;
+	gl3wEndQuery = NullEndQuery;
+	gl3wFenceSync = NullFenceSync;
+	gl3wFramebufferRenderbuffer = NullFramebufferRenderbuffer;
+	gl3wFramebufferTexture2D = NullFramebufferTexture2D;
+	gl3wGenBuffers = NullGenBuffers;
+	gl3wGenFramebuffers = NullGenFramebuffers;
+	gl3wGenQueries = NullGenQueries;
+	gl3wGenRenderbuffers = NullGenRenderbuffers;
+	gl3wGenSamplers = NullGenSamplers;
+	gl3wGenTextures = NullGenTextures;
+	gl3wGenVertexArrays = NullGenVertexArrays;
+	gl3wGetIntegerv = NullGetIntegerv;
+	gl3wGetProgramBinary = NullGetProgramBinary;
+	gl3wGetProgramInfoLog = NullGetInfoLog;
+	gl3wGetProgramiv = NullGetProgramiv;
+	gl3wGetQueryObjectiv = NullGetQueryObjectiv;
+	gl3wGetQueryObjectui64v = NullGetQueryObjectui64v;
+	gl3wGetShaderInfoLog = NullGetInfoLog;
+	gl3wGetShaderiv = NullGetShaderiv;
+	gl3wGetString = NullGetString;
+	gl3wGetStringi = NullGetStringi;
+	gl3wGetUniformBlockIndex = NullGetUniformBlockIndex;
+	gl3wGetUniformLocation = NullGetUniformLocation;
+	gl3wLinkProgram = NullLinkProgram;
+	gl3wMapBufferRange = NullMapBufferRange;
+	gl3wMultiDrawArraysIndirect = NullMultiDrawArraysIndirect;
+	gl3wMultiDrawElementsIndirect = NullMultiDrawElementsIndirect;
+	gl3wPixelStorei = NullPixelStorei;
+	gl3wProgramBinary = NullProgramBinary;
+	gl3wProgramParameteri = NullProgramParameteri;
+	gl3wReadBuffer = NullReadBuffer;
+	gl3wReadPixels = NullReadPixels;
+	gl3wRenderbufferStorage = NullRenderbufferStorage;
+	gl3wSamplerParameteri = NullSamplerParameteri;
+	gl3wShaderSource = NullShaderSource;
+	gl3wTexImage1D = NullTexImage1D;
+	gl3wTexImage2D = NullTexImage2D;
+	gl3wTexImage3D = NullTexImage3D;
+	gl3wTexParameteri = NullTexParameteri;
+	gl3wTexStorage1D = NullTexStorage1D;
+	gl3wTexStorage2D = NullTexStorage2D;
+	gl3wTexStorage3D = NullTexStorage3D;
+	gl3wTexSubImage1D = NullTexSubImage1D;
+	gl3wTexSubImage2D = NullTexSubImage2D;
+	gl3wTexSubImage3D = NullTexSubImage3D;
+	gl3wUniform1i = NullUniform1i;
+	gl3wUniformBlockBinding = NullUniformBlockBinding;
+	gl3wUnmapBuffer = NullUnmapBuffer;
+	gl3wUseProgram = NullUseProgram;
+	gl3wVertexAttribDivisor = NullVertexAttribDivisor;
+	gl3wVertexAttribIPointer = NullVertexAttribIPointer;
+	gl3wVertexAttribPointer = NullVertexAttribPointer;
+	gl3wViewport = NullViewport;
+
+	return NU_SUCCESS;
+}
+
+static void DeinitNullGl(void)
+{
+	if (gNullGl.trace) fclose(gNullGl.trace);
+	NuAllocator* allocator = &gNullGl.allocator;
+	for (size_t i = 0; i < nArrayLen(gNullGl.buffers); ++i) {
+		NullGlBuffer* buffer = gNullGl.buffers[i];
+		if (!buffer) continue;
+		if (buffer->data) n_free(buffer->data, allocator);
+		n_free(buffer, allocator);
+	}
+	nArrayFree(gNullGl.buffers, allocator);
+	nArrayFree(gNullGl.elementBuffers, allocator);
+	nZero(&gNullGl);
+}
+
+/**
+ * Restores the buffer and vertex array bindings of the context made current on this thread, as tracked
+ * by the device state cache in \p boundBuffers and \p vertexArray.
+ */
+static void NullGlMakeCurrent(GLuint const* boundBuffers, GLuint vertexArray)
+{
+	memcpy(gNullGlBoundBuffers, boundBuffers, sizeof *gNullGlBoundBuffers * NULL_GL_NUM_CACHED_BUFFER_TARGETS);
+	gNullGlBoundBuffers[NullGlBufferTargetIndex(GL_PIXEL_UNPACK_BUFFER)] = 0;
+	gNullGlBoundBuffers[NullGlBufferTargetIndex(GL_PIXEL_PACK_BUFFER)] = 0;
+	gNullGlBoundVertexArray = vertexArray;
+}
+
+static void NullGlSwapBuffers(void)
+{
+	NullTrace(NULL_GL_OP_SWAP_BUFFERS, 0);
+}
@@ -15,21 +15,13 @@
 #include <freetype/fttrigon.h>
 #include "nu_font.h"
 
-typedef struct GlyphPage
-{
-	struct GlyphPage* next;
-	uint fromCodePoint;
-	uint toCodePoint;
-	NuFaceGlyph glyphs[];
-} GlyphPage;
-
 typedef struct {
 	NuFaceMeasures measures;
-	GlyphPage*  firstPage;
 } Face;
 
 typedef struct NuFontImpl {
 	NuTexture   texture;
+	NHashMap    glyphs; /* GlyphKey() -> NuFaceGlyph */
 	size_t      numFaces;
 	Face        faces[];
 } Font;
@@ -61,16 +53,16 @@ static inline CompareTempGlyphData(const void* vlhs, const void* vrhs)
 		return rhs->size.height - lhs->size.height;
 }
 
+static inline uint64_t GlyphKey(uint faceId, uint code)
+{
+	return (uint64_t)faceId << 32 | code;
+}
+
 static inline NuFaceGlyph const* FetchGlyph(const Font* font, uint faceId, uint code)
 {
 	nAssert(faceId < font->numFaces);
-	GlyphPage const* page = font->faces[faceId].firstPage;
-	while (page) {
-		if (code >= page->fromCodePoint && code <= page->toCodePoint) {
-			return &page->glyphs[code - page->fromCodePoint];
-		}
-	}
-	return NULL;
+	uint64_t key = GlyphKey(faceId, code);
+	return nHashMapFind(&font->glyphs, &key);
 }
 
 /*-------------------------------------------------------------------------------------------------
@@ -109,13 +101,15 @@ NuResult nuCreateFont(NuFontCreateInfo const * info, NuAllocator* allocator, NuT
 
 	/* preamble */
 	NuResult result = NU_SUCCESS;
-	allocator = nGetDefaultOrAllocator(allocator);
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_FONT);
 	NuAllocator* tempAllocator = nAllocatorFromTemp(_tempAllocator);
+	NuTempMark tempMark = nuTempMark();
 	*ppFont = NULL;
 
 	/* create the font */
-	Font* pFont = n_malloc(sizeof(Font) + sizeof(Face) * info->numFaces, allocator);
+	Font* pFont = n_newEx(allocator, sizeof(Font) + sizeof(Face) * info->numFaces, n_alignof(Font));
 	if (!pFont) {
+		nuTempRewind(tempMark);
 		return NU_ERROR_OUT_OF_MEMORY;
 	}
 
@@ -128,6 +122,14 @@ NuResult nuCreateFont(NuFontCreateInfo const * info, NuAllocator* allocator, NuT
 		totNumGlyphs += info->faces[i].charSets[j].toCodePoint- info->faces[i].charSets[j].fromCodePoint + 1;
 	}
 
+	/* reserve all glyphs upfront so that glyph pointers stay valid while the atlas is built */
+	nInitHashMap(&pFont->glyphs, allocator, sizeof(uint64_t), sizeof(NuFaceGlyph));
+	if (!nHashMapReserve(&pFont->glyphs, totNumGlyphs)) {
+		n_free(pFont, allocator);
+		nuTempRewind(tempMark);
+		return NU_ERROR_OUT_OF_MEMORY;
+	}
+
 	TempGlyphData* glyphs = n_newarray(TempGlyphData, totNumGlyphs, tempAllocator);
 	uint glyphIndex = 0;
 
@@ -142,7 +144,7 @@ NuResult nuCreateFont(NuFontCreateInfo const * info, NuAllocator* allocator, NuT
 		/* load face file bytes */
 		size_t faceByteSize = info->faceLoader(faceBytes, tempBufferSize, faceInfo->userData, info->faceLoaderUserData);
 		while (faceByteSize > tempBufferSize) {
-			n_realloc(faceBytes, faceByteSize, tempAllocator);
+			faceBytes = n_realloc(faceBytes, faceByteSize, tempAllocator);
 			tempBufferSize = faceByteSize;
 			faceByteSize = info->faceLoader(faceBytes, tempBufferSize, faceInfo->userData, info->faceLoaderUserData);
 		}
@@ -168,26 +170,10 @@ NuResult nuCreateFont(NuFontCreateInfo const * info, NuAllocator* allocator, NuT
 		face->measures.descender = ftFace->size->metrics.descender / 64;
 		face->measures.lineHeight = ftFace->size->metrics.height / 64;
 
-		GlyphPage* lastPage = NULL;
-
 		// Load each glyph in the charmap
 		for (uint j = 0; j <faceInfo->numCharSets; ++j) {
 			NuCharSet const* charSet = &faceInfo->charSets[j];
 
-			/* create a glyph page for current face */
-			GlyphPage* page = n_malloc(sizeof(GlyphPage) + sizeof(NuFaceGlyph) * (charSet->toCodePoint - charSet->fromCodePoint + 1), allocator);
-			if (lastPage) {
-				lastPage->next = page;
-				lastPage = page;
-			}
-			else {
-				face->firstPage = page;
-			}
-
-			page->next = NULL;
-			page->fromCodePoint = charSet->fromCodePoint;
-			page->toCodePoint = charSet->toCodePoint;
-
 			for (uint ch = charSet->fromCodePoint; ch <= charSet->toCodePoint; ++ch) {
 				if (FT_Load_Char(ftFace, ch, FT_LOAD_RENDER)) {
 					nDebugWarning("Error loading freetype character with code %c.", ch);
@@ -210,9 +196,12 @@ NuResult nuCreateFont(NuFontCreateInfo const * info, NuAllocator* allocator, NuT
 				// Push the temp glyph
 				FT_BitmapGlyph bitmapGlyph = (FT_BitmapGlyph)glyph;
 				nAssert(glyphIndex < totNumGlyphs);
+				uint64_t glyphKey = GlyphKey(i, ch);
+				NuFaceGlyph* faceGlyph = nHashMapInsert(&pFont->glyphs, &glyphKey, NULL);
+				nZero(faceGlyph);
 				glyphs[glyphIndex++] = (TempGlyphData) {
 					face,
-					&page->glyphs[ch - charSet->fromCodePoint],
+					faceGlyph,
 					ch,
 					advance,
 					bitmapPos,
@@ -230,7 +219,7 @@ NuResult nuCreateFont(NuFontCreateInfo const * info, NuAllocator* allocator, NuT
 	nTempAllocatorUnlockMalloc();
 
 	/* all needed glyphs are stored into glyph. Sort this list by height and then by width */
-	qsort(glyphs, totNumGlyphs, sizeof(TempGlyphData), CompareTempGlyphData);
+	qsort(glyphs, glyphIndex, sizeof(TempGlyphData), CompareTempGlyphData);
 
 	/* render each glyph in the atlas */
 	uint8_t* imagedata = n_malloc(info->textureWidth * info->textureHeight, tempAllocator);
@@ -239,7 +228,7 @@ NuResult nuCreateFont(NuFontCreateInfo const * info, NuAllocator* allocator, NuT
 	Section* lastSection = sections;
 	sections->s = (NuSize2i) { info->textureWidth, info->textureHeight };
 
-	for (uint j = 0, n = totNumGlyphs; j < n; ++j) {
+	for (uint j = 0, n = glyphIndex; j < n; ++j) {
 		TempGlyphData* glyph = &glyphs[j];
 
 	  // Find a suitable section.
@@ -304,11 +293,13 @@ NuResult nuCreateFont(NuFontCreateInfo const * info, NuAllocator* allocator, NuT
 		}
 	}
 
-	/* finally create the atlas texture */
+	/* finally create the atlas texture, keeping it in system memory too so that text can be rendered
+	 * by nu2dRenderToImage() */
 	nuCreateTexture(&(NuTextureCreateInfo) {
 		NU_TEXTURE_TYPE_2D,
 		{ info->textureWidth, info->textureHeight, 1 },
 		NU_TEXTURE_FORMAT_R8_UNORM,
+		.keepCpuCopy = true,
 	}, allocator, &pFont->texture);
 
 	nuTextureUpdateLevels(pFont->texture, 0, 1, &(NuImageView) {
@@ -322,24 +313,21 @@ NuResult nuCreateFont(NuFontCreateInfo const * info, NuAllocator* allocator, NuT
 
 cleanup:
 	// Clear the bitmap glyphs
-	for (size_t i = 0, n = totNumGlyphs; i < n; ++i)
+	for (size_t i = 0, n = glyphIndex; i < n; ++i)
 		FT_Done_Glyph((FT_Glyph)glyphs[i].bitmap_glyph);
 
+	/* release all scratch memory used to build the atlas */
+	nuTempRewind(tempMark);
+
 	return result;
 }
 
 void nuDestroyFont(NuFont font, NuAllocator * allocator)
 {
 	if (!font) return;
-	allocator = nGetDefaultOrAllocator(allocator);
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_FONT);
 	nuDestroyTexture(font->texture, allocator);
-	
-	/* destroy face glyph pages */
-	for (size_t i = 0; i < font->numFaces; ++i)
-	for (GlyphPage* page = font->faces[i].firstPage, *next = page->next; page; page = next) {
-		n_free(page, allocator);
-	}
-
+	nDeinitHashMap(&font->glyphs);
 	n_free(font, allocator);
 }
 
@@ -5,8 +5,17 @@
  */
 
 #include "nunki/image.h"
+#include "nunki/job.h"
 #include "nu_libs.h"
 
+#include <float.h>
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define N_IMAGE_SSE2 1
+#endif
+
 typedef struct NuImageImpl {
 	NuImageFormat format;
 	NuSize2i      size;
@@ -14,17 +23,770 @@ typedef struct NuImageImpl {
 	char          data[];
 } Image;
 
-static const kPixelSize[NU_IMAGE_FORMAT_COUNT_] = {
-	/* NU_IMAGE_FORMAT_RGBA8 */ 4,
+/* bytes per texel of uncompressed formats, per 4x4 block of compressed ones */
+static const uint kPixelSize[NU_IMAGE_FORMAT_COUNT_] = {
+	/* NU_IMAGE_FORMAT_R8 */ 1,
+	/* NU_IMAGE_FORMAT_R8G8 */ 2,
+	/* NU_IMAGE_FORMAT_R8G8B8 */ 3,
+	/* NU_IMAGE_FORMAT_R8G8B8A8 */ 4,
+	/* NU_IMAGE_FORMAT_BC1 */ 8,
+	/* NU_IMAGE_FORMAT_BC3 */ 16,
+	/* NU_IMAGE_FORMAT_BC4 */ 8,
+	/* NU_IMAGE_FORMAT_BC5 */ 16,
+	/* NU_IMAGE_FORMAT_BC7 */ 16,
+};
+
+static const NuImageFormat kDecompressedFormat[NU_IMAGE_FORMAT_COUNT_] = {
+	NU_IMAGE_FORMAT_R8,
+	NU_IMAGE_FORMAT_R8G8,
+	NU_IMAGE_FORMAT_R8G8B8,
+	NU_IMAGE_FORMAT_R8G8B8A8,
+	/* NU_IMAGE_FORMAT_BC1 */ NU_IMAGE_FORMAT_R8G8B8A8,
+	/* NU_IMAGE_FORMAT_BC3 */ NU_IMAGE_FORMAT_R8G8B8A8,
+	/* NU_IMAGE_FORMAT_BC4 */ NU_IMAGE_FORMAT_R8,
+	/* NU_IMAGE_FORMAT_BC5 */ NU_IMAGE_FORMAT_R8G8,
+	/* NU_IMAGE_FORMAT_BC7 */ NU_IMAGE_FORMAT_R8G8B8A8,
+};
+
+#define KAISER_ALPHA 4.f      /* Kaiser window shape, higher trades sharpness for less ringing */
+#define KAISER_RADIUS 2.f     /* radius of the Kaiser filter in destination texels */
+#define MAX_KERNEL_TAPS 16    /* source texels a destination texel is filtered from, along one axis */
+#define DOWNSAMPLE_GRAIN 32   /* destination rows per job when downsampling in parallel */
+
+/* BC7 index interpolation weights by index bits */
+static const uint8_t kBc7Weights2[] = { 0, 21, 43, 64 };
+static const uint8_t kBc7Weights3[] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const uint8_t kBc7Weights4[] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+static const uint8_t* const kBc7Weights[] = { NULL, NULL, kBc7Weights2, kBc7Weights3, kBc7Weights4 };
+
+/* BC7 block layout of each mode */
+typedef struct {
+	uint8_t numSubsets;
+	uint8_t partitionBits;
+	uint8_t rotationBits;
+	uint8_t indexSelectionBits;
+	uint8_t colorBits;
+	uint8_t alphaBits;           /* 0 if the mode has no alpha, which is then opaque */
+	uint8_t endpointPBits;       /* 1 if each endpoint has its own p-bit */
+	uint8_t sharedPBits;         /* 1 if the endpoints of a subset share a p-bit */
+	uint8_t indexBits;
+	uint8_t secondaryIndexBits;  /* 0 if colors and alpha share the same indices */
+} Bc7Mode;
+
+static const Bc7Mode kBc7Modes[8] = {
+	{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+	{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+	{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+	{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+	{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+	{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+	{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+	{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+};
+
+/* BC7 subset of each texel by partition, two bits per texel */
+static const uint32_t kBc7Partitions2[64] = {
+	0x50505050, 0x40404040, 0x54545454, 0x54505040, 0x50404000, 0x55545450, 0x55545040, 0x54504000,
+	0x50400000, 0x55555450, 0x55544000, 0x54400000, 0x55555440, 0x55550000, 0x55555500, 0x55000000,
+	0x55150100, 0x00004054, 0x15010000, 0x00405054, 0x00004050, 0x15050100, 0x05010000, 0x40505054,
+	0x00404050, 0x05010100, 0x14141414, 0x05141450, 0x01155440, 0x00555500, 0x15014054, 0x05414150,
+	0x44444444, 0x55005500, 0x11441144, 0x05055050, 0x05500550, 0x11114444, 0x41144114, 0x44111144,
+	0x15055054, 0x01055040, 0x05041050, 0x05455150, 0x14414114, 0x50050550, 0x41411414, 0x00141400,
+	0x00041504, 0x00105410, 0x10541000, 0x04150400, 0x50410514, 0x41051450, 0x05415014, 0x14054150,
+	0x41050514, 0x41505014, 0x40011554, 0x54150140, 0x50505500, 0x00555050, 0x15151010, 0x54540404,
+};
+static const uint32_t kBc7Partitions3[64] = {
+	0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+	0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+	0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+	0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+	0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+	0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+	0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+	0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+};
+/* BC7 anchor texels of the second and third subsets by partition, the first subset's is texel 0 */
+static const uint8_t kBc7Anchors2[64] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+	15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+	6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+};
+static const uint8_t kBc7Anchors3a[64] = {
+	3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+	3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+	8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+	3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3,
 };
+static const uint8_t kBc7Anchors3b[64] = {
+	15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+	15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+	15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+	15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8,
+};
+
+/*-------------------------------------------------------------------------------------------------
+ * Block encoding
+ *-----------------------------------------------------------------------------------------------*/
+/* The 16 texels of a block being encoded, by channel so that they can be processed four at a time. */
+typedef struct {
+	float c[4][16];
+} Block;
+
+typedef struct {
+	uint8_t* data;
+	uint     bit;
+} BitWriter;
+
+static void WriteBits(BitWriter* writer, uint value, uint numBits)
+{
+	for (uint i = 0; i < numBits; ++i, ++writer->bit) {
+		writer->data[writer->bit >> 3] |= ((value >> i) & 1) << (writer->bit & 7);
+	}
+}
+
+/**
+ * Loads the block at \p bx, \p by of uncompressed \p image as RGBA, replicating the edge texels of
+ * blocks crossing the image border.
+ */
+static void LoadBlock(NuImageView const* image, uint bx, uint by, Block* block)
+{
+	const uint pixelSize = kPixelSize[image->format];
+	const uint8_t* data = image->data;
+	for (uint i = 0; i < 16; ++i) {
+		uint x = min_uint(bx * 4 + (i & 3), image->size.width - 1);
+		uint y = min_uint(by * 4 + (i >> 2), image->size.height - 1);
+		const uint8_t* texel = data + ((size_t)y * image->size.width + x) * pixelSize;
+		block->c[0][i] = texel[0];
+		block->c[1][i] = pixelSize > 1 ? texel[1] : 0.f;
+		block->c[2][i] = pixelSize > 2 ? texel[2] : 0.f;
+		block->c[3][i] = pixelSize > 3 ? texel[3] : 255.f;
+	}
+}
+
+/**
+ * Finds for each texel of \p block the closest of the \p numColors entries of \p palette, comparing
+ * channels [\p firstChannel, \p firstChannel + \p numChannels).
+ * @returns the total squared error.
+ */
+static float FitIndices(Block const* block, float const (*palette)[4], uint numColors, uint firstChannel, uint numChannels, uint8_t indices[16])
+{
+	float error = 0.f;
+#ifdef N_IMAGE_SSE2
+	for (uint i = 0; i < 16; i += 4) {
+		__m128 bestError = _mm_set1_ps(FLT_MAX);
+		__m128 bestIndex = _mm_setzero_ps();
+		for (uint j = 0; j < numColors; ++j) {
+			__m128 e = _mm_setzero_ps();
+			for (uint c = firstChannel; c < firstChannel + numChannels; ++c) {
+				__m128 d = _mm_sub_ps(_mm_loadu_ps(&block->c[c][i]), _mm_set1_ps(palette[j][c]));
+				e = _mm_add_ps(e, _mm_mul_ps(d, d));
+			}
+			__m128 better = _mm_cmplt_ps(e, bestError);
+			bestError = _mm_min_ps(e, bestError);
+			bestIndex = _mm_or_ps(_mm_and_ps(better, _mm_set1_ps((float)j)), _mm_andnot_ps(better, bestIndex));
+		}
+		float errors[4], bestIndices[4];
+		_mm_storeu_ps(errors, bestError);
+		_mm_storeu_ps(bestIndices, bestIndex);
+		for (uint k = 0; k < 4; ++k) {
+			indices[i + k] = (uint8_t)bestIndices[k];
+			error += errors[k];
+		}
+	}
+#else
+	for (uint i = 0; i < 16; ++i) {
+		float bestError = FLT_MAX;
+		for (uint j = 0; j < numColors; ++j) {
+			float e = 0.f;
+			for (uint c = firstChannel; c < firstChannel + numChannels; ++c) {
+				float d = block->c[c][i] - palette[j][c];
+				e += d * d;
+			}
+			if (e < bestError) {
+				bestError = e;
+				indices[i] = (uint8_t)j;
+			}
+		}
+		error += bestError;
+	}
+#endif
+	return error;
+}
+
+/**
+ * Fits a line to channels [0, \p numChannels) of \p block along their principal axis, found by power
+ * iteration on their covariance, and writes the extremes of the texels projected on it.
+ */
+static void FitEndpoints(Block const* block, uint numChannels, float e0[4], float e1[4])
+{
+	float mean[4] = { 0 }, min[4], max[4];
+	for (uint c = 0; c < numChannels; ++c) {
+		min[c] = max[c] = block->c[c][0];
+		for (uint i = 0; i < 16; ++i) {
+			mean[c] += block->c[c][i];
+			min[c] = min_float(min[c], block->c[c][i]);
+			max[c] = max_float(max[c], block->c[c][i]);
+		}
+		mean[c] /= 16.f;
+	}
+
+	float covariance[4][4] = { 0 };
+	for (uint i = 0; i < 16; ++i) {
+		for (uint c = 0; c < numChannels; ++c) {
+			for (uint d = c; d < numChannels; ++d) {
+				covariance[c][d] += (block->c[c][i] - mean[c]) * (block->c[d][i] - mean[d]);
+			}
+		}
+	}
+
+	float axis[4];
+	for (uint c = 0; c < numChannels; ++c) axis[c] = max[c] - min[c];
+	for (uint iteration = 0; iteration < 8; ++iteration) {
+		float next[4] = { 0 }, length = 0.f;
+		for (uint c = 0; c < numChannels; ++c) {
+			for (uint d = 0; d < numChannels; ++d) {
+				next[c] += (c <= d ? covariance[c][d] : covariance[d][c]) * axis[d];
+			}
+			length = max_float(length, next[c] * next[c]);
+		}
+		if (length == 0.f) break;
+		length = sqrtf(length);
+		for (uint c = 0; c < numChannels; ++c) axis[c] = next[c] / length;
+	}
+
+	float tMin = 0.f, tMax = 0.f, axisLength = 0.f;
+	for (uint c = 0; c < numChannels; ++c) axisLength += axis[c] * axis[c];
+	if (axisLength == 0.f) {
+		for (uint c = 0; c < numChannels; ++c) e0[c] = e1[c] = mean[c];
+		return;
+	}
+	for (uint i = 0; i < 16; ++i) {
+		float t = 0.f;
+		for (uint c = 0; c < numChannels; ++c) t += (block->c[c][i] - mean[c]) * axis[c];
+		t /= axisLength;
+		tMin = min_float(tMin, t);
+		tMax = max_float(tMax, t);
+	}
+	for (uint c = 0; c < numChannels; ++c) {
+		e0[c] = min_float(max_float(mean[c] + tMin * axis[c], 0.f), 255.f);
+		e1[c] = min_float(max_float(mean[c] + tMax * axis[c], 0.f), 255.f);
+	}
+}
+
+static inline uint16_t PackRgb565(float const rgb[4])
+{
+	uint r = (uint)(rgb[0] * 31.f / 255.f + .5f);
+	uint g = (uint)(rgb[1] * 63.f / 255.f + .5f);
+	uint b = (uint)(rgb[2] * 31.f / 255.f + .5f);
+	return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+static inline void UnpackRgb565(uint16_t c, uint8_t rgb[3])
+{
+	uint r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = (uint8_t)(r << 3 | r >> 2);
+	rgb[1] = (uint8_t)(g << 2 | g >> 4);
+	rgb[2] = (uint8_t)(b << 3 | b >> 2);
+}
+
+/**
+ * Encodes the colors of \p block in the 4 color mode of BC1, the one BC3 color blocks always use.
+ */
+static void EncodeBc1Block(Block const* block, uint8_t out[8])
+{
+	float e0[4], e1[4];
+	FitEndpoints(block, 3, e0, e1);
+	uint16_t c0 = PackRgb565(e1), c1 = PackRgb565(e0);
+	if (c0 < c1) {
+		uint16_t t = c0; c0 = c1; c1 = t;
+	}
+
+	uint8_t rgb0[3], rgb1[3];
+	UnpackRgb565(c0, rgb0);
+	UnpackRgb565(c1, rgb1);
+	float palette[4][4];
+	for (uint c = 0; c < 3; ++c) {
+		palette[0][c] = rgb0[c];
+		palette[1][c] = rgb1[c];
+		palette[2][c] = (2 * rgb0[c] + rgb1[c]) / 3;
+		palette[3][c] = (rgb0[c] + 2 * rgb1[c]) / 3;
+	}
+
+	uint8_t indices[16];
+	FitIndices(block, palette, c0 == c1 ? 1 : 4, 0, 3, indices);
+
+	uint32_t bits = 0;
+	for (uint i = 0; i < 16; ++i) bits |= (uint32_t)indices[i] << (i * 2);
+	out[0] = (uint8_t)c0; out[1] = (uint8_t)(c0 >> 8);
+	out[2] = (uint8_t)c1; out[3] = (uint8_t)(c1 >> 8);
+	memcpy(out + 4, &bits, 4);
+}
+
+/**
+ * Encodes \p channel of \p block as a BC4 block, in the mode interpolating 8 values.
+ */
+static void EncodeBc4Block(Block const* block, uint channel, uint8_t out[8])
+{
+	float min = block->c[channel][0], max = min;
+	for (uint i = 1; i < 16; ++i) {
+		min = min_float(min, block->c[channel][i]);
+		max = max_float(max, block->c[channel][i]);
+	}
+
+	const uint a0 = (uint)(max + .5f), a1 = (uint)(min + .5f);
+	float palette[8][4];
+	palette[0][channel] = (float)a0;
+	palette[1][channel] = (float)a1;
+	for (uint i = 2; i < 8; ++i) palette[i][channel] = (float)(((8 - i) * a0 + (i - 1) * a1) / 7);
+
+	uint8_t indices[16];
+	FitIndices(block, palette, a0 == a1 ? 1 : 8, channel, 1, indices);
+
+	uint64_t bits = 0;
+	for (uint i = 0; i < 16; ++i) bits |= (uint64_t)indices[i] << (i * 3);
+	out[0] = (uint8_t)a0;
+	out[1] = (uint8_t)a1;
+	for (uint i = 0; i < 6; ++i) out[2 + i] = (uint8_t)(bits >> (i * 8));
+}
+
+/**
+ * Encodes \p block as a BC7 block in mode 6, a single subset of RGBA endpoints with 7 bits per channel
+ * plus a shared bit per endpoint and 4 bit indices. Every combination of shared bits is tried.
+ */
+static void EncodeBc7Block(Block const* block, uint8_t out[16])
+{
+	float e[2][4];
+	FitEndpoints(block, 4, e[0], e[1]);
+
+	float bestError = FLT_MAX;
+	uint bestEndpoints[2][4], bestP[2];
+	uint8_t bestIndices[16];
+	for (uint p = 0; p < 4; ++p) {
+		const uint pBits[2] = { p & 1, p >> 1 };
+		uint q[2][4];
+		float palette[16][4];
+		for (uint c = 0; c < 4; ++c) {
+			for (uint k = 0; k < 2; ++k) {
+				int v = (int)((e[k][c] - pBits[k]) * .5f + .5f);
+				q[k][c] = (uint)(v < 0 ? 0 : v > 127 ? 127 : v);
+			}
+			const uint v0 = q[0][c] << 1 | pBits[0], v1 = q[1][c] << 1 | pBits[1];
+			for (uint i = 0; i < 16; ++i) palette[i][c] = (float)(((64 - kBc7Weights4[i]) * v0 + kBc7Weights4[i] * v1 + 32) >> 6);
+		}
+
+		uint8_t indices[16];
+		float error = FitIndices(block, palette, 16, 0, 4, indices);
+		if (error < bestError) {
+			bestError = error;
+			memcpy(bestEndpoints, q, sizeof q);
+			memcpy(bestP, pBits, sizeof pBits);
+			memcpy(bestIndices, indices, sizeof indices);
+		}
+	}
+
+	/* the first index is stored without its top bit, swap endpoints so that it is clear */
+	if (bestIndices[0] & 8) {
+		for (uint c = 0; c < 4; ++c) {
+			uint t = bestEndpoints[0][c]; bestEndpoints[0][c] = bestEndpoints[1][c]; bestEndpoints[1][c] = t;
+		}
+		uint t = bestP[0]; bestP[0] = bestP[1]; bestP[1] = t;
+		for (uint i = 0; i < 16; ++i) bestIndices[i] = 15 - bestIndices[i];
+	}
+
+	memset(out, 0, 16);
+	BitWriter writer = { out, 0 };
+	WriteBits(&writer, 1 << 6, 7);
+	for (uint c = 0; c < 4; ++c) {
+		WriteBits(&writer, bestEndpoints[0][c], 7);
+		WriteBits(&writer, bestEndpoints[1][c], 7);
+	}
+	WriteBits(&writer, bestP[0], 1);
+	WriteBits(&writer, bestP[1], 1);
+	for (uint i = 0; i < 16; ++i) WriteBits(&writer, bestIndices[i], i ? 4 : 3);
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * Block decoding
+ *-----------------------------------------------------------------------------------------------*/
+typedef struct {
+	uint8_t const* data;
+	uint           bit;
+} BitReader;
+
+static uint ReadBits(BitReader* reader, uint numBits)
+{
+	uint value = 0;
+	for (uint i = 0; i < numBits; ++i, ++reader->bit) {
+		value |= ((reader->data[reader->bit >> 3] >> (reader->bit & 7)) & 1u) << i;
+	}
+	return value;
+}
+
+/**
+ * Decodes BC1 color block \p in to \p texels, in 4 color mode only if \p fourColorMode is set.
+ */
+static void DecodeBc1Block(uint8_t const in[8], bool fourColorMode, uint8_t texels[16][4])
+{
+	const uint16_t c0 = (uint16_t)(in[0] | in[1] << 8), c1 = (uint16_t)(in[2] | in[3] << 8);
+	uint8_t palette[4][4];
+	UnpackRgb565(c0, palette[0]);
+	UnpackRgb565(c1, palette[1]);
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+	for (uint c = 0; c < 3; ++c) {
+		if (fourColorMode || c0 > c1) {
+			palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c]) / 3);
+			palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c]) / 3);
+		}
+		else {
+			palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c]) / 2);
+			palette[3][c] = 0;
+		}
+	}
+	if (!fourColorMode && c0 <= c1) palette[3][3] = 0;
+
+	uint32_t bits;
+	memcpy(&bits, in + 4, 4);
+	for (uint i = 0; i < 16; ++i) memcpy(texels[i], palette[(bits >> (i * 2)) & 3], 4);
+}
+
+static void DecodeBc4Block(uint8_t const in[8], uint channel, uint8_t texels[16][4])
+{
+	const uint a0 = in[0], a1 = in[1];
+	uint8_t palette[8] = { (uint8_t)a0, (uint8_t)a1 };
+	if (a0 > a1) {
+		for (uint i = 2; i < 8; ++i) palette[i] = (uint8_t)(((8 - i) * a0 + (i - 1) * a1) / 7);
+	}
+	else {
+		for (uint i = 2; i < 6; ++i) palette[i] = (uint8_t)(((6 - i) * a0 + (i - 1) * a1) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64_t bits = 0;
+	for (uint i = 0; i < 6; ++i) bits |= (uint64_t)in[2 + i] << (i * 8);
+	for (uint i = 0; i < 16; ++i) texels[i][channel] = palette[(bits >> (i * 3)) & 7];
+}
+
+static inline uint8_t Bc7Unquantize(uint value, uint numBits)
+{
+	value <<= 8 - numBits;
+	return (uint8_t)(value | value >> numBits);
+}
+
+static inline uint8_t Bc7Interpolate(uint e0, uint e1, uint weight)
+{
+	return (uint8_t)(((64 - weight) * e0 + weight * e1 + 32) >> 6);
+}
+
+/**
+ * Decodes BC7 block \p in. Blocks in the reserved mode decode to transparent black.
+ * @returns false if the block mode is reserved.
+ */
+static bool DecodeBc7Block(uint8_t const in[16], uint8_t texels[16][4])
+{
+	uint mode = 0;
+	while (mode < 8 && !(in[0] & (1 << mode))) ++mode;
+	if (mode == 8) {
+		memset(texels, 0, 16 * 4);
+		return false;
+	}
+
+	const Bc7Mode* info = &kBc7Modes[mode];
+	BitReader reader = { in, mode + 1 };
+	const uint partition = ReadBits(&reader, info->partitionBits);
+	const uint rotation = ReadBits(&reader, info->rotationBits);
+	const uint indexSelection = ReadBits(&reader, info->indexSelectionBits);
+	const uint numEndpoints = info->numSubsets * 2;
+
+	/* endpoints are stored channel by channel, then their p-bits */
+	uint e[6][4], endpointBits[4];
+	for (uint c = 0; c < 4; ++c) {
+		endpointBits[c] = c < 3 ? info->colorBits : info->alphaBits;
+		for (uint i = 0; i < numEndpoints; ++i) e[i][c] = ReadBits(&reader, endpointBits[c]);
+	}
+	if (info->endpointPBits || info->sharedPBits) {
+		uint pBits[6];
+		for (uint i = 0; i < numEndpoints; i += info->endpointPBits ? 1 : 2) pBits[i] = pBits[i + info->sharedPBits] = ReadBits(&reader, 1);
+		for (uint c = 0; c < 4; ++c) {
+			if (!endpointBits[c]) continue;
+			for (uint i = 0; i < numEndpoints; ++i) e[i][c] = e[i][c] << 1 | pBits[i];
+			++endpointBits[c];
+		}
+	}
+	for (uint c = 0; c < 4; ++c) {
+		for (uint i = 0; i < numEndpoints; ++i) e[i][c] = endpointBits[c] ? Bc7Unquantize(e[i][c], endpointBits[c]) : 255;
+	}
+
+	/* anchor texels store their index with one bit less, the secondary indices have a single anchor */
+	uint8_t subsets[16], anchors[3] = { 0 };
+	for (uint i = 0; i < 16; ++i) {
+		subsets[i] = (uint8_t)(info->numSubsets == 2 ? kBc7Partitions2[partition] >> (i * 2) & 3 :
+		                       info->numSubsets == 3 ? kBc7Partitions3[partition] >> (i * 2) & 3 : 0);
+	}
+	if (info->numSubsets == 2) anchors[1] = kBc7Anchors2[partition];
+	if (info->numSubsets == 3) {
+		anchors[1] = kBc7Anchors3a[partition];
+		anchors[2] = kBc7Anchors3b[partition];
+	}
+	uint8_t primary[16], secondary[16];
+	for (uint i = 0; i < 16; ++i) {
+		const bool anchor = anchors[subsets[i]] == i;
+		primary[i] = (uint8_t)ReadBits(&reader, info->indexBits - anchor);
+	}
+	if (info->secondaryIndexBits) {
+		for (uint i = 0; i < 16; ++i) secondary[i] = (uint8_t)ReadBits(&reader, i ? info->secondaryIndexBits : info->secondaryIndexBits - 1);
+	}
+
+	for (uint i = 0; i < 16; ++i) {
+		uint const* e0 = e[subsets[i] * 2];
+		uint const* e1 = e[subsets[i] * 2 + 1];
+		uint8_t const* colorWeights = kBc7Weights[info->indexBits];
+		uint8_t const* alphaWeights = colorWeights;
+		uint colorIndex = primary[i], alphaIndex = primary[i];
+		if (info->secondaryIndexBits) {
+			alphaWeights = kBc7Weights[info->secondaryIndexBits];
+			alphaIndex = secondary[i];
+			if (indexSelection) {
+				colorWeights = kBc7Weights[info->secondaryIndexBits];
+				alphaWeights = kBc7Weights[info->indexBits];
+				colorIndex = secondary[i];
+				alphaIndex = primary[i];
+			}
+		}
+		for (uint c = 0; c < 3; ++c) texels[i][c] = Bc7Interpolate(e0[c], e1[c], colorWeights[colorIndex]);
+		texels[i][3] = Bc7Interpolate(e0[3], e1[3], alphaWeights[alphaIndex]);
+
+		if (rotation) {
+			uint8_t t = texels[i][3];
+			texels[i][3] = texels[i][rotation - 1];
+			texels[i][rotation - 1] = t;
+		}
+	}
+	return true;
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * Downsampling
+ *-----------------------------------------------------------------------------------------------*/
+/* Images are downsampled by a separable filter, first along rows into a ring of filtered rows,
+ * then along columns. Texels are processed as four floats whatever the format. */
+#ifdef N_IMAGE_SSE2
+typedef __m128 Texel4;
+
+static inline Texel4 LoadTexel4(uint8_t const* texel, uint pixelSize)
+{
+	uint32_t bits = 0;
+	memcpy(&bits, texel, pixelSize);
+	__m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)bits), _mm_setzero_si128());
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+}
+
+static inline void StoreTexel4(Texel4 t, uint8_t* texel, uint pixelSize)
+{
+	__m128i v = _mm_cvtps_epi32(t);
+	v = _mm_packus_epi16(_mm_packs_epi32(v, v), v);
+	uint32_t bits = (uint32_t)_mm_cvtsi128_si32(v);
+	memcpy(texel, &bits, pixelSize);
+}
+
+static inline Texel4 Texel4Zero(void) { return _mm_setzero_ps(); }
+static inline Texel4 Texel4MulAdd(Texel4 acc, Texel4 t, float w) { return _mm_add_ps(acc, _mm_mul_ps(t, _mm_set1_ps(w))); }
+#else
+typedef struct {
+	float v[4];
+} Texel4;
+
+static inline Texel4 LoadTexel4(uint8_t const* texel, uint pixelSize)
+{
+	Texel4 t = { 0 };
+	for (uint c = 0; c < pixelSize; ++c) t.v[c] = texel[c];
+	return t;
+}
+
+static inline void StoreTexel4(Texel4 t, uint8_t* texel, uint pixelSize)
+{
+	for (uint c = 0; c < pixelSize; ++c) texel[c] = (uint8_t)(min_float(max_float(t.v[c], 0.f), 255.f) + .5f);
+}
+
+static inline Texel4 Texel4Zero(void) { return (Texel4) { 0 }; }
+
+static inline Texel4 Texel4MulAdd(Texel4 acc, Texel4 t, float w)
+{
+	for (uint c = 0; c < 4; ++c) acc.v[c] += t.v[c] * w;
+	return acc;
+}
+#endif
+
+/* filter taps of a destination texel along one axis, over consecutive source texels */
+typedef struct {
+	uint  first;
+	uint  numTaps;
+	float weights[MAX_KERNEL_TAPS];
+} KernelTaps;
+
+static float BesselI0(float x)
+{
+	float sum = 1.f, term = 1.f;
+	for (uint k = 1; k < 16; ++k) {
+		term *= (x * .5f / k) * (x * .5f / k);
+		sum += term;
+	}
+	return sum;
+}
+
+/**
+ * @returns the weight of the Kaiser windowed sinc at \p t destination texels from the center.
+ */
+static float KaiserSinc(float t)
+{
+	if (fabsf(t) >= KAISER_RADIUS) return 0.f;
+	const float pi = 3.14159265f;
+	const float sinc = t == 0.f ? 1.f : sinf(pi * t) / (pi * t);
+	const float w = t / KAISER_RADIUS;
+	return sinc * BesselI0(KAISER_ALPHA * sqrtf(1.f - w * w)) / BesselI0(KAISER_ALPHA);
+}
+
+/**
+ * Computes the taps of the \p dstSize destination texels filtered from \p srcSize source texels.
+ * Box taps weigh source texels by their coverage of the destination texel, taps falling outside the
+ * image are folded on the edge texels.
+ */
+static void ComputeKernel(NuMipFilter filter, uint srcSize, uint dstSize, KernelTaps* taps)
+{
+	const float scale = (float)srcSize / dstSize;
+	const float radius = filter == NU_MIP_FILTER_BOX ? scale * .5f : KAISER_RADIUS * scale;
+
+	for (uint x = 0; x < dstSize; ++x) {
+		KernelTaps* kernel = &taps[x];
+		const float center = (x + .5f) * scale;
+		const int lo = (int)floorf(center - radius), hi = min_int((int)ceilf(center + radius), lo + MAX_KERNEL_TAPS - 1);
+		kernel->first = (uint)max_int(lo, 0);
+		kernel->numTaps = (uint)min_int(hi, (int)srcSize - 1) - kernel->first + 1;
+		memset(kernel->weights, 0, sizeof kernel->weights);
+
+		float sum = 0.f;
+		for (int i = lo; i <= hi; ++i) {
+			float w;
+			if (filter == NU_MIP_FILTER_BOX) {
+				w = max_float(min_float(i + 1.f, center + radius) - max_float((float)i, center - radius), 0.f);
+			} else {
+				w = KaiserSinc((i + .5f - center) / scale);
+			}
+			kernel->weights[min_int(max_int(i, 0), (int)srcSize - 1) - (int)kernel->first] += w;
+			sum += w;
+		}
+		for (uint i = 0; i < kernel->numTaps; ++i) kernel->weights[i] /= sum;
+	}
+}
+
+typedef struct {
+	NuImageView const* src;
+	Image*             dst;
+	KernelTaps const*  xTaps;
+	KernelTaps const*  yTaps;
+	NuAllocator*       allocator;
+	int32_t volatile   outOfMemory;
+} DownsampleJob;
+
+/**
+ * Filters destination rows [\p begin, \p end) of downsample \p data.
+ */
+static void DownsampleRows(void* data, uint begin, uint end)
+{
+	DownsampleJob* job = data;
+	const uint pixelSize = kPixelSize[job->src->format];
+	const uint srcWidth = job->src->size.width, dstWidth = job->dst->size.width;
+	uint8_t const* src = job->src->data;
+	uint8_t* dst = (uint8_t*)job->dst->data;
+
+	/* rows filtered horizontally, source row r is kept in slot r % MAX_KERNEL_TAPS */
+	NuAllocator* allocator = job->allocator;
+	Texel4* rows = n_malloc(sizeof(Texel4) * dstWidth * MAX_KERNEL_TAPS, allocator);
+	if (!rows) {
+		nAtomicStore32(&job->outOfMemory, 1);
+		return;
+	}
+	uint rowIndices[MAX_KERNEL_TAPS];
+	memset(rowIndices, 0xff, sizeof rowIndices);
+
+	for (uint y = begin; y < end; ++y) {
+		KernelTaps const* yKernel = &job->yTaps[y];
+		for (uint i = 0; i < yKernel->numTaps; ++i) {
+			const uint r = yKernel->first + i;
+			Texel4* row = rows + (size_t)(r % MAX_KERNEL_TAPS) * dstWidth;
+			if (rowIndices[r % MAX_KERNEL_TAPS] == r) continue;
+			rowIndices[r % MAX_KERNEL_TAPS] = r;
+
+			uint8_t const* srcRow = src + (size_t)r * srcWidth * pixelSize;
+			for (uint x = 0; x < dstWidth; ++x) {
+				KernelTaps const* xKernel = &job->xTaps[x];
+				Texel4 acc = Texel4Zero();
+				for (uint j = 0; j < xKernel->numTaps; ++j) {
+					acc = Texel4MulAdd(acc, LoadTexel4(srcRow + (size_t)(xKernel->first + j) * pixelSize, pixelSize), xKernel->weights[j]);
+				}
+				row[x] = acc;
+			}
+		}
+
+		uint8_t* dstRow = dst + (size_t)y * dstWidth * pixelSize;
+		for (uint x = 0; x < dstWidth; ++x) {
+			Texel4 acc = Texel4Zero();
+			for (uint i = 0; i < yKernel->numTaps; ++i) {
+				const uint r = yKernel->first + i;
+				acc = Texel4MulAdd(acc, rows[(size_t)(r % MAX_KERNEL_TAPS) * dstWidth + x], yKernel->weights[i]);
+			}
+			StoreTexel4(acc, dstRow + (size_t)x * pixelSize, pixelSize);
+		}
+	}
+
+	n_free(rows, allocator);
+}
+
+/**
+ * Downsamples uncompressed \p image to the next mip level.
+ */
+static NuResult DownsampleUncompressed(NuImageView const* image, NuMipFilter filter, bool parallel, NuAllocator* allocator, NuImage* pImage)
+{
+	const NuSize2i size = { max_uint(image->size.width / 2, 1), max_uint(image->size.height / 2, 1) };
+	NuImage downsampled;
+	NuResult result = nuCreateImage(&(NuImageCreateInfo) { .format = image->format, .size = size }, allocator, &downsampled);
+	if (result) return result;
+
+	KernelTaps* taps = n_malloc(sizeof(KernelTaps) * (size.width + size.height), allocator);
+	if (!taps) {
+		nuDestroyImage(downsampled, allocator);
+		return NU_ERROR_OUT_OF_MEMORY;
+	}
+	ComputeKernel(filter, image->size.width, size.width, taps);
+	ComputeKernel(filter, image->size.height, size.height, taps + size.width);
+
+	DownsampleJob job = { .src = image, .dst = downsampled, .xTaps = taps, .yTaps = taps + size.width, .allocator = allocator };
+	if (parallel) {
+		nuParallelFor(size.height, DOWNSAMPLE_GRAIN, DownsampleRows, &job);
+	} else {
+		DownsampleRows(&job, 0, size.height);
+	}
+	n_free(taps, allocator);
+
+	if (job.outOfMemory) {
+		nuDestroyImage(downsampled, allocator);
+		return NU_ERROR_OUT_OF_MEMORY;
+	}
+	*pImage = downsampled;
+	return NU_SUCCESS;
+}
 
+/*-------------------------------------------------------------------------------------------------
+ * API
+ *-----------------------------------------------------------------------------------------------*/
 NuResult nuCreateImage(NuImageCreateInfo const* info, NuAllocator* allocator, NuImage* ppImage)
 {
-	allocator = nGetDefaultOrAllocator(allocator);
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_IMAGE);
 	*ppImage = NULL;
 
 	/* compute total image size */
-	uint byteSize = kPixelSize[info->format] * info->size.width * info->size.height;
+	uint byteSize = (uint)nuImageFormatGetDataSize(info->format, info->size);
 
 	Image* image = n_malloc(sizeof(Image) + byteSize, allocator);
 	if (!image) { return NU_ERROR_OUT_OF_MEMORY; }
@@ -44,7 +806,7 @@ NuResult nuCreateImage(NuImageCreateInfo const* info, NuAllocator* allocator, Nu
 void nuDestroyImage(NuImage image, NuAllocator* allocator)
 {
 	if (!image) return;
-	n_free(image, allocator);
+	n_free(image, nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_IMAGE));
 }
 
 NuImageView nuImageGetView(NuImage const image)
@@ -60,3 +822,169 @@ void* nuImageGetWritableDataPtr(NuImage image)
 {
 	return image->data;
 }
+
+bool nuImageFormatIsCompressed(NuImageFormat format)
+{
+	return format >= NU_IMAGE_FORMAT_BC1;
+}
+
+NuImageFormat nuImageFormatGetDecompressed(NuImageFormat format)
+{
+	return kDecompressedFormat[format];
+}
+
+size_t nuImageFormatGetDataSize(NuImageFormat format, NuSize2i size)
+{
+	if (nuImageFormatIsCompressed(format)) {
+		return (size_t)kPixelSize[format] * ((size.width + 3) / 4) * ((size.height + 3) / 4);
+	}
+	return (size_t)kPixelSize[format] * size.width * size.height;
+}
+
+NuResult nuImageCompress(NuImageView const* image, NuImageFormat format, NuAllocator* allocator, NuImage* pImage)
+{
+	nEnforce(!nuImageFormatIsCompressed(image->format), "Image is already compressed.");
+	nEnforce(nuImageFormatIsCompressed(format), "Target format is not a compressed format.");
+	*pImage = NULL;
+
+	NuImage compressed;
+	NuResult result = nuCreateImage(&(NuImageCreateInfo) { .format = format, .size = image->size }, allocator, &compressed);
+	if (result) return result;
+	if (!image->size.width || !image->size.height) {
+		*pImage = compressed;
+		return NU_SUCCESS;
+	}
+
+	const uint numBlocksX = (image->size.width + 3) / 4, numBlocksY = (image->size.height + 3) / 4;
+	uint8_t* out = (uint8_t*)compressed->data;
+	for (uint by = 0; by < numBlocksY; ++by) {
+		for (uint bx = 0; bx < numBlocksX; ++bx, out += kPixelSize[format]) {
+			Block block;
+			LoadBlock(image, bx, by, &block);
+			switch (format) {
+				case NU_IMAGE_FORMAT_BC1: EncodeBc1Block(&block, out); break;
+				case NU_IMAGE_FORMAT_BC3: EncodeBc4Block(&block, 3, out); EncodeBc1Block(&block, out + 8); break;
+				case NU_IMAGE_FORMAT_BC4: EncodeBc4Block(&block, 0, out); break;
+				case NU_IMAGE_FORMAT_BC5: EncodeBc4Block(&block, 0, out); EncodeBc4Block(&block, 1, out + 8); break;
+				case NU_IMAGE_FORMAT_BC7: EncodeBc7Block(&block, out); break;
+				default: nAssert(false);
+			}
+		}
+	}
+
+	*pImage = compressed;
+	return NU_SUCCESS;
+}
+
+NuResult nuImageDecompress(NuImageView const* image, NuAllocator* allocator, NuImage* pImage)
+{
+	nEnforce(nuImageFormatIsCompressed(image->format), "Image is not compressed.");
+	*pImage = NULL;
+
+	const NuImageFormat format = kDecompressedFormat[image->format];
+	NuImage decompressed;
+	NuResult result = nuCreateImage(&(NuImageCreateInfo) { .format = format, .size = image->size }, allocator, &decompressed);
+	if (result) return result;
+
+	const uint pixelSize = kPixelSize[format];
+	const uint numBlocksX = (image->size.width + 3) / 4, numBlocksY = (image->size.height + 3) / 4;
+	uint8_t const* in = image->data;
+	bool invalidBlocks = false;
+	for (uint by = 0; by < numBlocksY; ++by) {
+		for (uint bx = 0; bx < numBlocksX; ++bx, in += kPixelSize[image->format]) {
+			uint8_t texels[16][4] = { 0 };
+			switch (image->format) {
+				case NU_IMAGE_FORMAT_BC1: DecodeBc1Block(in, false, texels); break;
+				case NU_IMAGE_FORMAT_BC3: DecodeBc1Block(in + 8, true, texels); DecodeBc4Block(in, 3, texels); break;
+				case NU_IMAGE_FORMAT_BC4: DecodeBc4Block(in, 0, texels); break;
+				case NU_IMAGE_FORMAT_BC5: DecodeBc4Block(in, 0, texels); DecodeBc4Block(in + 8, 1, texels); break;
+				case NU_IMAGE_FORMAT_BC7: invalidBlocks |= !DecodeBc7Block(in, texels); break;
+				default: nAssert(false);
+			}
+
+			/* crop blocks crossing the image border */
+			for (uint i = 0; i < 16; ++i) {
+				uint x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+				if (x >= image->size.width || y >= image->size.height) continue;
+				memcpy(decompressed->data + ((size_t)y * image->size.width + x) * pixelSize, texels[i], pixelSize);
+			}
+		}
+	}
+
+	if (invalidBlocks) nDebugWarning("BC7 blocks in the reserved mode were decoded to transparent black.");
+	*pImage = decompressed;
+	return NU_SUCCESS;
+}
+
+uint nuImageGetNumMipLevels(NuSize2i size)
+{
+	uint numLevels = 1;
+	for (uint extent = max_uint(size.width, size.height); extent > 1; extent /= 2) ++numLevels;
+	return numLevels;
+}
+
+NuResult nuImageDownsample(NuImageView const* image, NuMipFilter filter, bool parallel, NuAllocator* allocator, NuImage* pImage)
+{
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_IMAGE);
+	*pImage = NULL;
+	if (!nuImageFormatIsCompressed(image->format)) return DownsampleUncompressed(image, filter, parallel, allocator, pImage);
+
+	NuImage decompressed, downsampled;
+	NuResult result = nuImageDecompress(image, allocator, &decompressed);
+	if (result) return result;
+	NuImageView view = nuImageGetView(decompressed);
+	result = DownsampleUncompressed(&view, filter, parallel, allocator, &downsampled);
+	nuDestroyImage(decompressed, allocator);
+	if (result) return result;
+	view = nuImageGetView(downsampled);
+	result = nuImageCompress(&view, image->format, allocator, pImage);
+	nuDestroyImage(downsampled, allocator);
+	return result;
+}
+
+NuResult nuImageGenerateMips(NuImageView const* image, NuMipFilter filter, bool parallel, uint numLevels, NuAllocator* allocator, NuImage* levels)
+{
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_IMAGE);
+	nEnforce(numLevels <= nuImageGetNumMipLevels(image->size), "More mip levels requested than the image has.");
+	if (numLevels <= 1) return NU_SUCCESS;
+	memset(levels, 0, sizeof(NuImage) * (numLevels - 1));
+
+	/* compressed chains are built decoded so that encoding errors do not accumulate */
+	const bool compressed = nuImageFormatIsCompressed(image->format);
+	NuImage base = NULL, previous = NULL;
+	NuResult result = NU_SUCCESS;
+	if (compressed) {
+		result = nuImageDecompress(image, allocator, &base);
+		if (result) return result;
+	}
+
+	NuImageView source = compressed ? nuImageGetView(base) : *image;
+	for (uint level = 1; level < numLevels && !result; ++level) {
+		NuImage downsampled;
+		result = DownsampleUncompressed(&source, filter, parallel, allocator, &downsampled);
+		if (result) break;
+
+		source = nuImageGetView(downsampled);
+		if (compressed) {
+			result = nuImageCompress(&source, image->format, allocator, &levels[level - 1]);
+
+			/* the decoded previous level is only needed to downsample the next one */
+			nuDestroyImage(previous, allocator);
+			previous = downsampled;
+		} else {
+			levels[level - 1] = downsampled;
+		}
+	}
+
+	if (compressed) {
+		nuDestroyImage(previous, allocator);
+		nuDestroyImage(base, allocator);
+	}
+	if (result) {
+		for (uint i = 0; i + 1 < numLevels; ++i) {
+			nuDestroyImage(levels[i], allocator);
+			levels[i] = NULL;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,413 @@
+/*
+ * Nunki (simple rendering engine)
+ * Copyright (C) 2015 Canio Massimo Tristano <massimo.tristano@gmail.com>.
+ * For licensing info see LICENSE.
+ */
+
+#include "nu_job.h"
+#include "nu_base.h"
+#include "nu_libs.h"
+
+#define MAX_WORKER_THREADS 64
+#define JOB_DEQUE_SIZE 4096 /* must be a power of two */
+#define GLOBAL_QUEUE_SIZE 4096
+#define PARALLEL_FOR_MAX_CHUNKS 128
+#define PARALLEL_FOR_CHUNKS_PER_THREAD 4
+#define IDLE_SPIN_COUNT 64
+
+typedef struct {
+	NuJobFunc     func;
+	void*         data;
+	NuJobCounter* counter;
+} Job;
+
+/* Chase-Lev work-stealing deque. The owner worker pushes and pops at the bottom while other threads
+ * steal from the top. */
+typedef struct {
+	int64_t volatile top;
+	char             padding0[56];
+	int64_t volatile bottom;
+	char             padding1[56];
+	Job              jobs[JOB_DEQUE_SIZE];
+} JobDeque;
+
+typedef struct {
+	NThread  thread;
+	JobDeque deque;
+} Worker;
+
+/* A batch of jobs waiting for a counter to drop to zero, job declarations follow the struct. */
+typedef struct ParkedJobs {
+	struct ParkedJobs* next;
+	NuJobCounter*      counter;
+	uint               numJobs;
+} ParkedJobs;
+
+typedef struct {
+	NuParallelForFunc func;
+	void*             data;
+	uint              begin;
+	uint              end;
+} ParallelForRange;
+
+static struct {
+	bool             initialized;
+	NuAllocator      allocator;
+	uint             numWorkers;
+	Worker*          workers;
+	int32_t volatile quit;
+	int32_t volatile numSleeping;
+	NSemaphore       wakeup;
+
+	/* queue of the jobs scheduled by non worker threads or overflowing a worker deque */
+	int32_t volatile globalLock;
+	uint             globalHead;
+	int32_t volatile globalCount;
+	Job              globalQueue[GLOBAL_QUEUE_SIZE];
+} gJobs;
+
+/* index + 1 of the worker running on this thread, zero for any other thread */
+static n_threadlocal uint gWorkerIndex;
+static n_threadlocal uint32_t gRandomState;
+
+#define EnforceInitialized() nEnforce(gJobs.initialized, "Job module uninitialized.");
+
+/*-------------------------------------------------------------------------------------------------
+ * Queues
+ *-----------------------------------------------------------------------------------------------*/
+static bool DequePush(JobDeque* deque, Job const* job)
+{
+	int64_t bottom = deque->bottom;
+	int64_t top = nAtomicLoad64(&deque->top);
+	if (bottom - top >= JOB_DEQUE_SIZE) return false;
+	deque->jobs[bottom & (JOB_DEQUE_SIZE - 1)] = *job;
+	nAtomicStore64(&deque->bottom, bottom + 1);
+	return true;
+}
+
+static bool DequePop(JobDeque* deque, Job* job)
+{
+	int64_t bottom = deque->bottom - 1;
+	nAtomicStore64(&deque->bottom, bottom);
+	nAtomicFence();
+	int64_t top = nAtomicLoad64(&deque->top);
+
+	if (top > bottom) {
+		/* empty */
+		nAtomicStore64(&deque->bottom, bottom + 1);
+		return false;
+	}
+
+	*job = deque->jobs[bottom & (JOB_DEQUE_SIZE - 1)];
+	if (top < bottom) return true;
+
+	/* last job in the deque, race against thieves for it */
+	bool taken = nAtomicCas64(&deque->top, top, top + 1);
+	nAtomicStore64(&deque->bottom, bottom + 1);
+	return taken;
+}
+
+static bool DequeSteal(JobDeque* deque, Job* job)
+{
+	int64_t top = nAtomicLoad64(&deque->top);
+	nAtomicFence();
+	int64_t bottom = nAtomicLoad64(&deque->bottom);
+	if (top >= bottom) return false;
+	*job = deque->jobs[top & (JOB_DEQUE_SIZE - 1)];
+	return nAtomicCas64(&deque->top, top, top + 1);
+}
+
+static bool GlobalPush(Job const* job)
+{
+	nSpinLock(&gJobs.globalLock);
+	bool pushed = gJobs.globalCount < GLOBAL_QUEUE_SIZE;
+	if (pushed) {
+		gJobs.globalQueue[(gJobs.globalHead + gJobs.globalCount) % GLOBAL_QUEUE_SIZE] = *job;
+		nAtomicStore32(&gJobs.globalCount, gJobs.globalCount + 1);
+	}
+	nSpinUnlock(&gJobs.globalLock);
+	return pushed;
+}
+
+static bool GlobalPop(Job* job)
+{
+	if (!nAtomicLoad32(&gJobs.globalCount)) return false;
+	nSpinLock(&gJobs.globalLock);
+	bool popped = gJobs.globalCount > 0;
+	if (popped) {
+		*job = gJobs.globalQueue[gJobs.globalHead];
+		gJobs.globalHead = (gJobs.globalHead + 1) % GLOBAL_QUEUE_SIZE;
+		nAtomicStore32(&gJobs.globalCount, gJobs.globalCount - 1);
+	}
+	nSpinUnlock(&gJobs.globalLock);
+	return popped;
+}
+
+static bool FindJob(Job* job)
+{
+	if (gWorkerIndex && DequePop(&gJobs.workers[gWorkerIndex - 1].deque, job)) return true;
+	if (GlobalPop(job)) return true;
+	if (!gJobs.numWorkers) return false;
+
+	/* xorshift to pick the first victim */
+	uint32_t x = gRandomState ? gRandomState : 0x9e3779b9u;
+	x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+	gRandomState = x;
+
+	for (uint i = 0, victim = x % gJobs.numWorkers; i < gJobs.numWorkers; ++i, victim = (victim + 1) % gJobs.numWorkers) {
+		if (victim + 1 == gWorkerIndex) continue;
+		if (DequeSteal(&gJobs.workers[victim].deque, job)) return true;
+	}
+	return false;
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * Execution
+ *-----------------------------------------------------------------------------------------------*/
+static void ScheduleJob(Job const* job);
+
+static void DecrementCounter(NuJobCounter* counter)
+{
+	/* fast path, the counter does not reach zero */
+	for (int32_t value = nAtomicLoad32(&counter->value); value > 1; value = nAtomicLoad32(&counter->value)) {
+		if (nAtomicCas32(&counter->value, value, value - 1)) return;
+	}
+
+	/* the last decrement happens under the lock so that waiters, which also check the lock, never
+	 * see the counter released while this thread still touches it */
+	nSpinLock(&counter->lock);
+	int32_t value = nAtomicAdd32(&counter->value, -1);
+	nAssert(value >= 0);
+	ParkedJobs* parked = value == 0 ? counter->waiters : NULL;
+	if (parked) counter->waiters = NULL;
+	nSpinUnlock(&counter->lock);
+
+	while (parked) {
+		ParkedJobs* next = parked->next;
+		NuJobDecl const* decls = (NuJobDecl const*)(parked + 1);
+		for (uint i = 0; i < parked->numJobs; ++i) {
+			ScheduleJob(&(Job) { decls[i].func, decls[i].data, parked->counter });
+		}
+		n_free(parked, (&gJobs.allocator));
+		parked = next;
+	}
+}
+
+static void ExecuteJob(Job const* job)
+{
+	NuTempMark tempMark = nuTempMark();
+	job->func(job->data);
+	nuTempRewind(tempMark);
+	if (job->counter) DecrementCounter(job->counter);
+}
+
+static void ScheduleJob(Job const* job)
+{
+	bool pushed = (gWorkerIndex && DequePush(&gJobs.workers[gWorkerIndex - 1].deque, job)) || GlobalPush(job);
+	if (!pushed) {
+		/* all queues full, run it right away */
+		ExecuteJob(job);
+		return;
+	}
+
+	nAtomicFence();
+	if (nAtomicLoad32(&gJobs.numSleeping) > 0) {
+		nSemaphorePost(&gJobs.wakeup, 1);
+	}
+}
+
+static void WorkerMain(void* data)
+{
+	uint index = (uint)(uintptr_t)data;
+	gWorkerIndex = index + 1;
+	gRandomState = (index + 1) * 0x9e3779b9u;
+
+	NuResult result = nInitThreadTempAllocator(NULL);
+	nEnforce(result == NU_SUCCESS, "Could not initialize worker thread temporary allocator.");
+
+	Job job;
+	while (!nAtomicLoad32(&gJobs.quit)) {
+		bool found = false;
+		for (uint i = 0; i < IDLE_SPIN_COUNT && !found; ++i) {
+			found = FindJob(&job);
+			if (!found) nCpuPause();
+		}
+
+		if (!found) {
+			/* announce sleeping before checking one last time, pairs with the fence in ScheduleJob() */
+			nAtomicAdd32(&gJobs.numSleeping, 1);
+			found = FindJob(&job);
+			if (!found && !nAtomicLoad32(&gJobs.quit)) {
+				nSemaphoreWait(&gJobs.wakeup);
+			}
+			nAtomicAdd32(&gJobs.numSleeping, -1);
+		}
+
+		if (found) ExecuteJob(&job);
+	}
+
+	nDeinitThreadTempAllocator(NULL);
+}
+
+static void ParallelForJob(void* data)
+{
+	ParallelForRange* range = data;
+	range->func(range->data, range->begin, range->end);
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * Internal API
+ *-----------------------------------------------------------------------------------------------*/
+NuResult nInitJobModule(NuAllocator* allocator, uint numWorkerThreads)
+{
+	nAssert(!gJobs.initialized);
+	gJobs.initialized = true;
+	gJobs.allocator = *allocator;
+
+	numWorkerThreads = min_uint(numWorkerThreads, MAX_WORKER_THREADS);
+	if (!numWorkerThreads) return NU_SUCCESS;
+
+	if (!nInitSemaphore(&gJobs.wakeup, 0)) {
+		nDeinitJobModule();
+		return NU_FAILURE;
+	}
+
+	gJobs.workers = n_newarray(Worker, numWorkerThreads, allocator);
+	if (!gJobs.workers) {
+		nDeinitSemaphore(&gJobs.wakeup);
+		nZero(&gJobs);
+		return NU_ERROR_OUT_OF_MEMORY;
+	}
+
+	/* numWorkers must be final before any worker starts stealing */
+	gJobs.numWorkers = numWorkerThreads;
+	for (uint i = 0; i < numWorkerThreads; ++i) {
+		if (!nCreateThread(&gJobs.workers[i].thread, WorkerMain, (void*)(uintptr_t)i)) {
+			nDebugError("Could not start job worker thread.");
+			nAtomicStore32(&gJobs.quit, 1);
+			nSemaphorePost(&gJobs.wakeup, i);
+			for (uint j = 0; j < i; ++j) nJoinThread(&gJobs.workers[j].thread);
+			n_free(gJobs.workers, allocator);
+			nDeinitSemaphore(&gJobs.wakeup);
+			nZero(&gJobs);
+			return NU_FAILURE;
+		}
+	}
+
+	return NU_SUCCESS;
+}
+
+void nDeinitJobModule(void)
+{
+	if (!gJobs.initialized) return;
+	nEnforce(gJobs.globalCount == 0, "Job module terminated with pending jobs.");
+
+	if (gJobs.numWorkers) {
+		nAtomicStore32(&gJobs.quit, 1);
+		nSemaphorePost(&gJobs.wakeup, gJobs.numWorkers);
+		for (uint i = 0; i < gJobs.numWorkers; ++i) {
+			nJoinThread(&gJobs.workers[i].thread);
+		}
+		n_free(gJobs.workers, (&gJobs.allocator));
+		nDeinitSemaphore(&gJobs.wakeup);
+	}
+
+	nZero(&gJobs);
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------------------------*/
+void nuRunJobs(NuJobDecl const* jobs, uint numJobs, NuJobCounter* counter)
+{
+	EnforceInitialized();
+	if (counter) nAtomicAdd32(&counter->value, numJobs);
+	for (uint i = 0; i < numJobs; ++i) {
+		ScheduleJob(&(Job) { jobs[i].func, jobs[i].data, counter });
+	}
+}
+
+void nuRunJobsAfter(NuJobCounter* dependency, NuJobDecl const* jobs, uint numJobs, NuJobCounter* counter)
+{
+	EnforceInitialized();
+	if (!dependency || !nAtomicLoad32(&dependency->value)) {
+		nuRunJobs(jobs, numJobs, counter);
+		return;
+	}
+
+	ParkedJobs* parked = n_malloc(sizeof(ParkedJobs) + sizeof(NuJobDecl) * numJobs, (&gJobs.allocator));
+	nEnforce(parked, "Out of memory.");
+	parked->counter = counter;
+	parked->numJobs = numJobs;
+	memcpy(parked + 1, jobs, sizeof(NuJobDecl) * numJobs);
+
+	/* count the parked jobs right away so that waiting on counter also waits for them */
+	if (counter) nAtomicAdd32(&counter->value, numJobs);
+
+	nSpinLock(&dependency->lock);
+	bool park = nAtomicLoad32(&dependency->value) > 0;
+	if (park) {
+		parked->next = dependency->waiters;
+		dependency->waiters = parked;
+	}
+	nSpinUnlock(&dependency->lock);
+
+	if (!park) {
+		/* dependency completed in the meantime */
+		for (uint i = 0; i < numJobs; ++i) {
+			ScheduleJob(&(Job) { jobs[i].func, jobs[i].data, counter });
+		}
+		n_free(parked, (&gJobs.allocator));
+	}
+}
+
+void nuWaitForCounter(NuJobCounter* counter)
+{
+	EnforceInitialized();
+	Job job;
+	while (nAtomicLoad32(&counter->value) > 0 || nAtomicLoad32(&counter->lock)) {
+		if (FindJob(&job)) {
+			ExecuteJob(&job);
+		}
+		else {
+			nCpuPause();
+		}
+	}
+}
+
+void nuParallelFor(uint count, uint grainSize, NuParallelForFunc func, void* data)
+{
+	EnforceInitialized();
+	if (!count) return;
+
+	grainSize = max_uint(grainSize, 1);
+	uint numChunks = count / grainSize + (count % grainSize != 0);
+	numChunks = min_uint(numChunks, min_uint((gJobs.numWorkers + 1) * PARALLEL_FOR_CHUNKS_PER_THREAD, PARALLEL_FOR_MAX_CHUNKS));
+	if (numChunks <= 1) {
+		func(data, 0, count);
+		return;
+	}
+
+	ParallelForRange ranges[PARALLEL_FOR_MAX_CHUNKS];
+	NuJobCounter counter = { 0 };
+	nAtomicAdd32(&counter.value, numChunks - 1);
+
+	for (uint i = 0; i < numChunks; ++i) {
+		ranges[i] = (ParallelForRange) {
+			func,
+			data,
+			(uint)((uint64_t)count * i / numChunks),
+			(uint)((uint64_t)count * (i + 1) / numChunks),
+		};
+		if (i > 0) ScheduleJob(&(Job) { ParallelForJob, &ranges[i], &counter });
+	}
+
+	/* the calling thread takes the first chunk */
+	ParallelForJob(&ranges[0]);
+	nuWaitForCounter(&counter);
+}
+
+uint nuGetNumWorkerThreads(void)
+{
+	return gJobs.numWorkers;
+}
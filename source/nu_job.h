@@ -0,0 +1,19 @@
+/*
+ * Nunki (simple rendering engine)
+ * Copyright (C) 2015 Canio Massimo Tristano <massimo.tristano@gmail.com>.
+ * For licensing info see LICENSE.
+ */
+
+#pragma once
+
+#include "nunki/job.h"
+
+/**
+ * Starts \p numWorkerThreads worker threads, each owning a job deque and a thread temporary allocator.
+ */
+NuResult nInitJobModule(NuAllocator* allocator, uint numWorkerThreads);
+
+/**
+ * Stops and joins the worker threads. Pending jobs must have been waited for.
+ */
+void nDeinitJobModule(void);
@@ -9,8 +9,17 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define N_HASH_MAP_SSE2 1
+#endif
+
 #ifdef _WIN32
 #include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sched.h>
+#include <unistd.h>
 #endif
 
 NDebugDialogResult nDebugShowDialog(NDebugDialogType type, const char* title, const char* format, ...)
@@ -22,7 +31,9 @@ NDebugDialogResult nDebugShowDialog(NDebugDialogType type, const char* title, co
 
 	char buffer[1024];
 	vsnprintf(buffer, 1024, format, args);
+	va_end(args);
 
+#ifdef _WIN32
 	uint wtype = 0;
 	switch (type) {
 		case N_DEBUG_DIALOG_TYPE_OK: wtype = MB_OK; break;
@@ -39,14 +50,11 @@ NDebugDialogResult nDebugShowDialog(NDebugDialogType type, const char* title, co
 		case IDRETRY: return N_DEBUG_DIALOG_RESULT_RETRY;
 		default: return 0;
 	}
-
-#ifdef _MSC_VER
-	OutputDebugStringA(buffer);
 #else
-	printf(buffer);
+	/* no dialogs here (e.g. headless benchmark runs), print and abort */
+	fprintf(stderr, "[%s] %s\n", title, buffer);
+	return type == N_DEBUG_DIALOG_TYPE_OK ? N_DEBUG_DIALOG_RESULT_OK : N_DEBUG_DIALOG_RESULT_ABORT;
 #endif
-
-	va_end(args);
 }
 
 void nDebugPrint(const char* format, ...)
@@ -66,85 +74,531 @@ void nDebugPrint(const char* format, ...)
 }
 
 /*-------------------------------------------------------------------------------------------------
- * array
+ * virtual memory
  *-----------------------------------------------------------------------------------------------*/
-typedef struct {
-	uint capacity;
-	uint length;
-} ArrayHeader;
+size_t nVirtualPageSize(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+void* nVirtualReserve(size_t size)
+{
+#ifdef _WIN32
+	return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	void* ptr = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return ptr == MAP_FAILED ? NULL : ptr;
+#endif
+}
+
+bool nVirtualCommit(void* ptr, size_t size)
+{
+#ifdef _WIN32
+	return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+	return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
 
-static inline ArrayHeader* getArrayHeader(void* array)
+void nVirtualRelease(void* ptr, size_t size)
+{
+	if (!ptr) return;
+#ifdef _WIN32
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	munmap(ptr, size);
+#endif
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * threads
+ *-----------------------------------------------------------------------------------------------*/
+#ifdef _WIN32
+static DWORD WINAPI ThreadEntry(LPVOID data)
+{
+	NThread* thread = data;
+	thread->func(thread->data);
+	return 0;
+}
+#else
+static void* ThreadEntry(void* data)
 {
-	return nAlignPtrDown((ArrayHeader*)array - 1, n_alignof(void*));
+	NThread* thread = data;
+	thread->func(thread->data);
+	return NULL;
 }
-bool nArrayReserveEx(void** parray, NuAllocator* allocator, uint elementSize, uint capacity)
+#endif
+
+bool nCreateThread(NThread* thread, NThreadFunc func, void* data)
 {
-	ArrayHeader* header = getArrayHeader(*parray);
+	thread->func = func;
+	thread->data = data;
+#ifdef _WIN32
+	thread->handle = CreateThread(NULL, 0, ThreadEntry, thread, 0, NULL);
+	return thread->handle != NULL;
+#else
+	return pthread_create(&thread->handle, NULL, ThreadEntry, thread) == 0;
+#endif
+}
 
-	/* reallocate if necessary */
-	if (!*parray || header->capacity < capacity) {
-		const uint old_capacity = *parray ? header->capacity : 10u;
-		const uint oldLength = *parray ? header->length : 0;
-		const uint newCapacity = max_uint(old_capacity * 2, capacity);
+void nJoinThread(NThread* thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+}
 
-		/* compute the total size */
-		uint totalSize = n_alignof(void*) + sizeof(ArrayHeader); // max alignment + size of header
-		totalSize = (uint)nAlignUintUp(totalSize, n_alignof(void*)); // add padding for type alignment
+void nYieldThread(void)
+{
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
 
-		uint dataOffset = totalSize - n_alignof(void*);  // remember the offset in bytes from the allocation pointer to the actual data array
+uint nGetNumLogicalCores(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint)count : 1;
+#endif
+}
 
-		totalSize += elementSize * newCapacity; // actual storage of values
-		totalSize -= n_alignof(void*); // remove max alignment
+bool nInitSemaphore(NSemaphore* semaphore, uint initialCount)
+{
+#ifdef _WIN32
+	semaphore->handle = CreateSemaphoreA(NULL, initialCount, 0x7fffffff, NULL);
+	return semaphore->handle != NULL;
+#else
+	return sem_init(&semaphore->handle, 0, initialCount) == 0;
+#endif
+}
 
-		/* allocate the new array and copy the data over */
-		ArrayHeader* newArrayHeader = n_malloc(totalSize, allocator);
-		if (!newArrayHeader) return false;
+void nDeinitSemaphore(NSemaphore* semaphore)
+{
+#ifdef _WIN32
+	CloseHandle(semaphore->handle);
+#else
+	sem_destroy(&semaphore->handle);
+#endif
+}
 
-		void* new_array = (char*)newArrayHeader + dataOffset;
+void nSemaphorePost(NSemaphore* semaphore, uint count)
+{
+#ifdef _WIN32
+	ReleaseSemaphore(semaphore->handle, count, NULL);
+#else
+	while (count--) sem_post(&semaphore->handle);
+#endif
+}
 
-		if (*parray) {
-			memcpy(new_array, *parray, elementSize * oldLength);
-			n_free(header, allocator);
+void nSemaphoreWait(NSemaphore* semaphore)
+{
+#ifdef _WIN32
+	WaitForSingleObject(semaphore->handle, INFINITE);
+#else
+	while (sem_wait(&semaphore->handle) != 0) {}
+#endif
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * linear arena
+ *-----------------------------------------------------------------------------------------------*/
+typedef struct OverflowBlock {
+	struct OverflowBlock* next;
+	size_t size;
+} OverflowBlock;
+
+#define OVERFLOW_BLOCK_HEADER_SIZE nAlignUintUp(sizeof(OverflowBlock), 16)
+
+static void* LinearArenaMalloc(size_t size, size_t alignment, void* userData)
+{
+	NLinearArena* arena = userData;
+	char* cursor = arena->buffer + arena->size;
+	char* allocationPtr = nAlignPtrUp(cursor, (uint)alignment);
+
+	if (arena->buffer && allocationPtr + size <= arena->buffer + arena->capacity) {
+		arena->size = allocationPtr + size - arena->buffer;
+		arena->lastAllocationPtr = allocationPtr;
+		return allocationPtr;
+	}
+
+	/* arena full, serve the request from the backing allocator until next reset */
+	nAssert(alignment <= 16);
+	NuAllocator* backing = &arena->backingAllocator;
+	OverflowBlock* block = backing->malloc(OVERFLOW_BLOCK_HEADER_SIZE + size, 16, backing->userData);
+	if (!block) return NULL;
+
+	block->next = arena->overflowBlocks;
+	block->size = size;
+	arena->overflowBlocks = block;
+	arena->overflowSize += size;
+	return (char*)block + OVERFLOW_BLOCK_HEADER_SIZE;
+}
+
+static void* LinearArenaRealloc(void* ptr, size_t newSize, size_t alignment, void* userData)
+{
+	NLinearArena* arena = userData;
+	char* bufferEnd = arena->buffer + arena->capacity;
+
+	/* grow or shrink the last allocation in place if possible */
+	if (ptr && ptr == arena->lastAllocationPtr && (char*)ptr + newSize <= bufferEnd) {
+		arena->size = (char*)ptr + newSize - arena->buffer;
+		return ptr;
+	}
+
+	/* blocks in the buffer cannot extend past the cursor, overflow blocks know their size */
+	size_t oldSize = 0;
+	if (ptr && (char*)ptr >= arena->buffer && (char*)ptr < bufferEnd) {
+		oldSize = arena->buffer + arena->size - (char*)ptr;
+	}
+	else if (ptr) {
+		oldSize = ((OverflowBlock*)((char*)ptr - OVERFLOW_BLOCK_HEADER_SIZE))->size;
+	}
+
+	void* newPtr = LinearArenaMalloc(newSize, alignment, userData);
+	if (newPtr && ptr) {
+		memcpy(newPtr, ptr, min_size_t(oldSize, newSize));
+	}
+	return newPtr;
+}
+
+static void LinearArenaFree(void* ptr, void* userData)
+{
+	NLinearArena* arena = userData;
+	if (ptr && ptr == arena->lastAllocationPtr) {
+		arena->size = (char*)ptr - arena->buffer;
+		arena->lastAllocationPtr = NULL;
+	}
+}
+
+NuResult nInitLinearArena(NLinearArena* arena, NuAllocator* backingAllocator, size_t capacity)
+{
+	nZero(arena);
+	arena->allocator = (NuAllocator) {
+		arena,
+		LinearArenaMalloc,
+		LinearArenaRealloc,
+		LinearArenaFree,
+	};
+	arena->backingAllocator = *backingAllocator;
+
+	if (capacity) {
+		arena->buffer = backingAllocator->malloc(capacity, 16, backingAllocator->userData);
+		if (!arena->buffer) return NU_ERROR_OUT_OF_MEMORY;
+		arena->capacity = capacity;
+		arena->minCapacity = capacity;
+	}
+
+	return NU_SUCCESS;
+}
+
+static void FreeOverflowBlocks(NLinearArena* arena)
+{
+	NuAllocator* backing = &arena->backingAllocator;
+	for (OverflowBlock* block = arena->overflowBlocks, *next; block; block = next) {
+		next = block->next;
+		backing->free(block, backing->userData);
+	}
+	arena->overflowBlocks = NULL;
+	arena->overflowSize = 0;
+}
+
+void nDeinitLinearArena(NLinearArena* arena)
+{
+	FreeOverflowBlocks(arena);
+	if (arena->buffer) {
+		arena->backingAllocator.free(arena->buffer, arena->backingAllocator.userData);
+	}
+	nZero(arena);
+}
+
+void nLinearArenaReset(NLinearArena* arena)
+{
+	/* record this round usage and compute the recent high-water mark */
+	arena->history[arena->historyIndex] = arena->size + arena->overflowSize;
+	arena->historyIndex = (arena->historyIndex + 1) % N_LINEAR_ARENA_HISTORY_SIZE;
+
+	size_t highWater = 0;
+	for (uint i = 0; i < N_LINEAR_ARENA_HISTORY_SIZE; ++i) {
+		highWater = max_size_t(highWater, arena->history[i]);
+	}
+
+	/* resize the buffer if it is too small or way too large for recent usage */
+	if (arena->overflowBlocks || arena->capacity > max_size_t(highWater * 2, arena->minCapacity)) {
+		NuAllocator* backing = &arena->backingAllocator;
+		size_t newCapacity = max_size_t(nAlignUintUp(highWater + highWater / 4, 4096), arena->minCapacity);
+		void* newBuffer = newCapacity ? backing->malloc(newCapacity, 16, backing->userData) : NULL;
+		if (newBuffer || !newCapacity) {
+			if (arena->buffer) backing->free(arena->buffer, backing->userData);
+			arena->buffer = newBuffer;
+			arena->capacity = newCapacity;
 		}
+	}
+
+	FreeOverflowBlocks(arena);
+	arena->size = 0;
+	arena->lastAllocationPtr = NULL;
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * pool
+ *-----------------------------------------------------------------------------------------------*/
+/* Each slab starts with the generations and free list links of its slots, followed by the elements. */
+typedef struct {
+	uint16_t generation;
+	uint32_t nextFree;
+} PoolSlot;
+
+static inline size_t PoolSlabHeaderSize(NPool const* pool)
+{
+	return nAlignUintUp(sizeof(PoolSlot) << pool->slabShift, 16);
+}
+
+static inline PoolSlot* PoolGetSlot(NPool const* pool, uint index)
+{
+	return (PoolSlot*)pool->slabs[index >> pool->slabShift] + (index & ((1u << pool->slabShift) - 1));
+}
+
+static inline void* PoolGetElement(NPool const* pool, uint index)
+{
+	char* slab = pool->slabs[index >> pool->slabShift];
+	return slab + PoolSlabHeaderSize(pool) + (size_t)(index & ((1u << pool->slabShift) - 1)) * pool->elementSize;
+}
+
+void nInitPool(NPool* pool, NuAllocator* allocator, uint elementSize, uint slabShift)
+{
+	nZero(pool);
+	pool->allocator = *allocator;
+	pool->elementSize = (uint)nAlignUintUp(elementSize, 8);
+	pool->slabShift = slabShift;
+}
+
+void nDeinitPool(NPool* pool)
+{
+	const uint slabSize = 1u << pool->slabShift;
+	for (uint i = 0; i < pool->numSlots; i += slabSize) {
+		n_free(pool->slabs[i >> pool->slabShift], (&pool->allocator));
+	}
+	nZero(pool);
+}
+
+NHandle nPoolAlloc(NPool* pool, void** pElement)
+{
+	uint index;
+
+	if (pool->freeList) {
+		index = pool->freeList - 1;
+		pool->freeList = PoolGetSlot(pool, index)->nextFree;
+	}
+	else {
+		index = pool->numSlots;
+		if (index > N_POOL_INDEX_MASK || (index >> pool->slabShift) >= N_POOL_MAX_SLABS) {
+			nDebugError("Pool exhausted.");
+			return 0;
+		}
+
+		/* allocate a new slab if the slot is the first of its slab */
+		if ((index & ((1u << pool->slabShift) - 1)) == 0) {
+			size_t slabSize = PoolSlabHeaderSize(pool) + ((size_t)pool->elementSize << pool->slabShift);
+			char* slab = pool->allocator.malloc(slabSize, 16, pool->allocator.userData);
+			if (!slab) return 0;
+			memset(slab, 0, PoolSlabHeaderSize(pool));
+			pool->slabs[index >> pool->slabShift] = slab;
+		}
+
+		++pool->numSlots;
+	}
+
+	PoolSlot* slot = PoolGetSlot(pool, index);
+	++slot->generation; /* odd, alive */
+	slot->nextFree = 0;
+	++pool->numAlive;
+
+	void* element = PoolGetElement(pool, index);
+	memset(element, 0, pool->elementSize);
+	*pElement = element;
+
+	return (NHandle)(slot->generation & N_POOL_GENERATION_MASK) << N_POOL_INDEX_BITS | index;
+}
+
+void nPoolFree(NPool* pool, NHandle handle)
+{
+	nEnforce(nPoolGet(pool, handle), "Invalid or stale handle freed.");
+	uint index = handle & N_POOL_INDEX_MASK;
+	PoolSlot* slot = PoolGetSlot(pool, index);
+
+	++slot->generation; /* even, free. Alive generations are odd, so handles are never zero */
+	slot->nextFree = pool->freeList;
+	pool->freeList = index + 1;
+	--pool->numAlive;
+}
+
+void* nPoolGet(NPool const* pool, NHandle handle)
+{
+	uint index = handle & N_POOL_INDEX_MASK;
+	if (!handle || index >= pool->numSlots) return NULL;
+	PoolSlot const* slot = PoolGetSlot(pool, index);
+	if ((slot->generation & 1) == 0 || (slot->generation & N_POOL_GENERATION_MASK) != handle >> N_POOL_INDEX_BITS) {
+		return NULL;
+	}
+	return PoolGetElement(pool, index);
+}
+
+void* nPoolAt(NPool const* pool, uint index, NHandle* pHandle)
+{
+	nAssert(index < pool->numSlots);
+	PoolSlot const* slot = PoolGetSlot(pool, index);
+	if ((slot->generation & 1) == 0) return NULL;
+	*pHandle = (NHandle)(slot->generation & N_POOL_GENERATION_MASK) << N_POOL_INDEX_BITS | index;
+	return PoolGetElement(pool, index);
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * array
+ *-----------------------------------------------------------------------------------------------*/
+/* the header is padded to the array alignment so that elements start aligned */
+#define ARRAY_ALIGNMENT 16
+
+typedef struct {
+	size_t capacity;
+	size_t length;
+} ArrayHeader;
+
+#define ARRAY_HEADER_SIZE nAlignUintUp(sizeof(ArrayHeader), ARRAY_ALIGNMENT)
+#define ARRAY_MIN_CAPACITY 8
 
-		header = newArrayHeader;
-		header->capacity = newCapacity;
-		header->length = oldLength;
+static inline ArrayHeader* GetArrayHeader(void const* array)
+{
+	return (ArrayHeader*)((char*)array - ARRAY_HEADER_SIZE);
+}
 
-		*parray = new_array;
+static bool ArrayRealloc(void** parray, NuAllocator* allocator, size_t elementSize, size_t capacity)
+{
+	if (elementSize && capacity > (SIZE_MAX - ARRAY_HEADER_SIZE) / elementSize) {
+		nDebugWarning("Array size overflow.");
+		return false;
 	}
 
+	const size_t totalSize = ARRAY_HEADER_SIZE + elementSize * capacity;
+	void* oldBlock = *parray ? GetArrayHeader(*parray) : NULL;
+	ArrayHeader* header = allocator->realloc(oldBlock, totalSize, ARRAY_ALIGNMENT, allocator->userData);
+	if (!header) return false;
+
+	if (!oldBlock) header->length = 0;
+	header->capacity = capacity;
+	*parray = (char*)header + ARRAY_HEADER_SIZE;
 	return true;
 }
 
-void* nArrayPushEx(void** parray, NuAllocator* allocator, uint elementSize, uint count)
+bool nArrayReserveEx(void** parray, NuAllocator* allocator, size_t elementSize, size_t capacity)
+{
+	const size_t oldCapacity = nArrayCapacity(*parray);
+	if (*parray && oldCapacity >= capacity) return true;
+
+	/* grow geometrically, falling back to the exact capacity if doubling would overflow */
+	size_t newCapacity = oldCapacity <= SIZE_MAX / 2 ? oldCapacity * 2 : capacity;
+	newCapacity = max_size_t(max_size_t(newCapacity, capacity), ARRAY_MIN_CAPACITY);
+	return ArrayRealloc(parray, allocator, elementSize, newCapacity) ||
+		(newCapacity > capacity && ArrayRealloc(parray, allocator, elementSize, capacity));
+}
+
+void* nArrayPushEx(void** parray, NuAllocator* allocator, size_t elementSize, size_t count)
+{
+	const size_t oldLength = nArrayLen(*parray);
+	if (count > SIZE_MAX - oldLength) return NULL;
+
+	if (!nArrayReserveEx(parray, allocator, elementSize, oldLength + count)) {
+		return NULL;
+	}
+
+	GetArrayHeader(*parray)->length = oldLength + count;
+	return (char*)*parray + oldLength * elementSize;
+}
+
+void* nArrayInsertEx(void** parray, NuAllocator* allocator, size_t elementSize, size_t index, size_t count)
 {
-	uint old_length = nArrayLen(*parray);
-	uint new_length = old_length + count;
+	const size_t oldLength = nArrayLen(*parray);
+	nEnforce(index <= oldLength, "Array insertion index out of bounds.");
 
-	if (!nArrayReserveEx(parray, allocator, elementSize, new_length)) {
+	if (!nArrayPushEx(parray, allocator, elementSize, count)) {
 		return NULL;
 	}
 
-	getArrayHeader(*parray)->length = new_length;
+	char* at = (char*)*parray + index * elementSize;
+	memmove(at + count * elementSize, at, (oldLength - index) * elementSize);
+	return at;
+}
+
+void nArrayEraseEx(void* array, size_t elementSize, size_t index, size_t count)
+{
+	if (!count) return;
+	ArrayHeader* header = GetArrayHeader(array);
+	nEnforce(index <= header->length && count <= header->length - index, "Array erase range out of bounds.");
+
+	char* at = (char*)array + index * elementSize;
+	memmove(at, at + count * elementSize, (header->length - index - count) * elementSize);
+	header->length -= count;
+}
+
+void nArraySwapRemoveEx(void* array, size_t elementSize, size_t index)
+{
+	ArrayHeader* header = GetArrayHeader(array);
+	nEnforce(index < header->length, "Array index out of bounds.");
+
+	const size_t last = --header->length;
+	if (index != last) {
+		memcpy((char*)array + index * elementSize, (char*)array + last * elementSize, elementSize);
+	}
+}
+
+bool nArrayShrinkToFitEx(void** parray, NuAllocator* allocator, size_t elementSize)
+{
+	if (!*parray) return true;
+	ArrayHeader* header = GetArrayHeader(*parray);
+	if (header->length == header->capacity) return true;
+
+	if (!header->length) {
+		n_free(header, allocator);
+		*parray = NULL;
+		return true;
+	}
 
-	return ((char*)*parray) + old_length * elementSize;
+	return ArrayRealloc(parray, allocator, elementSize, header->length);
 }
 
 void nArrayFree(void* array, NuAllocator* allocator)
 {
-	if (array) n_free(getArrayHeader(array), allocator);
+	if (array) n_free(GetArrayHeader(array), allocator);
 }
 
 void nArrayClear(void* array)
 {
-	ArrayHeader* header = getArrayHeader(array);
-	if (array) header->length = 0;
+	if (array) GetArrayHeader(array)->length = 0;
+}
+
+size_t nArrayLen(void const* array)
+{
+	return array ? GetArrayHeader(array)->length : 0;
 }
 
-uint nArrayLen(void* array)
+size_t nArrayCapacity(void const* array)
 {
-	return array ? getArrayHeader(array)->length : 0;
+	return array ? GetArrayHeader(array)->capacity : 0;
 }
 
 bool nArrayAlignUp(void** parray, NuAllocator* allocator, uint alignment)
@@ -154,8 +608,326 @@ bool nArrayAlignUp(void** parray, NuAllocator* allocator, uint alignment)
 			return false;
 		}
 	}
-	ArrayHeader* header = getArrayHeader(*parray);
+	nAssert(alignment <= ARRAY_ALIGNMENT);
+	ArrayHeader* header = GetArrayHeader(*parray);
 	char* back = (char*)*parray + header->length;
-	uint64_t offset = (char*)nAlignPtrUp(back, alignment) - back;
-	return nArrayPushEx(parray, allocator, 1, (uint)offset) != NULL;
+	size_t offset = (char*)nAlignPtrUp(back, alignment) - back;
+	return nArrayPushEx(parray, allocator, 1, offset) != NULL;
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * hashing
+ *-----------------------------------------------------------------------------------------------*/
+static inline uint64_t MulFold64(uint64_t a, uint64_t b)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	uint64_t hi;
+	uint64_t lo = _umul128(a, b, &hi);
+	return lo ^ hi;
+#elif defined(__SIZEOF_INT128__)
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+	uint64_t ha = a >> 32, la = (uint32_t)a, hb = b >> 32, lb = (uint32_t)b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+	return lo ^ hi;
+#endif
+}
+
+static inline uint64_t Read64(uint8_t const* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t Read32(uint8_t const* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+uint64_t nHash64(void const* data, size_t size, uint64_t seed)
+{
+	/* multiply-fold hash in the style of wyhash */
+	static const uint64_t k0 = 0xa0761d6478bd642full, k1 = 0xe7037ed1a0b428dbull;
+	static const uint64_t k2 = 0x8ebc6af09c88c6e3ull, k3 = 0x589965cc75374cc3ull;
+
+	uint8_t const* p = data;
+	uint64_t a, b;
+	seed ^= k0;
+
+	if (size <= 16) {
+		if (size >= 4) {
+			size_t middle = (size >> 3) << 2;
+			a = (Read32(p) << 32) | Read32(p + middle);
+			b = (Read32(p + size - 4) << 32) | Read32(p + size - 4 - middle);
+		}
+		else if (size > 0) {
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8) | p[size - 1];
+			b = 0;
+		}
+		else {
+			a = b = 0;
+		}
+	}
+	else {
+		size_t left = size;
+		if (left > 48) {
+			uint64_t seed1 = seed, seed2 = seed;
+			do {
+				seed = MulFold64(Read64(p) ^ k1, Read64(p + 8) ^ seed);
+				seed1 = MulFold64(Read64(p + 16) ^ k2, Read64(p + 24) ^ seed1);
+				seed2 = MulFold64(Read64(p + 32) ^ k3, Read64(p + 40) ^ seed2);
+				p += 48;
+				left -= 48;
+			} while (left > 48);
+			seed ^= seed1 ^ seed2;
+		}
+		while (left > 16) {
+			seed = MulFold64(Read64(p) ^ k1, Read64(p + 8) ^ seed);
+			p += 16;
+			left -= 16;
+		}
+		a = Read64(p + left - 16);
+		b = Read64(p + left - 8);
+	}
+
+	return MulFold64(k1 ^ size, MulFold64(a ^ k1, b ^ seed));
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * hash map
+ *-----------------------------------------------------------------------------------------------*/
+#define CTRL_EMPTY   ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xfe)
+
+/* one bit per slot of the group */
+typedef uint32_t GroupMask;
+
+static inline GroupMask GroupMatch(uint8_t const* group, uint8_t h2)
+{
+#ifdef N_HASH_MAP_SSE2
+	__m128i ctrl = _mm_loadu_si128((__m128i const*)group);
+	return (GroupMask)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2)));
+#else
+	GroupMask mask = 0;
+	for (uint i = 0; i < N_HASH_MAP_GROUP_SIZE; ++i) mask |= (GroupMask)(group[i] == h2) << i;
+	return mask;
+#endif
+}
+
+static inline GroupMask GroupMatchEmpty(uint8_t const* group)
+{
+	return GroupMatch(group, CTRL_EMPTY);
+}
+
+static inline GroupMask GroupMatchEmptyOrDeleted(uint8_t const* group)
+{
+#ifdef N_HASH_MAP_SSE2
+	/* full slots have the high bit clear */
+	return (GroupMask)_mm_movemask_epi8(_mm_loadu_si128((__m128i const*)group));
+#else
+	GroupMask mask = 0;
+	for (uint i = 0; i < N_HASH_MAP_GROUP_SIZE; ++i) mask |= (GroupMask)(group[i] >> 7) << i;
+	return mask;
+#endif
+}
+
+static inline uint LowestBitIndex(GroupMask mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static inline uint HighestBitIndex(GroupMask mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, mask);
+	return index;
+#else
+	return 31 - __builtin_clz(mask);
+#endif
+}
+
+static inline uint64_t HashMapHashKey(NHashMap const* map, void const* key)
+{
+	switch (map->keySize) {
+		case 4: return nHashU64(Read32(key));
+		case 8: return nHashU64(Read64(key));
+		default: return nHash64(key, map->keySize, 0);
+	}
+}
+
+static inline size_t HashMapMaxCount(size_t capacity)
+{
+	return capacity - capacity / 8;
+}
+
+static inline void HashMapSetCtrl(NHashMap* map, size_t index, uint8_t value)
+{
+	map->ctrl[index] = value;
+	if (index < N_HASH_MAP_GROUP_SIZE) {
+		map->ctrl[map->capacity + index] = value;
+	}
+}
+
+static size_t HashMapFindIndex(NHashMap const* map, void const* key, uint64_t hash)
+{
+	if (!map->capacity) return SIZE_MAX;
+
+	const size_t mask = map->capacity - 1;
+	const uint8_t h2 = (uint8_t)(hash & 0x7f);
+	size_t pos = (size_t)(hash >> 7) & mask;
+
+	/* triangular probing over groups visits every group when capacity is a power of two */
+	for (size_t stride = N_HASH_MAP_GROUP_SIZE;; stride += N_HASH_MAP_GROUP_SIZE) {
+		uint8_t const* group = map->ctrl + pos;
+		for (GroupMask match = GroupMatch(group, h2); match; match &= match - 1) {
+			size_t index = (pos + LowestBitIndex(match)) & mask;
+			if (memcmp(map->keys + index * map->keySize, key, map->keySize) == 0) return index;
+		}
+		if (GroupMatchEmpty(group)) return SIZE_MAX;
+		pos = (pos + stride) & mask;
+	}
+}
+
+static size_t HashMapFindInsertIndex(NHashMap const* map, uint64_t hash)
+{
+	const size_t mask = map->capacity - 1;
+	size_t pos = (size_t)(hash >> 7) & mask;
+	for (size_t stride = N_HASH_MAP_GROUP_SIZE;; stride += N_HASH_MAP_GROUP_SIZE) {
+		GroupMask match = GroupMatchEmptyOrDeleted(map->ctrl + pos);
+		if (match) return (pos + LowestBitIndex(match)) & mask;
+		pos = (pos + stride) & mask;
+	}
+}
+
+static bool HashMapRehash(NHashMap* map, size_t newCapacity)
+{
+	const size_t keysOffset = nAlignUintUp(newCapacity + N_HASH_MAP_GROUP_SIZE, 16);
+	const size_t valuesOffset = keysOffset + nAlignUintUp(newCapacity * map->keySize, 16);
+	const size_t allocationSize = valuesOffset + newCapacity * map->valueSize;
+
+	char* memory = map->allocator.malloc(allocationSize, 16, map->allocator.userData);
+	if (!memory) return false;
+
+	NHashMap old = *map;
+	map->capacity = newCapacity;
+	map->ctrl = (uint8_t*)memory;
+	map->keys = memory + keysOffset;
+	map->values = memory + valuesOffset;
+	map->growthLeft = HashMapMaxCount(newCapacity) - map->count;
+	memset(map->ctrl, CTRL_EMPTY, newCapacity + N_HASH_MAP_GROUP_SIZE);
+
+	for (size_t i = 0; i < old.capacity; ++i) {
+		if (old.ctrl[i] & 0x80) continue;
+		void const* key = old.keys + i * old.keySize;
+		size_t index = HashMapFindInsertIndex(map, HashMapHashKey(map, key));
+		HashMapSetCtrl(map, index, old.ctrl[i]);
+		memcpy(map->keys + index * map->keySize, key, map->keySize);
+		memcpy(map->values + index * map->valueSize, old.values + i * old.valueSize, map->valueSize);
+	}
+
+	if (old.ctrl) {
+		n_free(old.ctrl, (&map->allocator));
+	}
+	return true;
+}
+
+void nInitHashMap(NHashMap* map, NuAllocator* allocator, uint keySize, uint valueSize)
+{
+	nZero(map);
+	map->allocator = *allocator;
+	map->keySize = keySize;
+	map->valueSize = valueSize;
+}
+
+void nDeinitHashMap(NHashMap* map)
+{
+	if (map->ctrl) {
+		n_free(map->ctrl, (&map->allocator));
+	}
+	nZero(map);
+}
+
+bool nHashMapReserve(NHashMap* map, size_t count)
+{
+	if (count <= map->count + map->growthLeft) return true;
+	size_t capacity = N_HASH_MAP_GROUP_SIZE;
+	while (HashMapMaxCount(capacity) < count) capacity *= 2;
+	return HashMapRehash(map, capacity);
+}
+
+void nHashMapClear(NHashMap* map)
+{
+	if (!map->capacity) return;
+	memset(map->ctrl, CTRL_EMPTY, map->capacity + N_HASH_MAP_GROUP_SIZE);
+	map->count = 0;
+	map->growthLeft = HashMapMaxCount(map->capacity);
+}
+
+void* nHashMapFind(NHashMap const* map, void const* key)
+{
+	nAssert(key);
+	size_t index = HashMapFindIndex(map, key, HashMapHashKey(map, key));
+	return index == SIZE_MAX ? NULL : map->values + index * map->valueSize;
+}
+
+void* nHashMapInsert(NHashMap* map, void const* key, bool* pInserted)
+{
+	const uint64_t hash = HashMapHashKey(map, key);
+	size_t index = HashMapFindIndex(map, key, hash);
+
+	if (index != SIZE_MAX) {
+		if (pInserted) *pInserted = false;
+		return map->values + index * map->valueSize;
+	}
+
+	if (!map->growthLeft) {
+		/* grow, or only drop tombstones if they are what is filling the map */
+		size_t capacity = map->capacity;
+		if (!capacity) capacity = N_HASH_MAP_GROUP_SIZE;
+		else if (map->count + 1 > HashMapMaxCount(capacity) / 2) capacity *= 2;
+		if (!HashMapRehash(map, capacity)) return NULL;
+	}
+
+	index = HashMapFindInsertIndex(map, hash);
+	if (map->ctrl[index] == CTRL_EMPTY) --map->growthLeft;
+	HashMapSetCtrl(map, index, (uint8_t)(hash & 0x7f));
+	memcpy(map->keys + index * map->keySize, key, map->keySize);
+	++map->count;
+
+	if (pInserted) *pInserted = true;
+	return map->values + index * map->valueSize;
+}
+
+bool nHashMapRemove(NHashMap* map, void const* key)
+{
+	size_t index = HashMapFindIndex(map, key, HashMapHashKey(map, key));
+	if (index == SIZE_MAX) return false;
+
+	/* the slot can go back to empty only if no probe sequence ever went past it, that is if no window
+	 * of N_HASH_MAP_GROUP_SIZE slots containing it has ever been full */
+	const size_t before = (index - N_HASH_MAP_GROUP_SIZE) & (map->capacity - 1);
+	const GroupMask emptyAfter = GroupMatchEmpty(map->ctrl + index);
+	const GroupMask emptyBefore = GroupMatchEmpty(map->ctrl + before);
+	if (emptyBefore && emptyAfter &&
+		LowestBitIndex(emptyAfter) + (N_HASH_MAP_GROUP_SIZE - 1 - HighestBitIndex(emptyBefore)) < N_HASH_MAP_GROUP_SIZE) {
+		HashMapSetCtrl(map, index, CTRL_EMPTY);
+		++map->growthLeft;
+	}
+	else {
+		HashMapSetCtrl(map, index, CTRL_DELETED);
+	}
+	--map->count;
+	return true;
+}
+
+void* nHashMapAt(NHashMap const* map, size_t index, void const** pKey)
+{
+	nAssert(index < map->capacity);
+	if (map->ctrl[index] & 0x80) return NULL;
+	if (pKey) *pKey = map->keys + index * map->keySize;
+	return map->values + index * map->valueSize;
 }
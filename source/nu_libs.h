@@ -11,6 +11,11 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
 typedef unsigned uint;
 
  /*-------------------------------------------------------------------------------------------------
@@ -20,6 +25,10 @@ typedef unsigned uint;
 	#define n_threadlocal __declspec(thread)
 	#define n_forceinline __forceinline
 	#define n_alignof(type) _Alignof(type)
+#elif defined(__GNUC__)
+	#define n_threadlocal __thread
+	#define n_forceinline inline __attribute__((always_inline))
+	#define n_alignof(type) _Alignof(type)
 #else
 	#error implement this
 #endif
@@ -27,6 +36,46 @@ typedef unsigned uint;
 #define nStringifyX(x) #x
 #define nStringify(x) nStringifyX(x)
 
+/*-------------------------------------------------------------------------------------------------
+ * atomics
+ *-----------------------------------------------------------------------------------------------*/
+#ifdef _MSC_VER
+	#include <intrin.h>
+	static n_forceinline int32_t nAtomicAdd32(int32_t volatile* p, int32_t v) { return _InterlockedExchangeAdd((long volatile*)p, v) + v; }
+	static n_forceinline int64_t nAtomicAdd64(int64_t volatile* p, int64_t v) { return _InterlockedExchangeAdd64(p, v) + v; }
+	static n_forceinline int32_t nAtomicExchange32(int32_t volatile* p, int32_t v) { return _InterlockedExchange((long volatile*)p, v); }
+	static n_forceinline bool nAtomicCas32(int32_t volatile* p, int32_t expected, int32_t desired) { return _InterlockedCompareExchange((long volatile*)p, desired, expected) == expected; }
+	static n_forceinline bool nAtomicCas64(int64_t volatile* p, int64_t expected, int64_t desired) { return _InterlockedCompareExchange64(p, desired, expected) == expected; }
+	static n_forceinline int32_t nAtomicLoad32(int32_t volatile const* p) { int32_t v = *p; _ReadWriteBarrier(); return v; }
+	static n_forceinline int64_t nAtomicLoad64(int64_t volatile const* p) { int64_t v = *p; _ReadWriteBarrier(); return v; }
+	static n_forceinline void nAtomicStore32(int32_t volatile* p, int32_t v) { _ReadWriteBarrier(); *p = v; }
+	static n_forceinline void nAtomicStore64(int64_t volatile* p, int64_t v) { _ReadWriteBarrier(); *p = v; }
+	static n_forceinline void nAtomicFence(void) { _mm_mfence(); }
+	static n_forceinline void nCpuPause(void) { _mm_pause(); }
+#else
+	static n_forceinline int32_t nAtomicAdd32(int32_t volatile* p, int32_t v) { return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST); }
+	static n_forceinline int64_t nAtomicAdd64(int64_t volatile* p, int64_t v) { return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST); }
+	static n_forceinline int32_t nAtomicExchange32(int32_t volatile* p, int32_t v) { return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST); }
+	static n_forceinline bool nAtomicCas32(int32_t volatile* p, int32_t expected, int32_t desired) { return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+	static n_forceinline bool nAtomicCas64(int64_t volatile* p, int64_t expected, int64_t desired) { return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+	static n_forceinline int32_t nAtomicLoad32(int32_t volatile const* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+	static n_forceinline int64_t nAtomicLoad64(int64_t volatile const* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+	static n_forceinline void nAtomicStore32(int32_t volatile* p, int32_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+	static n_forceinline void nAtomicStore64(int64_t volatile* p, int64_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+	static n_forceinline void nAtomicFence(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+	static n_forceinline void nCpuPause(void) { __builtin_ia32_pause(); }
+#endif
+
+/**
+ * Atomically raises *\p p to \p v if lower.
+ */
+static inline void nAtomicMax64(int64_t volatile* p, int64_t v)
+{
+	for (int64_t current = nAtomicLoad64(p); current < v; current = nAtomicLoad64(p)) {
+		if (nAtomicCas64(p, current, v)) break;
+	}
+}
+
 /*-------------------------------------------------------------------------------------------------
  * debugging
  *-----------------------------------------------------------------------------------------------*/
@@ -44,10 +93,13 @@ typedef enum
 	N_DEBUG_DIALOG_TYPE_OK_IGNORE_ABORT_RETRY,
 } NDebugDialogType;
 
-#ifdef _DEBUG
+/* premake configurations define DEBUG, MSVC debug runtimes _DEBUG */
+#if defined(DEBUG) || defined(_DEBUG)
 
 #ifdef _MSC_VER
 	#define nDebugBreak() __debugbreak()
+#elif defined(__GNUC__)
+	#define nDebugBreak() __builtin_trap()
 #else
 	#define nDebugBreak()
 #endif
@@ -55,19 +107,19 @@ typedef enum
 #define nDebugError(format, ...) {\
 	static bool ___n_ignore = false;\
 	if (___n_ignore) {\
-		nDebugPrint("[error] " format "\n", __VA_ARGS__);\
+		nDebugPrint("[error] " format "\n", ##__VA_ARGS__);\
 	}\
 	else {\
-		NDebugDialogResult ___n_result = nDebugShowDialog(N_DEBUG_DIALOG_TYPE_OK_IGNORE_ABORT_RETRY, "Debug Error", "[error] " format, __VA_ARGS__); \
+		NDebugDialogResult ___n_result = nDebugShowDialog(N_DEBUG_DIALOG_TYPE_OK_IGNORE_ABORT_RETRY, "Debug Error", "[error] " format, ##__VA_ARGS__); \
 		if (___n_result == N_DEBUG_DIALOG_RESULT_IGNORE) ___n_ignore = true; \
 		else if (___n_result == N_DEBUG_DIALOG_RESULT_RETRY) nDebugBreak(); \
 		else exit(-1);\
 	}\
 }
 
-#define nDebugWarning(format, ...)	nDebugPrint("[warning] " format "\n", __VA_ARGS__)
+#define nDebugWarning(format, ...)	nDebugPrint("[warning] " format "\n", ##__VA_ARGS__)
 
-#define nDebugInfo(format, ...) 	nDebugPrint("[info] " format "\n", __VA_ARGS__)
+#define nDebugInfo(format, ...) 	nDebugPrint("[info] " format "\n", ##__VA_ARGS__)
 
 #define nAssert(condition) nEnforce(condition, "Assertion failure:\n\t" # condition)
 
@@ -75,7 +127,7 @@ typedef enum
 	if (!(condition)) {\
 		static bool ___n_ignore = false;\
 		if (!___n_ignore) {\
-			NDebugDialogResult ___n_result = nDebugShowDialog(N_DEBUG_DIALOG_TYPE_OK_IGNORE_ABORT_RETRY, "Error", message, __VA_ARGS__); \
+			NDebugDialogResult ___n_result = nDebugShowDialog(N_DEBUG_DIALOG_TYPE_OK_IGNORE_ABORT_RETRY, "Error", message, ##__VA_ARGS__); \
 			if (___n_result == N_DEBUG_DIALOG_RESULT_IGNORE) ___n_ignore = true; \
 			else if (___n_result == N_DEBUG_DIALOG_RESULT_RETRY) nDebugBreak(); \
 			else exit(-1);\
@@ -92,7 +144,7 @@ typedef enum
 
 #define nEnforce(condition, message, ...) \
 	if (!(condition)) {\
-		nDebugShowDialog(N_DEBUG_DIALOG_TYPE_OK, "Fatal error", message ## "\nThe application will now close.", __VA_ARGS__); \
+		nDebugShowDialog(N_DEBUG_DIALOG_TYPE_OK, "Fatal error, the application will now close", message, ##__VA_ARGS__); \
 		exit(-1);\
 	}
 
@@ -140,6 +192,7 @@ n_forceinline void* nAlignPtrDown(void* ptr, uint alignment)
 nunki_define_min_max(int)
 nunki_define_min_max(uint)
 nunki_define_min_max(size_t)
+nunki_define_min_max(uint64_t)
 nunki_define_min_max(float)
 nunki_define_min_max(double)
 
@@ -152,18 +205,352 @@ inline uint nSwizzleUInt(uint ui)
 	return (ui >> 24) | ((ui >> 8) & 0x0000ff00) | ((ui << 8) & 0x00ff0000) | (ui << 24);
 }
 
+/*-------------------------------------------------------------------------------------------------
+ * virtual memory
+ *-----------------------------------------------------------------------------------------------*/
+/**
+ * @returns the granularity in bytes at which memory can be committed.
+ */
+size_t nVirtualPageSize(void);
+
+/**
+ * Reserves \p size bytes of address space without backing them with physical memory.
+ * @returns the base address of the reserved range or NULL on failure.
+ */
+void* nVirtualReserve(size_t size);
+
+/**
+ * Backs with physical memory the page-aligned range [\p ptr, \p ptr + \p size) of a reserved range.
+ */
+bool nVirtualCommit(void* ptr, size_t size);
+
+/**
+ * Releases a whole range previously returned by nVirtualReserve().
+ */
+void nVirtualRelease(void* ptr, size_t size);
+
+/*-------------------------------------------------------------------------------------------------
+ * threads
+ *-----------------------------------------------------------------------------------------------*/
+typedef void (*NThreadFunc)(void* data);
+
+typedef struct {
+#ifdef _WIN32
+	void* handle;
+#else
+	pthread_t handle;
+#endif
+	NThreadFunc func;
+	void* data;
+} NThread;
+
+typedef struct {
+#ifdef _WIN32
+	void* handle;
+#else
+	sem_t handle;
+#endif
+} NSemaphore;
+
+/**
+ * Starts a thread running \p func(\p data). The \p thread object must stay alive until joined.
+ */
+bool nCreateThread(NThread* thread, NThreadFunc func, void* data);
+
+/**
+ * Waits for \p thread to return and releases it.
+ */
+void nJoinThread(NThread* thread);
+
+/**
+ * Gives up the rest of the calling thread time slice.
+ */
+void nYieldThread(void);
+
+/**
+ * @returns the number of logical processors in the system.
+ */
+uint nGetNumLogicalCores(void);
+
+bool nInitSemaphore(NSemaphore* semaphore, uint initialCount);
+void nDeinitSemaphore(NSemaphore* semaphore);
+void nSemaphorePost(NSemaphore* semaphore, uint count);
+void nSemaphoreWait(NSemaphore* semaphore);
+
+static inline void nSpinLock(int32_t volatile* lock)
+{
+	while (nAtomicExchange32(lock, 1)) {
+		while (nAtomicLoad32(lock)) nCpuPause();
+	}
+}
+
+static inline bool nSpinTryLock(int32_t volatile* lock)
+{
+	return !nAtomicLoad32(lock) && !nAtomicExchange32(lock, 1);
+}
+
+static inline void nSpinUnlock(int32_t volatile* lock)
+{
+	nAtomicStore32(lock, 0);
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * linear arena
+ *-----------------------------------------------------------------------------------------------*/
+#define N_LINEAR_ARENA_HISTORY_SIZE 8
+
+/**
+ * A bump allocator over a single buffer that is reclaimed in O(1) by nLinearArenaReset(). Requests that
+ * do not fit are served by the backing allocator and are taken into account when the buffer is
+ * resized at the next reset, so that in steady state no allocation reaches the backing allocator.
+ */
+typedef struct NLinearArena {
+	NuAllocator allocator; /* allocates from this arena, must be the first member */
+	NuAllocator backingAllocator;
+	char*  buffer;
+	size_t capacity;
+	size_t minCapacity;
+	size_t size;
+	char*  lastAllocationPtr;
+	void*  overflowBlocks;
+	size_t overflowSize;
+	size_t history[N_LINEAR_ARENA_HISTORY_SIZE];
+	uint   historyIndex;
+} NLinearArena;
+
+/**
+ * Initializes \p arena with an initial buffer of \p capacity bytes allocated from \p backingAllocator.
+ */
+NuResult nInitLinearArena(NLinearArena* arena, NuAllocator* backingAllocator, size_t capacity);
+
+/**
+ * Releases all memory owned by \p arena.
+ */
+void nDeinitLinearArena(NLinearArena* arena);
+
+/**
+ * Reclaims every allocation made from \p arena and resizes its buffer to the high-water mark of the
+ * last N_LINEAR_ARENA_HISTORY_SIZE resets.
+ */
+void nLinearArenaReset(NLinearArena* arena);
+
+/**
+ * @returns the allocator interface of \p arena.
+ */
+static inline NuAllocator* nLinearArenaAllocator(NLinearArena* arena) { return &arena->allocator; }
+
+/*-------------------------------------------------------------------------------------------------
+ * pool
+ *-----------------------------------------------------------------------------------------------*/
+#define N_POOL_INDEX_BITS 20
+#define N_POOL_INDEX_MASK ((1u << N_POOL_INDEX_BITS) - 1)
+#define N_POOL_GENERATION_MASK ((1u << (32 - N_POOL_INDEX_BITS)) - 1)
+#define N_POOL_MAX_SLABS 4096
+
+/**
+ * 32 bit handle to a pool element: the low N_POOL_INDEX_BITS are the slot index, the rest the slot
+ * generation at the time of allocation. Zero is never a valid handle.
+ */
+typedef uint32_t NHandle;
+
+/**
+ * Stores fixed size elements in slabs of 2^slabShift contiguous elements. Slabs are never moved or
+ * released before the pool is deinitialized, so element pointers are stable. Each slot has a
+ * generation counter, odd while the slot is alive, that is bumped on allocation and free so that
+ * stale handles are detected in O(1).
+ */
+typedef struct NPool {
+	NuAllocator allocator;
+	uint        elementSize;
+	uint        slabShift;
+	uint        numSlots;
+	uint        numAlive;
+	uint        freeList; /* index + 1 of the first free slot, zero if none */
+	char*       slabs[N_POOL_MAX_SLABS];
+} NPool;
+
+/**
+ * Initializes an empty pool of elements of \p elementSize bytes.
+ */
+void nInitPool(NPool* pool, NuAllocator* allocator, uint elementSize, uint slabShift);
+
+/**
+ * Releases all pool slabs. Live elements are not destructed.
+ */
+void nDeinitPool(NPool* pool);
+
+/**
+ * Allocates a zeroed element and writes its address to \p pElement.
+ * @returns the element handle or zero if out of memory.
+ */
+NHandle nPoolAlloc(NPool* pool, void** pElement);
+
+/**
+ * Frees the element referenced by \p handle, which must be alive.
+ */
+void nPoolFree(NPool* pool, NHandle handle);
+
+/**
+ * @returns the element referenced by \p handle or NULL if the handle is null or stale.
+ */
+void* nPoolGet(NPool const* pool, NHandle handle);
+
+/**
+ * Used to iterate over live elements, slot indices go from zero to pool->numSlots excluded.
+ * @returns the element in slot \p index and writes its handle to \p pHandle, or NULL if the slot is free.
+ */
+void* nPoolAt(NPool const* pool, uint index, NHandle* pHandle);
+
+/*-------------------------------------------------------------------------------------------------
+ * hashing
+ *-----------------------------------------------------------------------------------------------*/
+/**
+ * @returns a 64 bit hash of \p size bytes at \p data, suitable for hash tables but not cryptography.
+ */
+uint64_t nHash64(void const* data, size_t size, uint64_t seed);
+
+/**
+ * @returns a well mixed 64 bit hash of integer \p x.
+ */
+static inline uint64_t nHashU64(uint64_t x)
+{
+	/* splitmix64 finalizer */
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+/**
+ * Combines hash \p h with \p value.
+ */
+static inline uint64_t nHashCombine(uint64_t h, uint64_t value)
+{
+	return nHashU64(h ^ (value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2)));
+}
+
+/*-------------------------------------------------------------------------------------------------
+ * hash map
+ *-----------------------------------------------------------------------------------------------*/
+#define N_HASH_MAP_GROUP_SIZE 16
+
+/**
+ * Open-addressing hash map of fixed size keys and values compared bytewise. Slots are probed a group
+ * of N_HASH_MAP_GROUP_SIZE at a time through an array of one control byte per slot holding 7 bits of
+ * the key hash, so that most mismatching keys are skipped without touching them. Keys and values are
+ * stored in two separate arrays. Value pointers are invalidated by insertions that grow the map.
+ */
+typedef struct {
+	NuAllocator allocator;
+	uint        keySize;
+	uint        valueSize;
+	size_t      capacity;   /* power of two, zero or at least N_HASH_MAP_GROUP_SIZE */
+	size_t      count;
+	size_t      growthLeft; /* insertions into empty slots left before growing */
+	uint8_t*    ctrl;       /* capacity + N_HASH_MAP_GROUP_SIZE bytes, the tail mirrors the first group */
+	char*       keys;
+	char*       values;
+} NHashMap;
+
+/**
+ * Initializes an empty map of \p keySize bytes keys to \p valueSize bytes values. No memory is
+ * allocated before the first insertion.
+ */
+void nInitHashMap(NHashMap* map, NuAllocator* allocator, uint keySize, uint valueSize);
+
+/**
+ * Releases the map memory.
+ */
+void nDeinitHashMap(NHashMap* map);
+
+/**
+ * Grows the map so that it can hold \p count elements without further allocations.
+ */
+bool nHashMapReserve(NHashMap* map, size_t count);
+
+/**
+ * Removes all elements, keeping the memory.
+ */
+void nHashMapClear(NHashMap* map);
+
+/**
+ * @returns the value associated to \p key or NULL if not found.
+ */
+void* nHashMapFind(NHashMap const* map, void const* key);
+
+/**
+ * Finds the value associated to \p key or inserts a new one, whose content is undefined, if absent.
+ * Optionally writes in \p pInserted whether the key was inserted.
+ * @returns the value or NULL if out of memory.
+ */
+void* nHashMapInsert(NHashMap* map, void const* key, bool* pInserted);
+
+/**
+ * Removes \p key from the map.
+ * @returns whether the key was found.
+ */
+bool nHashMapRemove(NHashMap* map, void const* key);
+
+/**
+ * Used to iterate over map elements, slot indices go from zero to map->capacity excluded.
+ * @returns the value in slot \p index and writes its key pointer to \p pKey, or NULL if the slot is empty.
+ */
+void* nHashMapAt(NHashMap const* map, size_t index, void const** pKey);
+
 /*-------------------------------------------------------------------------------------------------
  * array
  *-----------------------------------------------------------------------------------------------*/
-bool nArrayReserveEx(void** parray, NuAllocator* allocator, uint elementSize, uint capacity);
-void* nArrayPushEx(void** parray, NuAllocator* allocator, uint elementSize, uint count);
-void  nArrayFree(void* array, NuAllocator* allocator);
-void  nArrayClear(void* array);
-uint  nArrayLen(void* array);
+/* Dynamic arrays are plain pointers to their first element, preceded in memory by their capacity and
+ * length. A NULL pointer is a valid empty array. Storage is grown through the allocator realloc so
+ * that allocators able to extend blocks in place avoid copying. */
+
+/**
+ * Ensures the array can hold \p capacity elements without reallocating.
+ * @returns false if out of memory or if the size overflows, leaving the array untouched.
+ */
+bool   nArrayReserveEx(void** parray, NuAllocator* allocator, size_t elementSize, size_t capacity);
+
+/**
+ * Appends \p count uninitialized elements.
+ * @returns a pointer to the first appended element or NULL if out of memory.
+ */
+void*  nArrayPushEx(void** parray, NuAllocator* allocator, size_t elementSize, size_t count);
+
+/**
+ * Inserts \p count uninitialized elements before element \p index, shifting the following ones.
+ * @returns a pointer to the first inserted element or NULL if out of memory.
+ */
+void*  nArrayInsertEx(void** parray, NuAllocator* allocator, size_t elementSize, size_t index, size_t count);
+
+/**
+ * Removes \p count elements starting at \p index, preserving the order of the remaining ones.
+ */
+void   nArrayEraseEx(void* array, size_t elementSize, size_t index, size_t count);
+
+/**
+ * Removes element \p index in constant time by moving the last element in its place.
+ */
+void   nArraySwapRemoveEx(void* array, size_t elementSize, size_t index);
+
+/**
+ * Reallocates the array to fit exactly its length, freeing it if empty.
+ */
+bool   nArrayShrinkToFitEx(void** parray, NuAllocator* allocator, size_t elementSize);
+
+void   nArrayFree(void* array, NuAllocator* allocator);
+void   nArrayClear(void* array);
+size_t nArrayLen(void const* array);
+size_t nArrayCapacity(void const* array);
 
 #define nArrayReserve(parray, allocator, type, capacity) nArrayReserveEx(parray, allocator, sizeof(type), capacity)
 #define nArrayPush(parray, allocator, type) (type*)nArrayPushEx(parray, allocator, sizeof(type), 1)
 #define nArrayPushN(parray, allocator, type, N) (type*)nArrayPushEx(parray, allocator, sizeof(type), N)
+#define nArrayInsertN(parray, allocator, type, index, N) (type*)nArrayInsertEx(parray, allocator, sizeof(type), index, N)
+#define nArrayErase(array, type, index, N) nArrayEraseEx(array, sizeof(type), index, N)
+#define nArraySwapRemove(array, type, index) nArraySwapRemoveEx(array, sizeof(type), index)
+#define nArrayShrinkToFit(parray, allocator, type) nArrayShrinkToFitEx(parray, allocator, sizeof(type))
 
 /**
  * Write the #documentation.
@@ -8,6 +8,7 @@
 #include "nu_window.h"
 #include "nu_device.h"
 #include "nu_builtin_resources.h"
+#include "nu_job.h"
 #include "nu_scene2d.h"
 #include "nu_font.h"
 #include "nu_base.h"
@@ -42,13 +43,30 @@ NuResult nuInitialize(NuInitializeInfo const* info, NuAllocator* allocator)
 	gRoot.initialized = true;
 	allocator = nGetDefaultOrAllocator(allocator);
 	gRoot.allocator = *allocator;
+	nInitTaggedAllocators(allocator);
+	NuAllocator* deviceAllocator = nGetTaggedOrAllocator(NULL, NU_MEMORY_TAG_DEVICE);
+	NuAllocator* scene2dAllocator = nGetTaggedOrAllocator(NULL, NU_MEMORY_TAG_SCENE2D);
+
+	uint numWorkerThreads = 0;
+	if (info && info->enableWorkerThreads) {
+		numWorkerThreads = info->numWorkerThreads ? info->numWorkerThreads : max_uint(nGetNumLogicalCores(), 2) - 1;
+	}
+
+	if (result = nInitJobModule(nGetTaggedOrAllocator(NULL, NU_MEMORY_TAG_GENERAL), numWorkerThreads)) {
+		nDebugError("Could not initialize job module.");
+		nuTerminate();
+		return result;
+	}
 	
 	if (result = nInitWindowModule()) {
 		nuTerminate();
 		return result;
 	}
 
-	if (result = nInitDevice(allocator, nGetDummyWindowHandle())) {
+	bool nullDevice = info && info->nullDevice;
+	const char* deviceTraceFilePath = nullDevice ? info->deviceTraceFilePath : NULL;
+	const char* programCacheDirectory = info ? info->programCacheDirectory : NULL;
+	if (result = nInitDevice(deviceAllocator, nGetDummyWindowHandle(), nullDevice, deviceTraceFilePath, programCacheDirectory)) {
 		nuTerminate();
 		return result;
 	}
@@ -59,9 +77,9 @@ NuResult nuInitialize(NuInitializeInfo const* info, NuAllocator* allocator)
 		return result;
 	}
 
-	nInitBuiltinResources(allocator);
+	nInitBuiltinResources(deviceAllocator);
 
-	if (result = nInitScene2D(allocator)) {
+	if (result = nInitScene2D(scene2dAllocator)) {
 		nuTerminate();
 		return result;
 	}
@@ -72,11 +90,12 @@ NuResult nuInitialize(NuInitializeInfo const* info, NuAllocator* allocator)
 void nuTerminate(void)
 {
 	EnforceInitialized();
-	nDeinitScene2D(&gRoot.allocator);
-	nDeinitBuiltinResources(&gRoot.allocator);
+	nDeinitScene2D(nGetTaggedOrAllocator(NULL, NU_MEMORY_TAG_SCENE2D));
+	nDeinitBuiltinResources(nGetTaggedOrAllocator(NULL, NU_MEMORY_TAG_DEVICE));
 	nDeinitFontModule();
 	nDeinitDevice();
 	nDeinitWindowModule();
+	nDeinitJobModule();
 	nDeinitThreadTempAllocator(&gRoot.allocator);
 	gRoot.initialized = false;
 }
@@ -6,9 +6,17 @@
 
 #include "nu_scene2d.h"
 #include "nu_builtin_resources.h"
+#include "nu_device.h"
 #include "nu_font.h"
 #include "nu_math.h"
 #include "nu_libs.h"
+#include "nunki/job.h"
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define N_RASTER_SSE2 1
+#endif
 
 /*-------------------------------------------------------------------------------------------------
  * Types
@@ -49,8 +57,7 @@ static const char* kMeshTypeStr[] = {
 
 typedef struct {
 	MeshType            meshType;
-	NuTechnique         technique;
-	const NuBlendState* blendState;
+	NuPipeline          pipeline;
 	NuTexture           texture;
 	NuSampler           sampler;
 	uint                enableTextures : 1;
@@ -70,18 +77,29 @@ typedef struct {
 	float transform[16];
 } Constants;
 
+#define DEFAULT_FRAME_ARENA_SIZE (64 * 1024)
+
 typedef struct NuScene2DImpl {
 	NuAllocator        allocator;
 	NuRect2i           viewport;
 	Command*           commands;
 	char*              instanceData;
+
+	/* frame arena mode */
+	bool               useFrameArena;
+	uint               frameIndex;
+	NLinearArena       frameArenas[2];
+	size_t             commandsHint;
+	size_t             instanceDataHint;
+
+	Nu2dStats          stats;
 } Scene2D;
 
 static struct {
 	bool initialized;
 	NuAllocator allocator;
 	uint quadMeshVertexBufferOffset;
-	NuBuffer constantBuffer;
+	NuBuffer constantBuffer; /* used when the device constant ring is full */
 	NuBuffer primitivesVertexBuffer;
 	NuBuffer instancesVertexBuffer;
 
@@ -91,6 +109,7 @@ static struct {
 	bool      immediateHasCommand;
 	Command   immediateCommand;
 	char*     immediateInstanceData;
+	Nu2dStats immediateStats;
 } gScene2D;
 
 /*-------------------------------------------------------------------------------------------------
@@ -98,12 +117,20 @@ static struct {
  *-----------------------------------------------------------------------------------------------*/
 #define EnforceInitialized() nEnforce(gScene2D.initialized, "Scene 2D module uninitialized.");
 
+/**
+ * @returns the allocator scene commands and instance data are recorded with.
+ */
+static inline NuAllocator* GetRecordingAllocator(Scene2D* scene)
+{
+	return scene->useFrameArena ? nLinearArenaAllocator(&scene->frameArenas[scene->frameIndex]) : &scene->allocator;
+}
+
 /**
  * Sets the device state so that draw commands can be issued.
  */
 static void SetDeviceViewport(NuContext context, NuRect2i viewport)
 {
-	/* update the constant buffer */
+	/* write the constants to the device constant ring */
 	Constants constants;
 	nOrtho((float)viewport.position.x,
 		(float)viewport.position.y,
@@ -111,11 +138,13 @@ static void SetDeviceViewport(NuContext context, NuRect2i viewport)
 		(float)viewport.position.y + viewport.size.height,
 		0.f, 1.f, constants.transform);
 
-	nuBufferUpdate(gScene2D.constantBuffer, 0, &constants, sizeof constants);
-
-	nuDeviceSetConstantBuffers(context, 0, 1, (NuBufferView[]) {
-		gScene2D.constantBuffer, 0, 0
-	});
+	NuBufferView constantsView;
+	if (nuDeviceWriteConstants(context, &constants, sizeof constants, &constantsView)) {
+		/* the ring is full, update the constant buffer instead */
+		nuBufferUpdate(gScene2D.constantBuffer, 0, &constants, sizeof constants);
+		constantsView = (NuBufferView) { gScene2D.constantBuffer, 0, 0 };
+	}
+	nuDeviceSetConstantBuffers(context, 0, 1, &constantsView);
 
 	/* set device viewport */
 	nuDeviceSetViewport(context, viewport);
@@ -127,11 +156,9 @@ static void SetDeviceViewport(NuContext context, NuRect2i viewport)
 static void ExecuteCommand(Command* command, NuContext context)
 {
 	DeviceState* state = &command->deviceState;
-	
-	nuDeviceSetBlendState(context, state->blendState);
 
 	/* set device state */
-	nuDeviceSetTechnique(context, state->technique);
+	nuDeviceSetPipeline(context, state->pipeline);
 
 	uint primitiveVertexOffset = (uint[]) {
 		gScene2D.quadMeshVertexBufferOffset,
@@ -156,16 +183,31 @@ static void ExecuteImmediateCommand(Command* command, NuContext context)
 {
 	nuBufferUpdate(gScene2D.instancesVertexBuffer, 0, gScene2D.immediateInstanceData, nArrayLen(gScene2D.immediateInstanceData));
 	ExecuteCommand(command, context);
-	nArrayClear(&gScene2D.immediateInstanceData);
+	nArrayClear(gScene2D.immediateInstanceData);
 	gScene2D.immediateHasCommand = false;
 }
 
-static bool CompatibleDeviceStates(const DeviceState* s1, const DeviceState* s2)
+/**
+ * @returns the first state that differs between \p s1 and \p s2, NU_2D_BATCH_BREAK_COUNT_ if they can
+ * be drawn by the same command.
+ */
+static Nu2dBatchBreak GetBatchBreak(const DeviceState* s1, const DeviceState* s2)
 {
-	return s1->meshType == s2->meshType &&
-		s1->technique == s2->technique &&
-		memcmp(&s1->blendState, &s2->blendState, sizeof(NuBlendState)) == 0 &&
-		s1->texture == s2->texture;
+	if (s1->meshType != s2->meshType) return NU_2D_BATCH_BREAK_MESH_TYPE;
+	if (s1->pipeline != s2->pipeline) return NU_2D_BATCH_BREAK_PIPELINE;
+	if (s1->texture != s2->texture) return NU_2D_BATCH_BREAK_TEXTURE;
+	if (s1->sampler != s2->sampler) return NU_2D_BATCH_BREAK_SAMPLER;
+	return NU_2D_BATCH_BREAK_COUNT_;
+}
+
+/**
+ * @returns the device pipeline for \p technique and \p blendState or zero if out of memory.
+ */
+static NuPipeline GetPipeline(NuTechnique technique, NuBlendState const* blendState)
+{
+	NuPipeline pipeline;
+	NuPipelineCreateInfo info = { technique, blendState };
+	return nuCreatePipeline(&info, &pipeline) == NU_SUCCESS ? pipeline : 0;
 }
 
 /**
@@ -177,34 +219,47 @@ static Command* NewCommand(Scene2D* scene, DeviceState const* deviceState)
 	Command* command = NULL;
 	char** instanceData;
 	NuAllocator* allocator;
+	Nu2dStats* stats;
 
 	if (scene) {
-		uint n = nArrayLen(scene->commands);
-		if (n > 0 && CompatibleDeviceStates(&scene->commands[n - 1].deviceState, deviceState)) {
+		size_t n = nArrayLen(scene->commands);
+		Nu2dBatchBreak batchBreak = n > 0 ? GetBatchBreak(&scene->commands[n - 1].deviceState, deviceState) : NU_2D_BATCH_BREAK_COUNT_;
+		if (n > 0 && batchBreak == NU_2D_BATCH_BREAK_COUNT_) {
 			return &scene->commands[n - 1];
 		}
-		command = nArrayPush(&scene->commands, &scene->allocator, Command);
+		allocator = GetRecordingAllocator(scene);
+		command = nArrayPush(&scene->commands, allocator, Command);
 		if (!command) return NULL;
 
-		allocator = &scene->allocator;
 		instanceData = &scene->instanceData;
+		stats = &scene->stats;
+		if (batchBreak != NU_2D_BATCH_BREAK_COUNT_) ++stats->numBatchBreaks[batchBreak];
 	}
 	/* if null, user asks for immediate mode scene */
 	else {
+		stats = &gScene2D.immediateStats;
+
 		/* if different commands, we need to flush the current one before continuing */
-		if (gScene2D.immediateHasCommand && !CompatibleDeviceStates(&gScene2D.immediateCommand.deviceState, deviceState)) {
+		Nu2dBatchBreak batchBreak = gScene2D.immediateHasCommand ? GetBatchBreak(&gScene2D.immediateCommand.deviceState, deviceState) : NU_2D_BATCH_BREAK_COUNT_;
+		if (batchBreak != NU_2D_BATCH_BREAK_COUNT_) {
 			ExecuteImmediateCommand(&gScene2D.immediateCommand, gScene2D.immediateContext);
+			++stats->numBatchBreaks[batchBreak];
 		}
 		gScene2D.immediateHasCommand = true;
 		command = &gScene2D.immediateCommand;
 		allocator = &gScene2D.allocator;
 		instanceData = &gScene2D.immediateInstanceData;
 	}
+	++stats->numCommands;
 
 	nAssert(command);
 	command->deviceState = *deviceState;
 
-	if (!nArrayAlignUp(instanceData, allocator, n_alignof(float))) {
+	/* start instances at a multiple of their size, so that the device can draw them from the same
+	 * vertex array using a base instance */
+	uint instanceSize = kMeshInstanceSize[deviceState->meshType];
+	size_t padding = (instanceSize - nArrayLen(*instanceData) % instanceSize) % instanceSize;
+	if (padding && !nArrayPushEx(instanceData, allocator, 1, padding)) {
 		return NULL;
 	}
 
@@ -219,20 +274,25 @@ static inline void* NewInstance(NuScene2D scene, MeshType checkMeshType)
 	EnforceInitialized();
 	Command* command = NULL;
 	void* instance = NULL;
+	Nu2dStats* stats;
 	if (scene) {
-		uint n = nArrayLen(scene->commands);
+		size_t n = nArrayLen(scene->commands);
 		nEnforce(n > 0, "No command given for specified Scene2D, you possibly forgot a nu2dBegin*() call?");
 		command = &scene->commands[n - 1];
-		instance = nArrayPushEx(&scene->instanceData, &scene->allocator, 1, kMeshInstanceSize[checkMeshType]);
+		instance = nArrayPushEx(&scene->instanceData, GetRecordingAllocator(scene), 1, kMeshInstanceSize[checkMeshType]);
+		stats = &scene->stats;
 	}
 	else {
 		nEnforce(gScene2D.immediateHasCommand, "No command given for immediate Scene2D, you possibly forgot a nu2dBegin*() call?");
 		command = &gScene2D.immediateCommand;
 		instance = nArrayPushEx(&gScene2D.immediateInstanceData, &gScene2D.allocator, 1, kMeshInstanceSize[checkMeshType]);
+		stats = &gScene2D.immediateStats;
 	}
+	if (!instance) return NULL;
 	nEnforce(command->deviceState.meshType == checkMeshType, "Instance 2D pushed on scene not in the correct draw state, current is '%s', instance pushed for draw state '%s'.",
 		kMeshTypeStr[command->deviceState.meshType], kMeshTypeStr[checkMeshType]);
 	++command->instanceCount;
+	++stats->numInstances;
 	return instance;
 }
 
@@ -240,7 +300,7 @@ static inline Command* LastCommand(NuScene2D scene)
 {
 	EnforceInitialized();
 	if (scene) {
-		uint n = nArrayLen(scene->commands);
+		size_t n = nArrayLen(scene->commands);
 		return n > 0 ? &scene->commands[n - 1] : NULL;
 	}
 	else {
@@ -248,6 +308,345 @@ static inline Command* LastCommand(NuScene2D scene)
 	}
 }
 
+/*-------------------------------------------------------------------------------------------------
+ * CPU rendering
+ *-----------------------------------------------------------------------------------------------*/
+/* nu2dRenderToImage() bins the scene quads into square tiles of the target and rasterizes the tiles in
+ * parallel. Pixels are shaded as the builtin 2D shaders do and blended as GL would with the command
+ * blend state, pixel centers at half integers and quad edges following the top-left rule. */
+
+#define RASTER_TILE_SIZE 64
+
+typedef enum {
+	RASTER_SHADER_SOLID,
+	RASTER_SHADER_TEXTURED,
+	RASTER_SHADER_FONT,
+} RasterShader;
+
+typedef enum {
+	RASTER_BLEND_REPLACE, /* default blend state */
+	RASTER_BLEND_ALPHA,   /* alpha blend state */
+	RASTER_BLEND_GENERIC,
+} RasterBlend;
+
+typedef struct {
+	RasterShader        shader;
+	RasterBlend         blend;
+	NuBlendState        blendState;
+	NuImageView         texture;
+	NuSamplerCreateInfo sampler;
+	bool                skip;
+} RasterCommand;
+
+typedef struct {
+	int     x0, y0, x1, y1;                 /* covered pixels, clipped to the target */
+	float   left, top, invWidth, invHeight; /* quad in target pixels, to interpolate uvs */
+	NuRect2 uvRect;
+	uint    color;
+	uint    command;
+} RasterQuad;
+
+typedef struct {
+	RasterCommand const* commands;
+	RasterQuad const*    quads;
+	uint const*          tileOffsets; /* first tileQuads entry of each tile, plus one past the last */
+	uint const*          tileQuads;
+	uint                 numTilesX;
+	uint8_t*             pixels;
+	uint                 width;
+	uint                 height;
+} RasterTarget;
+
+static const uint kRasterTexelSize[NU_IMAGE_FORMAT_COUNT_] = { 1, 2, 3, 4 };
+
+static inline void UnpackColor(uint color, float* c)
+{
+	c[0] = (color & 0xff) / 255.f;
+	c[1] = (color >> 8 & 0xff) / 255.f;
+	c[2] = (color >> 16 & 0xff) / 255.f;
+	c[3] = (color >> 24) / 255.f;
+}
+
+static inline uint8_t FloatToUnorm8(float v)
+{
+	v = v < 0 ? 0 : (v > 1 ? 1 : v);
+	return (uint8_t)(v * 255.f + 0.5f);
+}
+
+/**
+ * @returns x / 255 rounded to nearest, for x in [0, 255 * 255].
+ */
+static inline uint Div255(uint x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+static inline int WrapTexelCoord(int i, uint size, NuWrapMode mode)
+{
+	if (mode == NU_WRAP_MODE_REPEAT) {
+		i %= (int)size;
+		return i < 0 ? i + (int)size : i;
+	}
+	return i < 0 ? 0 : (i >= (int)size ? (int)size - 1 : i);
+}
+
+static void FetchTexel(RasterCommand const* command, int x, int y, float* texel)
+{
+	NuImageView const* texture = &command->texture;
+	x = WrapTexelCoord(x, texture->size.width, command->sampler.uWrapMode);
+	y = WrapTexelCoord(y, texture->size.height, command->sampler.vWrapMode);
+
+	uint texelSize = kRasterTexelSize[texture->format];
+	uint8_t const* p = (uint8_t const*)texture->data + ((size_t)y * texture->size.width + x) * texelSize;
+	texel[0] = 0; texel[1] = 0; texel[2] = 0; texel[3] = 1;
+	for (uint i = 0; i < texelSize; ++i) {
+		texel[i] = p[i] / 255.f;
+	}
+}
+
+/**
+ * Samples level zero of the command texture as textureLod(t, uv, 0) does, that is always with the
+ * magnification filter.
+ */
+static void SampleTexture(RasterCommand const* command, float u, float v, float* texel)
+{
+	float x = u * command->texture.size.width;
+	float y = v * command->texture.size.height;
+
+	if (command->sampler.magFilterMode == NU_FILTER_MODE_NEAREST || command->sampler.magFilterMode == NU_FILTER_MODE_MIPMAP_NEAREST) {
+		FetchTexel(command, (int)floorf(x), (int)floorf(y), texel);
+		return;
+	}
+
+	x -= 0.5f;
+	y -= 0.5f;
+	int x0 = (int)floorf(x), y0 = (int)floorf(y);
+	float ax = x - x0, ay = y - y0;
+	float t00[4], t10[4], t01[4], t11[4];
+	FetchTexel(command, x0, y0, t00);
+	FetchTexel(command, x0 + 1, y0, t10);
+	FetchTexel(command, x0, y0 + 1, t01);
+	FetchTexel(command, x0 + 1, y0 + 1, t11);
+	for (uint i = 0; i < 4; ++i) {
+		float top = t00[i] + (t10[i] - t00[i]) * ax;
+		float bottom = t01[i] + (t11[i] - t01[i]) * ax;
+		texel[i] = top + (bottom - top) * ay;
+	}
+}
+
+static float BlendFactor(NuBlendFactor factor, float const* src, float const* dst, uint channel)
+{
+	switch (factor) {
+		case NU_BLEND_FACTOR_ZERO: return 0;
+		case NU_BLEND_FACTOR_ONE: return 1;
+		case NU_BLEND_FACTOR_SRC_COLOR: case NU_BLEND_FACTOR_SRC1_COLOR: return src[channel];
+		case NU_BLEND_FACTOR_ONE_MINUS_SRC_COLOR: case NU_BLEND_FACTOR_ONE_MINUS_SRC1_COLOR: return 1 - src[channel];
+		case NU_BLEND_FACTOR_DST_COLOR: return dst[channel];
+		case NU_BLEND_FACTOR_ONE_MINUS_DST_COLOR: return 1 - dst[channel];
+		case NU_BLEND_FACTOR_SRC_ALPHA: case NU_BLEND_FACTOR_SRC1_ALPHA: return src[3];
+		case NU_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA: case NU_BLEND_FACTOR_ONE_MINUS_SRC1_ALPHA: return 1 - src[3];
+		case NU_BLEND_FACTOR_DST_ALPHA: return dst[3];
+		case NU_BLEND_FACTOR_ONE_MINUS_DST_ALPHA: return 1 - dst[3];
+		/* the device never sets a blend color, which defaults to zero */
+		case NU_BLEND_FACTOR_CONSTANT_COLOR: case NU_BLEND_FACTOR_CONSTANT_ALPHA: return 0;
+		case NU_BLEND_FACTOR_ONE_MINUS_CONSTANT_COLOR: case NU_BLEND_FACTOR_ONE_MINUS_CONSTANT_ALPHA: return 1;
+		case NU_BLEND_FACTOR_SRC_ALPHA_SATURATE: return channel == 3 ? 1 : min_float(src[3], 1 - dst[3]);
+	}
+	return 0;
+}
+
+static float BlendChannel(NuBlendOp op, float src, float srcFactor, float dst, float dstFactor)
+{
+	switch (op) {
+		case NU_BLEND_FUNC_ADD: return src * srcFactor + dst * dstFactor;
+		case NU_BLEND_FUNC_SUB: return src * srcFactor - dst * dstFactor;
+		case NU_BLEND_FUNC_REVERSE_SUB: return dst * dstFactor - src * srcFactor;
+		case NU_BLEND_FUNC_MIN: return min_float(src, dst);
+		case NU_BLEND_FUNC_MAX: return max_float(src, dst);
+	}
+	return src;
+}
+
+static void BlendPixel(RasterCommand const* command, float const* src, uint8_t* pixel)
+{
+	switch (command->blend) {
+		case RASTER_BLEND_REPLACE:
+			for (uint i = 0; i < 4; ++i) pixel[i] = FloatToUnorm8(src[i]);
+			return;
+
+		case RASTER_BLEND_ALPHA:
+			for (uint i = 0; i < 3; ++i) pixel[i] = FloatToUnorm8(src[i] * src[3] + pixel[i] / 255.f * (1 - src[3]));
+			pixel[3] = FloatToUnorm8(src[3]);
+			return;
+
+		case RASTER_BLEND_GENERIC:
+		{
+			NuBlendState const* blendState = &command->blendState;
+			float dst[4];
+			UnpackColor(pixel[0] | pixel[1] << 8 | pixel[2] << 16 | (uint)pixel[3] << 24, dst);
+			for (uint i = 0; i < 3; ++i) {
+				pixel[i] = FloatToUnorm8(BlendChannel(blendState->rgbOp,
+					src[i], BlendFactor(blendState->srcRgbFactor, src, dst, i),
+					dst[i], BlendFactor(blendState->dstRgbFactor, src, dst, i)));
+			}
+			pixel[3] = FloatToUnorm8(BlendChannel(blendState->alphaOp,
+				src[3], BlendFactor(blendState->srcAlphaFactor, src, dst, 3),
+				dst[3], BlendFactor(blendState->dstAlphaFactor, src, dst, 3)));
+			return;
+		}
+	}
+}
+
+/**
+ * Fills \p count pixels starting at \p pixels with a solid quad of \p color.
+ */
+static void FillSolidSpan(RasterCommand const* command, uint color, uint8_t* pixels, int count)
+{
+	int i = 0;
+
+	if (command->blend == RASTER_BLEND_REPLACE) {
+#ifdef N_RASTER_SSE2
+		__m128i color4 = _mm_set1_epi32((int)color);
+		for (; i + 4 <= count; i += 4) {
+			_mm_storeu_si128((__m128i*)(pixels + i * 4), color4);
+		}
+#endif
+		for (; i < count; ++i) {
+			memcpy(pixels + i * 4, &color, 4);
+		}
+		return;
+	}
+
+	if (command->blend == RASTER_BLEND_ALPHA) {
+		/* the source is exactly representable in 8 bits, blend in integers: rgb = s * a + d * (1 - a), alpha = a */
+		uint r = color & 0xff, g = color >> 8 & 0xff, b = color >> 16 & 0xff, a = color >> 24;
+#ifdef N_RASTER_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i srcTimesAlpha = _mm_set_epi16(0, (short)(b * a), (short)(g * a), (short)(r * a), 0, (short)(b * a), (short)(g * a), (short)(r * a));
+		const __m128i invAlpha = _mm_set_epi16(0, (short)(255 - a), (short)(255 - a), (short)(255 - a), 0, (short)(255 - a), (short)(255 - a), (short)(255 - a));
+		const __m128i rounding = _mm_set1_epi16(128);
+		const __m128i alphaMask = _mm_set1_epi32((int)0xff000000);
+		const __m128i alphaBits = _mm_set1_epi32((int)(a << 24));
+		for (; i + 4 <= count; i += 4) {
+			__m128i dst = _mm_loadu_si128((__m128i const*)(pixels + i * 4));
+			__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), invAlpha), srcTimesAlpha), rounding);
+			__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), invAlpha), srcTimesAlpha), rounding);
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+			__m128i result = _mm_packus_epi16(lo, hi);
+			_mm_storeu_si128((__m128i*)(pixels + i * 4), _mm_or_si128(_mm_andnot_si128(alphaMask, result), alphaBits));
+		}
+#endif
+		for (; i < count; ++i) {
+			uint8_t* pixel = pixels + i * 4;
+			pixel[0] = (uint8_t)Div255(r * a + pixel[0] * (255 - a));
+			pixel[1] = (uint8_t)Div255(g * a + pixel[1] * (255 - a));
+			pixel[2] = (uint8_t)Div255(b * a + pixel[2] * (255 - a));
+			pixel[3] = (uint8_t)a;
+		}
+		return;
+	}
+
+	float src[4];
+	UnpackColor(color, src);
+	for (; i < count; ++i) {
+		BlendPixel(command, src, pixels + i * 4);
+	}
+}
+
+/**
+ * Shades and blends the pixels of row \p y between \p x0 and \p x1 covered by a textured quad.
+ */
+static void FillTexturedSpan(RasterCommand const* command, RasterQuad const* quad, uint8_t* row, int y, int x0, int x1)
+{
+	float color[4];
+	UnpackColor(quad->color, color);
+	float v = quad->uvRect.position.y + quad->uvRect.size.height * ((y + 0.5f - quad->top) * quad->invHeight);
+
+	for (int x = x0; x < x1; ++x) {
+		float u = quad->uvRect.position.x + quad->uvRect.size.width * ((x + 0.5f - quad->left) * quad->invWidth);
+		float texel[4], src[4];
+		SampleTexture(command, u, v, texel);
+
+		if (command->shader == RASTER_SHADER_FONT) {
+			/* 2d_quad_textured_font_frag.glsl */
+			if (texel[0] <= 0.01f) continue;
+			src[0] = color[0];
+			src[1] = color[1];
+			src[2] = color[2];
+			src[3] = color[3] * texel[0];
+		}
+		else {
+			/* 2d_quad_textured_frag.glsl */
+			for (uint i = 0; i < 4; ++i) src[i] = color[i] * texel[i];
+		}
+
+		BlendPixel(command, src, row + x * 4);
+	}
+}
+
+static void RasterizeTiles(void* data, uint begin, uint end)
+{
+	RasterTarget const* target = data;
+
+	for (uint tile = begin; tile < end; ++tile) {
+		int tileX0 = (int)(tile % target->numTilesX) * RASTER_TILE_SIZE;
+		int tileY0 = (int)(tile / target->numTilesX) * RASTER_TILE_SIZE;
+		int tileX1 = min_int(tileX0 + RASTER_TILE_SIZE, (int)target->width);
+		int tileY1 = min_int(tileY0 + RASTER_TILE_SIZE, (int)target->height);
+
+		for (uint i = target->tileOffsets[tile]; i < target->tileOffsets[tile + 1]; ++i) {
+			RasterQuad const* quad = &target->quads[target->tileQuads[i]];
+			RasterCommand const* command = &target->commands[quad->command];
+			int x0 = max_int(quad->x0, tileX0), x1 = min_int(quad->x1, tileX1);
+			int y0 = max_int(quad->y0, tileY0), y1 = min_int(quad->y1, tileY1);
+
+			for (int y = y0; y < y1; ++y) {
+				uint8_t* row = target->pixels + (size_t)y * target->width * 4;
+				if (command->shader == RASTER_SHADER_SOLID) {
+					FillSolidSpan(command, quad->color, row + x0 * 4, x1 - x0);
+				}
+				else {
+					FillTexturedSpan(command, quad, row, y, x0, x1);
+				}
+			}
+		}
+	}
+}
+
+static void PrepareRasterCommand(DeviceState const* state, RasterCommand* command)
+{
+	NBuiltinResources const* builtins = nGetBuiltins();
+	NuDeviceDefaults const* defaults = nuDeviceGetDefaults();
+
+	NuPipelineCreateInfo const pipeline = nPipelineGetInfo(state->pipeline);
+
+	nZero(command);
+	command->shader = pipeline.technique == builtins->technique2dQuadTexturedFont ? RASTER_SHADER_FONT :
+		(state->meshType == MESH_TYPE_QUAD_TEXTURED ? RASTER_SHADER_TEXTURED : RASTER_SHADER_SOLID);
+
+	command->blendState = *pipeline.blendState;
+	if (!memcmp(pipeline.blendState, &defaults->defaultBlendState, sizeof(NuBlendState))) {
+		command->blend = RASTER_BLEND_REPLACE;
+	}
+	else if (!memcmp(pipeline.blendState, &defaults->alphaBlendState, sizeof(NuBlendState))) {
+		command->blend = RASTER_BLEND_ALPHA;
+	}
+	else {
+		command->blend = RASTER_BLEND_GENERIC;
+	}
+
+	if (command->shader != RASTER_SHADER_SOLID) {
+		command->texture = nTextureGetCpuCopy(state->texture);
+		command->sampler = nSamplerGetInfo(state->sampler);
+		if (!command->texture.data) {
+			nDebugWarning("Skipping Scene2D textured quads, their texture was not created with keepCpuCopy.");
+			command->skip = true;
+		}
+	}
+}
+
 /*-------------------------------------------------------------------------------------------------
  * Internal API
  *-----------------------------------------------------------------------------------------------*/
@@ -285,6 +684,7 @@ NuResult nInitScene2D(NuAllocator* allocator)
 	};
 	
 	NuResult result = nuCreateBuffer(&bufferInfo, allocator, &gScene2D.primitivesVertexBuffer);
+	nArrayFree(data, allocator);
 	if (result) {
 		nDebugError("Could not create scene 2d device primitives vertex buffer.");
 		goto error;
@@ -328,6 +728,7 @@ void nDeinitScene2D(NuAllocator* allocator)
 	nArrayFree(gScene2D.immediateInstanceData, &gScene2D.allocator);
 	nuDestroyBuffer(gScene2D.primitivesVertexBuffer, allocator);
 	nuDestroyBuffer(gScene2D.instancesVertexBuffer, allocator);
+	nuDestroyBuffer(gScene2D.constantBuffer, allocator);
 	nZero(&gScene2D);
 }
 
@@ -340,6 +741,7 @@ void nu2dImmediateBegin(Nu2dBeginImmediateInfo const* info)
 	nEnforce(!gScene2D.immediateHasCommand, "Immediate 2D rendering already begun.");
 	gScene2D.immediateContext  = info->context;
 	gScene2D.immediateViewport = info->viewport;
+	nZero(&gScene2D.immediateStats);
 	SetDeviceViewport(info->context, info->viewport);
 }
 
@@ -352,33 +754,73 @@ void nu2dImmediateEnd(void)
 	nArrayClear(gScene2D.immediateInstanceData);
 }
 
-NuResult nuCreateScene2D(NuAllocator* allocator, NuScene2D* ppScene)
+NuResult nuCreateScene2D(NuScene2DCreateInfo const* info, NuAllocator* allocator, NuScene2D* ppScene)
 {
 	EnforceInitialized();
-	allocator = nGetDefaultOrAllocator(allocator);
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_SCENE2D);
 	*ppScene = n_new(Scene2D, allocator);
 	Scene2D* scene = *ppScene;
 	if (!scene) return NU_ERROR_OUT_OF_MEMORY;
 	scene->allocator = *allocator;
-	nArrayReserve(&scene->commands, allocator, Command, 10);
+
+	if (info && info->useFrameArena) {
+		size_t arenaSize = info->frameArenaSize ? info->frameArenaSize : DEFAULT_FRAME_ARENA_SIZE;
+		scene->useFrameArena = true;
+		if (nInitLinearArena(&scene->frameArenas[0], allocator, arenaSize) ||
+			nInitLinearArena(&scene->frameArenas[1], allocator, arenaSize)) {
+			nuDestroyScene2D(scene, allocator);
+			*ppScene = NULL;
+			return NU_ERROR_OUT_OF_MEMORY;
+		}
+	}
+
+	nArrayReserve(&scene->commands, GetRecordingAllocator(scene), Command, 10);
 	return NU_SUCCESS;
 }
 
 void nuDestroyScene2D(NuScene2D scene, NuAllocator* allocator)
 {
 	EnforceInitialized();
-	allocator = nGetDefaultOrAllocator(allocator);
-	nArrayFree(scene->commands, allocator);
-	nArrayFree(scene->instanceData, allocator);
-	n_free(scene, nGetDefaultOrAllocator(allocator));
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_SCENE2D);
+	if (scene->useFrameArena) {
+		nDeinitLinearArena(&scene->frameArenas[0]);
+		nDeinitLinearArena(&scene->frameArenas[1]);
+	}
+	else {
+		nArrayFree(scene->commands, allocator);
+		nArrayFree(scene->instanceData, allocator);
+	}
+	n_free(scene, allocator);
 }
 
 NuResult nu2dReset(NuScene2D scene, NuRect2i viewport)
 {
 	EnforceInitialized();
 	scene->viewport = viewport;
-	nArrayClear(scene->commands);
-	nArrayClear(scene->instanceData);
+	nZero(&scene->stats);
+
+	if (!scene->useFrameArena) {
+		nArrayClear(scene->commands);
+		nArrayClear(scene->instanceData);
+		return NU_SUCCESS;
+	}
+
+	/* size next frame arrays after recent frames, decaying slowly so that spikes are forgotten */
+	scene->commandsHint = max_size_t(nArrayLen(scene->commands), scene->commandsHint - scene->commandsHint / 8);
+	scene->instanceDataHint = max_size_t(nArrayLen(scene->instanceData), scene->instanceDataHint - scene->instanceDataHint / 8);
+
+	/* swap frame arenas, the previous frame data stays valid until the next reset */
+	scene->frameIndex ^= 1;
+	nLinearArenaReset(&scene->frameArenas[scene->frameIndex]);
+	scene->commands = NULL;
+	scene->instanceData = NULL;
+
+	NuAllocator* allocator = GetRecordingAllocator(scene);
+	if (!nArrayReserve(&scene->commands, allocator, Command, scene->commandsHint) ||
+		!nArrayReserveEx(&scene->instanceData, allocator, 1, scene->instanceDataHint)) {
+		return NU_ERROR_OUT_OF_MEMORY;
+	}
+
 	return NU_SUCCESS;
 }
 
@@ -398,13 +840,135 @@ void nu2dPresent(NuScene2D scene, NuContext context)
 	}
 }
 
+void nu2dGetStats(NuScene2D scene, Nu2dStats* stats)
+{
+	EnforceInitialized();
+	*stats = scene ? scene->stats : gScene2D.immediateStats;
+}
+
+NuResult nu2dRenderToImage(NuScene2D scene, NuImage image)
+{
+	EnforceInitialized();
+	nEnforce(scene, "The immediate Scene2D cannot be rendered to an image.");
+	NuImageView view = nuImageGetView(image);
+	nEnforce(view.format == NU_IMAGE_FORMAT_R8G8B8A8, "Scene 2D can only be rendered to R8G8B8A8 images.");
+
+	uint numCommands = nArrayLen(scene->commands);
+	if (numCommands == 0 || view.size.width == 0 || view.size.height == 0) return NU_SUCCESS;
+
+	NuTempMark tempMark = nuTempMark();
+	NuAllocator* tempAllocator = nGetTempAllocator();
+
+	uint numQuads = 0;
+	for (uint i = 0; i < numCommands; ++i) {
+		numQuads += scene->commands[i].instanceCount;
+	}
+
+	uint numTilesX = (view.size.width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	uint numTilesY = (view.size.height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	uint numTiles = numTilesX * numTilesY;
+
+	RasterCommand* commands = n_newarray(RasterCommand, numCommands, tempAllocator);
+	RasterQuad* quads = n_newarray(RasterQuad, numQuads, tempAllocator);
+	uint* tileOffsets = n_newarray(uint, numTiles + 1, tempAllocator);
+	if (!commands || !quads || !tileOffsets) {
+		nuTempRewind(tempMark);
+		return NU_ERROR_OUT_OF_MEMORY;
+	}
+	memset(tileOffsets, 0, sizeof(uint) * (numTiles + 1));
+
+	/* map scene coordinates to target pixels and count the quads overlapping each tile */
+	float scaleX = view.size.width / (float)scene->viewport.size.width;
+	float scaleY = view.size.height / (float)scene->viewport.size.height;
+	uint numBinned = 0, numRasterQuads = 0;
+
+	for (uint i = 0; i < numCommands; ++i) {
+		Command const* command = &scene->commands[i];
+		PrepareRasterCommand(&command->deviceState, &commands[i]);
+		if (commands[i].skip) continue;
+
+		char const* instance = scene->instanceData + command->firstInstanceOffset;
+		uint instanceSize = kMeshInstanceSize[command->deviceState.meshType];
+
+		for (uint j = 0; j < command->instanceCount; ++j, instance += instanceSize) {
+			/* all instance types start like QuadSolid */
+			QuadSolid const* solid = (QuadSolid const*)instance;
+			float left = (solid->rect.position.x - scene->viewport.position.x) * scaleX;
+			float top = (solid->rect.position.y - scene->viewport.position.y) * scaleY;
+			float right = left + solid->rect.size.width * scaleX;
+			float bottom = top + solid->rect.size.height * scaleY;
+
+			/* pixels whose center is inside the quad */
+			RasterQuad* quad = &quads[numRasterQuads];
+			quad->x0 = max_int((int)ceilf(left - 0.5f), 0);
+			quad->y0 = max_int((int)ceilf(top - 0.5f), 0);
+			quad->x1 = min_int((int)ceilf(right - 0.5f), (int)view.size.width);
+			quad->y1 = min_int((int)ceilf(bottom - 0.5f), (int)view.size.height);
+			if (quad->x0 >= quad->x1 || quad->y0 >= quad->y1) continue;
+
+			quad->left = left;
+			quad->top = top;
+			quad->invWidth = 1.f / (right - left);
+			quad->invHeight = 1.f / (bottom - top);
+			quad->color = solid->color;
+			quad->command = i;
+			quad->uvRect = command->deviceState.meshType == MESH_TYPE_QUAD_TEXTURED ? ((QuadTextured const*)instance)->uvRect : (NuRect2) { 0 };
+			++numRasterQuads;
+
+			for (int ty = quad->y0 / RASTER_TILE_SIZE; ty <= (quad->y1 - 1) / RASTER_TILE_SIZE; ++ty) {
+				for (int tx = quad->x0 / RASTER_TILE_SIZE; tx <= (quad->x1 - 1) / RASTER_TILE_SIZE; ++tx) {
+					++tileOffsets[ty * numTilesX + tx + 1];
+					++numBinned;
+				}
+			}
+		}
+	}
+
+	/* bin the quads in submission order */
+	uint* tileQuads = n_newarray(uint, numBinned, tempAllocator);
+	uint* tileCursors = n_newarray(uint, numTiles, tempAllocator);
+	if ((numBinned && !tileQuads) || !tileCursors) {
+		nuTempRewind(tempMark);
+		return NU_ERROR_OUT_OF_MEMORY;
+	}
+
+	for (uint i = 0; i < numTiles; ++i) {
+		tileOffsets[i + 1] += tileOffsets[i];
+		tileCursors[i] = tileOffsets[i];
+	}
+
+	for (uint i = 0; i < numRasterQuads; ++i) {
+		RasterQuad const* quad = &quads[i];
+		for (int ty = quad->y0 / RASTER_TILE_SIZE; ty <= (quad->y1 - 1) / RASTER_TILE_SIZE; ++ty) {
+			for (int tx = quad->x0 / RASTER_TILE_SIZE; tx <= (quad->x1 - 1) / RASTER_TILE_SIZE; ++tx) {
+				tileQuads[tileCursors[ty * numTilesX + tx]++] = i;
+			}
+		}
+	}
+
+	RasterTarget target = {
+		.commands = commands,
+		.quads = quads,
+		.tileOffsets = tileOffsets,
+		.tileQuads = tileQuads,
+		.numTilesX = numTilesX,
+		.pixels = nuImageGetWritableDataPtr(image),
+		.width = view.size.width,
+		.height = view.size.height,
+	};
+	nuParallelFor(numTiles, 1, RasterizeTiles, &target);
+
+	nuTempRewind(tempMark);
+	return NU_SUCCESS;
+}
+
 NuResult nu2dBeginQuadsSolid(NuScene2D scene, const Nu2dQuadsSolidBeginInfo* info)
 {
 	DeviceState state = {
 		.meshType = MESH_TYPE_QUAD_SOLID,
-		.technique = nGetBuiltins()->technique2dQuadSolid,
-		.blendState = info->blendState,
+		.pipeline = GetPipeline(nGetBuiltins()->technique2dQuadSolid, info->blendState),
 	};
+	if (!state.pipeline) return NU_ERROR_OUT_OF_MEMORY;
 
 	Command* command = NewCommand(scene, &state);
 	return command ? NU_SUCCESS : NU_ERROR_OUT_OF_MEMORY;
@@ -433,12 +997,12 @@ NuResult nu2dBeginQuadsTextured(NuScene2D scene, const Nu2dQuadsTexturedBeginInf
 	EnforceInitialized();
 	DeviceState state = {
 		.meshType = MESH_TYPE_QUAD_TEXTURED,
-		.technique = nGetBuiltins()->technique2dQuadTextured,
-		.blendState = info->blendState,
+		.pipeline = GetPipeline(nGetBuiltins()->technique2dQuadTextured, info->blendState),
 		.texture = info->texture,
 		.sampler = info->sampler,
 		.enableTextures = true,
 	};
+	if (!state.pipeline) return NU_ERROR_OUT_OF_MEMORY;
 
 	Command* command = NewCommand(scene, &state);
 	return command ? NU_SUCCESS : NU_ERROR_OUT_OF_MEMORY;
@@ -470,12 +1034,12 @@ NuResult nu2dBeginText(NuScene2D scene, NuFont font)
 	EnforceInitialized();
 	DeviceState state = {
 		.meshType = MESH_TYPE_QUAD_TEXTURED,
-		.technique = nGetBuiltins()->technique2dQuadTexturedFont,
-		.blendState = &nuDeviceGetDefaults()->alphaBlendState,
+		.pipeline = GetPipeline(nGetBuiltins()->technique2dQuadTexturedFont, &nuDeviceGetDefaults()->alphaBlendState),
 		.texture = nFontGetTexture(font),
 		.sampler = nuDeviceGetDefaults()->nearestSampler,
 		.enableTextures = true,
 	};
+	if (!state.pipeline) return NU_ERROR_OUT_OF_MEMORY;
 
 	Command* command = NewCommand(scene, &state);
 	command->extra.font = font;
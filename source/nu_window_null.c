@@ -0,0 +1,99 @@
+/*
+ * Nunki (simple rendering engine)
+ * Copyright (C) 2015 Canio Massimo Tristano <massimo.tristano@gmail.com>.
+ * For licensing info see LICENSE.
+ */
+
+/* Window module for platforms without a windowing layer. Windows are plain objects that never
+ * receive events, enough to drive the null device backend on headless machines. */
+#ifndef _WIN32
+
+#include "nu_window.h"
+#include "nu_libs.h"
+#include "nu_base.h"
+
+static struct
+{
+	bool initialized;
+} gWindow;
+
+#define EnforceInitialized() nEnforce(gWindow.initialized, "Window module not initialized.");
+
+typedef struct NuWindowImpl
+{
+	uint width;
+	uint height;
+} Window;
+
+NuResult nuCreateWindow(NuWindowCreateInfo const *info, NuAllocator* allocator, NuWindow *outWindow)
+{
+	EnforceInitialized();
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_GENERAL);
+
+	nEnforce(info, "Null info provided.");
+	nEnforce(outWindow, "Null handle provided.");
+
+	*outWindow = NULL;
+	Window* window = n_new(Window, allocator);
+	if (!window) return NU_ERROR_OUT_OF_MEMORY;
+
+	window->width = info->width;
+	window->height = info->height;
+
+	*outWindow = window;
+	return NU_SUCCESS;
+}
+
+void nuDestroyWindow(NuWindow window, NuAllocator* allocator)
+{
+	if (!window) return;
+	n_free(window, nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_GENERAL));
+}
+
+void nuWindowSetTitle(NuWindow window, const char* title)
+{
+	nEnforce(window, "Invalid window provided.");
+}
+
+void nuWindowShowCursor(NuWindow window, bool show)
+{
+	nEnforce(window, "Invalid window provided.");
+}
+
+bool nuWindowPollEvents(NuWindow window, NuWindowEvent *e)
+{
+	nEnforce(window, "Invalid window provided.");
+	e->type = NU_WINDOW_EVENT_TYPE_NONE;
+	return false;
+}
+
+NuSize2i nuWindowGetSize(NuWindow window)
+{
+	return (NuSize2i) { window->width, window->height };
+}
+
+void* nuWindowGetNativeHandle(NuWindow window)
+{
+	nEnforce(window, "Invalid window provided.");
+	return window;
+}
+
+NuResult nInitWindowModule(void)
+{
+	nEnforce(!gWindow.initialized, "Window module has already been initialized.");
+	gWindow.initialized = true;
+	return NU_SUCCESS;
+}
+
+void nDeinitWindowModule(void)
+{
+	gWindow.initialized = false;
+}
+
+void* nGetDummyWindowHandle(void)
+{
+	EnforceInitialized();
+	return NULL;
+}
+
+#endif
@@ -4,6 +4,8 @@
  * For licensing info see LICENSE.
  */
 
+#ifdef _WIN32
+
 #include "nu_window.h"
 #include "nu_libs.h"
 #include "nu_base.h"
@@ -35,7 +37,7 @@ static LRESULT CALLBACK wndProc(HWND hWnd, UINT uMsg, WPARAM  wParam, LPARAM lPa
 NuResult nuCreateWindow(NuWindowCreateInfo const *info, NuAllocator* allocator, NuWindow *outWindow)
 {
 	EnforceInitialized();
-	allocator = nGetDefaultOrAllocator(allocator);
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_GENERAL);
 
 	nEnforce(info, "Null info provided.");
 	nEnforce(outWindow, "Null handle provided.");
@@ -148,7 +150,7 @@ NuResult nuCreateWindow(NuWindowCreateInfo const *info, NuAllocator* allocator,
 void nuDestroyWindow(NuWindow window, NuAllocator* allocator)
 {
 	if (!window) return;
-	allocator = nGetDefaultOrAllocator(allocator);
+	allocator = nGetTaggedOrAllocator(allocator, NU_MEMORY_TAG_GENERAL);
 
 	if (window->fullscreen) {
 		ChangeDisplaySettings(NULL, 0);
@@ -618,3 +620,5 @@ LRESULT CALLBACK wndProc(HWND hWnd, UINT uMsg, WPARAM  wParam, LPARAM lParam)
 
 
 #pragma endregion
+
+#endif